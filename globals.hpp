@@ -1,6 +1,8 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <string_view>
 #include <map>
 #include <set>
 #include <functional>
@@ -8,6 +10,8 @@
 #include <unordered_map>
 #include <optional>
 #include <array>
+#include <atomic>
+#include <memory>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -19,6 +23,12 @@
 #include <iostream>
 #include <filesystem>
 
+#include "utils/history_log.hpp"
+#include "utils/path_index.hpp"
+#include "utils/status_board.hpp"
+#include "utils/git_status.hpp"
+#include "utils/workspace_index.hpp"
+
 namespace platform {
 class TermRaw;
 void register_raw_terminal(TermRaw* term);
@@ -164,6 +174,16 @@ struct MatchResult {
   bool isPrefix = false;
 };
 
+// 候选的排名置换：order[r] 为第 r 名在各并行数组中的下标，只保证前 sorted 名有序，
+// 其余按需再排（见 main.cpp 的 ensureCandidatesRanked）。order 为空表示按存储顺序。
+struct CandidateRanking {
+  std::vector<size_t> order;
+  size_t sorted = 0;
+  bool byScore = false;
+  bool exactFirst = false;
+  bool byUsage = false;
+};
+
 struct Candidates {
   std::vector<std::string> items;
   std::vector<std::string> labels;
@@ -171,6 +191,11 @@ struct Candidates {
   std::vector<std::string> annotations;
   std::vector<bool> exactMatches;
   std::vector<MatchResult> matchDetails;
+  // 可选：labels 的字符签名（label_char_signature），为空或长度不符时按需计算
+  std::vector<uint64_t> labelSignatures;
+  // 可选：按使用频率给出的排名加成，与匹配分数相加；为空表示没有使用记录
+  std::vector<double> usageBonus;
+  CandidateRanking ranking;
 };
 
 using ToolExecutor = std::function<ToolExecutionResult(const ToolExecutionRequest&)>;
@@ -183,14 +208,31 @@ struct ToolDefinition {
   ToolCompletionProvider completion;
 };
 
+// 后台补全线程运行提供者时指向当前任务的取消标志；耗时的候选生成循环可据此提前放弃
+inline thread_local const std::atomic<bool>* g_completion_cancel = nullptr;
+inline bool completion_cancelled(){
+  return g_completion_cancel && g_completion_cancel->load(std::memory_order_relaxed);
+}
+
 MatchResult compute_match(const std::string& candidate, const std::string& pattern);
+// scoreFloor：排名模式下若能断定分数低于该值，则只做贪心对齐（分数为下界）
+MatchResult compute_match(const std::string& candidate, const std::string& pattern, double scoreFloor);
 void sortCandidatesByMatch(const std::string& query, Candidates& cand);
+// 64 位字符存在性签名（ASCII 字母忽略大小写）；查询签名不是标签签名的子集时必然不匹配
+uint64_t label_char_signature(std::string_view text);
 
+// render 与 watches 在状态线程中调用，不能依赖主线程持有的锁
 struct StatusProvider {
   std::string name;
   std::function<std::string()> render; // 纯文本（样式由 main 添加）
+  StatusRefreshPolicy refresh;
+  std::function<std::vector<LoopWatch>()> watches; // refresh.onFileChange 时要监视的路径
+  std::function<void(const std::vector<std::string>&)> changed; // 被监视路径中具体变化了哪些（可选）
 };
 
+// 状态段的后台计算与缓存（见 utils/status_board.hpp）
+StatusBoard& status_board();
+
 bool tool_visible_in_ui(const ToolSpec& spec);
 
 struct ToolRegistry {
@@ -212,16 +254,18 @@ struct ToolRegistry {
     }
     std::sort(r.begin(), r.end()); return r;
   }
-  void registerStatusProvider(const StatusProvider& sp){ statusProviders.push_back(sp); }
-  std::string renderStatusPrefix() const {
-    std::string out; for (auto &sp : statusProviders) { try{ if(sp.render) out += sp.render(); }catch(...){} } return out;
+  void registerStatusProvider(const StatusProvider& sp){
+    statusProviders.push_back(sp);
+    status_board().add(sp.name, sp.render, sp.refresh, sp.watches, sp.changed);
   }
+  // 只读缓存，不调用提供者
+  std::string renderStatusPrefix() const { return status_board().text(); }
 };
 
 // ===== Global state (defined in main.cpp) =====
 enum class CwdMode { Full, Omit, Hidden };
 extern ToolRegistry REG;
-extern CwdMode      g_cwd_mode;
+extern std::atomic<CwdMode> g_cwd_mode; // 状态线程也会读取
 extern bool         g_should_exit;
 extern std::string  g_parse_error_cmd;
 
@@ -268,7 +312,7 @@ struct MemoryConfig {
 struct AppSettings {
   CwdMode cwdMode = CwdMode::Full;
   bool completionIgnoreCase = false;
-  bool completionSubsequence = false;
+  bool completionSubsequence = true;
   SubsequenceStrategy completionSubsequenceStrategy = SubsequenceStrategy::Ranked;
   std::string language = "en";
   bool showPathErrorHint = true;
@@ -281,12 +325,15 @@ struct AppSettings {
   bool promptInputEllipsisRightWidthAuto = true;
   int  promptInputEllipsisRightWidth = 0;
   int  historyRecentLimit = 10;
+  int  completionDeadlineMs = 8;
   std::string configHome;
   bool agentExposeFsTools = false;
   MemoryConfig memory;
 };
 
 extern AppSettings g_settings;
+// 补全提供者与排名读取设置时用它：后台补全线程上返回提交时复制的快照，其余线程即 g_settings
+const AppSettings& active_settings();
 
 inline std::optional<std::array<int, 6>> theme_gradient_colors(const std::string& theme){
   if(theme == "blue-purple"){
@@ -339,7 +386,12 @@ std::vector<MessageFileInfo> message_all_files();
 std::vector<MessageFileInfo> message_pending_files();
 bool message_mark_read(const std::string& path);
 std::optional<std::string> message_resolve_label(const std::string& label);
-std::vector<std::string> message_all_file_labels();
+// 补全用的去重文件名及其未读标注，只在监视状态变化后重建
+struct MessageFileLabel {
+  std::string label;
+  std::string annotation;
+};
+std::shared_ptr<const std::vector<MessageFileLabel>> message_all_file_labels();
 
 // ===== Prompt badges =====
 struct PromptIndicatorDescriptor {
@@ -378,6 +430,37 @@ bool llm_has_unread();
 void llm_mark_seen();
 
 // ===== Command history =====
-void history_record_command(const std::string& command);
-const std::vector<std::string>& history_recent_commands();
-void history_apply_limit();
+// 历史保存在配置目录的 mycli_history.log（见 utils/history_log.hpp），多个会话共享
+void history_initialize();
+// cwd 是输入命令时所在的目录，由调用方在执行命令前取得
+void history_record_command(const std::string& command, const std::string& cwd, std::optional<int> exitCode = std::nullopt);
+// 最近使用的 history.recent_limit 条不同命令，最新在前
+std::vector<HistoryRecord> history_recent_commands();
+// 在全部历史中模糊搜索 query，返回得分最高的若干条（query 为空时即最近命令）
+Candidates history_search_candidates(const std::string& query);
+std::string history_age_label(int64_t timestamp);
+
+// ===== Usage ranking =====
+// 命令、子命令、选项值与设置项的使用频率，保存在配置目录的 mycli_usage.tsv
+void usage_initialize();
+void usage_record_command(const std::vector<std::string>& tokens);
+
+// ===== PATH executables =====
+// $PATH 中可执行文件的索引，后台逐目录构建并随 inotify 更新（见 utils/path_index.hpp）
+ExecutableIndex& executable_index();
+// 名字模糊匹配 word 的可执行文件；插入文本为 before + insertPrefix + 名字，未排序
+Candidates executable_candidates_for_word(const std::string& before, const std::string& word,
+                                          const std::string& insertPrefix = std::string());
+
+// ===== Workspace search =====
+// 项目根为从 dir 向上第一个含 .git 的目录（没有则为 dir），其下全部路径建有持久索引；
+// 根目录与家目录不作项目根，在其中查找没有结果
+struct WorkspaceMatch {
+  std::string path;   // 相对于 dir
+  bool isDir = false;
+  MatchResult match;
+};
+// 模糊匹配 query 的前 limit 条路径。wholeProject 为假时只在 dir 之下查找并对 dir 下的相对路径打分，
+// 为真时在整个项目中查找；fresh 为真时先同步校验索引，否则索引还没建好时先返回空结果
+std::vector<WorkspaceMatch> workspace_search(const std::string& dir, const std::string& query,
+                                             size_t limit, bool wholeProject, bool fresh);
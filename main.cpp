@@ -15,6 +15,7 @@
 #include <csignal>
 #include <cstdio>
 #include <cstdlib>
+#include <cstdint>
 #include <cstring>
 #include <clocale>
 #include <codecvt>
@@ -26,6 +27,7 @@
 #include <cctype>
 #include <ctime>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <algorithm>
 #include <iostream>
@@ -35,16 +37,30 @@
 #include <numeric>
 #include <type_traits>
 #include <cmath>
+#include <charconv>
 #include <limits>
 #include <utility>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include "globals.hpp"
 #include "tools.hpp"
 #include "settings.hpp"
+#include "utils/event_loop.hpp"
+#include "utils/parallel.hpp"
+#include "utils/completion_cache.hpp"
+#include "utils/frecency.hpp"
 
 namespace platform {
+inline void write_stdout(const char* data, size_t len);
+
+// 括号粘贴模式只在原始模式下开启，执行外部命令或交互式输入时随原始模式一起关闭
+inline constexpr char kBracketedPasteOn[] = "\x1b[?2004h";
+inline constexpr char kBracketedPasteOff[] = "\x1b[?2004l";
+
 #ifdef _WIN32
 
 class TermRaw {
@@ -61,9 +77,11 @@ public:
     mode |= ENABLE_VIRTUAL_TERMINAL_INPUT;
     if(!SetConsoleMode(hIn, mode)) std::exit(1);
     active = true;
+    write_stdout(kBracketedPasteOn, sizeof(kBracketedPasteOn) - 1);
   }
   void disable(){
     if(active){
+      write_stdout(kBracketedPasteOff, sizeof(kBracketedPasteOff) - 1);
       SetConsoleMode(hIn, origMode);
       active = false;
     }
@@ -110,6 +128,14 @@ inline bool read_char(char &ch){
   return read == 1;
 }
 
+// 控制台句柄无法可靠得知已就绪的字节数（按键抬起等事件也会使其处于可读状态），逐字节读取
+inline bool read_available(std::string& out){
+  char ch;
+  if(!read_char(ch)) return false;
+  out.push_back(ch);
+  return true;
+}
+
 inline void write_stdout(const char* data, size_t len){
   DWORD written = 0;
   WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), data, static_cast<DWORD>(len), &written, nullptr);
@@ -155,9 +181,11 @@ public:
     raw.c_cc[VTIME] = 0;
     if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) std::exit(1);
     active = true;
+    write_stdout(kBracketedPasteOn, sizeof(kBracketedPasteOn) - 1);
   }
   void disable(){
     if(active){
+      write_stdout(kBracketedPasteOff, sizeof(kBracketedPasteOff) - 1);
       tcsetattr(STDIN_FILENO, TCSANOW, &orig);
       active = false;
     }
@@ -180,8 +208,31 @@ inline bool read_char(char &ch){
   return n == 1;
 }
 
+// 阻塞读取至少一个字节，并一并取走内核缓冲区中已就绪的其余输入
+inline bool read_available(std::string& out){
+  int ready = 0;
+  if(::ioctl(STDIN_FILENO, FIONREAD, &ready) != 0 || ready <= 0) ready = 1;
+  size_t want = static_cast<size_t>(std::min(ready, 1 << 16));
+  size_t base = out.size();
+  out.resize(base + want);
+  ssize_t n;
+  do{
+    n = ::read(STDIN_FILENO, &out[base], want);
+  }while(n < 0 && errno == EINTR);
+  out.resize(base + (n > 0 ? static_cast<size_t>(n) : 0));
+  return n > 0;
+}
+
 inline void write_stdout(const char* data, size_t len){
-  ::write(STDOUT_FILENO, data, len);
+  while(len > 0){
+    ssize_t n = ::write(STDOUT_FILENO, data, len);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      return;
+    }
+    data += n;
+    len -= static_cast<size_t>(n);
+  }
 }
 
 inline void flush_stdout(){
@@ -247,13 +298,40 @@ void resume_raw_mode(){
 
 // ===== Global state definitions =====
 ToolRegistry REG;
-CwdMode      g_cwd_mode = CwdMode::Full;
+std::atomic<CwdMode> g_cwd_mode{CwdMode::Full};
 bool         g_should_exit = false;
 std::string  g_parse_error_cmd;
 
 static std::string g_config_home;
 static bool g_config_home_initialized = false;
 
+// 后台补全线程看到的主线程状态副本：在 g_completion_state_mutex 内复制，
+// 提供者与排名随后不持锁运行，主线程执行命令时也就不必等它们读完目录
+struct CompletionStateSnapshot {
+  AppSettings settings;
+  std::string configHome;
+  std::shared_ptr<const std::vector<MessageFileLabel>> messageLabels;
+};
+static thread_local const CompletionStateSnapshot* t_completion_snapshot = nullptr;
+
+// 在当前线程上启用快照，析构时恢复；线程局部变量不随任务进入线程池，并行任务里也要各装一份
+class CompletionSnapshotScope {
+public:
+  explicit CompletionSnapshotScope(const CompletionStateSnapshot* snapshot) : saved_(t_completion_snapshot){
+    t_completion_snapshot = snapshot;
+  }
+  ~CompletionSnapshotScope(){ t_completion_snapshot = saved_; }
+  CompletionSnapshotScope(const CompletionSnapshotScope&) = delete;
+  CompletionSnapshotScope& operator=(const CompletionSnapshotScope&) = delete;
+
+private:
+  const CompletionStateSnapshot* saved_;
+};
+
+const AppSettings& active_settings(){
+  return t_completion_snapshot ? t_completion_snapshot->settings : g_settings;
+}
+
 static std::string trim_copy(const std::string& s){
   size_t a = 0, b = s.size();
   while(a < b && std::isspace(static_cast<unsigned char>(s[a]))) ++a;
@@ -261,7 +339,6 @@ static std::string trim_copy(const std::string& s){
   return s.substr(a, b - a);
 }
 
-static std::vector<std::string> g_command_history;
 static std::atomic<int> g_agent_running_sessions{0};
 static std::atomic<int> g_agent_pending_sessions{0};
 static std::atomic<int> g_agent_guard_alerts{0};
@@ -272,6 +349,11 @@ static std::atomic<bool> g_memory_import_recent_complete{false};
 static std::atomic<bool> g_todo_has_active{false};
 static std::atomic<int> g_todo_urgency_level{0}; // 0:none, 1:<=5m, 2:<=1m
 static std::atomic<bool> g_todo_critical_blink_phase{false};
+static std::atomic<long long> g_todo_next_change_at{0};
+
+static constexpr auto kIndicatorBlinkInterval = std::chrono::milliseconds(500);
+static std::chrono::steady_clock::time_point g_agent_blink_last_toggle{};
+static std::chrono::steady_clock::time_point g_todo_blink_last_toggle{};
 
 static void agent_indicator_refresh_state(){
   PromptIndicatorState state = prompt_indicator_current("agent");
@@ -303,8 +385,6 @@ static void agent_indicator_refresh_state(){
 }
 
 static bool agent_indicator_tick_blink(){
-  static constexpr auto interval = std::chrono::milliseconds(500);
-  static auto lastToggle = std::chrono::steady_clock::now();
   static int lastGuardCount = 0;
   int guardAlerts = g_agent_guard_alerts.load(std::memory_order_relaxed);
   if(guardAlerts <= 0){
@@ -320,14 +400,14 @@ static bool agent_indicator_tick_blink(){
   if(lastGuardCount <= 0){
     lastGuardCount = guardAlerts;
     g_agent_guard_blink_phase.store(false, std::memory_order_relaxed);
-    lastToggle = std::chrono::steady_clock::now();
+    g_agent_blink_last_toggle = std::chrono::steady_clock::now();
     agent_indicator_refresh_state();
     return true;
   }
   lastGuardCount = guardAlerts;
   auto now = std::chrono::steady_clock::now();
-  if(now - lastToggle >= interval){
-    lastToggle = now;
+  if(now - g_agent_blink_last_toggle >= kIndicatorBlinkInterval){
+    g_agent_blink_last_toggle = now;
     bool next = !g_agent_guard_blink_phase.load(std::memory_order_relaxed);
     g_agent_guard_blink_phase.store(next, std::memory_order_relaxed);
     agent_indicator_refresh_state();
@@ -366,6 +446,7 @@ static bool todo_indicator_poll(bool force = false){
   lastEvalSec = nowSec;
 
   tool::TodoIndicatorSnapshot snapshot = tool::Todo::indicatorSnapshot(nowSec);
+  g_todo_next_change_at.store(snapshot.nextChangeAt, std::memory_order_relaxed);
   bool previousActive = g_todo_has_active.exchange(snapshot.hasActive, std::memory_order_relaxed);
   int previousUrgency = g_todo_urgency_level.exchange(snapshot.urgencyLevel, std::memory_order_relaxed);
 
@@ -385,8 +466,6 @@ static bool todo_indicator_poll(bool force = false){
 }
 
 static bool todo_indicator_tick_blink(){
-  static constexpr auto interval = std::chrono::milliseconds(500);
-  static auto lastToggle = std::chrono::steady_clock::now();
   static bool lastCritical = false;
 
   int urgencyLevel = g_todo_urgency_level.load(std::memory_order_relaxed);
@@ -406,14 +485,14 @@ static bool todo_indicator_tick_blink(){
   if(!lastCritical){
     lastCritical = true;
     g_todo_critical_blink_phase.store(false, std::memory_order_relaxed);
-    lastToggle = std::chrono::steady_clock::now();
+    g_todo_blink_last_toggle = std::chrono::steady_clock::now();
     todo_indicator_refresh_state();
     return true;
   }
 
   auto now = std::chrono::steady_clock::now();
-  if(now - lastToggle >= interval){
-    lastToggle = now;
+  if(now - g_todo_blink_last_toggle >= kIndicatorBlinkInterval){
+    g_todo_blink_last_toggle = now;
     bool next = !g_todo_critical_blink_phase.load(std::memory_order_relaxed);
     g_todo_critical_blink_phase.store(next, std::memory_order_relaxed);
     todo_indicator_refresh_state();
@@ -422,6 +501,30 @@ static bool todo_indicator_tick_blink(){
   return false;
 }
 
+// 主循环下一次需要醒来的时间：正在闪烁的指示器翻转相位，或待办紧急程度即将变化
+static std::optional<std::chrono::steady_clock::time_point> indicator_next_deadline(){
+  using Clock = std::chrono::steady_clock;
+  std::optional<Clock::time_point> next;
+  auto consider = [&](Clock::time_point t){
+    if(!next || t < *next) next = t;
+  };
+  if(g_agent_guard_alerts.load(std::memory_order_relaxed) > 0){
+    consider(g_agent_blink_last_toggle + kIndicatorBlinkInterval);
+  }
+  if(g_todo_urgency_level.load(std::memory_order_relaxed) >= 2){
+    consider(g_todo_blink_last_toggle + kIndicatorBlinkInterval);
+  }
+  long long changeAt = g_todo_next_change_at.load(std::memory_order_relaxed);
+  if(changeAt > 0){
+    auto wallNowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+    // 稍微越过整秒边界，保证醒来时 todo_indicator_poll 已进入新的一秒
+    long long deltaMs = changeAt * 1000 - wallNowMs + 5;
+    consider(Clock::now() + std::chrono::milliseconds(std::max(0LL, deltaMs)));
+  }
+  return next;
+}
+
 static void agent_indicator_decrement(std::atomic<int>& counter){
   int current = counter.load(std::memory_order_relaxed);
   while(current > 0){
@@ -431,33 +534,37 @@ static void agent_indicator_decrement(std::atomic<int>& counter){
   }
 }
 
-void history_apply_limit(){
-  int limit = g_settings.historyRecentLimit;
-  if(limit <= 0){
-    g_command_history.clear();
-    return;
-  }
-  size_t maxSize = static_cast<size_t>(limit);
-  if(g_command_history.size() > maxSize){
-    g_command_history.resize(maxSize);
-  }
-}
+static HistoryLog g_history_log;
 
-void history_record_command(const std::string& command){
+void history_record_command(const std::string& command, const std::string& cwd, std::optional<int> exitCode){
+  if(g_settings.historyRecentLimit <= 0) return;
   std::string trimmed = trim_copy(command);
   if(trimmed.empty()) return;
-  auto it = std::remove(g_command_history.begin(), g_command_history.end(), trimmed);
-  g_command_history.erase(it, g_command_history.end());
-  g_command_history.insert(g_command_history.begin(), trimmed);
-  history_apply_limit();
+  HistoryRecord rec;
+  rec.timestamp = static_cast<int64_t>(std::time(nullptr));
+  rec.exitCode = exitCode;
+  rec.cwd = cwd;
+  rec.command = std::move(trimmed);
+  g_history_log.append(rec);
+}
+
+std::vector<HistoryRecord> history_recent_commands(){
+  int limit = active_settings().historyRecentLimit;
+  if(limit <= 0) return {};
+  return g_history_log.recent(static_cast<size_t>(limit));
 }
 
-const std::vector<std::string>& history_recent_commands(){
-  return g_command_history;
+std::string history_age_label(int64_t timestamp){
+  int64_t age = static_cast<int64_t>(std::time(nullptr)) - timestamp;
+  if(age < 0) age = 0;
+  if(age < 60) return std::to_string(age) + "s";
+  if(age < 3600) return std::to_string(age / 60) + "m";
+  if(age < 86400) return std::to_string(age / 3600) + "h";
+  return std::to_string(age / 86400) + "d";
 }
 
 bool agent_tools_exposed(){
-  return g_settings.agentExposeFsTools;
+  return active_settings().agentExposeFsTools;
 }
 
 bool tool_visible_in_ui(const ToolSpec& spec){
@@ -551,27 +658,32 @@ void agent_indicator_clear(){
   g_agent_monitor_active.store(false, std::memory_order_relaxed);
   g_agent_guard_blink_phase.store(false, std::memory_order_relaxed);
   agent_indicator_refresh_state();
+  event_loop_notify();
 }
 
 void agent_indicator_set_running(){
   g_agent_running_sessions.fetch_add(1, std::memory_order_relaxed);
   agent_indicator_refresh_state();
+  event_loop_notify();
 }
 
 void agent_indicator_set_finished(){
   agent_indicator_decrement(g_agent_running_sessions);
   g_agent_pending_sessions.fetch_add(1, std::memory_order_relaxed);
   agent_indicator_refresh_state();
+  event_loop_notify();
 }
 
 void agent_indicator_mark_acknowledged(){
   agent_indicator_decrement(g_agent_pending_sessions);
   agent_indicator_refresh_state();
+  event_loop_notify();
 }
 
 void agent_indicator_guard_alert_inc(){
   g_agent_guard_alerts.fetch_add(1, std::memory_order_relaxed);
   agent_indicator_refresh_state();
+  event_loop_notify();
 }
 
 void agent_indicator_guard_alert_dec(){
@@ -580,11 +692,13 @@ void agent_indicator_guard_alert_dec(){
     g_agent_guard_blink_phase.store(false, std::memory_order_relaxed);
   }
   agent_indicator_refresh_state();
+  event_loop_notify();
 }
 
 void agent_monitor_set_active(bool active){
   g_agent_monitor_active.store(active, std::memory_order_relaxed);
   agent_indicator_refresh_state();
+  event_loop_notify();
 }
 
 static void load_env_overrides(){
@@ -631,6 +745,7 @@ static void ensure_config_home_initialized(){
 }
 
 const std::string& config_home(){
+  if(t_completion_snapshot) return t_completion_snapshot->configHome;
   ensure_config_home_initialized();
   return g_config_home;
 }
@@ -640,6 +755,10 @@ static std::string config_file_path(const std::string& name){
   return std::filesystem::absolute(full).string();
 }
 
+void history_initialize(){
+  g_history_log.open(config_file_path("mycli_history.log"));
+}
+
 const std::string& settings_file_path(){
   static std::string path;
   path = config_file_path("mycli_settings.conf");
@@ -718,6 +837,7 @@ struct MessageWatcherState {
   std::string folder;
   std::map<std::string, std::time_t> known;
   std::map<std::string, std::time_t> seen;
+  uint64_t generation = 0; // known 或 seen 每次变化时递增，作为补全缓存的版本号
 };
 
 static MessageWatcherState g_message_watcher;
@@ -793,6 +913,7 @@ void message_set_watch_folder(const std::string& path){
   g_message_watcher.folder = normalized;
   g_message_watcher.known.clear();
   g_message_watcher.seen.clear();
+  ++g_message_watcher.generation;
   if(normalized.empty()) return;
   auto files = collectMarkdownFiles(normalized);
   for(const auto& item : files){
@@ -816,6 +937,7 @@ void message_poll(){
     if(current.find(it->first)==current.end()) it = g_message_watcher.seen.erase(it);
     else ++it;
   }
+  if(current != g_message_watcher.known) ++g_message_watcher.generation;
   g_message_watcher.known = std::move(current);
   bool unread = message_has_unread();
   PromptIndicatorState state = prompt_indicator_current("message");
@@ -887,7 +1009,11 @@ std::vector<MessageFileInfo> message_pending_files(){
 bool message_mark_read(const std::string& path){
   auto it = g_message_watcher.known.find(path);
   if(it==g_message_watcher.known.end()) return false;
-  g_message_watcher.seen[path] = it->second;
+  auto seenIt = g_message_watcher.seen.find(path);
+  if(seenIt == g_message_watcher.seen.end() || seenIt->second != it->second){
+    g_message_watcher.seen[path] = it->second;
+    ++g_message_watcher.generation;
+  }
   bool unread = message_has_unread();
   PromptIndicatorState state = prompt_indicator_current("message");
   state.visible = unread;
@@ -920,16 +1046,24 @@ std::optional<std::string> message_resolve_label(const std::string& label){
   return std::nullopt;
 }
 
-std::vector<std::string> message_all_file_labels(){
-  std::vector<std::string> labels;
-  std::set<std::string> seen;
-  for(const auto& info : message_all_files()){
-    std::string name = basenameOf(info.path);
-    if(seen.insert(name).second){
-      labels.push_back(std::move(name));
-    }
-  }
-  return labels;
+std::shared_ptr<const std::vector<MessageFileLabel>> message_all_file_labels(){
+  if(t_completion_snapshot) return t_completion_snapshot->messageLabels;
+  return completion_data_cache().get<std::vector<MessageFileLabel>>(
+    "message.labels", {}, g_message_watcher.generation, []{
+      std::vector<MessageFileLabel> labels;
+      std::set<std::string> seen;
+      for(const auto& info : message_all_files()){
+        std::string name = basenameOf(info.path);
+        if(!seen.insert(name).second) continue;
+        MessageFileLabel entry;
+        entry.label = std::move(name);
+        if(info.isUnread){
+          entry.annotation = info.isNew? "[NEW]" : "[UPDATED]";
+        }
+        labels.push_back(std::move(entry));
+      }
+      return labels;
+    });
 }
 
 void register_prompt_indicator(const PromptIndicatorDescriptor& desc){
@@ -1061,18 +1195,21 @@ void memory_import_indicator_begin(){
   g_memory_import_running.store(1, std::memory_order_relaxed);
   g_memory_import_recent_complete.store(false, std::memory_order_relaxed);
   memory_import_indicator_refresh();
+  event_loop_notify();
 }
 
 void memory_import_indicator_complete(){
   g_memory_import_running.store(0, std::memory_order_relaxed);
   g_memory_import_recent_complete.store(true, std::memory_order_relaxed);
   memory_import_indicator_refresh();
+  event_loop_notify();
 }
 
 void memory_import_indicator_mark_seen(){
   g_memory_import_running.store(0, std::memory_order_relaxed);
   g_memory_import_recent_complete.store(false, std::memory_order_relaxed);
   memory_import_indicator_refresh();
+  event_loop_notify();
 }
 
 static void persist_home_path_to_env(const std::string& path){
@@ -1161,7 +1298,10 @@ bool set_config_home(const std::string& path, std::string& error){
   };
   if(!move_file("mycli_settings.conf") ||
      !move_file("mycli_tools.conf") ||
-     !move_file("mycli_llm_history.json")){
+     !move_file("mycli_llm_history.json") ||
+     !move_file("mycli_history.log") ||
+     !move_file("mycli_usage.tsv") ||
+     !move_file("mycli_dirs.db")){
     error = "fs_error";
     return false;
   }
@@ -1171,6 +1311,8 @@ bool set_config_home(const std::string& path, std::string& error){
   g_llm_watcher.initialized = false;
   g_llm_watcher.path.clear();
   llm_initialize();
+  history_initialize();
+  usage_initialize();
   return true;
 }
 
@@ -1196,25 +1338,6 @@ static void utf8PopBack(std::string& text){
   text.clear();
 }
 
-static size_t utf8PrevIndex(const std::string& text, size_t cursor){
-  if(cursor == 0) return 0;
-  size_t i = std::min(cursor, text.size());
-  while(i > 0){
-    --i;
-    unsigned char byte = static_cast<unsigned char>(text[i]);
-    if((byte & 0xC0) != 0x80) return i;
-  }
-  return 0;
-}
-
-static size_t utf8NextIndex(const std::string& text, size_t cursor){
-  if(cursor >= text.size()) return text.size();
-  unsigned char lead = static_cast<unsigned char>(text[cursor]);
-  size_t advance = utf8CharLength(lead);
-  if(cursor + advance > text.size()) advance = 1;
-  return std::min(text.size(), cursor + advance);
-}
-
 struct CursorWordInfo {
   size_t wordStart = 0;
   size_t wordEnd = 0;
@@ -1224,27 +1347,6 @@ struct CursorWordInfo {
   std::string afterWord;
 };
 
-static CursorWordInfo analyzeWordAtCursor(const std::string& buf, size_t cursor){
-  CursorWordInfo info;
-  info.wordStart = std::min(cursor, buf.size());
-  while(info.wordStart > 0){
-    unsigned char ch = static_cast<unsigned char>(buf[info.wordStart - 1]);
-    if(std::isspace(ch)) break;
-    --info.wordStart;
-  }
-  info.wordEnd = std::min(cursor, buf.size());
-  while(info.wordEnd < buf.size()){
-    unsigned char ch = static_cast<unsigned char>(buf[info.wordEnd]);
-    if(std::isspace(ch)) break;
-    ++info.wordEnd;
-  }
-  info.beforeWord = buf.substr(0, info.wordStart);
-  info.wordBeforeCursor = buf.substr(info.wordStart, std::min(cursor, buf.size()) - info.wordStart);
-  info.wordAfterCursor = buf.substr(std::min(cursor, buf.size()), info.wordEnd - std::min(cursor, buf.size()));
-  info.afterWord = buf.substr(info.wordEnd);
-  return info;
-}
-
 static std::string promptNamePlain(){
   if(g_settings.promptName.empty()) return std::string("mycli");
   return g_settings.promptName;
@@ -1304,7 +1406,7 @@ void set_tool_help_locale(ToolSpec& spec, const std::string& lang, const std::st
 }
 
 std::string localized_tool_summary(const ToolSpec& spec){
-  auto it = spec.summaryLocales.find(g_settings.language);
+  auto it = spec.summaryLocales.find(active_settings().language);
   if(it!=spec.summaryLocales.end() && !it->second.empty()) return it->second;
   auto en = spec.summaryLocales.find("en");
   if(en!=spec.summaryLocales.end() && !en->second.empty()) return en->second;
@@ -1312,7 +1414,7 @@ std::string localized_tool_summary(const ToolSpec& spec){
 }
 
 std::string localized_tool_help(const ToolSpec& spec){
-  auto it = spec.helpLocales.find(g_settings.language);
+  auto it = spec.helpLocales.find(active_settings().language);
   if(it!=spec.helpLocales.end() && !it->second.empty()) return it->second;
   auto en = spec.helpLocales.find("en");
   if(en!=spec.helpLocales.end() && !en->second.empty()) return en->second;
@@ -1322,7 +1424,7 @@ std::string localized_tool_help(const ToolSpec& spec){
 std::string tr(const std::string& key){
   auto it = g_i18n.find(key);
   if(it!=g_i18n.end()){
-    auto jt = it->second.find(g_settings.language);
+    auto jt = it->second.find(active_settings().language);
     if(jt!=it->second.end()) return jt->second;
     jt = it->second.find("en");
     if(jt!=it->second.end()) return jt->second;
@@ -1481,100 +1583,72 @@ static std::optional<MatchResult> greedy_subsequence_alignment(const std::string
   return result;
 }
 
-static std::optional<MatchResult> best_subsequence_alignment(const std::string& target,
-                                                             const std::string& query,
-                                                             bool ignoreCase){
-  const int n = static_cast<int>(target.size());
-  const int m = static_cast<int>(query.size());
-  if(m == 0){
-    MatchResult base;
-    base.matched = true;
-    base.exact = target.empty();
-    base.isExactEqual = base.exact;
-    base.isSubstring = true;
-    base.isPrefix = true;
-    base.score = 0.0;
-    return base;
-  }
+// 整数化的权重（放大 100 倍），让 DP 内层只做整数运算。
+struct SubsequenceCosts {
+  int64_t baseHit;
+  int64_t boundaryBonus;
+  int64_t headBonus;
+  int64_t consecutiveBonus;
+  int64_t caseMatchBonus;
+  int64_t gapBase;
+  int64_t gapQuad;
+  int64_t firstIndexPenalty;
+};
 
-  const double NEG_INF = -1e300;
-  std::vector<std::vector<double>> dp(n, std::vector<double>(m, NEG_INF));
-  std::vector<std::vector<int>> prev(n, std::vector<int>(m, -1));
-  std::vector<int> boundary(n, 0);
-  for(int i=0;i<n;++i){
-    boundary[i] = subseq_is_boundary(target, i) ? 1 : 0;
-  }
+static constexpr double kSubsequenceScoreScale = 100.0;
 
-  auto eq = [&](char a, char b){
-    if(ignoreCase){
-      return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
-    }
-    return a == b;
-  };
+static SubsequenceCosts makeSubsequenceCosts(const SubsequenceWeights& w){
+  auto scaled = [](double v){ return static_cast<int64_t>(std::llround(v * kSubsequenceScoreScale)); };
+  return SubsequenceCosts{scaled(w.baseHit), scaled(w.boundaryBonus), scaled(w.headBonus),
+                          scaled(w.consecutiveBonusPerExtend), scaled(w.caseMatchBonus),
+                          scaled(w.gapBase), scaled(w.gapQuad), scaled(w.firstIndexPenalty)};
+}
 
-  for(int i=0;i<n;++i){
-    if(!eq(target[i], query[0])) continue;
-    double score = kSubsequenceWeights.baseHit;
-    if(boundary[i]) score += kSubsequenceWeights.boundaryBonus;
-    if(i == 0) score += kSubsequenceWeights.headBonus;
-    if(target[i] == query[0]) score += kSubsequenceWeights.caseMatchBonus;
-    score -= kSubsequenceWeights.firstIndexPenalty * i;
-    dp[i][0] = score;
-    prev[i][0] = -1;
-  }
-
-  for(int j=1;j<m;++j){
-    for(int i=j;i<n;++i){
-      if(!eq(target[i], query[j])) continue;
-      double bestScore = NEG_INF;
-      int bestPrev = -1;
-      for(int k=j-1;k<i;++k){
-        double prevScore = dp[k][j-1];
-        if(prevScore <= NEG_INF/2) continue;
-        double trans = prevScore;
-        int gap = i - k - 1;
-        if(gap > 0){
-          double penalty = kSubsequenceWeights.gapBase * gap;
-          if(gap > 1){
-            penalty += kSubsequenceWeights.gapQuad * (gap - 1) * (gap - 1);
-          }
-          trans -= penalty;
-        }
-        trans += kSubsequenceWeights.baseHit;
-        if(boundary[i]) trans += kSubsequenceWeights.boundaryBonus;
-        if(target[i] == query[j]) trans += kSubsequenceWeights.caseMatchBonus;
-        if(i == k + 1) trans += kSubsequenceWeights.consecutiveBonusPerExtend;
-        if(trans > bestScore){
-          bestScore = trans;
-          bestPrev = k;
-        }
-      }
-      if(bestPrev != -1){
-        dp[i][j] = bestScore;
-        prev[i][j] = bestPrev;
-      }
-    }
-  }
+static const SubsequenceCosts kSubsequenceCosts = makeSubsequenceCosts(kSubsequenceWeights);
 
-  double best = NEG_INF;
-  int endIndex = -1;
-  for(int i=m-1;i<n;++i){
-    if(dp[i][m-1] > best){
-      best = dp[i][m-1];
-      endIndex = i;
+static inline int64_t subseq_gap_penalty(int64_t gap){
+  if(gap <= 0) return 0;
+  int64_t penalty = kSubsequenceCosts.gapBase * gap;
+  if(gap > 1) penalty += kSubsequenceCosts.gapQuad * (gap - 1) * (gap - 1);
+  return penalty;
+}
+
+// 对给定的对齐位置按 DP 同样的规则打分（不含整体奖励）。
+static int64_t subseq_alignment_score(const std::string& target, const std::string& query,
+                                      const std::vector<int>& pos){
+  int64_t score = 0;
+  for(size_t j = 0; j < pos.size(); ++j){
+    int i = pos[j];
+    score += kSubsequenceCosts.baseHit;
+    if(subseq_is_boundary(target, i)) score += kSubsequenceCosts.boundaryBonus;
+    if(target[static_cast<size_t>(i)] == query[j]) score += kSubsequenceCosts.caseMatchBonus;
+    if(j == 0){
+      if(i == 0) score += kSubsequenceCosts.headBonus;
+      score -= kSubsequenceCosts.firstIndexPenalty * i;
+    }else if(i == pos[j-1] + 1){
+      score += kSubsequenceCosts.consecutiveBonus;
+    }else{
+      score -= subseq_gap_penalty(i - pos[j-1] - 1);
     }
   }
-  if(endIndex == -1) return std::nullopt;
+  return score;
+}
 
-  std::vector<int> pos(static_cast<size_t>(m));
-  int ci = endIndex;
-  int cj = m - 1;
-  while(cj >= 0){
-    pos[static_cast<size_t>(cj)] = ci;
-    ci = prev[ci][cj];
-    --cj;
-  }
+// 任意对齐能拿到的分数上限：首字符之后每个字符都按边界+同大小写+连续计。
+static int64_t subseq_row_gain_bound(){
+  return kSubsequenceCosts.baseHit + kSubsequenceCosts.boundaryBonus +
+         kSubsequenceCosts.caseMatchBonus + kSubsequenceCosts.consecutiveBonus;
+}
+
+static double subseq_final_bonus_bound(size_t targetLength, size_t queryLength){
+  double bonus = kSubsequenceWeights.substringBonus + kSubsequenceWeights.prefixBonus;
+  if(targetLength == queryLength) bonus += kSubsequenceWeights.exactEqualBonus;
+  return bonus - kSubsequenceWeights.lengthPenaltyLambda * std::log1p(static_cast<double>(targetLength));
+}
 
+static MatchResult subseq_finish_alignment(const std::string& target, const std::string& query,
+                                           std::vector<int> pos, int64_t scaledScore){
+  const int m = static_cast<int>(query.size());
   int firstIndex = pos.front();
   int windowSpan = pos.back() - pos.front();
   int gaps = 0;
@@ -1590,6 +1664,7 @@ static std::optional<MatchResult> best_subsequence_alignment(const std::string&
                             [&](char a, char b){ return std::tolower(static_cast<unsigned char>(a)) ==
                                                       std::tolower(static_cast<unsigned char>(b)); });
 
+  double best = static_cast<double>(scaledScore) / kSubsequenceScoreScale;
   if(isExact) best += kSubsequenceWeights.exactEqualBonus;
   if(isSubstring) best += kSubsequenceWeights.substringBonus;
   if(isPrefix) best += kSubsequenceWeights.prefixBonus;
@@ -1612,10 +1687,312 @@ static std::optional<MatchResult> best_subsequence_alignment(const std::string&
   return result;
 }
 
+// DP 的可复用工作区；按线程保存，避免每个候选都重新分配。
+struct SubsequenceScratch {
+  std::vector<int64_t> prevRow;
+  std::vector<int64_t> curRow;
+  std::vector<int32_t> back;     // m 行 × 带宽，记录每个命中点的前驱
+  std::vector<uint8_t> boundary;
+  std::vector<char> foldedQuery;
+  std::vector<int32_t> queueIndex;
+  std::vector<int32_t> queueStart;
+};
+
+static SubsequenceScratch& subsequenceScratch(){
+  static thread_local SubsequenceScratch scratch;
+  return scratch;
+}
+
+// 排名模式下的最优对齐。转移 dp[j][i] = max_k dp[j-1][k] - gap(i-k-1) + bonus(i)，
+// gap 为凸函数，较早的前驱一旦被较晚的前驱超过就永远不会再胜出，
+// 因此每行用一个单调队列维护“当前最优的带间隙前驱”，整体约为 O(n·m·log n)，
+// 不再逐个枚举 k。scoreFloor 用于前 K 名筛选：若已能断定分数进不了前 K，
+// 就提前停止 DP，退回到贪心对齐的分数（它是最优分数的下界）。
+static std::optional<MatchResult> best_subsequence_alignment(const std::string& target,
+                                                             const std::string& query,
+                                                             bool ignoreCase,
+                                                             double scoreFloor = -std::numeric_limits<double>::infinity()){
+  const int n = static_cast<int>(target.size());
+  const int m = static_cast<int>(query.size());
+  if(m == 0){
+    MatchResult base;
+    base.matched = true;
+    base.exact = target.empty();
+    base.isExactEqual = base.exact;
+    base.isSubstring = true;
+    base.isPrefix = true;
+    base.score = 0.0;
+    return base;
+  }
+  if(m > n) return std::nullopt;
+
+  auto fold = [&](char ch){
+    return ignoreCase ? static_cast<char>(std::tolower(static_cast<unsigned char>(ch))) : ch;
+  };
+
+  auto greedyFallback = [&]()->std::optional<MatchResult>{
+    std::vector<int> pos;
+    pos.reserve(static_cast<size_t>(m));
+    for(int i = 0; i < n && static_cast<int>(pos.size()) < m; ++i){
+      if(fold(target[static_cast<size_t>(i)]) == fold(query[pos.size()])) pos.push_back(i);
+    }
+    if(static_cast<int>(pos.size()) != m) return std::nullopt;
+    int64_t scaled = subseq_alignment_score(target, query, pos);
+    return subseq_finish_alignment(target, query, std::move(pos), scaled);
+  };
+
+  const double finalBound = subseq_final_bonus_bound(target.size(), query.size());
+  const int64_t rowGain = subseq_row_gain_bound();
+  auto cannotReachFloor = [&](int64_t bestSoFar, int rowsLeft){
+    if(!(scoreFloor > -std::numeric_limits<double>::infinity())) return false;
+    double bound = static_cast<double>(bestSoFar + rowGain * rowsLeft) / kSubsequenceScoreScale + finalBound;
+    return bound < scoreFloor;
+  };
+  const int64_t firstGain = kSubsequenceCosts.baseHit + kSubsequenceCosts.boundaryBonus +
+                            kSubsequenceCosts.headBonus + kSubsequenceCosts.caseMatchBonus;
+  if(cannotReachFloor(firstGain, m - 1)) return greedyFallback();
+
+  SubsequenceScratch& sc = subsequenceScratch();
+  const int width = n - m + 1;  // 第 j 个查询字符只可能落在 [j, j+width)
+  constexpr int64_t kNeg = std::numeric_limits<int64_t>::min() / 4;
+  sc.prevRow.assign(static_cast<size_t>(n), kNeg);
+  sc.curRow.assign(static_cast<size_t>(n), kNeg);
+  sc.back.resize(static_cast<size_t>(m) * static_cast<size_t>(width));
+  sc.boundary.resize(static_cast<size_t>(n));
+  sc.foldedQuery.resize(static_cast<size_t>(m));
+  sc.queueIndex.resize(static_cast<size_t>(n));
+  sc.queueStart.resize(static_cast<size_t>(n));
+  for(int i = 0; i < n; ++i) sc.boundary[static_cast<size_t>(i)] = subseq_is_boundary(target, i) ? 1 : 0;
+  for(int j = 0; j < m; ++j) sc.foldedQuery[static_cast<size_t>(j)] = fold(query[static_cast<size_t>(j)]);
+
+  auto hitBonus = [&](int i, int j){
+    int64_t bonus = kSubsequenceCosts.baseHit;
+    if(sc.boundary[static_cast<size_t>(i)]) bonus += kSubsequenceCosts.boundaryBonus;
+    if(target[static_cast<size_t>(i)] == query[static_cast<size_t>(j)]) bonus += kSubsequenceCosts.caseMatchBonus;
+    return bonus;
+  };
+
+  int64_t rowBest = kNeg;
+  for(int i = 0; i < width; ++i){
+    if(fold(target[static_cast<size_t>(i)]) != sc.foldedQuery[0]) continue;
+    int64_t score = hitBonus(i, 0);
+    if(i == 0) score += kSubsequenceCosts.headBonus;
+    score -= kSubsequenceCosts.firstIndexPenalty * i;
+    sc.prevRow[static_cast<size_t>(i)] = score;
+    sc.back[static_cast<size_t>(i)] = -1;
+    rowBest = std::max(rowBest, score);
+  }
+  if(rowBest == kNeg) return std::nullopt;
+  if(cannotReachFloor(rowBest, m - 1)) return greedyFallback();
+
+  for(int j = 1; j < m; ++j){
+    const int lo = j;
+    const int hi = j + width - 1;
+    int32_t* rowBack = sc.back.data() + static_cast<size_t>(j) * static_cast<size_t>(width);
+    const int64_t* prev = sc.prevRow.data();
+    // 前驱 k 在第 i 处的转移值（不含 i 自身的奖励）
+    auto via = [&](int k, int i){ return prev[k] - subseq_gap_penalty(i - k - 1); };
+    // 较晚的前驱 c 从哪个位置起严格优于较早的 b（差值随 i 单调不减，二分查找）
+    auto overtakeAt = [&](int b, int c){
+      int left = c + 2;
+      int right = hi + 1;
+      while(left < right){
+        int mid = left + (right - left) / 2;
+        if(via(c, mid) > via(b, mid)) right = mid;
+        else left = mid + 1;
+      }
+      return left;
+    };
+    int qHead = 0;
+    int qTail = 0;
+    rowBest = kNeg;
+    for(int i = lo - 1; i <= hi; ++i) sc.curRow[static_cast<size_t>(i)] = kNeg;
+    for(int i = lo; i <= hi; ++i){
+      int cand = i - 2;
+      if(cand >= j - 1 && prev[cand] != kNeg){
+        while(qTail > qHead){
+          int t = overtakeAt(sc.queueIndex[static_cast<size_t>(qTail - 1)], cand);
+          if(t <= sc.queueStart[static_cast<size_t>(qTail - 1)]) --qTail;
+          else break;
+        }
+        if(qTail == qHead){
+          sc.queueIndex[static_cast<size_t>(qTail)] = cand;
+          sc.queueStart[static_cast<size_t>(qTail)] = cand + 2;
+          ++qTail;
+        }else{
+          int t = overtakeAt(sc.queueIndex[static_cast<size_t>(qTail - 1)], cand);
+          if(t <= hi){
+            sc.queueIndex[static_cast<size_t>(qTail)] = cand;
+            sc.queueStart[static_cast<size_t>(qTail)] = t;
+            ++qTail;
+          }
+        }
+      }
+      while(qTail - qHead >= 2 && sc.queueStart[static_cast<size_t>(qHead + 1)] <= i) ++qHead;
+      if(fold(target[static_cast<size_t>(i)]) != sc.foldedQuery[static_cast<size_t>(j)]) continue;
+
+      int64_t bestScore = kNeg;
+      int bestPrev = -1;
+      if(qTail > qHead){
+        int k = sc.queueIndex[static_cast<size_t>(qHead)];
+        bestScore = via(k, i);
+        bestPrev = k;
+      }
+      if(prev[i - 1] != kNeg){
+        int64_t adjacent = prev[i - 1] + kSubsequenceCosts.consecutiveBonus;
+        if(adjacent > bestScore){
+          bestScore = adjacent;
+          bestPrev = i - 1;
+        }
+      }
+      if(bestPrev == -1) continue;
+      bestScore += hitBonus(i, j);
+      sc.curRow[static_cast<size_t>(i)] = bestScore;
+      rowBack[i - lo] = bestPrev;
+      rowBest = std::max(rowBest, bestScore);
+    }
+    if(rowBest == kNeg) return std::nullopt;
+    if(cannotReachFloor(rowBest, m - 1 - j)) return greedyFallback();
+    std::swap(sc.prevRow, sc.curRow);
+  }
+
+  const int64_t* last = sc.prevRow.data();
+  int64_t best = kNeg;
+  int endIndex = -1;
+  for(int i = m - 1; i < n; ++i){
+    if(last[i] > best){
+      best = last[i];
+      endIndex = i;
+    }
+  }
+  if(endIndex == -1) return std::nullopt;
+
+  std::vector<int> pos(static_cast<size_t>(m));
+  int ci = endIndex;
+  for(int cj = m - 1; cj >= 0; --cj){
+    pos[static_cast<size_t>(cj)] = ci;
+    ci = sc.back[static_cast<size_t>(cj) * static_cast<size_t>(width) + static_cast<size_t>(ci - cj)];
+  }
+  return subseq_finish_alignment(target, query, std::move(pos), best);
+}
+
+// 字符签名：a-z（折叠大小写）占 0-25 位，0-9 占 26-35 位，其余 ASCII 字节散列到
+// 36-62 位，所有非 ASCII 字节共用第 63 位。签名只表达“出现过”，因此区分大小写时也成立。
+struct LabelSignatureTable {
+  uint64_t bits[256];
+};
+
+static constexpr LabelSignatureTable buildLabelSignatureTable(){
+  LabelSignatureTable table{};
+  for(int c = 0; c < 256; ++c){
+    int bit = 0;
+    if(c >= 'a' && c <= 'z') bit = c - 'a';
+    else if(c >= 'A' && c <= 'Z') bit = c - 'A';
+    else if(c >= '0' && c <= '9') bit = 26 + (c - '0');
+    else if(c < 0x80) bit = 36 + (c % 27);
+    else bit = 63;
+    table.bits[c] = uint64_t{1} << bit;
+  }
+  return table;
+}
+
+static constexpr LabelSignatureTable kLabelSignatureTable = buildLabelSignatureTable();
+
+uint64_t label_char_signature(std::string_view text){
+  uint64_t sig = 0;
+  for(char ch : text) sig |= kLabelSignatureTable.bits[static_cast<unsigned char>(ch)];
+  return sig;
+}
+
+// 依次查找每个查询字符在上一命中之后的首次出现（memchr 在主流 libc 中是向量化实现），
+// 只判定能否构成子序列。忽略大小写时另一种大小写只在已找到的位置之前再查一次。
+static bool subseq_scan_feasible(std::string_view target, std::string_view query, bool ignoreCase){
+  const char* data = target.data();
+  const size_t n = target.size();
+  size_t from = 0;
+  for(char qc : query){
+    if(from >= n) return false;
+    const void* hit = std::memchr(data + from, qc, n - from);
+    size_t at = hit ? static_cast<size_t>(static_cast<const char*>(hit) - data) : n;
+    if(ignoreCase && at > from){
+      char other = qc;
+      if(qc >= 'a' && qc <= 'z') other = static_cast<char>(qc - 'a' + 'A');
+      else if(qc >= 'A' && qc <= 'Z') other = static_cast<char>(qc - 'A' + 'a');
+      if(other != qc){
+        if(const void* alt = std::memchr(data + from, other, at - from)){
+          at = static_cast<size_t>(static_cast<const char*>(alt) - data);
+        }
+      }
+    }
+    if(at >= n) return false;
+    from = at + 1;
+  }
+  return true;
+}
+
+// 批量匹配时对查询只算一次签名；标签签名缺失时现算。
+class MatchPrefilter {
+public:
+  explicit MatchPrefilter(const std::string& query) : signature_(label_char_signature(query)) {}
+
+  static uint64_t signatureAt(const Candidates& cand, size_t idx){
+    if(cand.labelSignatures.size() == cand.labels.size()) return cand.labelSignatures[idx];
+    return label_char_signature(cand.labels[idx]);
+  }
+
+  bool rejects(uint64_t labelSignature) const { return (signature_ & ~labelSignature) != 0; }
+
+private:
+  uint64_t signature_;
+};
+
+// 记录目前为止前 K 名的分数；满 K 个之后第 K 名即为新候选的淘汰下限。
+class RankedScoreFloor {
+public:
+  explicit RankedScoreFloor(size_t keep) : keep_(keep) {}
+
+  double floor() const {
+    if(keep_ == 0 || heap_.size() < keep_) return -std::numeric_limits<double>::infinity();
+    return heap_.front();
+  }
+
+  void offer(double score){
+    if(keep_ == 0) return;
+    if(heap_.size() < keep_){
+      heap_.push_back(score);
+      std::push_heap(heap_.begin(), heap_.end(), std::greater<double>());
+    }else if(score > heap_.front()){
+      std::pop_heap(heap_.begin(), heap_.end(), std::greater<double>());
+      heap_.back() = score;
+      std::push_heap(heap_.begin(), heap_.end(), std::greater<double>());
+    }
+  }
+
+private:
+  size_t keep_;
+  std::vector<double> heap_;
+};
+
+// 候选数超过该值时才启用前 K 名淘汰；前 K 名之外的候选只用贪心对齐近似打分。
+static constexpr size_t kRankedFloorMinCandidates = 2048;
+static constexpr size_t kRankedExactTopK = 256;
+
+static size_t rankedFloorKeepFor(size_t candidateCount){
+  const AppSettings& settings = active_settings();
+  if(!settings.completionSubsequence) return 0;
+  if(settings.completionSubsequenceStrategy != SubsequenceStrategy::Ranked) return 0;
+  return candidateCount >= kRankedFloorMinCandidates ? kRankedExactTopK : 0;
+}
+
 MatchResult compute_match(const std::string& candidate, const std::string& pattern){
+  return compute_match(candidate, pattern, -std::numeric_limits<double>::infinity());
+}
+
+MatchResult compute_match(const std::string& candidate, const std::string& pattern, double scoreFloor){
   MatchResult res;
-  bool ignoreCase = g_settings.completionIgnoreCase;
-  bool subseq = g_settings.completionSubsequence;
+  const AppSettings& settings = active_settings();
+  bool ignoreCase = settings.completionIgnoreCase;
+  bool subseq = settings.completionSubsequence;
 
   if(pattern.empty()){
     res.matched = true;
@@ -1628,8 +2005,10 @@ MatchResult compute_match(const std::string& candidate, const std::string& patte
   }
 
   if(subseq){
-    if(g_settings.completionSubsequenceStrategy == SubsequenceStrategy::Ranked){
-      if(auto best = best_subsequence_alignment(candidate, pattern, ignoreCase)){
+    // 不构成子序列时前缀也必然不成立，可直接返回未匹配
+    if(!subseq_scan_feasible(candidate, pattern, ignoreCase)) return res;
+    if(settings.completionSubsequenceStrategy == SubsequenceStrategy::Ranked){
+      if(auto best = best_subsequence_alignment(candidate, pattern, ignoreCase, scoreFloor)){
         return *best;
       }
     }else{
@@ -1677,20 +2056,18 @@ MatchResult compute_match(const std::string& candidate, const std::string& patte
   return res;
 }
 
-void sortCandidatesByMatch(const std::string& query, Candidates& cand){
-  if(!g_settings.completionSubsequence) return;
-  if(g_settings.completionSubsequenceStrategy != SubsequenceStrategy::Ranked) return;
-  if(query.empty()) return;
-  size_t n = cand.labels.size();
-  if(n <= 1) return;
-  if(cand.matchDetails.size() != n) return;
-
-  std::vector<size_t> order(n);
-  std::iota(order.begin(), order.end(), size_t{0});
-  auto cmp = [&](size_t lhs, size_t rhs){
+static bool candidateRanksBefore(const Candidates& cand, const CandidateRanking& ranking, size_t lhs, size_t rhs){
+  if(ranking.exactFirst){
+    bool ea = lhs < cand.exactMatches.size() && cand.exactMatches[lhs];
+    bool eb = rhs < cand.exactMatches.size() && cand.exactMatches[rhs];
+    if(ea != eb) return ea;
+  }
+  double ua = ranking.byUsage ? cand.usageBonus[lhs] : 0.0;
+  double ub = ranking.byUsage ? cand.usageBonus[rhs] : 0.0;
+  if(ranking.byScore){
     const MatchResult& a = cand.matchDetails[lhs];
     const MatchResult& b = cand.matchDetails[rhs];
-    if(a.score != b.score) return a.score > b.score;
+    if(a.score + ua != b.score + ub) return a.score + ua > b.score + ub;
     if(a.isExactEqual != b.isExactEqual) return a.isExactEqual && !b.isExactEqual;
     if(a.isSubstring != b.isSubstring) return a.isSubstring && !b.isSubstring;
     if(a.isPrefix != b.isPrefix) return a.isPrefix && !b.isPrefix;
@@ -1700,33 +2077,166 @@ void sortCandidatesByMatch(const std::string& query, Candidates& cand){
     if(a.windowSpan != b.windowSpan) return a.windowSpan < b.windowSpan;
     if(a.firstIndex != b.firstIndex) return a.firstIndex < b.firstIndex;
     if(a.caseMismatch != b.caseMismatch) return a.caseMismatch < b.caseMismatch;
-    if(cand.labels[lhs].size() != cand.labels[rhs].size()) return cand.labels[lhs].size() < cand.labels[rhs].size();
-    return cand.labels[lhs] < cand.labels[rhs];
-  };
+    const std::string& la = cand.labels[lhs];
+    const std::string& lb = cand.labels[rhs];
+    if(la.size() != lb.size()) return la.size() < lb.size();
+    int c = la.compare(lb);
+    if(c != 0) return c < 0;
+  }else if(ua != ub){
+    return ua > ub;
+  }
+  // 以存储下标收尾，结果与旧的 stable_sort 一致
+  return lhs < rhs;
+}
+
+// 每次至少排好这么多名：界面只显示选中项及其后三项，留出余量免得上下翻动时反复排序。
+static constexpr size_t kCandidateRankBatch = 32;
+
+static void ensureCandidatesRanked(Candidates& cand, size_t upTo){
+  CandidateRanking& ranking = cand.ranking;
+  if(ranking.order.empty()) return;
+  if(ranking.order.size() != cand.labels.size()){
+    ranking = CandidateRanking{};
+    return;
+  }
+  upTo = std::min(upTo, ranking.order.size());
+  if(upTo <= ranking.sorted) return;
+  size_t target = std::min(ranking.order.size(), std::max(upTo, ranking.sorted + kCandidateRankBatch));
+  // 已排好的前缀都不劣于剩余部分，只需在剩余部分里再选出下一段
+  std::partial_sort(ranking.order.begin() + static_cast<std::ptrdiff_t>(ranking.sorted),
+                    ranking.order.begin() + static_cast<std::ptrdiff_t>(target),
+                    ranking.order.end(),
+                    [&](size_t lhs, size_t rhs){ return candidateRanksBefore(cand, ranking, lhs, rhs); });
+  ranking.sorted = target;
+}
+
+static constexpr size_t kParallelRankMinCandidates = 16384;
+static constexpr size_t kParallelRankChunk = 8192;
+
+// 各线程在自己分到的块里维护前 K 名的堆（堆顶为其中最差者），最后合并各堆得到全局前 K 名；
+// 其余下标按存储顺序排在后面，之后需要时再由 ensureCandidatesRanked 继续排。
+static void selectTopRanksParallel(Candidates& cand, size_t keep){
+  CandidateRanking& ranking = cand.ranking;
+  const size_t n = cand.labels.size();
+  keep = std::min(keep, n);
+  auto before = [&](size_t lhs, size_t rhs){ return candidateRanksBefore(cand, ranking, lhs, rhs); };
+
+  WorkStealingPool& pool = WorkStealingPool::shared();
+  std::vector<std::vector<size_t>> heaps(pool.concurrency());
+  pool.parallelFor(n, kParallelRankChunk, [&](size_t worker, size_t begin, size_t end){
+    std::vector<size_t>& heap = heaps[worker];
+    for(size_t i = begin; i < end; ++i){
+      if(heap.size() < keep){
+        heap.push_back(i);
+        std::push_heap(heap.begin(), heap.end(), before);
+      }else if(before(i, heap.front())){
+        std::pop_heap(heap.begin(), heap.end(), before);
+        heap.back() = i;
+        std::push_heap(heap.begin(), heap.end(), before);
+      }
+    }
+  });
 
-  std::stable_sort(order.begin(), order.end(), cmp);
+  std::vector<size_t> top;
+  for(const auto& heap : heaps) top.insert(top.end(), heap.begin(), heap.end());
+  std::partial_sort(top.begin(), top.begin() + static_cast<std::ptrdiff_t>(keep), top.end(), before);
+  top.resize(keep);
 
-  bool changed = false;
-  for(size_t i=0;i<n;++i){
-    if(order[i] != i){ changed = true; break; }
+  std::vector<char> taken(n, 0);
+  ranking.order.clear();
+  ranking.order.reserve(n);
+  for(size_t idx : top){
+    taken[idx] = 1;
+    ranking.order.push_back(idx);
+  }
+  for(size_t i = 0; i < n; ++i){
+    if(!taken[i]) ranking.order.push_back(i);
   }
-  if(!changed) return;
+  ranking.sorted = keep;
+}
 
-  auto reorderVec = [&](auto& vec){
-    using VecType = std::decay_t<decltype(vec)>;
-    VecType tmp;
-    tmp.reserve(vec.size());
-    for(size_t idx : order){
-      tmp.push_back(vec[idx]);
+// 只建立排名置换并选出前 K 名，不移动任何并行数组。
+static void rankCandidates(Candidates& cand, const std::string& query, bool exactFirst){
+  size_t n = cand.labels.size();
+  CandidateRanking ranking;
+  const AppSettings& settings = active_settings();
+  ranking.byScore = settings.completionSubsequence &&
+                    settings.completionSubsequenceStrategy == SubsequenceStrategy::Ranked &&
+                    !query.empty() &&
+                    cand.matchDetails.size() == n;
+  ranking.exactFirst = exactFirst &&
+                       std::any_of(cand.exactMatches.begin(), cand.exactMatches.end(), [](bool v){ return v; });
+  ranking.byUsage = cand.usageBonus.size() == n;
+  cand.ranking = CandidateRanking{};
+  if(n <= 1 || (!ranking.byScore && !ranking.exactFirst && !ranking.byUsage)) return;
+  if(n >= kParallelRankMinCandidates && WorkStealingPool::shared().concurrency() > 1){
+    cand.ranking = std::move(ranking);
+    selectTopRanksParallel(cand, kCandidateRankBatch);
+    return;
+  }
+  ranking.order.resize(n);
+  std::iota(ranking.order.begin(), ranking.order.end(), size_t{0});
+  cand.ranking = std::move(ranking);
+  ensureCandidatesRanked(cand, kCandidateRankBatch);
+}
+
+static size_t candidateIndexAt(const Candidates& cand, size_t rank){
+  return cand.ranking.order.empty() ? rank : cand.ranking.order[rank];
+}
+
+static const std::vector<int>& candidatePositionsAt(const Candidates& cand, size_t idx){
+  static const std::vector<int> kNone;
+  if(cand.matchPositions.size() == cand.labels.size()) return cand.matchPositions[idx];
+  if(cand.matchDetails.size() == cand.labels.size()) return cand.matchDetails[idx].positions;
+  return kNone;
+}
+
+template <typename Vec>
+static void permuteInPlace(Vec& vec, const std::vector<size_t>& order){
+  size_t n = order.size();
+  if(vec.size() != n) return;
+  std::vector<bool> placed(n, false);
+  for(size_t start = 0; start < n; ++start){
+    if(placed[start] || order[start] == start) continue;
+    typename Vec::value_type held = std::move(vec[start]);
+    size_t at = start;
+    while(true){
+      placed[at] = true;
+      size_t from = order[at];
+      if(from == start) break;
+      vec[at] = std::move(vec[from]);
+      at = from;
     }
-    vec = std::move(tmp);
-  };
-  reorderVec(cand.items);
-  reorderVec(cand.labels);
-  reorderVec(cand.matchPositions);
-  reorderVec(cand.annotations);
-  reorderVec(cand.exactMatches);
-  reorderVec(cand.matchDetails);
+    vec[at] = std::move(held);
+  }
+}
+
+// 供工具直接读取 labels 顺序的场合：完整排序后按置换就地移动各数组，不再整体复制。
+void sortCandidatesByMatch(const std::string& query, Candidates& cand){
+  size_t n = cand.labels.size();
+  if(n <= 1) return;
+  const AppSettings& settings = active_settings();
+  bool byScore = settings.completionSubsequence &&
+                 settings.completionSubsequenceStrategy == SubsequenceStrategy::Ranked &&
+                 !query.empty() && cand.matchDetails.size() == n;
+  if(!byScore && cand.usageBonus.size() != n) return;
+
+  rankCandidates(cand, query, false);
+  ensureCandidatesRanked(cand, n);
+  std::vector<size_t> order = std::move(cand.ranking.order);
+  cand.ranking = CandidateRanking{};
+  if(order.empty()) return;
+
+  permuteInPlace(cand.items, order);
+  permuteInPlace(cand.labels, order);
+  permuteInPlace(cand.matchPositions, order);
+  permuteInPlace(cand.annotations, order);
+  permuteInPlace(cand.exactMatches, order);
+  permuteInPlace(cand.matchDetails, order);
+  if(cand.labelSignatures.size() == n) permuteInPlace(cand.labelSignatures, order);
+  else cand.labelSignatures.clear();
+  if(cand.usageBonus.size() == n) permuteInPlace(cand.usageBonus, order);
+  else cand.usageBonus.clear();
 }
 
 // ===== Prompt params =====
@@ -1737,179 +2247,744 @@ struct CodepointRange {
   char32_t last;
 };
 
-static bool isInRange(char32_t cp, const CodepointRange& range){
-  return cp >= range.first && cp <= range.last;
-}
-
-static bool isCombining(char32_t cp){
-  // Combining mark ranges adapted from Markus Kuhn's wcwidth implementation
-  // (https://www.cl.cam.ac.uk/~mgk25/ucs/wcwidth.c) updated for modern Unicode.
-  static constexpr CodepointRange ranges[] = {
-    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF},
-    {0x05C1, 0x05C2}, {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0600, 0x0605},
-    {0x0610, 0x061A}, {0x061C, 0x061C}, {0x064B, 0x065F}, {0x0670, 0x0670},
-    {0x06D6, 0x06DD}, {0x06DF, 0x06E4}, {0x06E7, 0x06E8}, {0x06EA, 0x06ED},
-    {0x070F, 0x070F}, {0x0711, 0x0711}, {0x0730, 0x074A}, {0x07A6, 0x07B0},
-    {0x07EB, 0x07F3}, {0x07FD, 0x07FD}, {0x0816, 0x0819}, {0x081B, 0x0823},
-    {0x0825, 0x0827}, {0x0829, 0x082D}, {0x0859, 0x085B}, {0x08D3, 0x08E1},
-    {0x08E3, 0x0902}, {0x093A, 0x093A}, {0x093C, 0x093C}, {0x0941, 0x0948},
-    {0x094D, 0x094D}, {0x0951, 0x0957}, {0x0962, 0x0963}, {0x0981, 0x0981},
-    {0x09BC, 0x09BC}, {0x09C1, 0x09C4}, {0x09CD, 0x09CD}, {0x09E2, 0x09E3},
-    {0x09FE, 0x09FE}, {0x0A01, 0x0A02}, {0x0A3C, 0x0A3C}, {0x0A41, 0x0A42},
-    {0x0A47, 0x0A48}, {0x0A4B, 0x0A4D}, {0x0A51, 0x0A51}, {0x0A70, 0x0A71},
-    {0x0A75, 0x0A75}, {0x0A81, 0x0A82}, {0x0ABC, 0x0ABC}, {0x0AC1, 0x0AC5},
-    {0x0AC7, 0x0AC8}, {0x0ACD, 0x0ACD}, {0x0AE2, 0x0AE3}, {0x0AFA, 0x0AFF},
-    {0x0B01, 0x0B01}, {0x0B3C, 0x0B3C}, {0x0B3F, 0x0B3F}, {0x0B41, 0x0B44},
-    {0x0B4D, 0x0B4D}, {0x0B56, 0x0B56}, {0x0B62, 0x0B63}, {0x0B82, 0x0B82},
-    {0x0BC0, 0x0BC0}, {0x0BCD, 0x0BCD}, {0x0C00, 0x0C00}, {0x0C04, 0x0C04},
-    {0x0C3E, 0x0C40}, {0x0C46, 0x0C48}, {0x0C4A, 0x0C4D}, {0x0C55, 0x0C56},
-    {0x0C62, 0x0C63}, {0x0C81, 0x0C81}, {0x0CBC, 0x0CBC}, {0x0CBF, 0x0CBF},
-    {0x0CC6, 0x0CC6}, {0x0CCC, 0x0CCD}, {0x0CE2, 0x0CE3}, {0x0D00, 0x0D01},
-    {0x0D3B, 0x0D3C}, {0x0D41, 0x0D44}, {0x0D4D, 0x0D4D}, {0x0D62, 0x0D63},
-    {0x0D81, 0x0D81}, {0x0DCA, 0x0DCA}, {0x0DD2, 0x0DD4}, {0x0DD6, 0x0DD6},
-    {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x0EB1, 0x0EB1},
-    {0x0EB4, 0x0EBC}, {0x0EC8, 0x0ECD}, {0x0F18, 0x0F19}, {0x0F35, 0x0F35},
-    {0x0F37, 0x0F37}, {0x0F39, 0x0F39}, {0x0F71, 0x0F7E}, {0x0F80, 0x0F84},
-    {0x0F86, 0x0F87}, {0x0F8D, 0x0F97}, {0x0F99, 0x0FBC}, {0x0FC6, 0x0FC6},
-    {0x102D, 0x1030}, {0x1032, 0x1037}, {0x1039, 0x103A}, {0x103D, 0x103E},
-    {0x1058, 0x1059}, {0x105E, 0x1060}, {0x1071, 0x1074}, {0x1082, 0x1082},
-    {0x1085, 0x1086}, {0x108D, 0x108D}, {0x109D, 0x109D}, {0x135D, 0x135F},
-    {0x1712, 0x1714}, {0x1732, 0x1734}, {0x1752, 0x1753}, {0x1772, 0x1773},
-    {0x17B4, 0x17B5}, {0x17B7, 0x17BD}, {0x17C6, 0x17C6}, {0x17C9, 0x17D3},
-    {0x17DD, 0x17DD}, {0x180B, 0x180D}, {0x180F, 0x180F}, {0x1885, 0x1886},
-    {0x18A9, 0x18A9}, {0x1920, 0x1922}, {0x1927, 0x1928}, {0x1932, 0x1932},
-    {0x1939, 0x193B}, {0x1A17, 0x1A18}, {0x1A1B, 0x1A1B}, {0x1A56, 0x1A56},
-    {0x1A58, 0x1A5E}, {0x1A60, 0x1A60}, {0x1A62, 0x1A62}, {0x1A65, 0x1A6C},
-    {0x1A73, 0x1A7C}, {0x1A7F, 0x1A7F}, {0x1AB0, 0x1ABE}, {0x1ABF, 0x1ACE},
-    {0x1B00, 0x1B03}, {0x1B34, 0x1B34}, {0x1B36, 0x1B3A}, {0x1B3C, 0x1B3C},
-    {0x1B42, 0x1B42}, {0x1B6B, 0x1B73}, {0x1B80, 0x1B81}, {0x1BA2, 0x1BA5},
-    {0x1BA8, 0x1BA9}, {0x1BAB, 0x1BAD}, {0x1BE6, 0x1BE6}, {0x1BE8, 0x1BE9},
-    {0x1BED, 0x1BED}, {0x1BEF, 0x1BF1}, {0x1C2C, 0x1C33}, {0x1C36, 0x1C37},
-    {0x1CD0, 0x1CD2}, {0x1CD4, 0x1CE0}, {0x1CE2, 0x1CE8}, {0x1CED, 0x1CED},
-    {0x1CF4, 0x1CF4}, {0x1CF8, 0x1CF9}, {0x1DC0, 0x1DF9}, {0x1DFB, 0x1DFF},
-    {0x200B, 0x200F}, {0x202A, 0x202E}, {0x2060, 0x2064}, {0x2066, 0x206F},
-    {0x20D0, 0x20DC}, {0x20DD, 0x20E0}, {0x20E1, 0x20E1}, {0x20E2, 0x20E4},
-    {0x20E5, 0x20F0}, {0x2CEF, 0x2CF1}, {0x2D7F, 0x2D7F}, {0x2DE0, 0x2DFF},
-    {0x302A, 0x302D}, {0x302E, 0x302F}, {0x3099, 0x309A}, {0xA66F, 0xA66F},
-    {0xA674, 0xA67D}, {0xA69E, 0xA69F}, {0xA6F0, 0xA6F1}, {0xA802, 0xA802},
-    {0xA806, 0xA806}, {0xA80B, 0xA80B}, {0xA825, 0xA826}, {0xA82C, 0xA82C},
-    {0xA8C4, 0xA8C5}, {0xA8E0, 0xA8F1}, {0xA8FF, 0xA8FF}, {0xA926, 0xA92D},
-    {0xA947, 0xA951}, {0xA980, 0xA982}, {0xA9B3, 0xA9B3}, {0xA9B6, 0xA9B9},
-    {0xA9BC, 0xA9BD}, {0xA9E5, 0xA9E5}, {0xAA29, 0xAA2E}, {0xAA31, 0xAA32},
-    {0xAA35, 0xAA36}, {0xAA43, 0xAA43}, {0xAA4C, 0xAA4C}, {0xAA7C, 0xAA7C},
-    {0xAAB0, 0xAAB0}, {0xAAB2, 0xAAB4}, {0xAAB7, 0xAAB8}, {0xAABE, 0xAABF},
-    {0xAAC1, 0xAAC1}, {0xAAEC, 0xAAED}, {0xAAF6, 0xAAF6}, {0xABE5, 0xABE5},
-    {0xABE8, 0xABE8}, {0xABED, 0xABED}, {0xFB1E, 0xFB1E}, {0xFE00, 0xFE0F},
-    {0xFE20, 0xFE2F}, {0x101FD, 0x101FD}, {0x102E0, 0x102E0},
-    {0x10376, 0x1037A}, {0x10A01, 0x10A03}, {0x10A05, 0x10A06},
-    {0x10A0C, 0x10A0F}, {0x10A38, 0x10A3A}, {0x10A3F, 0x10A3F},
-    {0x10AE5, 0x10AE6}, {0x10D24, 0x10D27}, {0x10EAB, 0x10EAC},
-    {0x10EFD, 0x10EFF}, {0x10F46, 0x10F50}, {0x10F82, 0x10F85},
-    {0x11001, 0x11001}, {0x11038, 0x11046}, {0x1107F, 0x11081},
-    {0x110B3, 0x110B6}, {0x110B9, 0x110BA}, {0x11100, 0x11102},
-    {0x11127, 0x1112B}, {0x1112D, 0x11134}, {0x11173, 0x11173},
-    {0x11180, 0x11181}, {0x111B6, 0x111BE}, {0x111C9, 0x111CC},
-    {0x111CF, 0x111CF}, {0x1122F, 0x11231}, {0x11234, 0x11234},
-    {0x11236, 0x11237}, {0x1123E, 0x1123E}, {0x112DF, 0x112DF},
-    {0x112E3, 0x112EA}, {0x11300, 0x11301}, {0x1133B, 0x1133C},
-    {0x11340, 0x11340}, {0x11366, 0x1136C}, {0x11370, 0x11374},
-    {0x11438, 0x1143F}, {0x11442, 0x11444}, {0x11446, 0x11446},
-    {0x1145E, 0x1145E}, {0x114B3, 0x114B8}, {0x114BA, 0x114BA},
-    {0x114BF, 0x114C0}, {0x114C2, 0x114C3}, {0x115B2, 0x115B5},
-    {0x115BC, 0x115BD}, {0x115BF, 0x115C0}, {0x115DC, 0x115DD},
-    {0x11633, 0x1163A}, {0x1163D, 0x1163D}, {0x1163F, 0x11640},
-    {0x116AB, 0x116AB}, {0x116AD, 0x116AD}, {0x116B0, 0x116B5},
-    {0x116B7, 0x116B7}, {0x1171D, 0x1171F}, {0x11722, 0x11725},
-    {0x11727, 0x1172B}, {0x1182F, 0x11837}, {0x11839, 0x1183A},
-    {0x1193B, 0x1193C}, {0x1193E, 0x1193E}, {0x11943, 0x11943},
-    {0x119D4, 0x119D7}, {0x119DA, 0x119DB}, {0x119E0, 0x119E0},
-    {0x11A01, 0x11A0A}, {0x11A33, 0x11A38}, {0x11A3B, 0x11A3E},
-    {0x11A47, 0x11A47}, {0x11A51, 0x11A56}, {0x11A59, 0x11A5B},
-    {0x11A8A, 0x11A96}, {0x11A98, 0x11A99}, {0x11C30, 0x11C36},
-    {0x11C38, 0x11C3D}, {0x11C3F, 0x11C3F}, {0x11C92, 0x11CA7},
-    {0x11CAA, 0x11CB0}, {0x11CB2, 0x11CB3}, {0x11CB5, 0x11CB6},
-    {0x11D31, 0x11D36}, {0x11D3A, 0x11D3A}, {0x11D3C, 0x11D3D},
-    {0x11D3F, 0x11D45}, {0x11D47, 0x11D47}, {0x11D90, 0x11D91},
-    {0x11D95, 0x11D95}, {0x11D97, 0x11D97}, {0x11EF3, 0x11EF4},
-    {0x13430, 0x13438}, {0x16AF0, 0x16AF4}, {0x16B30, 0x16B36},
-    {0x16F4F, 0x16F4F}, {0x16F8F, 0x16F92}, {0x16FE4, 0x16FE4},
-    {0x16FF0, 0x16FF1}, {0x1BC9D, 0x1BC9E}, {0x1BCA0, 0x1BCA3},
-    {0x1D167, 0x1D169}, {0x1D173, 0x1D182}, {0x1D185, 0x1D18B},
-    {0x1D1AA, 0x1D1AD}, {0x1D242, 0x1D244}, {0x1DA00, 0x1DA36},
-    {0x1DA3B, 0x1DA6C}, {0x1DA75, 0x1DA75}, {0x1DA84, 0x1DA84},
-    {0x1DA9B, 0x1DA9F}, {0x1DAA1, 0x1DAAF}, {0x1E000, 0x1E006},
-    {0x1E008, 0x1E018}, {0x1E01B, 0x1E021}, {0x1E023, 0x1E024},
-    {0x1E026, 0x1E02A}, {0x1E08F, 0x1E08F}, {0x1E130, 0x1E136},
-    {0x1E2AE, 0x1E2AE}, {0x1E2EC, 0x1E2EF}, {0x1E4EC, 0x1E4EF},
-    {0x1E8D0, 0x1E8D6}, {0x1E944, 0x1E94A}, {0xE0100, 0xE01EF}
+// Combining mark ranges adapted from Markus Kuhn's wcwidth implementation
+// (https://www.cl.cam.ac.uk/~mgk25/ucs/wcwidth.c) updated for modern Unicode.
+static constexpr CodepointRange kCombiningRanges[] = {
+  {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF},
+  {0x05C1, 0x05C2}, {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0600, 0x0605},
+  {0x0610, 0x061A}, {0x061C, 0x061C}, {0x064B, 0x065F}, {0x0670, 0x0670},
+  {0x06D6, 0x06DD}, {0x06DF, 0x06E4}, {0x06E7, 0x06E8}, {0x06EA, 0x06ED},
+  {0x070F, 0x070F}, {0x0711, 0x0711}, {0x0730, 0x074A}, {0x07A6, 0x07B0},
+  {0x07EB, 0x07F3}, {0x07FD, 0x07FD}, {0x0816, 0x0819}, {0x081B, 0x0823},
+  {0x0825, 0x0827}, {0x0829, 0x082D}, {0x0859, 0x085B}, {0x08D3, 0x08E1},
+  {0x08E3, 0x0902}, {0x093A, 0x093A}, {0x093C, 0x093C}, {0x0941, 0x0948},
+  {0x094D, 0x094D}, {0x0951, 0x0957}, {0x0962, 0x0963}, {0x0981, 0x0981},
+  {0x09BC, 0x09BC}, {0x09C1, 0x09C4}, {0x09CD, 0x09CD}, {0x09E2, 0x09E3},
+  {0x09FE, 0x09FE}, {0x0A01, 0x0A02}, {0x0A3C, 0x0A3C}, {0x0A41, 0x0A42},
+  {0x0A47, 0x0A48}, {0x0A4B, 0x0A4D}, {0x0A51, 0x0A51}, {0x0A70, 0x0A71},
+  {0x0A75, 0x0A75}, {0x0A81, 0x0A82}, {0x0ABC, 0x0ABC}, {0x0AC1, 0x0AC5},
+  {0x0AC7, 0x0AC8}, {0x0ACD, 0x0ACD}, {0x0AE2, 0x0AE3}, {0x0AFA, 0x0AFF},
+  {0x0B01, 0x0B01}, {0x0B3C, 0x0B3C}, {0x0B3F, 0x0B3F}, {0x0B41, 0x0B44},
+  {0x0B4D, 0x0B4D}, {0x0B56, 0x0B56}, {0x0B62, 0x0B63}, {0x0B82, 0x0B82},
+  {0x0BC0, 0x0BC0}, {0x0BCD, 0x0BCD}, {0x0C00, 0x0C00}, {0x0C04, 0x0C04},
+  {0x0C3E, 0x0C40}, {0x0C46, 0x0C48}, {0x0C4A, 0x0C4D}, {0x0C55, 0x0C56},
+  {0x0C62, 0x0C63}, {0x0C81, 0x0C81}, {0x0CBC, 0x0CBC}, {0x0CBF, 0x0CBF},
+  {0x0CC6, 0x0CC6}, {0x0CCC, 0x0CCD}, {0x0CE2, 0x0CE3}, {0x0D00, 0x0D01},
+  {0x0D3B, 0x0D3C}, {0x0D41, 0x0D44}, {0x0D4D, 0x0D4D}, {0x0D62, 0x0D63},
+  {0x0D81, 0x0D81}, {0x0DCA, 0x0DCA}, {0x0DD2, 0x0DD4}, {0x0DD6, 0x0DD6},
+  {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x0EB1, 0x0EB1},
+  {0x0EB4, 0x0EBC}, {0x0EC8, 0x0ECD}, {0x0F18, 0x0F19}, {0x0F35, 0x0F35},
+  {0x0F37, 0x0F37}, {0x0F39, 0x0F39}, {0x0F71, 0x0F7E}, {0x0F80, 0x0F84},
+  {0x0F86, 0x0F87}, {0x0F8D, 0x0F97}, {0x0F99, 0x0FBC}, {0x0FC6, 0x0FC6},
+  {0x102D, 0x1030}, {0x1032, 0x1037}, {0x1039, 0x103A}, {0x103D, 0x103E},
+  {0x1058, 0x1059}, {0x105E, 0x1060}, {0x1071, 0x1074}, {0x1082, 0x1082},
+  {0x1085, 0x1086}, {0x108D, 0x108D}, {0x109D, 0x109D}, {0x135D, 0x135F},
+  {0x1712, 0x1714}, {0x1732, 0x1734}, {0x1752, 0x1753}, {0x1772, 0x1773},
+  {0x17B4, 0x17B5}, {0x17B7, 0x17BD}, {0x17C6, 0x17C6}, {0x17C9, 0x17D3},
+  {0x17DD, 0x17DD}, {0x180B, 0x180D}, {0x180F, 0x180F}, {0x1885, 0x1886},
+  {0x18A9, 0x18A9}, {0x1920, 0x1922}, {0x1927, 0x1928}, {0x1932, 0x1932},
+  {0x1939, 0x193B}, {0x1A17, 0x1A18}, {0x1A1B, 0x1A1B}, {0x1A56, 0x1A56},
+  {0x1A58, 0x1A5E}, {0x1A60, 0x1A60}, {0x1A62, 0x1A62}, {0x1A65, 0x1A6C},
+  {0x1A73, 0x1A7C}, {0x1A7F, 0x1A7F}, {0x1AB0, 0x1ABE}, {0x1ABF, 0x1ACE},
+  {0x1B00, 0x1B03}, {0x1B34, 0x1B34}, {0x1B36, 0x1B3A}, {0x1B3C, 0x1B3C},
+  {0x1B42, 0x1B42}, {0x1B6B, 0x1B73}, {0x1B80, 0x1B81}, {0x1BA2, 0x1BA5},
+  {0x1BA8, 0x1BA9}, {0x1BAB, 0x1BAD}, {0x1BE6, 0x1BE6}, {0x1BE8, 0x1BE9},
+  {0x1BED, 0x1BED}, {0x1BEF, 0x1BF1}, {0x1C2C, 0x1C33}, {0x1C36, 0x1C37},
+  {0x1CD0, 0x1CD2}, {0x1CD4, 0x1CE0}, {0x1CE2, 0x1CE8}, {0x1CED, 0x1CED},
+  {0x1CF4, 0x1CF4}, {0x1CF8, 0x1CF9}, {0x1DC0, 0x1DF9}, {0x1DFB, 0x1DFF},
+  {0x200B, 0x200F}, {0x202A, 0x202E}, {0x2060, 0x2064}, {0x2066, 0x206F},
+  {0x20D0, 0x20DC}, {0x20DD, 0x20E0}, {0x20E1, 0x20E1}, {0x20E2, 0x20E4},
+  {0x20E5, 0x20F0}, {0x2CEF, 0x2CF1}, {0x2D7F, 0x2D7F}, {0x2DE0, 0x2DFF},
+  {0x302A, 0x302D}, {0x302E, 0x302F}, {0x3099, 0x309A}, {0xA66F, 0xA66F},
+  {0xA674, 0xA67D}, {0xA69E, 0xA69F}, {0xA6F0, 0xA6F1}, {0xA802, 0xA802},
+  {0xA806, 0xA806}, {0xA80B, 0xA80B}, {0xA825, 0xA826}, {0xA82C, 0xA82C},
+  {0xA8C4, 0xA8C5}, {0xA8E0, 0xA8F1}, {0xA8FF, 0xA8FF}, {0xA926, 0xA92D},
+  {0xA947, 0xA951}, {0xA980, 0xA982}, {0xA9B3, 0xA9B3}, {0xA9B6, 0xA9B9},
+  {0xA9BC, 0xA9BD}, {0xA9E5, 0xA9E5}, {0xAA29, 0xAA2E}, {0xAA31, 0xAA32},
+  {0xAA35, 0xAA36}, {0xAA43, 0xAA43}, {0xAA4C, 0xAA4C}, {0xAA7C, 0xAA7C},
+  {0xAAB0, 0xAAB0}, {0xAAB2, 0xAAB4}, {0xAAB7, 0xAAB8}, {0xAABE, 0xAABF},
+  {0xAAC1, 0xAAC1}, {0xAAEC, 0xAAED}, {0xAAF6, 0xAAF6}, {0xABE5, 0xABE5},
+  {0xABE8, 0xABE8}, {0xABED, 0xABED}, {0xFB1E, 0xFB1E}, {0xFE00, 0xFE0F},
+  {0xFE20, 0xFE2F}, {0x101FD, 0x101FD}, {0x102E0, 0x102E0},
+  {0x10376, 0x1037A}, {0x10A01, 0x10A03}, {0x10A05, 0x10A06},
+  {0x10A0C, 0x10A0F}, {0x10A38, 0x10A3A}, {0x10A3F, 0x10A3F},
+  {0x10AE5, 0x10AE6}, {0x10D24, 0x10D27}, {0x10EAB, 0x10EAC},
+  {0x10EFD, 0x10EFF}, {0x10F46, 0x10F50}, {0x10F82, 0x10F85},
+  {0x11001, 0x11001}, {0x11038, 0x11046}, {0x1107F, 0x11081},
+  {0x110B3, 0x110B6}, {0x110B9, 0x110BA}, {0x11100, 0x11102},
+  {0x11127, 0x1112B}, {0x1112D, 0x11134}, {0x11173, 0x11173},
+  {0x11180, 0x11181}, {0x111B6, 0x111BE}, {0x111C9, 0x111CC},
+  {0x111CF, 0x111CF}, {0x1122F, 0x11231}, {0x11234, 0x11234},
+  {0x11236, 0x11237}, {0x1123E, 0x1123E}, {0x112DF, 0x112DF},
+  {0x112E3, 0x112EA}, {0x11300, 0x11301}, {0x1133B, 0x1133C},
+  {0x11340, 0x11340}, {0x11366, 0x1136C}, {0x11370, 0x11374},
+  {0x11438, 0x1143F}, {0x11442, 0x11444}, {0x11446, 0x11446},
+  {0x1145E, 0x1145E}, {0x114B3, 0x114B8}, {0x114BA, 0x114BA},
+  {0x114BF, 0x114C0}, {0x114C2, 0x114C3}, {0x115B2, 0x115B5},
+  {0x115BC, 0x115BD}, {0x115BF, 0x115C0}, {0x115DC, 0x115DD},
+  {0x11633, 0x1163A}, {0x1163D, 0x1163D}, {0x1163F, 0x11640},
+  {0x116AB, 0x116AB}, {0x116AD, 0x116AD}, {0x116B0, 0x116B5},
+  {0x116B7, 0x116B7}, {0x1171D, 0x1171F}, {0x11722, 0x11725},
+  {0x11727, 0x1172B}, {0x1182F, 0x11837}, {0x11839, 0x1183A},
+  {0x1193B, 0x1193C}, {0x1193E, 0x1193E}, {0x11943, 0x11943},
+  {0x119D4, 0x119D7}, {0x119DA, 0x119DB}, {0x119E0, 0x119E0},
+  {0x11A01, 0x11A0A}, {0x11A33, 0x11A38}, {0x11A3B, 0x11A3E},
+  {0x11A47, 0x11A47}, {0x11A51, 0x11A56}, {0x11A59, 0x11A5B},
+  {0x11A8A, 0x11A96}, {0x11A98, 0x11A99}, {0x11C30, 0x11C36},
+  {0x11C38, 0x11C3D}, {0x11C3F, 0x11C3F}, {0x11C92, 0x11CA7},
+  {0x11CAA, 0x11CB0}, {0x11CB2, 0x11CB3}, {0x11CB5, 0x11CB6},
+  {0x11D31, 0x11D36}, {0x11D3A, 0x11D3A}, {0x11D3C, 0x11D3D},
+  {0x11D3F, 0x11D45}, {0x11D47, 0x11D47}, {0x11D90, 0x11D91},
+  {0x11D95, 0x11D95}, {0x11D97, 0x11D97}, {0x11EF3, 0x11EF4},
+  {0x13430, 0x13438}, {0x16AF0, 0x16AF4}, {0x16B30, 0x16B36},
+  {0x16F4F, 0x16F4F}, {0x16F8F, 0x16F92}, {0x16FE4, 0x16FE4},
+  {0x16FF0, 0x16FF1}, {0x1BC9D, 0x1BC9E}, {0x1BCA0, 0x1BCA3},
+  {0x1D167, 0x1D169}, {0x1D173, 0x1D182}, {0x1D185, 0x1D18B},
+  {0x1D1AA, 0x1D1AD}, {0x1D242, 0x1D244}, {0x1DA00, 0x1DA36},
+  {0x1DA3B, 0x1DA6C}, {0x1DA75, 0x1DA75}, {0x1DA84, 0x1DA84},
+  {0x1DA9B, 0x1DA9F}, {0x1DAA1, 0x1DAAF}, {0x1E000, 0x1E006},
+  {0x1E008, 0x1E018}, {0x1E01B, 0x1E021}, {0x1E023, 0x1E024},
+  {0x1E026, 0x1E02A}, {0x1E08F, 0x1E08F}, {0x1E130, 0x1E136},
+  {0x1E2AE, 0x1E2AE}, {0x1E2EC, 0x1E2EF}, {0x1E4EC, 0x1E4EF},
+  {0x1E8D0, 0x1E8D6}, {0x1E944, 0x1E94A}, {0xE0100, 0xE01EF}
+};
+
+// East Asian wide / fullwidth ranges (including the common emoji blocks).
+static constexpr CodepointRange kWideRanges[] = {
+  {0x1100, 0x115F}, {0x2329, 0x232A}, {0x2E80, 0x303E}, {0x3040, 0xA4CF},
+  {0xAC00, 0xD7A3}, {0xF900, 0xFAFF}, {0xFE10, 0xFE19}, {0xFE30, 0xFE6F},
+  {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x1F300, 0x1F64F}, {0x1F680, 0x1F6FF},
+  {0x1F900, 0x1FAFF}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD}
+};
+
+// Two-level width table generated at compile time: the first level maps each
+// 256-codepoint block to a second-level block of packed 2-bit widths. Blocks
+// with a single uniform width share one of three canonical entries, so only
+// the blocks that actually mix widths are stored.
+static constexpr char32_t kWidthTableLimit = 0x40000;
+static constexpr size_t kWidthBlockShift = 8;
+static constexpr size_t kWidthBlockSize = size_t{1} << kWidthBlockShift;
+static constexpr size_t kWidthBlockCount = kWidthTableLimit >> kWidthBlockShift;
+static constexpr size_t kWidthPackedBytes = kWidthBlockSize / 4;
+
+struct WidthBlock {
+  uint8_t widths[kWidthBlockSize];
+};
+
+// Index of the first range whose last codepoint is >= cp (ranges are sorted).
+template<size_t N>
+static constexpr size_t firstRangeReaching(const CodepointRange (&ranges)[N], char32_t cp){
+  size_t lo = 0;
+  size_t hi = N;
+  while(lo < hi){
+    size_t mid = (lo + hi) / 2;
+    if(ranges[mid].last < cp) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// Returns the uniform width of a block, or -1 when it mixes widths. Only
+// blocks touched by more than one range or a partial range are inspected.
+static constexpr int classifyWidthBlock(size_t block){
+  const char32_t base = static_cast<char32_t>(block << kWidthBlockShift);
+  const char32_t top = base + static_cast<char32_t>(kWidthBlockSize - 1);
+  if(base <= 0x9F) return -1;
+  size_t wide = firstRangeReaching(kWideRanges, base);
+  size_t comb = firstRangeReaching(kCombiningRanges, base);
+  bool wideHit = wide < std::size(kWideRanges) && kWideRanges[wide].first <= top;
+  bool combHit = comb < std::size(kCombiningRanges) && kCombiningRanges[comb].first <= top;
+  if(!wideHit && !combHit) return 1;
+  auto covers = [&](const CodepointRange& range){ return range.first <= base && range.last >= top; };
+  if(combHit && covers(kCombiningRanges[comb])) return 0;
+  if(wideHit && !combHit && covers(kWideRanges[wide])) return 2;
+  return -1;
+}
+
+static constexpr WidthBlock computeWidthBlock(size_t block){
+  WidthBlock out{};
+  const char32_t base = static_cast<char32_t>(block << kWidthBlockShift);
+  const char32_t top = base + static_cast<char32_t>(kWidthBlockSize - 1);
+  for(size_t i = 0; i < kWidthBlockSize; ++i) out.widths[i] = 1;
+  auto apply = [&](const CodepointRange& range, uint8_t width){
+    if(range.last < base || range.first > top) return;
+    char32_t lo = range.first < base ? base : range.first;
+    char32_t hi = range.last > top ? top : range.last;
+    for(char32_t cp = lo; cp <= hi; ++cp) out.widths[cp - base] = width;
   };
-  for(const auto& range : ranges){
-    if(cp < range.first) break;
-    if(isInRange(cp, range)) return true;
+  for(size_t i = firstRangeReaching(kWideRanges, base); i < std::size(kWideRanges) && kWideRanges[i].first <= top; ++i){
+    apply(kWideRanges[i], 2);
   }
-  return false;
+  for(size_t i = firstRangeReaching(kCombiningRanges, base); i < std::size(kCombiningRanges) && kCombiningRanges[i].first <= top; ++i){
+    apply(kCombiningRanges[i], 0);
+  }
+  apply(CodepointRange{0x00, 0x1F}, 0);
+  apply(CodepointRange{0x7F, 0x9F}, 0);
+  return out;
+}
+
+static constexpr size_t countMixedWidthBlocks(){
+  size_t count = 0;
+  for(size_t block = 0; block < kWidthBlockCount; ++block){
+    if(classifyWidthBlock(block) < 0) ++count;
+  }
+  return count;
+}
+
+static constexpr size_t kMixedWidthBlocks = countMixedWidthBlocks();
+
+struct WidthTable {
+  uint16_t stage1[kWidthBlockCount];
+  uint8_t stage2[3 + kMixedWidthBlocks][kWidthPackedBytes];
+};
+
+static constexpr WidthTable buildWidthTable(){
+  WidthTable table{};
+  for(size_t uniform = 0; uniform < 3; ++uniform){
+    uint8_t packed = static_cast<uint8_t>(uniform | (uniform << 2) | (uniform << 4) | (uniform << 6));
+    for(size_t i = 0; i < kWidthPackedBytes; ++i) table.stage2[uniform][i] = packed;
+  }
+  size_t next = 3;
+  for(size_t block = 0; block < kWidthBlockCount; ++block){
+    int uniform = classifyWidthBlock(block);
+    if(uniform >= 0){
+      table.stage1[block] = static_cast<uint16_t>(uniform);
+      continue;
+    }
+    WidthBlock widths = computeWidthBlock(block);
+    for(size_t i = 0; i < kWidthBlockSize; ++i){
+      table.stage2[next][i / 4] = static_cast<uint8_t>(table.stage2[next][i / 4] | (widths.widths[i] << ((i % 4) * 2)));
+    }
+    table.stage1[block] = static_cast<uint16_t>(next);
+    ++next;
+  }
+  return table;
 }
 
+static constexpr WidthTable kWidthTable = buildWidthTable();
+
 static int codepointWidth(char32_t cp){
-  if(cp == 0) return 0;
-  if(cp < 0x20 || (cp >= 0x7F && cp < 0xA0)) return 0;
-  if(isCombining(cp)) return 0;
-  if(cp >= 0x1100 &&
-     (cp <= 0x115F ||
-      cp == 0x2329 || cp == 0x232A ||
-      (cp >= 0x2E80 && cp <= 0xA4CF && cp != 0x303F) ||
-      (cp >= 0xAC00 && cp <= 0xD7A3) ||
-      (cp >= 0xF900 && cp <= 0xFAFF) ||
-      (cp >= 0xFE10 && cp <= 0xFE19) ||
-      (cp >= 0xFE30 && cp <= 0xFE6F) ||
-      (cp >= 0xFF00 && cp <= 0xFF60) ||
-      (cp >= 0xFFE0 && cp <= 0xFFE6) ||
-      (cp >= 0x1F300 && cp <= 0x1F64F) ||
-      (cp >= 0x1F680 && cp <= 0x1F6FF) ||
-      (cp >= 0x1F900 && cp <= 0x1FAFF) ||
-      (cp >= 0x20000 && cp <= 0x2FFFD) ||
-      (cp >= 0x30000 && cp <= 0x3FFFD)))
-    return 2;
+  if(cp < kWidthTableLimit){
+    uint8_t packed = kWidthTable.stage2[kWidthTable.stage1[cp >> kWidthBlockShift]][(cp & (kWidthBlockSize - 1)) / 4];
+    return (packed >> ((cp % 4) * 2)) & 0x3;
+  }
+  // Above the table only a handful of variation-selector planes carry combining marks.
+  for(const auto& range : kCombiningRanges){
+    if(cp >= range.first && cp <= range.last) return 0;
+  }
   return 1;
 }
 
-static int displayWidth(const std::string& text){
-  static std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> conv;
-  std::u32string codepoints;
-  try {
-    codepoints = conv.from_bytes(text);
-  } catch (const std::range_error&) {
-    return static_cast<int>(text.size());
+// Length of the run of bytes starting at `from` that are all below 0x80 (or,
+// with printableOnly, all in 0x20..0x7E). Scans eight bytes per step.
+static size_t asciiSpanLength(std::string_view text, size_t from, bool printableOnly){
+  constexpr uint64_t ones = 0x0101010101010101ULL;
+  constexpr uint64_t highs = 0x8080808080808080ULL;
+  size_t i = from;
+  const size_t n = text.size();
+  while(i + 8 <= n){
+    uint64_t word;
+    std::memcpy(&word, text.data() + i, sizeof(word));
+    uint64_t stop = word & highs;
+    if(printableOnly){
+      uint64_t del = word ^ (ones * 0x7F);
+      stop |= ((word - ones * 0x20) & ~word & highs) | ((del - ones) & ~del & highs);
+    }
+    if(stop) break;
+    i += 8;
+  }
+  while(i < n){
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    if(c >= 0x80 || (printableOnly && (c < 0x20 || c == 0x7F))) break;
+    ++i;
+  }
+  return i - from;
+}
+
+enum class Utf8DecodeStatus { Ok, Invalid, Truncated };
+
+// Decodes one UTF-8 sequence with the same acceptance rules as the old
+// codecvt_utf8 path: overlong forms and values above U+10FFFF are invalid,
+// and a well-formed but incomplete sequence at the end is reported separately.
+static Utf8DecodeStatus utf8DecodeStatus(std::string_view text, size_t at, char32_t& cp, size_t& len){
+  unsigned char lead = static_cast<unsigned char>(text[at]);
+  if(lead < 0x80){ cp = lead; len = 1; return Utf8DecodeStatus::Ok; }
+  char32_t min = 0;
+  if(lead >= 0xC2 && lead <= 0xDF){ len = 2; cp = lead & 0x1F; min = 0x80; }
+  else if((lead & 0xF0) == 0xE0){ len = 3; cp = lead & 0x0F; min = 0x800; }
+  else if(lead >= 0xF0 && lead <= 0xF4){ len = 4; cp = lead & 0x07; min = 0x10000; }
+  else return Utf8DecodeStatus::Invalid;
+  size_t available = std::min(len, text.size() - at);
+  for(size_t k = 1; k < available; ++k){
+    unsigned char c = static_cast<unsigned char>(text[at + k]);
+    if((c & 0xC0) != 0x80) return Utf8DecodeStatus::Invalid;
+    cp = (cp << 6) | (c & 0x3F);
   }
+  if(available < len) return Utf8DecodeStatus::Truncated;
+  if(cp < min || cp > 0x10FFFF) return Utf8DecodeStatus::Invalid;
+  return Utf8DecodeStatus::Ok;
+}
+
+static bool utf8Decode(std::string_view text, size_t at, char32_t& cp, size_t& len){
+  return utf8DecodeStatus(text, at, cp, len) == Utf8DecodeStatus::Ok;
+}
+
+static int displayWidth(std::string_view text){
   int width = 0;
-  for(char32_t cp : codepoints){
+  size_t i = 0;
+  while(i < text.size()){
+    size_t run = asciiSpanLength(text, i, true);
+    width += static_cast<int>(run);
+    i += run;
+    if(i >= text.size()) break;
+    char32_t cp = 0;
+    size_t len = 1;
+    Utf8DecodeStatus status = utf8DecodeStatus(text, i, cp, len);
+    if(status == Utf8DecodeStatus::Truncated) break;
+    if(status == Utf8DecodeStatus::Invalid) return static_cast<int>(text.size());
     width += codepointWidth(cp);
+    i += len;
   }
   return width;
 }
 
 struct Utf8Glyph {
-  std::string bytes;
+  std::string_view bytes;
   int width = 1;
 };
 
-static std::vector<Utf8Glyph> utf8Glyphs(const std::string& text){
+// Walks a UTF-8 string one glyph at a time. Glyph bytes are views into the
+// source text, so the caller must keep it alive while using them.
+class Utf8GlyphCursor {
+public:
+  explicit Utf8GlyphCursor(std::string_view text) : text_(text) {}
+
+  bool next(Utf8Glyph& glyph){
+    if(pos_ >= text_.size()) return false;
+    if(asciiLeft_ == 0) asciiLeft_ = asciiSpanLength(text_, pos_, false);
+    if(asciiLeft_ > 0){
+      --asciiLeft_;
+      glyph.bytes = text_.substr(pos_, 1);
+      glyph.width = 1;
+      ++pos_;
+      return true;
+    }
+    size_t len = utf8CharLength(static_cast<unsigned char>(text_[pos_]));
+    if(pos_ + len > text_.size()) len = 1;
+    char32_t cp = 0;
+    size_t decoded = 0;
+    int width = (utf8Decode(text_, pos_, cp, decoded) && decoded == len)
+                  ? codepointWidth(cp) : static_cast<int>(len);
+    glyph.bytes = text_.substr(pos_, len);
+    glyph.width = width > 0 ? width : 1;
+    pos_ += len;
+    return true;
+  }
+
+  size_t offset() const { return pos_; }
+
+private:
+  std::string_view text_;
+  size_t pos_ = 0;
+  size_t asciiLeft_ = 0;
+};
+
+static std::vector<Utf8Glyph> utf8Glyphs(std::string_view text){
   std::vector<Utf8Glyph> glyphs;
   glyphs.reserve(text.size());
+  Utf8GlyphCursor cursor(text);
+  Utf8Glyph glyph;
+  while(cursor.next(glyph)) glyphs.push_back(glyph);
+  return glyphs;
+}
+
+static size_t utf8GlyphCount(std::string_view text){
+  size_t count = 0;
   size_t i = 0;
   while(i < text.size()){
-    unsigned char lead = static_cast<unsigned char>(text[i]);
-    size_t len = utf8CharLength(lead);
+    size_t run = asciiSpanLength(text, i, false);
+    count += run;
+    i += run;
+    if(i >= text.size()) break;
+    size_t len = utf8CharLength(static_cast<unsigned char>(text[i]));
     if(i + len > text.size()) len = 1;
-    std::string bytes = text.substr(i, len);
-    int width = displayWidth(bytes);
-    if(width <= 0) width = 1;
-    glyphs.push_back(Utf8Glyph{bytes, width});
     i += len;
+    ++count;
   }
-  return glyphs;
+  return count;
 }
 
+// ===== Input line =====
+// 输入行模型：字节存放在间隙缓冲区里，间隙跟随光标，光标处的插入和退格只移动
+// 间隙两端。按空白切分的词元区间与按块汇总的字形数/显示宽度随编辑增量更新：
+// 只重扫受影响的词元和块，其余区间整体平移。取光标所在词、行宽、按宽度定位裁剪
+// 点都不必解码整行；连续文本只在需要时（每帧至多一次）重建。
+class InputLine {
+public:
+  struct TokenSpan {
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  size_t size() const { return data_.size() - gapLength(); }
+  bool empty() const { return size() == 0; }
+  size_t cursor() const { return cursor_; }
+
+  const std::string& text() const {
+    if(!textValid_){
+      text_.assign(data_, 0, gapBegin_);
+      text_.append(data_, gapEnd_, std::string::npos);
+      textValid_ = true;
+    }
+    return text_;
+  }
+
+  void setCursor(size_t pos){ cursor_ = std::min(pos, size()); }
+
+  // 按 UTF-8 首字节前后移动一个字符，不需要连续文本
+  size_t prevCharIndex(size_t pos) const {
+    size_t i = std::min(pos, size());
+    while(i > 0){
+      --i;
+      if((static_cast<unsigned char>(byteAt(i)) & 0xC0) != 0x80) return i;
+    }
+    return 0;
+  }
+
+  size_t nextCharIndex(size_t pos) const {
+    size_t total = size();
+    if(pos >= total) return total;
+    size_t advance = utf8CharLength(static_cast<unsigned char>(byteAt(pos)));
+    if(pos + advance > total) advance = 1;
+    return pos + advance;
+  }
+
+  // 在光标处插入，光标移到插入内容之后
+  void insert(std::string_view bytes){
+    if(bytes.empty()) return;
+    size_t at = cursor_;
+    moveGap(at);
+    reserveGap(bytes.size());
+    std::memcpy(&data_[gapBegin_], bytes.data(), bytes.size());
+    gapBegin_ += bytes.size();
+    cursor_ = at + bytes.size();
+    edited(at, at, at + bytes.size());
+  }
+
+  // 删除 [begin, 光标)，光标移到 begin
+  void eraseBeforeCursor(size_t begin){
+    size_t end = cursor_;
+    if(begin >= end) return;
+    moveGap(end);
+    gapBegin_ = begin;
+    cursor_ = begin;
+    edited(begin, end, begin);
+  }
+
+  void assign(const std::string& value, size_t cursorPos){
+    data_ = value;
+    gapBegin_ = gapEnd_ = data_.size();
+    cursor_ = std::min(cursorPos, value.size());
+    tokens_.clear();
+    chunks_.clear();
+    textValid_ = false;
+    if(!value.empty()){
+      retokenize(0, 0, value.size());
+      chunks_.push_back(Chunk{value.size(), 0, 0});
+      remeasureChunk(0, 0);
+    }
+  }
+
+  void clear(){ assign(std::string(), 0); }
+
+  const std::vector<TokenSpan>& tokens() const { return tokens_; }
+
+  // 与 splitTokens(text().substr(0, pos)) 相同
+  std::vector<std::string> tokensBefore(size_t pos) const {
+    std::vector<std::string> out;
+    const std::string& full = text();
+    for(const auto& span : tokens_){
+      if(span.begin >= pos) break;
+      out.emplace_back(full, span.begin, std::min(span.end, pos) - span.begin);
+    }
+    return out;
+  }
+
+  // 光标所在的词（两侧连续的非空白字节）及其前后文本，词边界取自已维护的词元区间
+  CursorWordInfo wordAt(size_t pos) const {
+    const std::string& full = text();
+    pos = std::min(pos, full.size());
+    CursorWordInfo info;
+    info.wordStart = info.wordEnd = pos;
+    auto it = std::lower_bound(tokens_.begin(), tokens_.end(), pos,
+                               [](const TokenSpan& span, size_t value){ return span.end < value; });
+    if(it != tokens_.end() && it->begin <= pos){
+      info.wordStart = it->begin;
+      info.wordEnd = it->end;
+    }
+    info.beforeWord = full.substr(0, info.wordStart);
+    info.wordBeforeCursor = full.substr(info.wordStart, pos - info.wordStart);
+    info.wordAfterCursor = full.substr(pos, info.wordEnd - pos);
+    info.afterWord = full.substr(info.wordEnd);
+    return info;
+  }
+
+  // [0, pos) 的显示宽度（每个字形至少占一列，与省略窗口的算法一致）
+  int widthBefore(size_t pos) const {
+    size_t start = 0;
+    int width = 0;
+    for(const auto& chunk : chunks_){
+      if(pos >= start + chunk.bytes){
+        width += chunk.width;
+        start += chunk.bytes;
+        continue;
+      }
+      if(pos > start) width += measure(start, start + chunk.bytes, pos).width;
+      break;
+    }
+    return width;
+  }
+
+  int widthBetween(size_t begin, size_t end) const {
+    if(end <= begin) return 0;
+    return widthBefore(end) - widthBefore(begin);
+  }
+
+  // 满足 widthBefore(q) <= target 的最大字形边界 q
+  size_t boundaryAtOrBeforeWidth(int target) const {
+    if(target <= 0) return 0;
+    size_t start = 0;
+    int width = 0;
+    for(const auto& chunk : chunks_){
+      if(width + chunk.width <= target){
+        width += chunk.width;
+        start += chunk.bytes;
+        continue;
+      }
+      std::string scratch;
+      std::string_view view = contiguous(start, start + chunk.bytes, scratch);
+      Utf8GlyphCursor glyphs(view);
+      Utf8Glyph glyph;
+      size_t offset = 0;
+      while(glyphs.next(glyph)){
+        if(width + glyph.width > target) break;
+        width += glyph.width;
+        offset = glyphs.offset();
+      }
+      return start + offset;
+    }
+    return size();
+  }
+
+  // 满足 widthBefore(q) >= target 的最小字形边界 q（不存在时为行尾）
+  size_t boundaryAtOrAfterWidth(int target) const {
+    if(target <= 0) return 0;
+    size_t start = 0;
+    int width = 0;
+    for(const auto& chunk : chunks_){
+      if(width + chunk.width < target){
+        width += chunk.width;
+        start += chunk.bytes;
+        continue;
+      }
+      std::string scratch;
+      std::string_view view = contiguous(start, start + chunk.bytes, scratch);
+      Utf8GlyphCursor glyphs(view);
+      Utf8Glyph glyph;
+      while(width < target && glyphs.next(glyph)) width += glyph.width;
+      return start + glyphs.offset();
+    }
+    return size();
+  }
+
+private:
+  static constexpr size_t kChunkBytes = 256;
+  static constexpr size_t kMinGap = 64;
+
+  struct Chunk {
+    size_t bytes = 0;
+    size_t glyphs = 0;
+    int width = 0;
+  };
+
+  struct Measure {
+    size_t glyphs = 0;
+    int width = 0;
+    bool overrun = false; // 末尾字形的首字节声明的长度越过了块尾而行里还有后续字节
+  };
+
+  size_t gapLength() const { return gapEnd_ - gapBegin_; }
+
+  char byteAt(size_t pos) const {
+    return pos < gapBegin_ ? data_[pos] : data_[pos + gapLength()];
+  }
+
+  std::string_view contiguous(size_t begin, size_t end, std::string& scratch) const {
+    if(end <= gapBegin_) return std::string_view(data_).substr(begin, end - begin);
+    if(begin >= gapBegin_) return std::string_view(data_).substr(begin + gapLength(), end - begin);
+    scratch.assign(data_, begin, gapBegin_ - begin);
+    scratch.append(data_, gapEnd_, end - gapBegin_);
+    return scratch;
+  }
+
+  void moveGap(size_t pos){
+    if(pos < gapBegin_){
+      size_t n = gapBegin_ - pos;
+      std::memmove(&data_[gapEnd_ - n], &data_[pos], n);
+      gapBegin_ -= n;
+      gapEnd_ -= n;
+    }else if(pos > gapBegin_){
+      size_t n = pos - gapBegin_;
+      std::memmove(&data_[gapBegin_], &data_[gapEnd_], n);
+      gapBegin_ += n;
+      gapEnd_ += n;
+    }
+  }
+
+  void reserveGap(size_t needed){
+    if(gapLength() >= needed) return;
+    size_t logical = size();
+    size_t gap = std::max({needed, kMinGap, logical / 2});
+    std::string grown;
+    grown.reserve(logical + gap);
+    grown.append(data_, 0, gapBegin_);
+    grown.append(gap, '\0');
+    grown.append(data_, gapEnd_, std::string::npos);
+    gapEnd_ = gapBegin_ + gap;
+    data_ = std::move(grown);
+  }
+
+  // 把 [begin, end) 当作一个块解码；limit 之后的字形不计入
+  Measure measure(size_t begin, size_t end, size_t limit = std::numeric_limits<size_t>::max()) const {
+    Measure m;
+    std::string scratch;
+    std::string_view view = contiguous(begin, end, scratch);
+    Utf8GlyphCursor glyphs(view);
+    Utf8Glyph glyph;
+    size_t total = size();
+    while(true){
+      size_t at = glyphs.offset();
+      if(begin + at >= limit || !glyphs.next(glyph)) break;
+      ++m.glyphs;
+      m.width += glyph.width;
+      unsigned char lead = static_cast<unsigned char>(view[at]);
+      size_t declared = lead < 0x80 ? 1 : utf8CharLength(lead);
+      if(glyph.bytes.size() < declared && begin + at + declared <= total) m.overrun = true;
+    }
+    return m;
+  }
+
+  void remeasureChunk(size_t index, size_t start){
+    while(true){
+      Chunk& chunk = chunks_[index];
+      Measure m = measure(start, start + chunk.bytes);
+      if(m.overrun && index + 1 < chunks_.size()){
+        chunk.bytes += chunks_[index + 1].bytes;
+        chunks_.erase(chunks_.begin() + static_cast<std::ptrdiff_t>(index + 1));
+        continue;
+      }
+      chunk.glyphs = m.glyphs;
+      chunk.width = m.width;
+      break;
+    }
+    if(chunks_[index].bytes == 0){
+      chunks_.erase(chunks_.begin() + static_cast<std::ptrdiff_t>(index));
+      return;
+    }
+    // 过大的块在字形边界处切开，保持单块解码量有上限
+    while(chunks_[index].bytes > 2 * kChunkBytes){
+      std::string scratch;
+      std::string_view view = contiguous(start, start + chunks_[index].bytes, scratch);
+      Utf8GlyphCursor glyphs(view);
+      Utf8Glyph glyph;
+      Chunk head;
+      while(glyphs.offset() < kChunkBytes && glyphs.next(glyph)){
+        ++head.glyphs;
+        head.width += glyph.width;
+      }
+      head.bytes = glyphs.offset();
+      Chunk tail;
+      tail.bytes = chunks_[index].bytes - head.bytes;
+      tail.glyphs = chunks_[index].glyphs - head.glyphs;
+      tail.width = chunks_[index].width - head.width;
+      chunks_[index] = head;
+      chunks_.insert(chunks_.begin() + static_cast<std::ptrdiff_t>(index + 1), tail);
+      start += head.bytes;
+      ++index;
+    }
+  }
+
+  // 编辑把旧文本的 [begin, oldEnd) 换成了新文本的 [begin, newEnd)
+  void edited(size_t begin, size_t oldEnd, size_t newEnd){
+    textValid_ = false;
+    retokenize(begin, oldEnd, newEnd);
+
+    size_t start = 0;
+    size_t first = 0;
+    while(first + 1 < chunks_.size() && start + chunks_[first].bytes <= begin){
+      start += chunks_[first].bytes;
+      ++first;
+    }
+    if(chunks_.empty()){
+      if(newEnd == begin) return;
+      chunks_.push_back(Chunk{});
+    }
+    // 合并被删除区间覆盖到的后续块
+    size_t chunkEnd = start + chunks_[first].bytes;
+    while(chunkEnd < oldEnd && first + 1 < chunks_.size()){
+      chunkEnd += chunks_[first + 1].bytes;
+      chunks_.erase(chunks_.begin() + static_cast<std::ptrdiff_t>(first + 1));
+    }
+    chunks_[first].bytes = chunkEnd - start - (oldEnd - begin) + (newEnd - begin);
+    remeasureChunk(first, start);
+  }
+
+  void retokenize(size_t begin, size_t oldEnd, size_t newEnd){
+    auto first = std::lower_bound(tokens_.begin(), tokens_.end(), begin,
+                                  [](const TokenSpan& span, size_t value){ return span.end < value; });
+    auto last = first;
+    while(last != tokens_.end() && last->begin <= oldEnd) ++last;
+
+    long long delta = static_cast<long long>(newEnd) - static_cast<long long>(oldEnd);
+    size_t scanBegin = begin;
+    size_t scanEnd = newEnd;
+    if(first != last){
+      scanBegin = std::min(scanBegin, first->begin);
+      long long shiftedEnd = static_cast<long long>((last - 1)->end) + delta;
+      if(shiftedEnd > static_cast<long long>(scanEnd)) scanEnd = static_cast<size_t>(shiftedEnd);
+    }
+
+    std::vector<TokenSpan> rescanned;
+    size_t i = scanBegin;
+    while(i < scanEnd){
+      while(i < scanEnd && std::isspace(static_cast<unsigned char>(byteAt(i)))) ++i;
+      if(i >= scanEnd) break;
+      TokenSpan span;
+      span.begin = i;
+      while(i < scanEnd && !std::isspace(static_cast<unsigned char>(byteAt(i)))) ++i;
+      span.end = i;
+      rescanned.push_back(span);
+    }
+
+    for(auto it = last; it != tokens_.end(); ++it){
+      it->begin = static_cast<size_t>(static_cast<long long>(it->begin) + delta);
+      it->end = static_cast<size_t>(static_cast<long long>(it->end) + delta);
+    }
+    size_t at = static_cast<size_t>(first - tokens_.begin());
+    tokens_.erase(first, last);
+    tokens_.insert(tokens_.begin() + static_cast<std::ptrdiff_t>(at), rescanned.begin(), rescanned.end());
+  }
+
+  std::string data_;
+  size_t gapBegin_ = 0;
+  size_t gapEnd_ = 0;
+  size_t cursor_ = 0;
+  std::vector<TokenSpan> tokens_;
+  std::vector<Chunk> chunks_;
+  mutable std::string text_;
+  mutable bool textValid_ = true;
+};
+
 static std::string renderHighlightedLabel(const std::string& label, const std::vector<int>& positions){
   std::string out;
   out.reserve(label.size()*4);
@@ -2264,9 +3339,19 @@ static int promptDisplayWidth(){
   return displayWidth(indicators.plain + plainPromptText());
 }
 
+// 终端宽度在收到 SIGWINCH（或其他平台的轮询超时）前保持缓存，避免每帧一次 ioctl
+static int g_terminal_width_cache = 0;
+
 static int terminalDisplayWidth(){
-  int width = platform::terminal_columns();
-  return width > 0 ? width : 80;
+  if(g_terminal_width_cache <= 0){
+    int width = platform::terminal_columns();
+    g_terminal_width_cache = width > 0 ? width : 80;
+  }
+  return g_terminal_width_cache;
+}
+
+static void terminalWidthInvalidate(){
+  g_terminal_width_cache = 0;
 }
 
 static int defaultEllipsisRightWidth(int statusWidth){
@@ -2390,11 +3475,121 @@ static bool inSubcommandSlot(const ToolSpec& spec, const std::vector<std::string
   return false;
 }
 
+// 这些结果只流向补全会话，会话按完整词重新排名，这里只建立前 K 名的置换即可
 static Candidates finalizeCandidates(const std::string& query, Candidates&& cand){
-  sortCandidatesByMatch(query, cand);
+  rankCandidates(cand, query, false);
   return std::move(cand);
 }
 
+// ===== Usage ranking =====
+// 补全时只查内存里的表，不读文件；执行命令后更新并写回 mycli_usage.tsv。
+// 按词在命令行中的位置记录，内置补全与工具提供的补全共用同一套键（见 usageContextFor）。
+// 表由 g_usage_mutex 保护：后台补全线程算加成时主线程可能正在记录刚执行的命令
+static std::mutex g_usage_mutex;
+static FrecencyTable g_usage_table;
+static std::string g_usage_path;
+static CompletionSourceStamp g_usage_stamp;
+
+void usage_initialize(){
+  std::lock_guard<std::mutex> lock(g_usage_mutex);
+  g_usage_path = config_file_path("mycli_usage.tsv");
+  g_usage_table.clear();
+  g_usage_table.load(g_usage_path);
+  g_usage_stamp = completion_source_stamp(g_usage_path);
+}
+
+// 第 index 个词的上下文：首词为空，第二个词（子命令）为命令名，紧跟选项的词为“命令 选项”，
+// 第三个词为“命令 子命令”。其余位置多是自由输入，不参与统计。
+static std::optional<std::string> usageContextFor(const std::vector<std::string>& toks, size_t index){
+  if(index == 0) return std::string();
+  if(toks.empty()) return std::nullopt;
+  const std::string& prev = toks[index - 1];
+  if(index >= 2 && startsWith(prev, "-")) return toks[0] + " " + prev;
+  if(index == 1) return toks[0];
+  if(index == 2) return toks[0] + " " + toks[1];
+  return std::nullopt;
+}
+
+static void applyUsageBonus(Candidates& cand, const std::string& context){
+  int64_t now = static_cast<int64_t>(std::time(nullptr));
+  // 工具自己给过加成（如 cds 的目录 frecency）时在其基础上累加
+  bool any = cand.usageBonus.size() == cand.labels.size();
+  std::vector<double> bonus = any ? cand.usageBonus : std::vector<double>(cand.labels.size(), 0.0);
+  std::string key = context + '\t';
+  const size_t keyBase = key.size();
+  std::lock_guard<std::mutex> lock(g_usage_mutex);
+  for(size_t i = 0; i < cand.labels.size(); ++i){
+    key.resize(keyBase);
+    key += cand.labels[i];
+    double weight = g_usage_table.score(key, now);
+    if(weight <= 0.0) continue;
+    bonus[i] += frecency_rank_bonus(weight);
+    any = true;
+  }
+  if(any) cand.usageBonus = std::move(bonus);
+}
+
+void usage_record_command(const std::vector<std::string>& toks){
+  if(toks.empty() || g_usage_path.empty()) return;
+  if(!REG.find(toks[0]) && toks[0] != "help") return;
+  std::lock_guard<std::mutex> lock(g_usage_mutex);
+  // 其他会话写过文件时先读回来，免得覆盖掉它们的记录
+  CompletionSourceStamp stamp = completion_source_stamp(g_usage_path);
+  if(stamp != g_usage_stamp) g_usage_table.load(g_usage_path);
+
+  int64_t now = static_cast<int64_t>(std::time(nullptr));
+  for(size_t i = 0; i < toks.size(); ++i){
+    if(i > 0 && startsWith(toks[i], "-")) continue;
+    if(auto context = usageContextFor(toks, i)){
+      g_usage_table.bump(*context + '\t' + toks[i], now);
+    }
+  }
+  g_usage_table.save(g_usage_path, now);
+  g_usage_stamp = completion_source_stamp(g_usage_path);
+}
+
+// ===== Status providers =====
+// 命令执行后最多等这么久让状态段算完，避免提示符先闪一下旧状态；超时则先画旧值，算完再重绘
+static constexpr std::chrono::milliseconds kStatusSettleWait{100};
+
+// 线程分离且对象不析构，理由同 completionWorker
+StatusBoard& status_board(){
+  static StatusBoard* board = new StatusBoard();
+  return *board;
+}
+
+// ===== PATH executables =====
+// 首词补全里系统命令的排名减分：匹配程度相同时内置工具排在前面
+static constexpr double kSystemCommandBias = -1.0;
+
+// 线程分离且对象不析构，理由同 completionWorker
+ExecutableIndex& executable_index(){
+  static ExecutableIndex* index = new ExecutableIndex();
+  return *index;
+}
+
+// 后台索引尚未扫完时只返回已扫描目录里的命令
+Candidates executable_candidates_for_word(const std::string& before, const std::string& word,
+                                          const std::string& insertPrefix){
+  Candidates out;
+  auto snapshot = executable_index().snapshot();
+  MatchPrefilter prefilter(word);
+  for(size_t i = 0; i < snapshot->names.size(); ++i){
+    if((i & 255) == 0 && completion_cancelled()) break;
+    const std::string& name = snapshot->names[i];
+    if(prefilter.rejects(label_char_signature(name))) continue;
+    MatchResult match = compute_match(name, word);
+    if(!match.matched) continue;
+    out.items.push_back(before + insertPrefix + name);
+    out.labels.push_back(name);
+    out.matchPositions.push_back(match.positions);
+    out.annotations.push_back(snapshot->directories[snapshot->directoryOf[i]]);
+    out.exactMatches.push_back(match.exact);
+    out.matchDetails.push_back(match);
+  }
+  return out;
+}
+
 static Candidates firstWordCandidates(const std::string& buf){
   Candidates out; auto sw=splitLastWord(buf);
   if(!sw.before.empty()) return out;
@@ -2415,6 +3610,26 @@ static Candidates firstWordCandidates(const std::string& buf){
     out.exactMatches.push_back(match.exact);
     out.matchDetails.push_back(match);
   }
+
+  // $PATH 里的命令不是内置工具，选中后插入为 run <命令>；与内置工具同名的不再列出。
+  // 空词时不列，免得几千个系统命令淹没内置工具
+  if(!sw.word.empty()){
+    Candidates system = executable_candidates_for_word(sw.before, sw.word, "run ");
+    std::vector<double> bias(out.labels.size(), 0.0);
+    bool anySystem = false;
+    for(size_t i = 0; i < system.labels.size(); ++i){
+      if(std::binary_search(names.begin(), names.end(), system.labels[i])) continue;
+      out.items.push_back(std::move(system.items[i]));
+      out.labels.push_back(std::move(system.labels[i]));
+      out.matchPositions.push_back(std::move(system.matchPositions[i]));
+      out.annotations.push_back("run");
+      out.exactMatches.push_back(system.exactMatches[i]);
+      out.matchDetails.push_back(std::move(system.matchDetails[i]));
+      bias.push_back(kSystemCommandBias);
+      anySystem = true;
+    }
+    if(anySystem) out.usageBonus = std::move(bias);
+  }
   return finalizeCandidates(sw.word, std::move(out));
 }
 
@@ -2446,7 +3661,7 @@ static Candidates candidatesForTool(const ToolSpec& spec, const std::string& buf
 
   if(spec.name == "setting" && sub){
     bool trailingSpace = (!buf.empty() && std::isspace(static_cast<unsigned char>(buf.back())));
-    bool ignoreCase = g_settings.completionIgnoreCase;
+    bool ignoreCase = active_settings().completionIgnoreCase;
     auto equalsIgnoreCase = [&](const std::string& a, const std::string& b){
       if(a.size() != b.size()) return false;
       for(size_t i=0; i<a.size(); ++i){
@@ -2559,20 +3774,15 @@ static Candidates candidatesForTool(const ToolSpec& spec, const std::string& buf
       expectingArgument = true;
     }
     if(expectingArgument){
-      std::set<std::string> seen;
-      for(const auto& info : message_all_files()){
-        std::string label = basenameOf(info.path);
-        if(!seen.insert(label).second) continue;
+      const auto labels = message_all_file_labels();
+      for(const auto& entry : *labels){
+        const std::string& label = entry.label;
         MatchResult match = compute_match(label, sw.word);
         if(!match.matched) continue;
         out.items.push_back(sw.before + label);
         out.labels.push_back(label);
         out.matchPositions.push_back(match.positions);
-        std::string annotation;
-        if(info.isUnread){
-          annotation = info.isNew? "[NEW]" : "[UPDATED]";
-        }
-        out.annotations.push_back(annotation);
+        out.annotations.push_back(entry.annotation);
         out.exactMatches.push_back(match.exact);
         out.matchDetails.push_back(match);
       }
@@ -2662,78 +3872,426 @@ static Candidates candidatesForTool(const ToolSpec& spec, const std::string& buf
   return out;
 }
 
-static void prioritizeExactMatches(Candidates& cand){
-  if(cand.labels.empty()) return;
-  if(cand.exactMatches.size() < cand.labels.size()){
-    cand.exactMatches.resize(cand.labels.size(), false);
-  }
-  bool hasExact = std::any_of(cand.exactMatches.begin(), cand.exactMatches.end(), [](bool v){ return v; });
-  if(!hasExact) return;
-  std::vector<size_t> order(cand.labels.size());
-  std::iota(order.begin(), order.end(), size_t{0});
-  std::stable_partition(order.begin(), order.end(), [&](size_t idx){
-    return cand.exactMatches[idx];
+// 候选数达到该值才分片到线程池并行匹配；小集合留在输入线程上，省去唤醒线程的开销。
+static constexpr size_t kParallelMatchMinCandidates = 16384;
+static constexpr size_t kParallelMatchChunk = 4096;
+
+struct MatchSurvivor {
+  size_t index = 0;
+  uint64_t signature = 0;
+  MatchResult match;
+};
+
+// 按存储顺序返回所有命中的候选。stopOnExact 时一旦遇到完整命中就放弃并置 sawExact。
+// `**/` 补全的标签是实际路径，匹配时去掉词里的 `**/`，只用目录前缀与查询部分
+static std::string completionMatchWord(const std::string& word){
+  size_t marker = word.find("**/");
+  if(marker == std::string::npos) return word;
+  return word.substr(0, marker) + word.substr(marker + 3);
+}
+
+static std::vector<MatchSurvivor> matchCandidateLabels(const Candidates& cand, const std::string& rawWord,
+                                                       bool stopOnExact, bool& sawExact){
+  const std::string word = completionMatchWord(rawWord);
+  sawExact = false;
+  const size_t count = cand.labels.size();
+  const size_t keep = rankedFloorKeepFor(count);
+  MatchPrefilter prefilter(word);
+  // 线程池里的线程没有调用方的取消标志与状态快照，这里先取出来
+  const std::atomic<bool>* cancel = g_completion_cancel;
+  const CompletionStateSnapshot* stateSnapshot = t_completion_snapshot;
+  auto cancelled = [cancel]{ return cancel && cancel->load(std::memory_order_relaxed); };
+
+  if(count < kParallelMatchMinCandidates || WorkStealingPool::shared().concurrency() <= 1){
+    std::vector<MatchSurvivor> out;
+    RankedScoreFloor floor(keep);
+    for(size_t i = 0; i < count; ++i){
+      if((i & 1023) == 0 && cancelled()) return {};
+      uint64_t signature = MatchPrefilter::signatureAt(cand, i);
+      if(prefilter.rejects(signature)) continue;
+      MatchResult match = compute_match(cand.labels[i], word, floor.floor());
+      if(!match.matched) continue;
+      floor.offer(match.score);
+      if(stopOnExact && match.exact){
+        sawExact = true;
+        return {};
+      }
+      out.push_back(MatchSurvivor{i, signature, std::move(match)});
+    }
+    return out;
+  }
+
+  // 每个线程维护自己的前 K 名下限；任一线程的第 K 名都不高于全局第 K 名，
+  // 所以取各线程下限的最大值共享出去仍然安全。
+  WorkStealingPool& pool = WorkStealingPool::shared();
+  const size_t chunks = (count + kParallelMatchChunk - 1) / kParallelMatchChunk;
+  std::vector<std::vector<MatchSurvivor>> perChunk(chunks);
+  std::vector<RankedScoreFloor> floors(pool.concurrency(), RankedScoreFloor(keep));
+  std::atomic<double> sharedFloor{-std::numeric_limits<double>::infinity()};
+  std::atomic<bool> exactSeen{false};
+
+  pool.parallelFor(count, kParallelMatchChunk, [&](size_t worker, size_t begin, size_t end){
+    CompletionSnapshotScope scope(stateSnapshot);
+    RankedScoreFloor& floor = floors[worker];
+    std::vector<MatchSurvivor>& out = perChunk[begin / kParallelMatchChunk];
+    if(cancelled()) return;
+    for(size_t i = begin; i < end; ++i){
+      if(stopOnExact && exactSeen.load(std::memory_order_relaxed)) return;
+      uint64_t signature = MatchPrefilter::signatureAt(cand, i);
+      if(prefilter.rejects(signature)) continue;
+      double limit = std::max(floor.floor(), sharedFloor.load(std::memory_order_relaxed));
+      MatchResult match = compute_match(cand.labels[i], word, limit);
+      if(!match.matched) continue;
+      if(stopOnExact && match.exact){
+        exactSeen.store(true, std::memory_order_relaxed);
+        return;
+      }
+      floor.offer(match.score);
+      double local = floor.floor();
+      double current = sharedFloor.load(std::memory_order_relaxed);
+      while(local > current && !sharedFloor.compare_exchange_weak(current, local, std::memory_order_relaxed)){}
+      out.push_back(MatchSurvivor{i, signature, std::move(match)});
+    }
   });
-  bool changed = false;
-  for(size_t i=0;i<order.size();++i){
-    if(order[i] != i){ changed = true; break; }
-  }
-  if(!changed) return;
-  auto reorderVec = [&](auto& vec){
-    using VecType = std::decay_t<decltype(vec)>;
-    VecType reordered;
-    reordered.reserve(vec.size());
-    for(size_t idx : order){
-      reordered.push_back(vec[idx]);
-    }
-    vec = std::move(reordered);
-  };
-  reorderVec(cand.items);
-  reorderVec(cand.labels);
-  reorderVec(cand.matchPositions);
-  reorderVec(cand.annotations);
-  reorderVec(cand.exactMatches);
-  reorderVec(cand.matchDetails);
+
+  if(exactSeen.load()){
+    sawExact = true;
+    return {};
+  }
+  size_t total = 0;
+  for(const auto& part : perChunk) total += part.size();
+  std::vector<MatchSurvivor> out;
+  out.reserve(total);
+  for(auto& part : perChunk){
+    std::move(part.begin(), part.end(), std::back_inserter(out));
+  }
+  return out;
 }
 
 static Candidates rematchCandidatesForWord(Candidates&& cand, const std::string& word){
   if(word.empty()) return std::move(cand);
 
+  bool sawExact = false;
+  std::vector<MatchSurvivor> survivors = matchCandidateLabels(cand, word, false, sawExact);
+
   Candidates filtered;
-  size_t count = cand.labels.size();
+  size_t count = survivors.size();
   filtered.items.reserve(count);
   filtered.labels.reserve(count);
-  filtered.matchPositions.reserve(count);
   filtered.annotations.reserve(count);
   filtered.exactMatches.reserve(count);
   filtered.matchDetails.reserve(count);
+  filtered.labelSignatures.reserve(count);
+  const bool carryUsage = cand.usageBonus.size() == cand.labels.size();
 
   auto takeString = [](std::vector<std::string>& src, size_t idx)->std::string{
     if(idx < src.size()) return std::move(src[idx]);
     return std::string();
   };
 
-  for(size_t i = 0; i < count; ++i){
-    const std::string& label = cand.labels[i];
-    MatchResult match = compute_match(label, word);
-    if(!match.matched) continue;
-
+  for(MatchSurvivor& hit : survivors){
+    size_t i = hit.index;
+    filtered.labelSignatures.push_back(hit.signature);
     filtered.items.push_back(takeString(cand.items, i));
     filtered.labels.push_back(std::move(cand.labels[i]));
-    filtered.matchPositions.push_back(match.positions);
     filtered.annotations.push_back(takeString(cand.annotations, i));
-    filtered.exactMatches.push_back(match.exact);
-    filtered.matchDetails.push_back(match);
+    filtered.exactMatches.push_back(hit.match.exact);
+    filtered.matchDetails.push_back(std::move(hit.match));
+    if(carryUsage) filtered.usageBonus.push_back(cand.usageBonus[i]);
   }
-
-  sortCandidatesByMatch(word, filtered);
   return filtered;
 }
 
-static Candidates computeCandidates(const std::string& buf, size_t cursor){
+// ===== Workspace search =====
+// `**/` 补全与 find 共用的工作区路径索引（见 utils/workspace_index.hpp）。
+// 与历史搜索一样并行扫描、每个线程只留前 K 名，所以 `**/` 的结果不可收窄复用。
+static constexpr size_t kWorkspaceCompletionResults = 256;
+
+static WorkspaceIndex& workspace_index(){
+  static WorkspaceIndex* index = new WorkspaceIndex();
+  return *index;
+}
+
+static uint64_t fnv1a64(std::string_view text, uint64_t hash = 1469598103934665603ULL){
+  for(unsigned char c : text){
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// 从 dir 向上找含 .git 的目录作为项目根；找不到就用 dir 本身。
+// 根目录与家目录不作项目根（家目录里的 .git 多半是 dotfiles 仓库，整棵树太大），此时返回空路径
+static std::filesystem::path workspace_root_for(const std::filesystem::path& dir){
+  std::error_code ec;
+  std::filesystem::path home;
+  if(const char* env = ::getenv("HOME"); env && *env) home = std::filesystem::weakly_canonical(env, ec);
+  auto tooBroad = [&](const std::filesystem::path& p){
+    return p == p.root_path() || (!home.empty() && p == home);
+  };
+  for(std::filesystem::path p = dir; !tooBroad(p); p = p.parent_path()){
+    if(std::filesystem::exists(p / ".git", ec)) return p;
+    if(!p.has_parent_path() || p.parent_path() == p) break;
+  }
+  return tooBroad(dir) ? std::filesystem::path() : dir;
+}
+
+// 忽略规则与 fs.tree 相同（load_ignore_rules），取自项目根的 .gitignore
+static std::shared_ptr<const WorkspaceSnapshot> workspace_snapshot(const std::filesystem::path& root, bool fresh){
+  auto rules = std::make_shared<std::vector<tool::IgnoreRule>>(tool::load_ignore_rules({root / ".gitignore"}));
+  uint64_t rulesHash = fnv1a64("");
+  for(const auto& rule : *rules){
+    rulesHash = fnv1a64(rule.pattern, rulesHash);
+    rulesHash = fnv1a64(rule.prefix ? "/\n" : "\n", rulesHash);
+  }
+  std::string rootStr = root.string();
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.idx", static_cast<unsigned long long>(fnv1a64(rootStr)));
+  std::string cacheFile = (std::filesystem::path(config_home()) / "workspace_index" / name).string();
+  auto ignore = [rules](const std::string& rel){ return tool::should_ignore(*rules, rel); };
+  return workspace_index().acquire(rootStr, cacheFile, ignore, rulesHash, fresh, g_completion_cancel);
+}
+
+struct WorkspaceHit {
+  size_t index = 0;
+  std::string path;
+  bool isDir = false;
+  MatchResult match;
+};
+
+std::vector<WorkspaceMatch> workspace_search(const std::string& dir, const std::string& query,
+                                             size_t limit, bool wholeProject, bool fresh){
+  std::vector<WorkspaceMatch> out;
+  std::error_code ec;
+  std::filesystem::path base = std::filesystem::weakly_canonical(dir.empty() ? std::string(".") : dir, ec);
+  if(ec || limit == 0 || !std::filesystem::is_directory(base, ec)) return out;
+  std::filesystem::path root = workspace_root_for(base);
+  if(root.empty()) return out;
+  std::string scope = base.lexically_relative(root).generic_string();
+  if(scope == ".") scope.clear();
+  auto snapshot = workspace_snapshot(root, fresh);
+  const std::string prefix = (wholeProject || scope.empty()) ? std::string() : scope + "/";
+
+  const AppSettings& settings = active_settings();
+  const bool byScore = settings.completionSubsequence &&
+                       settings.completionSubsequenceStrategy == SubsequenceStrategy::Ranked;
+  const bool ignoreCase = settings.completionIgnoreCase;
+  const bool subseq = settings.completionSubsequence;
+  // 分数高者在前，同分时路径短的在前
+  auto better = [byScore](const WorkspaceHit& lhs, const WorkspaceHit& rhs){
+    if(byScore && lhs.match.score != rhs.match.score) return lhs.match.score > rhs.match.score;
+    if(lhs.path.size() != rhs.path.size()) return lhs.path.size() < rhs.path.size();
+    return lhs.index < rhs.index;
+  };
+  const std::atomic<bool>* cancel = g_completion_cancel;
+  const CompletionStateSnapshot* stateSnapshot = t_completion_snapshot;
+  auto cancelled = [cancel]{ return cancel && cancel->load(std::memory_order_relaxed); };
+
+  WorkStealingPool& pool = WorkStealingPool::shared();
+  std::vector<std::vector<WorkspaceHit>> heaps(pool.concurrency());
+  auto scan = [&](size_t worker, size_t begin, size_t end){
+    CompletionSnapshotScope scope(stateSnapshot);
+    std::vector<WorkspaceHit>& heap = heaps[worker];
+    std::string scratch;
+    std::string rel;
+    for(size_t block = begin; block < end; ++block){
+      if((block & 31) == 0 && cancelled()) return;
+      snapshot->forEachInBlock(block, scratch, [&](size_t index, std::string_view path, bool isDir, int64_t){
+        if(!prefix.empty() && (path.size() <= prefix.size() || path.compare(0, prefix.size(), prefix) != 0)) return;
+        std::string_view candidate = path.substr(prefix.size());
+        MatchResult match;
+        if(query.empty()){
+          // 空查询按索引顺序取前几条即可
+          if(heap.size() >= limit) return;
+          match.matched = true;
+        }else{
+          if(subseq && !subseq_scan_feasible(candidate, query, ignoreCase)) return;
+          double floor = (byScore && heap.size() >= limit) ? heap.front().match.score
+                                                         : -std::numeric_limits<double>::infinity();
+          rel.assign(candidate.data(), candidate.size());
+          match = compute_match(rel, query, floor);
+          if(!match.matched) return;
+        }
+        WorkspaceHit hit{index, std::string(candidate), isDir, std::move(match)};
+        if(heap.size() < limit){
+          heap.push_back(std::move(hit));
+          std::push_heap(heap.begin(), heap.end(), better);
+        }else if(better(hit, heap.front())){
+          std::pop_heap(heap.begin(), heap.end(), better);
+          heap.back() = std::move(hit);
+          std::push_heap(heap.begin(), heap.end(), better);
+        }
+      });
+    }
+  };
+  const size_t blocks = snapshot->blockCount();
+  const size_t blockChunk = std::max<size_t>(1, kParallelMatchChunk / WorkspaceSnapshot::kBlockSize);
+  if(query.empty() || snapshot->count < kParallelMatchMinCandidates || pool.concurrency() <= 1) scan(0, 0, blocks);
+  else pool.parallelFor(blocks, blockChunk, scan);
+  if(cancelled()) return out;
+
+  std::vector<WorkspaceHit> top;
+  for(auto& heap : heaps) std::move(heap.begin(), heap.end(), std::back_inserter(top));
+  if(query.empty()){
+    std::sort(top.begin(), top.end(), [](const WorkspaceHit& a, const WorkspaceHit& b){ return a.index < b.index; });
+  }else{
+    std::sort(top.begin(), top.end(), better);
+  }
+  if(top.size() > limit) top.resize(limit);
+  out.reserve(top.size());
+  for(WorkspaceHit& hit : top){
+    WorkspaceMatch match;
+    match.isDir = hit.isDir;
+    match.match = std::move(hit.match);
+    // 在整个项目中查找时结果相对于 dir，位于 dir 之外的带 ../
+    if(!wholeProject || scope.empty()){
+      match.path = std::move(hit.path);
+    }else if(hit.path.size() > scope.size() && hit.path.compare(0, scope.size() + 1, scope + "/") == 0){
+      match.path = hit.path.substr(scope.size() + 1);
+    }else{
+      match.path = std::filesystem::path(hit.path).lexically_relative(scope).generic_string();
+    }
+    out.push_back(std::move(match));
+  }
+  return out;
+}
+
+// 形如 [目录/]**/查询 的词：在目录（默认当前目录）下的全部路径中模糊匹配查询部分
+static Candidates workspaceCompletionCandidates(const std::string& before, const std::string& word){
+  Candidates cand;
+  size_t marker = word.find("**/");
+  std::string dirPrefix = word.substr(0, marker);
+  if(!dirPrefix.empty() && dirPrefix.back() != '/') return cand;
+  std::string query = word.substr(marker + 3);
+  for(WorkspaceMatch& hit : workspace_search(dirPrefix, query, kWorkspaceCompletionResults, false, false)){
+    std::string label = dirPrefix + hit.path;
+    if(hit.isDir) label.push_back('/');
+    std::vector<int> positions;
+    positions.reserve(hit.match.positions.size());
+    for(int pos : hit.match.positions) positions.push_back(static_cast<int>(dirPrefix.size()) + pos);
+    cand.items.push_back(before + label);
+    cand.labels.push_back(std::move(label));
+    cand.matchPositions.push_back(std::move(positions));
+    cand.annotations.push_back(hit.isDir ? "[dir]" : "");
+    cand.exactMatches.push_back(hit.match.exact);
+    cand.matchDetails.push_back(std::move(hit.match));
+  }
+  return cand;
+}
+
+// ===== History search =====
+// 在全部去重历史上并行匹配：先用按命令编号缓存的字符签名预筛，再对映射中的原始字节做
+// 子序列可行性扫描，两关都过才构造字符串走 compute_match。每个线程只保留前 K 名，
+// 因此结果不会随历史条数线性膨胀；K 名之外的条目也就不能靠继续过滤得到，
+// 这正是 p 的补全结果不可“收窄”复用的原因（见 computeCandidates）。
+static constexpr size_t kHistorySearchResults = 256;
+static std::vector<uint64_t> g_history_signatures;
+static uint64_t g_history_signature_generation = 0;
+
+struct HistoryHit {
+  size_t rank = 0;
+  MatchResult match;
+};
+
+static void appendHistoryCandidate(Candidates& cand, const HistoryRecord& rec, MatchResult match){
+  std::string annotation = history_age_label(rec.timestamp);
+  if(rec.exitCode && *rec.exitCode != 0) annotation = "exit " + std::to_string(*rec.exitCode) + " · " + annotation;
+  cand.items.push_back(rec.command);
+  cand.labels.push_back(rec.command);
+  cand.matchPositions.push_back(match.positions);
+  cand.annotations.push_back(std::move(annotation));
+  cand.exactMatches.push_back(match.exact);
+  cand.matchDetails.push_back(std::move(match));
+}
+
+Candidates history_search_candidates(const std::string& query){
+  Candidates cand;
+  if(query.empty()){
+    for(const auto& rec : history_recent_commands()){
+      appendHistoryCandidate(cand, rec, compute_match(rec.command, query));
+    }
+    return cand;
+  }
+  const AppSettings& settings = active_settings();
+  if(settings.historyRecentLimit <= 0) return cand;
+
+  const bool byScore = settings.completionSubsequence &&
+                       settings.completionSubsequenceStrategy == SubsequenceStrategy::Ranked;
+  const bool ignoreCase = settings.completionIgnoreCase;
+  const bool subseq = settings.completionSubsequence;
+  // 分数高者在前，同分时越近使用的越靠前
+  auto better = [byScore](const HistoryHit& lhs, const HistoryHit& rhs){
+    if(byScore && lhs.match.score != rhs.match.score) return lhs.match.score > rhs.match.score;
+    return lhs.rank < rhs.rank;
+  };
+  const std::atomic<bool>* cancel = g_completion_cancel;
+  const CompletionStateSnapshot* stateSnapshot = t_completion_snapshot;
+  auto cancelled = [cancel]{ return cancel && cancel->load(std::memory_order_relaxed); };
+
+  g_history_log.withIndex([&](const HistoryLog::Index& index){
+    const size_t count = index.size();
+    if(g_history_signature_generation != index.generation()){
+      g_history_signatures.clear();
+      g_history_signature_generation = index.generation();
+    }
+    for(size_t id = g_history_signatures.size(); id < index.commandCount(); ++id){
+      // 转义后的字节只会多出字符，签名仍是原命令签名的超集，预筛不会误拒
+      g_history_signatures.push_back(label_char_signature(index.rawCommandOf(static_cast<uint32_t>(id))));
+    }
+
+    MatchPrefilter prefilter(query);
+    WorkStealingPool& pool = WorkStealingPool::shared();
+    std::vector<std::vector<HistoryHit>> heaps(pool.concurrency());
+    auto scan = [&](size_t worker, size_t begin, size_t end){
+      CompletionSnapshotScope scope(stateSnapshot);
+      std::vector<HistoryHit>& heap = heaps[worker];
+      std::string scratch;
+      for(size_t rank = begin; rank < end; ++rank){
+        if((rank & 1023) == 0 && cancelled()) return;
+        if(!index.live(rank) || prefilter.rejects(g_history_signatures[index.id(rank)])) continue;
+        std::string_view raw = index.rawCommand(rank);
+        if(index.needsDecode(rank)){
+          scratch = index.command(rank);
+        }else{
+          if(subseq && !subseq_scan_feasible(raw, query, ignoreCase)) continue;
+          scratch.assign(raw.data(), raw.size());
+        }
+        double floor = (byScore && heap.size() >= kHistorySearchResults)
+                         ? heap.front().match.score
+                         : -std::numeric_limits<double>::infinity();
+        MatchResult match = compute_match(scratch, query, floor);
+        if(!match.matched) continue;
+        HistoryHit hit{rank, std::move(match)};
+        if(heap.size() < kHistorySearchResults){
+          heap.push_back(std::move(hit));
+          std::push_heap(heap.begin(), heap.end(), better);
+        }else if(better(hit, heap.front())){
+          std::pop_heap(heap.begin(), heap.end(), better);
+          heap.back() = std::move(hit);
+          std::push_heap(heap.begin(), heap.end(), better);
+        }
+      }
+    };
+    if(count < kParallelMatchMinCandidates || pool.concurrency() <= 1) scan(0, 0, count);
+    else pool.parallelFor(count, kParallelMatchChunk, scan);
+    if(cancelled()) return;
+
+    std::vector<HistoryHit> top;
+    for(auto& heap : heaps) std::move(heap.begin(), heap.end(), std::back_inserter(top));
+    std::sort(top.begin(), top.end(), better);
+    if(top.size() > kHistorySearchResults) top.resize(kHistorySearchResults);
+    for(HistoryHit& hit : top){
+      appendHistoryCandidate(cand, index.record(hit.rank), std::move(hit.match));
+    }
+  });
+  return cand;
+}
+
+static Candidates generateCandidates(const std::string& buf, size_t cursor, bool* narrowable){
   std::string prefix = buf.substr(0, std::min(cursor, buf.size()));
   auto toks=splitTokens(prefix);
   auto sw  = splitLastWord(prefix);
+  if(narrowable) *narrowable = true;
 
   // help 二参补全
   if (!toks.empty() && toks[0] == "help") {
@@ -2757,8 +4315,14 @@ static Candidates computeCandidates(const std::string& buf, size_t cursor){
   }
 
   if(toks.empty()) return firstWordCandidates(prefix);
+  // 参数位置的 `**/` 进入递归模糊查找，先于各工具自己的补全
+  if(!sw.before.empty() && toks[0] != "p" && sw.word.find("**/") != std::string::npos){
+    if(narrowable) *narrowable = false;
+    return workspaceCompletionCandidates(sw.before, sw.word);
+  }
   if(const ToolDefinition* def = REG.find(toks[0])){
     if(def->completion){
+      if(narrowable) *narrowable = false;
       return def->completion(prefix, toks);
     }
     return candidatesForTool(def->ui, prefix);
@@ -2766,8 +4330,373 @@ static Candidates computeCandidates(const std::string& buf, size_t cursor){
   return firstWordCandidates(prefix);
 }
 
-static std::optional<std::string> detectPathErrorMessage(const std::string& prefix, const Candidates& cand){
+// narrowable 为 true 表示结果只是“候选源按当前词过滤”的产物：
+// 当前词继续变长时，可以直接在旧结果上再过滤，而无需重新生成候选源。
+// 结果按当前词所处位置附上使用频率加成，排名时与匹配分数相加。
+static Candidates computeCandidates(const std::string& buf, size_t cursor, bool* narrowable = nullptr){
+  Candidates cand = generateCandidates(buf, cursor, narrowable);
+  if(cand.labels.empty()) return cand;
+  std::string prefix = buf.substr(0, std::min(cursor, buf.size()));
   auto toks = splitTokens(prefix);
+  bool trailingSpace = !prefix.empty() && std::isspace(static_cast<unsigned char>(prefix.back()));
+  size_t index = (toks.empty() || trailingSpace) ? toks.size() : toks.size() - 1;
+  if(!toks.empty() && toks[0] == "p" && index > 0) return cand;
+  if(auto context = usageContextFor(toks, index)) applyUsageBonus(cand, *context);
+  return cand;
+}
+
+// ===== Completion session =====
+// 以“当前词之前的内容 + 当前词的目录部分”为上下文缓存候选结果。
+// 同一上下文中词变长时在上一次的幸存者上继续过滤；退格时直接复用链上的旧结果。
+struct CompletionSnapshot {
+  std::string word;      // 光标前的词
+  std::string fullWord;  // 光标所在的完整词
+  bool narrowable = false;
+  Candidates cand;
+};
+
+// ===== Async completion =====
+// 候选生成（提供者可能读目录、解析 JSON）在后台线程执行。新请求会取消仍在进行的旧请求，
+// 输入线程每帧最多等待 completion.deadline_ms，等不到就先显示临时结果，
+// 结果就绪后通过 event_loop_notify 唤醒主循环重绘。
+// 提供者读取的设置、配置目录与消息列表由后台线程在 g_completion_state_mutex 内
+// 复制一份（见 CompletionStateSnapshot），主线程修改它们前须持有同一把锁；
+// 命令历史、使用统计和各类索引自带锁，不在此列。
+static std::mutex g_completion_state_mutex;
+static constexpr std::chrono::milliseconds kTabCompletionWait{250};
+
+struct CompletionOutcome {
+  uint64_t id = 0;
+  bool narrowable = false;
+  Candidates cand;
+};
+
+class CompletionWorker {
+public:
+  CompletionWorker(){
+    std::thread([this]{ run(); }).detach();
+  }
+
+  // 提交新请求并取消之前的请求，返回请求编号
+  uint64_t submit(const std::string& buf, size_t cursor, const std::string& fullWord){
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelLocked();
+    Request req;
+    req.id = ++lastId_;
+    req.buf = buf;
+    req.cursor = cursor;
+    req.fullWord = fullWord;
+    req.cancel = std::make_shared<std::atomic<bool>>(false);
+    pending_ = std::move(req);
+    wake_.notify_all();
+    return lastId_;
+  }
+
+  void cancel(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelLocked();
+  }
+
+  // 等待编号为 id 的结果直到 deadline；就绪时取走结果
+  std::optional<CompletionOutcome> await(uint64_t id, std::chrono::steady_clock::time_point deadline){
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait_until(lock, deadline, [&]{ return finished_ && finished_->id == id; });
+    if(!finished_ || finished_->id != id) return std::nullopt;
+    std::optional<CompletionOutcome> out = std::move(finished_);
+    finished_.reset();
+    return out;
+  }
+
+private:
+  struct Request {
+    uint64_t id = 0;
+    std::string buf;
+    size_t cursor = 0;
+    std::string fullWord;
+    std::shared_ptr<std::atomic<bool>> cancel;
+  };
+
+  void cancelLocked(){
+    if(running_) running_->store(true, std::memory_order_relaxed);
+    pending_.reset();
+    finished_.reset();
+  }
+
+  void run(){
+    while(true){
+      Request req;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&]{ return pending_.has_value(); });
+        req = std::move(*pending_);
+        pending_.reset();
+        running_ = req.cancel;
+      }
+
+      CompletionOutcome outcome;
+      outcome.id = req.id;
+      g_completion_cancel = req.cancel.get();
+      // 只在复制状态时持锁；提供者可能读目录，期间主线程照常执行命令
+      CompletionStateSnapshot snapshot;
+      {
+        std::lock_guard<std::mutex> state(g_completion_state_mutex);
+        snapshot.settings = g_settings;
+        snapshot.configHome = config_home();
+        snapshot.messageLabels = message_all_file_labels();
+      }
+      {
+        CompletionSnapshotScope scope(&snapshot);
+        if(!completion_cancelled()){
+          outcome.cand = computeCandidates(req.buf, req.cursor, &outcome.narrowable);
+        }
+        if(!completion_cancelled()){
+          outcome.cand = rematchCandidatesForWord(std::move(outcome.cand), req.fullWord);
+          rankCandidates(outcome.cand, completionMatchWord(req.fullWord), true);
+        }
+      }
+      g_completion_cancel = nullptr;
+
+      bool delivered = false;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_.reset();
+        if(!req.cancel->load(std::memory_order_relaxed)){
+          finished_ = std::move(outcome);
+          delivered = true;
+        }
+      }
+      if(delivered){
+        done_.notify_all();
+        event_loop_notify();
+      }
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  std::optional<Request> pending_;
+  std::shared_ptr<std::atomic<bool>> running_;
+  std::optional<CompletionOutcome> finished_;
+  uint64_t lastId_ = 0;
+};
+
+// 线程分离且对象不析构：退出时不必等待可能卡在慢速文件系统上的提供者
+static CompletionWorker& completionWorker(){
+  static CompletionWorker* worker = new CompletionWorker();
+  return *worker;
+}
+
+struct CompletionSession {
+  bool valid = false;
+  std::string context;
+  std::string stem;
+  char shape = 0;
+  bool ignoreCase = false;
+  bool subsequence = false;
+  SubsequenceStrategy strategy = SubsequenceStrategy::Ranked;
+  uint64_t workspaceGeneration = 0;  // 工作区索引在后台建成或更新后，`**/` 的旧结果不再可信
+  std::vector<CompletionSnapshot> chain;
+  // 已提交给后台线程、尚未取回的请求
+  uint64_t pendingId = 0;
+  std::string pendingWord;
+  std::string pendingFullWord;
+  Candidates provisional;  // 等待期间显示的临时结果
+  std::optional<CompletionOutcome> ready;  // 已取回但尚未并入 chain 的结果
+};
+
+static CompletionSession g_completion_session;
+static constexpr size_t kCompletionChainLimit = 64;
+
+static void completion_session_drop_pending(){
+  CompletionSession& session = g_completion_session;
+  if(session.pendingId == 0) return;
+  session.pendingId = 0;
+  session.provisional = Candidates{};
+  session.ready.reset();
+  completionWorker().cancel();
+}
+
+static void completion_session_invalidate(){
+  g_completion_session.valid = false;
+  g_completion_session.chain.clear();
+  completion_session_drop_pending();
+}
+
+static bool completion_session_pending(){
+  return g_completion_session.pendingId != 0 && !g_completion_session.ready;
+}
+
+// 等待当前请求的结果最多 timeout；就绪后由下一次 completionSessionCandidates 并入
+static bool completion_session_wait(std::chrono::milliseconds timeout){
+  CompletionSession& session = g_completion_session;
+  if(session.pendingId == 0 || session.ready) return true;
+  session.ready = completionWorker().await(session.pendingId, std::chrono::steady_clock::now() + timeout);
+  return session.ready.has_value();
+}
+
+static std::string completionWordStem(const std::string& word){
+  size_t p = word.find_last_of("/\\");
+  if(p == std::string::npos) return std::string();
+  return word.substr(0, p + 1);
+}
+
+static char completionWordShape(const std::string& word){
+  if(word.empty()) return 'e';
+  if(word[0] == '-') return '-';
+  if(word[0] == '.') return '.';
+  return 'w';
+}
+
+static Candidates narrowCandidates(const Candidates& prev, const std::string& fullWord, bool& sawExact){
+  Candidates filtered;
+  std::vector<MatchSurvivor> survivors = matchCandidateLabels(prev, fullWord, true, sawExact);
+  if(sawExact) return filtered;
+  size_t count = survivors.size();
+  filtered.items.reserve(count);
+  filtered.labels.reserve(count);
+  filtered.annotations.reserve(count);
+  filtered.exactMatches.reserve(count);
+  filtered.matchDetails.reserve(count);
+  filtered.labelSignatures.reserve(count);
+  const bool carryUsage = prev.usageBonus.size() == prev.labels.size();
+  for(MatchSurvivor& hit : survivors){
+    size_t i = hit.index;
+    filtered.labelSignatures.push_back(hit.signature);
+    filtered.items.push_back(i < prev.items.size() ? prev.items[i] : std::string());
+    filtered.labels.push_back(prev.labels[i]);
+    filtered.annotations.push_back(i < prev.annotations.size() ? prev.annotations[i] : std::string());
+    filtered.exactMatches.push_back(hit.match.exact);
+    filtered.matchDetails.push_back(std::move(hit.match));
+    if(carryUsage) filtered.usageBonus.push_back(prev.usageBonus[i]);
+  }
+  rankCandidates(filtered, completionMatchWord(fullWord), false);
+  return filtered;
+}
+
+// 临时结果只在输入线程上算，只从上一份结果的前这么多名里过滤，不随候选总数增长
+static constexpr size_t kProvisionalCandidateLimit = 256;
+
+static Candidates provisionalCandidates(Candidates& prev, const std::string& fullWord){
+  bool sawExact = false;
+  const size_t n = prev.labels.size();
+  if(n <= kProvisionalCandidateLimit) return narrowCandidates(prev, fullWord, sawExact);
+  ensureCandidatesRanked(prev, kProvisionalCandidateLimit);
+  const bool carryUsage = prev.usageBonus.size() == n;
+  const bool carrySignatures = prev.labelSignatures.size() == n;
+  Candidates head;
+  head.items.reserve(kProvisionalCandidateLimit);
+  head.labels.reserve(kProvisionalCandidateLimit);
+  head.annotations.reserve(kProvisionalCandidateLimit);
+  for(size_t rank = 0; rank < kProvisionalCandidateLimit; ++rank){
+    size_t i = candidateIndexAt(prev, rank);
+    head.items.push_back(i < prev.items.size() ? prev.items[i] : std::string());
+    head.labels.push_back(prev.labels[i]);
+    head.annotations.push_back(i < prev.annotations.size() ? prev.annotations[i] : std::string());
+    if(carryUsage) head.usageBonus.push_back(prev.usageBonus[i]);
+    if(carrySignatures) head.labelSignatures.push_back(prev.labelSignatures[i]);
+  }
+  return narrowCandidates(head, fullWord, sawExact);
+}
+
+static Candidates& completionSessionCandidates(const std::string& buf, size_t cursor,
+                                               const CursorWordInfo& wordInfo){
+  CompletionSession& session = g_completion_session;
+  const std::string& word = wordInfo.wordBeforeCursor;
+  std::string fullWord = wordInfo.wordBeforeCursor + wordInfo.wordAfterCursor;
+  std::string stem = completionWordStem(word);
+  char shape = completionWordShape(word);
+
+  bool sameContext = session.valid &&
+                     session.context == wordInfo.beforeWord &&
+                     session.stem == stem &&
+                     session.shape == shape &&
+                     session.ignoreCase == g_settings.completionIgnoreCase &&
+                     session.subsequence == g_settings.completionSubsequence &&
+                     session.strategy == g_settings.completionSubsequenceStrategy &&
+                     session.workspaceGeneration == workspace_index().generation();
+  if(!sameContext){
+    session.valid = true;
+    session.context = wordInfo.beforeWord;
+    session.stem = stem;
+    session.shape = shape;
+    session.ignoreCase = g_settings.completionIgnoreCase;
+    session.subsequence = g_settings.completionSubsequence;
+    session.strategy = g_settings.completionSubsequenceStrategy;
+    session.workspaceGeneration = workspace_index().generation();
+    session.chain.clear();
+    completion_session_drop_pending();
+  }
+
+  // 退格或改写：丢弃不再是当前词前缀的结果
+  while(!session.chain.empty()){
+    const CompletionSnapshot& top = session.chain.back();
+    if(top.word.size() <= word.size() && word.compare(0, top.word.size(), top.word) == 0) break;
+    session.chain.pop_back();
+  }
+
+  if(!session.chain.empty()){
+    CompletionSnapshot& top = session.chain.back();
+    if(top.word == word && top.fullWord == fullWord){
+      completion_session_drop_pending();
+      return top.cand;
+    }
+    bool canNarrow = top.narrowable &&
+                     top.fullWord == top.word &&
+                     wordInfo.wordAfterCursor.empty() &&
+                     word.size() > top.word.size();
+    if(canNarrow){
+      bool sawExact = false;
+      Candidates narrowed = narrowCandidates(top.cand, fullWord, sawExact);
+      // 完整命中某个候选时，提供者可能切换到新的补全分支（例如已输入完整子命令），
+      // 此时回退到完整计算。
+      if(!sawExact){
+        completion_session_drop_pending();
+        if(session.chain.size() >= kCompletionChainLimit){
+          session.chain.erase(session.chain.begin());
+        }
+        session.chain.push_back(CompletionSnapshot{word, fullWord, true, std::move(narrowed)});
+        return session.chain.back().cand;
+      }
+    }
+  }
+
+  bool samePending = session.pendingId != 0 &&
+                     session.pendingWord == word &&
+                     session.pendingFullWord == fullWord;
+  if(!samePending){
+    session.ready.reset();
+    session.pendingId = completionWorker().submit(buf, cursor, fullWord);
+    session.pendingWord = word;
+    session.pendingFullWord = fullWord;
+    // 临时结果：用同一上下文里最近的结果按当前词过滤，真正的结果到达后替换
+    session.provisional = Candidates{};
+    if(!session.chain.empty()){
+      session.provisional = provisionalCandidates(session.chain.back().cand, fullWord);
+    }
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(g_settings.completionDeadlineMs);
+  std::optional<CompletionOutcome> outcome = std::move(session.ready);
+  session.ready.reset();
+  if(!outcome) outcome = completionWorker().await(session.pendingId, deadline);
+  if(!outcome) return session.provisional;
+  session.pendingId = 0;
+  session.provisional = Candidates{};
+
+  if(!session.chain.empty() && session.chain.back().word == word){
+    session.chain.pop_back();
+  }
+  if(session.chain.size() >= kCompletionChainLimit){
+    session.chain.erase(session.chain.begin());
+  }
+  session.chain.push_back(CompletionSnapshot{word, fullWord, outcome->narrowable, std::move(outcome->cand)});
+  return session.chain.back().cand;
+}
+
+static std::optional<std::string> detectPathErrorMessage(const std::string& prefix,
+                                                         const std::vector<std::string>& toks,
+                                                         const Candidates& cand){
   auto sw   = splitLastWord(prefix);
   if(toks.empty() || sw.word.empty()) return std::nullopt;
   if(!prefix.empty() && std::isspace(static_cast<unsigned char>(prefix.back()))) return std::nullopt;
@@ -2886,8 +4815,8 @@ static std::optional<std::string> detectPathErrorMessage(const std::string& pref
   return std::nullopt;
 }
 
-static std::string contextGhostFor(const std::string& prefix){
-  auto toks=splitTokens(prefix); auto sw=splitLastWord(prefix);
+static std::string contextGhostFor(const std::string& prefix, const std::vector<std::string>& toks){
+  auto sw=splitLastWord(prefix);
   if(toks.empty()) return "";
   if (toks[0] == "help"){
     if(toks.size()==1) return " <command>";
@@ -2909,16 +4838,17 @@ static std::string contextGhostFor(const std::string& prefix){
 }
 
 // ===== Rendering =====
-static void renderPromptLabel(){
-  auto indicator = promptIndicatorsRender();
-  if(!indicator.plain.empty()){
-    std::cout << indicator.colored;
-  }
-  const std::string name = promptNamePlain();
-  const std::string theme = g_settings.promptTheme;
+// 名称渐变只随名称/主题变化，缓存整段转义序列，避免每帧逐字形 snprintf
+static const std::string& promptNameLabel(const std::string& name, const std::string& theme){
+  static std::string cachedName;
+  static std::string cachedTheme;
+  static std::string cachedLabel;
+  static bool cachedValid = false;
+  if(cachedValid && cachedName == name && cachedTheme == theme) return cachedLabel;
+  std::string out;
   if(auto gradient = theme_gradient_colors(theme); gradient.has_value()){
     if(!name.empty()){
-      std::cout << ansi::BOLD;
+      out += ansi::BOLD;
       const auto& colors = *gradient;
       const int startR = colors[0], startG = colors[1], startB = colors[2];
       const int endR = colors[3], endG = colors[4], endB = colors[5];
@@ -2937,15 +4867,212 @@ static void renderPromptLabel(){
         int b = static_cast<int>(startB + (endB - startB) * t + 0.5);
         char buf[32];
         std::snprintf(buf, sizeof(buf), "\x1b[38;2;%d;%d;%dm", r, g, b);
-        std::cout << buf << glyphs[idx].bytes;
+        out += buf;
+        out += glyphs[idx].bytes;
         progress += glyphWidth;
       }
-      std::cout << ansi::RESET;
+      out += ansi::RESET;
     }
-    std::cout << ansi::CYAN << ansi::BOLD << "> " << ansi::RESET;
+    out += ansi::CYAN; out += ansi::BOLD; out += "> "; out += ansi::RESET;
   }else{
-    std::cout << ansi::CYAN << ansi::BOLD << name << "> " << ansi::RESET;
+    out += ansi::CYAN; out += ansi::BOLD; out += name; out += "> "; out += ansi::RESET;
+  }
+  cachedName = name;
+  cachedTheme = theme;
+  cachedLabel = std::move(out);
+  cachedValid = true;
+  return cachedLabel;
+}
+
+// 提示行中指示器所占的字节区间；闪烁只改颜色时据此原地重绘这几个单元格
+struct PromptIndicatorSpan {
+  size_t begin = 0;
+  size_t length = 0;
+  std::string plain;
+};
+
+static void renderPromptLabel(std::string& out, PromptIndicatorSpan* span = nullptr){
+  auto indicator = promptIndicatorsRender();
+  if(span){
+    span->begin = out.size();
+    span->length = indicator.plain.empty() ? 0 : indicator.colored.size();
+    span->plain = indicator.plain;
+  }
+  if(!indicator.plain.empty()){
+    out += indicator.colored;
+  }
+  out += promptNameLabel(promptNamePlain(), g_settings.promptTheme);
+}
+
+// ===== Screen =====
+// 每帧先完整构建为若干行，再与上一帧逐行比较，只重绘变化的行（或行尾），
+// 最后包裹在同步输出序列中一次性写出，避免闪烁和撕裂。
+struct ScreenFrame {
+  std::vector<std::string> rows;
+  int promptRows = 1;
+  int cursorRow = 0;
+  int cursorCol = 1;
+};
+
+// 帧中需要重绘的区域。只有指示器变化时原地改写其单元格；提示符或候选行变化时
+// 重新排版但沿用已算好的补全结果；只有输入行变化才重新计算补全、幽灵提示与路径检查
+struct RenderDirty {
+  static constexpr unsigned Indicators = 1u << 0;
+  static constexpr unsigned Prompt     = 1u << 1;
+  static constexpr unsigned Input      = 1u << 2;
+  static constexpr unsigned Candidates = 1u << 3;
+  static constexpr unsigned All        = Indicators | Prompt | Input | Candidates;
+};
+
+struct ScreenState {
+  ScreenFrame last;
+  bool haveLast = false;
+  bool forceRepaint = false;
+  std::string out;
+};
+
+static ScreenState g_screen;
+
+static int screenVisibleWidth(const std::string& s, size_t end){
+  std::string plain;
+  plain.reserve(end);
+  size_t i = 0;
+  while(i < end){
+    if(s[i] == '\x1b' && i + 1 < end && s[i+1] == '['){
+      i += 2;
+      while(i < end && !(s[i] >= 0x40 && s[i] <= 0x7e)) ++i;
+      if(i < end) ++i;
+      continue;
+    }
+    plain.push_back(s[i]);
+    ++i;
+  }
+  return displayWidth(plain);
+}
+
+// 两行的公共前缀只能在 RESET 之后截断，这样续写时无需恢复之前的样式状态
+static size_t screenStableRowPrefix(const std::string& oldRow, const std::string& newRow){
+  size_t n = 0;
+  size_t limit = std::min(oldRow.size(), newRow.size());
+  while(n < limit && oldRow[n] == newRow[n]) ++n;
+  const std::string reset = ansi::RESET;
+  if(n < reset.size()) return 0;
+  size_t pos = newRow.rfind(reset, n - reset.size());
+  if(pos == std::string::npos) return 0;
+  return pos + reset.size();
+}
+
+static void screenAppendNumber(std::string& out, int value){
+  char buf[16];
+  auto res = std::to_chars(buf, buf + sizeof(buf), value);
+  out.append(buf, res.ptr);
+}
+
+static void screenPresent(const ScreenFrame& frame){
+  ScreenState& st = g_screen;
+  std::string& out = st.out;
+  out.clear();
+  out += "\x1b[?2026h";
+  int current = st.haveLast ? st.last.cursorRow : 0;
+  auto moveToRow = [&](int row){
+    if(row < current){
+      out += ansi::CUU; screenAppendNumber(out, current - row); out += 'A';
+      current = row;
+    }
+    // 向下用换行，帧变高时终端会自动滚动出新行
+    while(current < row){ out += '\n'; ++current; }
+  };
+
+  int newRows = static_cast<int>(frame.rows.size());
+  int oldRows = st.haveLast ? static_cast<int>(st.last.rows.size()) : 0;
+  for(int r = 0; r < newRows; ++r){
+    const std::string& row = frame.rows[static_cast<size_t>(r)];
+    const std::string* previous = (r < oldRows && !st.forceRepaint) ? &st.last.rows[static_cast<size_t>(r)] : nullptr;
+    if(previous && *previous == row) continue;
+    moveToRow(r);
+    size_t keep = previous ? screenStableRowPrefix(*previous, row) : 0;
+    if(keep > 0){
+      out += ansi::CHA; screenAppendNumber(out, screenVisibleWidth(row, keep) + 1); out += 'G';
+    }else{
+      out += '\r';
+    }
+    out.append(row, keep, std::string::npos);
+    const std::string reset = ansi::RESET;
+    if(row.size() < reset.size() || row.compare(row.size() - reset.size(), reset.size(), reset) != 0){
+      out += reset;
+    }
+    out += "\x1b[K";
+  }
+  for(int r = newRows; r < oldRows; ++r){
+    moveToRow(r);
+    out += "\x1b[2K";
+  }
+  moveToRow(frame.cursorRow);
+  out += ansi::CHA; screenAppendNumber(out, frame.cursorCol); out += 'G';
+  out += "\x1b[?2026l";
+
+  std::cout.flush();
+  platform::write_stdout(out.data(), out.size());
+  st.last = frame;
+  st.haveLast = true;
+  st.forceRepaint = false;
+}
+
+// 执行命令前：擦除候选行，把光标停在提示行末尾并换行，之后的输出不再属于当前帧
+static void screenReleaseForOutput(){
+  ScreenState& st = g_screen;
+  if(!st.haveLast){
+    std::cout << "\n";
+    return;
   }
+  ScreenFrame frame = st.last;
+  int keep = std::max(1, std::min(frame.promptRows, static_cast<int>(frame.rows.size())));
+  frame.rows.resize(static_cast<size_t>(keep));
+  frame.cursorRow = keep - 1;
+  frame.cursorCol = screenVisibleWidth(frame.rows.back(), frame.rows.back().size()) + 1;
+  screenPresent(frame);
+  platform::write_stdout("\n", 1);
+  st.haveLast = false;
+  st.last = ScreenFrame{};
+}
+
+static void screenInvalidate(){
+  g_screen.forceRepaint = true;
+}
+
+// 把上一帧第 row 行中 [begin, begin+length) 换成等宽的 replacement，只输出这一段；
+// 上一帧不可用（已交给命令输出或需要整屏重绘）时返回 false
+static bool screenPatchRow(int row, size_t begin, size_t length, const std::string& replacement){
+  ScreenState& st = g_screen;
+  if(!st.haveLast || st.forceRepaint) return false;
+  if(row < 0 || row >= static_cast<int>(st.last.rows.size())) return false;
+  std::string& target = st.last.rows[static_cast<size_t>(row)];
+  if(begin + length > target.size()) return false;
+
+  std::string& out = st.out;
+  out.clear();
+  out += "\x1b[?2026h";
+  int current = st.last.cursorRow;
+  if(row < current){
+    out += ansi::CUU; screenAppendNumber(out, current - row); out += 'A';
+  }else if(row > current){
+    out += "\x1b["; screenAppendNumber(out, row - current); out += 'B';
+  }
+  out += ansi::CHA; screenAppendNumber(out, screenVisibleWidth(target, begin) + 1); out += 'G';
+  out += replacement;
+  out += ansi::RESET;
+  if(row < current){
+    out += "\x1b["; screenAppendNumber(out, current - row); out += 'B';
+  }else if(row > current){
+    out += ansi::CUU; screenAppendNumber(out, row - current); out += 'A';
+  }
+  out += ansi::CHA; screenAppendNumber(out, st.last.cursorCol); out += 'G';
+  out += "\x1b[?2026l";
+
+  std::cout.flush();
+  platform::write_stdout(out.data(), out.size());
+  target.replace(begin, length, replacement);
+  return true;
 }
 
 static void renderInputWithGhost(const std::string& status, int status_len,
@@ -2954,9 +5081,10 @@ static void renderInputWithGhost(const std::string& status, int status_len,
   int leftLimit = ellipsisEnabled ? g_settings.promptInputEllipsisLeftWidth : -1;
   int rightLimit = ellipsisEnabled ? effectiveEllipsisRightWidth(status_len) : -1;
 
+  std::string label;
+  renderPromptLabel(label);
   std::cout << ansi::CLR
-            << ansi::WHITE << status << ansi::RESET;
-  renderPromptLabel();
+            << ansi::WHITE << status << ansi::RESET << label;
 
   std::vector<EllipsisSegment> segments;
   segments.push_back(EllipsisSegment{EllipsisSegmentRole::Buffer, buf, {}});
@@ -2966,7 +5094,7 @@ static void renderInputWithGhost(const std::string& status, int status_len,
 
   EllipsisCursorLocation cursor;
   cursor.segmentIndex = 0;
-  cursor.glyphIndex = utf8Glyphs(buf).size();
+  cursor.glyphIndex = utf8GlyphCount(buf);
 
   auto view = applyWindowEllipsis(segments, cursor, leftLimit, rightLimit);
 
@@ -3038,7 +5166,8 @@ static std::string renderHighlightedLabelWithTailEllipsis(const std::string& lab
   return out;
 }
 
-static void printInlineSuggestionSegment(const EllipsisSegment& seg,
+static void printInlineSuggestionSegment(std::string& out,
+                                         const EllipsisSegment& seg,
                                          const WindowEllipsisResult& view,
                                          size_t segmentIndex){
   if(segmentIndex >= view.segmentGlyphs.size()) return;
@@ -3051,16 +5180,16 @@ static void printInlineSuggestionSegment(const EllipsisSegment& seg,
   int state = 0;
   auto flush = [&](int next){
     if(state == next) return;
-    if(state != 0) std::cout << ansi::RESET;
-    if(next == 1) std::cout << ansi::WHITE;
-    else if(next == 2) std::cout << ansi::GRAY;
+    if(state != 0) out += ansi::RESET;
+    if(next == 1) out += ansi::WHITE;
+    else if(next == 2) out += ansi::GRAY;
     state = next;
   };
   for(int j = 0; j < count && first + static_cast<size_t>(j) < glyphs.size(); ++j){
     size_t gi = first + static_cast<size_t>(j);
     bool isMatch = (gi < matched.size() && matched[gi]);
     flush(isMatch ? 1 : 2);
-    std::cout << glyphs[gi].bytes;
+    out += glyphs[gi].bytes;
   }
   flush(0);
 }
@@ -3146,42 +5275,35 @@ static std::string renderCandidateLineWithTailEllipsis(const std::string& label,
   return out;
 }
 
-static void renderBelowThree(const std::string& status, int status_len,
-                             int cursorCol,
+static void renderBelowThree(ScreenFrame& frame,
                              int indent,
                              const Candidates& cand,
-                             int sel, int &lastShown,
+                             int sel,
                              int tailLimit){
-  (void)status;
   int total = static_cast<int>(cand.labels.size());
   int toShow = std::min(3, std::max(0, total - 1));
   for(int i = 1; i <= toShow; ++i){
-    size_t idx = static_cast<size_t>((sel + i) % total);
+    size_t idx = candidateIndexAt(cand, static_cast<size_t>((sel + i) % total));
     const std::string& label = cand.labels[idx];
-    const std::vector<int>& matches = cand.matchPositions[idx];
+    const std::vector<int>& matches = candidatePositionsAt(cand, idx);
     std::string annotation = (idx < cand.annotations.size()) ? cand.annotations[idx] : "";
-    std::string line = renderCandidateLineWithTailEllipsis(label, matches, annotation, tailLimit);
-    std::cout << "\n" << "\x1b[2K";
-    for(int s = 0; s < indent; ++s) std::cout << ' ';
-    std::cout << line;
+    std::string line(static_cast<size_t>(std::max(0, indent)), ' ');
+    line += renderCandidateLineWithTailEllipsis(label, matches, annotation, tailLimit);
+    frame.rows.push_back(std::move(line));
   }
-  for(int pad = toShow; pad < lastShown; ++pad){ std::cout << "\n" << "\x1b[2K"; }
-  int up = toShow + ((lastShown > toShow) ? (lastShown - toShow) : 0);
-  if(up > 0) std::cout << ansi::CUU << up << "A";
-  std::cout << ansi::CHA << cursorCol << "G" << std::flush;
-  lastShown = toShow;
 }
 
 // ===== Exec & help =====
-static void execToolLine(const std::string& line){
-  auto toks = splitTokens(line); if(toks.empty()) return;
-  const ToolDefinition* def = REG.find(toks[0]); if(!def){ std::cout<<trFmt("unknown_command", {{"name", toks[0]}})<<"\n"; return; }
+// 返回退出码，供历史记录保存
+static int execToolLine(const std::string& line){
+  auto toks = splitTokens(line); if(toks.empty()) return 0;
+  const ToolDefinition* def = REG.find(toks[0]); if(!def){ std::cout<<trFmt("unknown_command", {{"name", toks[0]}})<<"\n"; return 1; }
   if(!tool_accessible_to_user(def->ui, false)){
     std::cout << "command " << toks[0] << " is reserved for the automation agent. "
               << "Enable it with `setting set agent.fs_tools.expose true`.\n";
-    return;
+    return 1;
   }
-  if(!def->executor){ std::cout<<"no handler\n"; return; }
+  if(!def->executor){ std::cout<<"no handler\n"; return 1; }
   ToolExecutionRequest req;
   req.tokens = toks;
   req.silent = false;
@@ -3192,6 +5314,7 @@ static void execToolLine(const std::string& line){
     if(out.back() != '\n') out.push_back('\n');
     std::cout << out << std::flush;
   }
+  return result.exitCode;
 }
 
 ToolExecutionResult invoke_registered_tool(const std::string& line, bool silent){
@@ -3291,12 +5414,68 @@ static void printHelpOne(const std::string& name){
 }
 
 // ===== Main =====
+// ===== Input =====
+// 一次取走所有已就绪的输入字节，整批处理完后只渲染一帧；
+// 转义序列或粘贴内容跨越读取边界时再阻塞读取后续字节。
+class InputQueue {
+public:
+  bool fill(){
+    compact();
+    return platform::read_available(bytes_);
+  }
+  bool pending() const { return pos_ < bytes_.size(); }
+  bool next(char& ch){
+    if(!pending() && !fill()) return false;
+    ch = bytes_[pos_++];
+    return true;
+  }
+
+private:
+  void compact(){
+    if(pos_ == 0) return;
+    bytes_.erase(0, pos_);
+    pos_ = 0;
+  }
+
+  std::string bytes_;
+  size_t pos_ = 0;
+};
+
+// 读取括号粘贴内容直到结束标记 ESC[201~；换行与制表符折叠为空格，其余控制字符丢弃
+static bool readBracketedPaste(InputQueue& input, std::string& out){
+  static const std::string endMarker = "\x1b[201~";
+  std::string raw;
+  char ch;
+  while(input.next(ch)){
+    raw.push_back(ch);
+    if(raw.size() >= endMarker.size() &&
+       raw.compare(raw.size() - endMarker.size(), endMarker.size(), endMarker) == 0){
+      raw.resize(raw.size() - endMarker.size());
+      break;
+    }
+  }
+  out.reserve(out.size() + raw.size());
+  for(size_t i = 0; i < raw.size(); ++i){
+    unsigned char c = static_cast<unsigned char>(raw[i]);
+    if(c == '\r' && i + 1 < raw.size() && raw[i+1] == '\n') continue;
+    if(c == '\r' || c == '\n' || c == '\t'){
+      out.push_back(' ');
+    }else if(c >= 0x20 && c != 0x7f){
+      out.push_back(static_cast<char>(c));
+    }
+  }
+  return true;
+}
+
 int main(){
   std::setlocale(LC_CTYPE, "");
   load_settings(settings_file_path());
   apply_settings_to_runtime();
   message_set_watch_folder(g_settings.messageWatchFolder);
   llm_initialize();
+  history_initialize();
+  usage_initialize();
+  if(const char* pathEnv = ::getenv("PATH")) executable_index().start(pathEnv);
 
   register_prompt_indicator(PromptIndicatorDescriptor{"message", "M"});
   register_prompt_indicator(PromptIndicatorDescriptor{"llm", "L"});
@@ -3308,6 +5487,7 @@ int main(){
   // 1) 注册内置工具与状态
   register_all_tools();
   register_status_providers();
+  status_board().settle(kStatusSettleWait);
 
   // 2) 从当前目录加载动态工具（如 git/pytool）
   const std::string conf = config_file_path("mycli_tools.conf");
@@ -3316,16 +5496,16 @@ int main(){
   // 3) 退出时回车复位
   std::atexit([](){ platform::write_stdout("\r\n", 2); platform::flush_stdout(); });
 #ifdef SIGINT
-  std::signal(SIGINT,  [](int){ platform::write_stdout("\r\n", 2); std::_Exit(128); });
+  std::signal(SIGINT,  [](int){ platform::write_stdout("\x1b[?2004l\r\n", 10); std::_Exit(128); });
 #endif
 #ifdef SIGTERM
-  std::signal(SIGTERM, [](int){ platform::write_stdout("\r\n", 2); std::_Exit(128); });
+  std::signal(SIGTERM, [](int){ platform::write_stdout("\x1b[?2004l\r\n", 10); std::_Exit(128); });
 #endif
 #ifdef SIGHUP
-  std::signal(SIGHUP,  [](int){ platform::write_stdout("\r\n", 2); std::_Exit(128); });
+  std::signal(SIGHUP,  [](int){ platform::write_stdout("\x1b[?2004l\r\n", 10); std::_Exit(128); });
 #endif
 #ifdef SIGQUIT
-  std::signal(SIGQUIT, [](int){ platform::write_stdout("\r\n", 2); std::_Exit(128); });
+  std::signal(SIGQUIT, [](int){ platform::write_stdout("\x1b[?2004l\r\n", 10); std::_Exit(128); });
 #endif
 
   // 4) 原始模式（最小化）
@@ -3337,10 +5517,8 @@ int main(){
     ~RawTerminalRegistration(){ platform::unregister_raw_terminal(term); }
   } rawTerminalRegistration{&term};
 
-  std::string buf;
-  size_t cursorByte = 0;
+  InputLine inputLine;
   int sel = 0;
-  int lastShown = 0;
 
   message_poll();
   llm_poll();
@@ -3348,7 +5526,8 @@ int main(){
   bool lastMessageUnread = message_has_unread();
   bool lastLlmUnread = llm_has_unread();
 
-  Candidates cand;
+  Candidates noCandidates;
+  Candidates* candView = &noCandidates;
   int total = 0;
   bool haveCand = false;
   std::string contextGhost;
@@ -3359,67 +5538,92 @@ int main(){
     plainTabNoCandCount = 0;
   };
 
-  bool needRender = true;
-  int lastPromptLines = 1;
-  int lastCursorRow = 0;
+  unsigned dirty = RenderDirty::All;
+  uint64_t statusTextGeneration = 0;
   int lastTerminalWidth = terminalDisplayWidth();
+  PromptIndicatorSpan indicatorSpan;
+  std::optional<std::string> pathError;
+
+  // 只有指示器变了：文字不变（仅颜色闪烁）就原地改写，否则退回完整排版
+  auto repaintIndicators = [&](){
+    auto indicator = promptIndicatorsRender();
+    if(indicator.plain != indicatorSpan.plain) return false;
+    std::string replacement = indicator.plain.empty() ? std::string() : indicator.colored;
+    if(!screenPatchRow(0, indicatorSpan.begin, indicatorSpan.length, replacement)) return false;
+    indicatorSpan.length = replacement.size();
+    return true;
+  };
 
   auto renderFrame = [&](){
-    std::string status = REG.renderStatusPrefix();
-    int status_len = displayWidth(status);
-
-    if(lastCursorRow > 0){
-      std::cout << ansi::CUU << lastCursorRow << "A";
+    if(dirty == RenderDirty::Indicators && repaintIndicators()){
+      dirty = 0;
+      lastMessageUnread = message_has_unread();
+      lastLlmUnread = llm_has_unread();
+      return;
     }
-    std::cout << ansi::CHA << 1 << "G";
+    bool recompute = (dirty & RenderDirty::Input) != 0;
 
-    int linesToClear = std::max(1, lastPromptLines + lastShown);
-    std::cout << ansi::CLR;
-    for(int i = 1; i < linesToClear; ++i){
-      std::cout << "\n" << "\x1b[2K";
-    }
-    if(linesToClear > 1){
-      std::cout << ansi::CUU << (linesToClear - 1) << "A";
-    }
-    std::cout << ansi::CHA << 1 << "G";
-    lastShown = 0;
+    statusTextGeneration = status_board().textGeneration();
+    std::string status = REG.renderStatusPrefix();
+    int status_len = displayWidth(status);
 
-    size_t cursorIndex = std::min(cursorByte, buf.size());
+    const std::string& buf = inputLine.text();
+    size_t cursorIndex = inputLine.cursor();
     std::string prefix = buf.substr(0, cursorIndex);
-    CursorWordInfo wordInfo = analyzeWordAtCursor(buf, cursorIndex);
+    CursorWordInfo wordInfo = inputLine.wordAt(cursorIndex);
 
-    cand = computeCandidates(buf, cursorIndex);
-    std::string fullWord = wordInfo.wordBeforeCursor + wordInfo.wordAfterCursor;
-    cand = rematchCandidatesForWord(std::move(cand), fullWord);
-    prioritizeExactMatches(cand);
-    total = static_cast<int>(cand.labels.size());
+    if(recompute){
+      candView = &completionSessionCandidates(buf, cursorIndex, wordInfo);
+    }
+    total = static_cast<int>(candView->labels.size());
     haveCand = total > 0;
     if(!haveCand){
       sel = 0;
     }else{
       if(sel < 0) sel = ((sel % total) + total) % total;
       if(sel >= total) sel = sel % total;
+      // 选中项及其后三项（可能回绕到开头）需要已排好名次
+      ensureCandidatesRanked(*candView, static_cast<size_t>(sel) + 4);
     }
+    const Candidates& cand = *candView;
+    size_t selIndex = haveCand ? candidateIndexAt(cand, static_cast<size_t>(sel)) : 0;
     bool showInlineSuggestion = haveCand && sel >= 0 && sel < total;
-    contextGhost = (haveCand && showInlineSuggestion) ? std::string() : contextGhostFor(prefix);
-    auto pathError = detectPathErrorMessage(prefix, cand);
+    if(recompute){
+      std::vector<std::string> prefixTokens = inputLine.tokensBefore(cursorIndex);
+      contextGhost = (haveCand && showInlineSuggestion) ? std::string() : contextGhostFor(prefix, prefixTokens);
+      pathError = detectPathErrorMessage(prefix, prefixTokens, cand);
+    }
 
-    std::string annotation = (sel < cand.annotations.size()) ? cand.annotations[sel] : "";
+    std::string annotation = (haveCand && selIndex < cand.annotations.size()) ? cand.annotations[selIndex] : "";
 
     bool ellipsisEnabled = g_settings.promptInputEllipsisEnabled;
     int leftLimit = ellipsisEnabled ? g_settings.promptInputEllipsisLeftWidth : -1;
     int rightLimit = ellipsisEnabled ? effectiveEllipsisRightWidth(status_len) : -1;
 
-    std::cout << ansi::CLR
-              << ansi::WHITE << status << ansi::RESET;
-    renderPromptLabel();
+    ScreenFrame frame;
+    frame.rows.emplace_back();
+    std::string* line = &frame.rows.back();
+    *line += ansi::WHITE; *line += status; *line += ansi::RESET;
+    renderPromptLabel(*line, &indicatorSpan);
 
     int baseIndent = status_len + promptDisplayWidth();
 
+    // 省略窗口只显示光标附近有限的宽度：光标所在词两侧超出窗口的部分在排版前
+    // 就按宽度裁掉（多留几列，省略号的判定不变），长行的排版开销与行长无关
+    size_t beforeClip = 0;
+    size_t afterClip = buf.size();
+    if(ellipsisEnabled && (leftLimit >= 0 || rightLimit >= 0)){
+      int keep = std::max(leftLimit, rightLimit) + 4;
+      int widthToWord = inputLine.widthBefore(wordInfo.wordStart);
+      if(widthToWord > keep) beforeClip = inputLine.boundaryAtOrBeforeWidth(widthToWord - keep);
+      if(rightLimit >= 0) afterClip = inputLine.boundaryAtOrAfterWidth(inputLine.widthBefore(wordInfo.wordEnd) + keep);
+    }
+
     std::vector<EllipsisSegment> segments;
-    segments.push_back(EllipsisSegment{EllipsisSegmentRole::Buffer, wordInfo.beforeWord, {}});
+    segments.push_back(EllipsisSegment{EllipsisSegmentRole::Buffer,
+                                       buf.substr(beforeClip, wordInfo.wordStart - beforeClip), {}});
     size_t cursorSegmentIndex = 0;
-    size_t wordPrefixGlyphCount = utf8Glyphs(wordInfo.wordBeforeCursor).size();
+    size_t wordPrefixGlyphCount = utf8GlyphCount(wordInfo.wordBeforeCursor);
     size_t cursorGlyphIndex = wordPrefixGlyphCount;
     size_t pathErrorSegmentIndex = std::numeric_limits<size_t>::max();
     std::string wordSuffixVisible;
@@ -3434,8 +5638,8 @@ int main(){
         segments.push_back(EllipsisSegment{EllipsisSegmentRole::PathErrorDetail, "  +" + *pathError, {}});
       }
     }else if(showInlineSuggestion){
-      const std::string& label = cand.labels[sel];
-      const auto& matches = cand.matchPositions[sel];
+      const std::string& label = cand.labels[selIndex];
+      const auto& matches = candidatePositionsAt(cand, selIndex);
       auto labelGlyphs = utf8Glyphs(label);
       size_t suggestionCursorGlyph = std::min(wordPrefixGlyphCount, labelGlyphs.size());
       if(wordPrefixGlyphCount > 0 && !matches.empty()){
@@ -3478,8 +5682,9 @@ int main(){
     if(!wordSuffixVisible.empty()){
       segments.push_back(EllipsisSegment{EllipsisSegmentRole::Buffer, wordSuffixVisible, {}});
     }
-    if(!wordInfo.afterWord.empty()){
-      segments.push_back(EllipsisSegment{EllipsisSegmentRole::Buffer, wordInfo.afterWord, {}});
+    if(afterClip > wordInfo.wordEnd){
+      segments.push_back(EllipsisSegment{EllipsisSegmentRole::Buffer,
+                                         buf.substr(wordInfo.wordEnd, afterClip - wordInfo.wordEnd), {}});
     }
     if(!contextGhost.empty()){
       segments.push_back(EllipsisSegment{EllipsisSegmentRole::Ghost, contextGhost, {}});
@@ -3502,9 +5707,12 @@ int main(){
 
       placeCursorIfNeeded(0, 0);
 
+      const char* color = ansi::WHITE;
       auto newlineWithIndent = [&](){
-        std::cout << "\n" << "\x1b[2K";
-        if(!indent.empty()) std::cout << indent;
+        *line += ansi::RESET;
+        frame.rows.push_back(indent);
+        line = &frame.rows.back();
+        *line += color;
         currentWidth = 0;
         lineCount += 1;
       };
@@ -3512,7 +5720,7 @@ int main(){
       for(size_t segIdx = 0; segIdx < segments.size(); ++segIdx){
         const auto& seg = segments[segIdx];
         auto glyphs = utf8Glyphs(seg.text);
-        const char* color = ansi::WHITE;
+        color = ansi::WHITE;
         switch(seg.role){
           case EllipsisSegmentRole::Buffer:
             color = (pathError && segIdx == pathErrorSegmentIndex) ? ansi::RED : ansi::WHITE;
@@ -3530,21 +5738,20 @@ int main(){
             color = ansi::YELLOW;
             break;
         }
-        std::cout << color;
+        *line += color;
         for(size_t gi = 0; gi < glyphs.size(); ++gi){
           placeCursorIfNeeded(segIdx, gi);
           int w = std::max(1, glyphs[gi].width);
           if(currentWidth + w > maxWidth){
             newlineWithIndent();
           }
-          std::cout << glyphs[gi].bytes;
+          *line += glyphs[gi].bytes;
           currentWidth += w;
         }
         placeCursorIfNeeded(segIdx, glyphs.size());
-        std::cout << ansi::RESET;
+        *line += ansi::RESET;
       }
       placeCursorIfNeeded(segments.size(), 0);
-      std::cout.flush();
       return {lineCount, caretRow, caretCol};
     };
 
@@ -3558,7 +5765,7 @@ int main(){
       int printedLeftDots = 0;
       if(view.leftApplied && view.leftDotWidth > 0){
         printedLeftDots = view.leftDotWidth;
-        std::cout << ansi::GRAY << std::string(static_cast<size_t>(printedLeftDots), '.') << ansi::RESET;
+        *line += ansi::GRAY; line->append(static_cast<size_t>(printedLeftDots), '.'); *line += ansi::RESET;
       }
 
       int widthBeforeAnchor = printedLeftDots;
@@ -3576,21 +5783,21 @@ int main(){
         switch(seg.role){
           case EllipsisSegmentRole::Buffer:{
             bool isErrorWord = pathError && i == pathErrorSegmentIndex;
-            std::cout << (isErrorWord ? ansi::RED : ansi::WHITE) << trimmed << ansi::RESET;
+            *line += (isErrorWord ? ansi::RED : ansi::WHITE); *line += trimmed; *line += ansi::RESET;
             break;
           }
           case EllipsisSegmentRole::InlineSuggestion:{
-            printInlineSuggestionSegment(seg, view, i);
+            printInlineSuggestionSegment(*line, seg, view, i);
             break;
           }
           case EllipsisSegmentRole::Annotation:
-            std::cout << ansi::GREEN << trimmed << ansi::RESET;
+            *line += ansi::GREEN; *line += trimmed; *line += ansi::RESET;
             break;
           case EllipsisSegmentRole::PathErrorDetail:
-            std::cout << ansi::YELLOW << trimmed << ansi::RESET;
+            *line += ansi::YELLOW; *line += trimmed; *line += ansi::RESET;
             break;
           case EllipsisSegmentRole::Ghost:
-            std::cout << ansi::GRAY << trimmed << ansi::RESET;
+            *line += ansi::GRAY; *line += trimmed; *line += ansi::RESET;
             break;
         }
       }
@@ -3598,11 +5805,9 @@ int main(){
       int printedRightDots = 0;
       if(view.rightApplied && view.rightDotWidth > 0){
         printedRightDots = view.rightDotWidth;
-        std::cout << ansi::GRAY << std::string(static_cast<size_t>(printedRightDots), '.') << ansi::RESET;
+        *line += ansi::GRAY; line->append(static_cast<size_t>(printedRightDots), '.'); *line += ansi::RESET;
       }
 
-      std::cout.flush();
-
       int caretWidth = printedLeftDots + view.leftKeptWidth;
       caretCol = baseIndent + caretWidth + 1;
       caretRow = 0;
@@ -3615,7 +5820,7 @@ int main(){
         if(tailLimit < 1) tailLimit = 1;
       }
 
-      renderBelowThree(status, status_len, caretCol, suggestionIndent, cand, sel, lastShown, tailLimit);
+      renderBelowThree(frame, suggestionIndent, cand, sel, tailLimit);
     }else{
       if(ellipsisEnabled){
         auto view = applyWindowEllipsis(segments, EllipsisCursorLocation{cursorSegmentIndex, cursorGlyphIndex},
@@ -3624,7 +5829,7 @@ int main(){
         int printedLeftDots = 0;
         if(view.leftApplied && view.leftDotWidth > 0){
           printedLeftDots = view.leftDotWidth;
-          std::cout << ansi::GRAY << std::string(static_cast<size_t>(printedLeftDots), '.') << ansi::RESET;
+          *line += ansi::GRAY; line->append(static_cast<size_t>(printedLeftDots), '.'); *line += ansi::RESET;
         }
 
         for(size_t i = 0; i < segments.size(); ++i){
@@ -3634,21 +5839,21 @@ int main(){
           switch(seg.role){
             case EllipsisSegmentRole::Buffer:{
               bool isErrorWord = pathError && i == pathErrorSegmentIndex;
-              std::cout << (isErrorWord ? ansi::RED : ansi::WHITE) << trimmed << ansi::RESET;
+              *line += (isErrorWord ? ansi::RED : ansi::WHITE); *line += trimmed; *line += ansi::RESET;
               break;
             }
             case EllipsisSegmentRole::InlineSuggestion:{
-              printInlineSuggestionSegment(seg, view, i);
+              printInlineSuggestionSegment(*line, seg, view, i);
               break;
             }
             case EllipsisSegmentRole::Annotation:
-              std::cout << ansi::GREEN << trimmed << ansi::RESET;
+              *line += ansi::GREEN; *line += trimmed; *line += ansi::RESET;
               break;
             case EllipsisSegmentRole::PathErrorDetail:
-              std::cout << ansi::YELLOW << trimmed << ansi::RESET;
+              *line += ansi::YELLOW; *line += trimmed; *line += ansi::RESET;
               break;
             case EllipsisSegmentRole::Ghost:
-              std::cout << ansi::GRAY << trimmed << ansi::RESET;
+              *line += ansi::GRAY; *line += trimmed; *line += ansi::RESET;
               break;
           }
         }
@@ -3656,11 +5861,9 @@ int main(){
         int printedRightDots = 0;
         if(view.rightApplied && view.rightDotWidth > 0){
           printedRightDots = view.rightDotWidth;
-          std::cout << ansi::GRAY << std::string(static_cast<size_t>(printedRightDots), '.') << ansi::RESET;
+          *line += ansi::GRAY; line->append(static_cast<size_t>(printedRightDots), '.'); *line += ansi::RESET;
         }
 
-        std::cout.flush();
-
         int caretWidth = printedLeftDots + view.leftKeptWidth;
         caretCol = baseIndent + caretWidth + 1;
         caretRow = 0;
@@ -3678,87 +5881,149 @@ int main(){
       }
     }
 
-    if(!haveCand){
-      if(promptLines > 0){
-        int moveUp = promptLines - 1 - caretRow;
-        if(moveUp > 0){
-          std::cout << ansi::CUU << moveUp << "A";
-        }
-        std::cout << ansi::CHA << caretCol << "G" << std::flush;
-      }
-    }
-
-    lastPromptLines = promptLines;
-    lastCursorRow = caretRow;
+    frame.promptRows = promptLines;
+    frame.cursorRow = caretRow;
+    frame.cursorCol = caretCol;
+    screenPresent(frame);
 
-    needRender = false;
+    dirty = 0;
     lastMessageUnread = message_has_unread();
     lastLlmUnread = llm_has_unread();
   };
 
-  while(true){
-    int currentTerminalWidth = terminalDisplayWidth();
-    if(currentTerminalWidth != lastTerminalWidth){
-      lastTerminalWidth = currentTerminalWidth;
-      // Terminal width changes can invalidate previous layouts (wrapping and
-      // ellipsis windows) even when the ellipsis window is not in auto mode.
-      // Always trigger a redraw so the prompt and input realign to the new
-      // available width.
-      needRender = true;
+  EventLoop loop;
+  loop.open();
+  InputQueue input;
+  // 状态段的监视集合由状态线程在重算后更新，变化时以 generation 区分
+  uint64_t statusWatchGeneration = 0;
+  auto syncStatusWatches = [&](){
+    statusWatchGeneration = status_board().watchGeneration();
+    loop.watch(LoopEvents::Status, status_board().watches());
+  };
+  auto syncWatches = [&](){
+    std::vector<LoopWatch> messageWatches;
+    if(!message_watch_folder().empty()){
+      messageWatches.push_back(LoopWatch{message_watch_folder(), std::string()});
     }
+    loop.watch(LoopEvents::Message, messageWatches);
 
-    bool blinkChanged = false;
-    if(agent_indicator_tick_blink()){
-      blinkChanged = true;
+    std::vector<LoopWatch> llmWatches;
+    if(!g_llm_watcher.path.empty()){
+      std::filesystem::path llmPath(g_llm_watcher.path);
+      llmWatches.push_back(LoopWatch{llmPath.parent_path().string(), llmPath.filename().string()});
     }
-    if(todo_indicator_tick_blink()){
-      blinkChanged = true;
+    loop.watch(LoopEvents::Llm, llmWatches);
+
+    std::vector<LoopWatch> todoWatches;
+    for(const auto& dir : tool::Todo::indicatorWatchDirectories()){
+      todoWatches.push_back(LoopWatch{dir.string(), std::string()});
     }
-    if(blinkChanged){
-      needRender = true;
+    loop.watch(LoopEvents::Todo, todoWatches);
+
+    std::vector<LoopWatch> pathWatches;
+    for(const auto& dir : executable_index().directories()){
+      pathWatches.push_back(LoopWatch{dir, std::string()});
     }
-    if(needRender){
+    loop.watch(LoopEvents::Path, pathWatches);
+    syncStatusWatches();
+  };
+  syncWatches();
+
+  unsigned carriedEvents = 0; // 命令执行后提前收取、留到下一轮处理的事件
+  while(true){
+    bool inputQueued = input.pending();
+    if(dirty && !inputQueued){
       renderFrame();
     }
 
-    int rc = platform::wait_for_input(200);
-    if(rc == 0){
+    unsigned events = carriedEvents;
+    carriedEvents = 0;
+    if(!inputQueued && !events){
+      loop.setDeadline(indicator_next_deadline());
+      events = loop.wait();
+    }
+    if(events & LoopEvents::Closed) break;
+
+    if(events & LoopEvents::Resize){
+      terminalWidthInvalidate();
+      int currentTerminalWidth = terminalDisplayWidth();
+      if(currentTerminalWidth != lastTerminalWidth){
+        lastTerminalWidth = currentTerminalWidth;
+        // Terminal width changes can invalidate previous layouts (wrapping and
+        // ellipsis windows) even when the ellipsis window is not in auto mode.
+        // Always trigger a redraw so the prompt and input realign to the new
+        // available width.
+        screenInvalidate();
+        dirty |= RenderDirty::Prompt;
+      }
+    }
+    if(events & LoopEvents::Wake){
+      // 唤醒来自后台指示器更新、状态段或补全结果；只有补全在途时才需要重算输入行
+      dirty |= RenderDirty::Indicators;
+      if(completion_session_pending()) dirty |= RenderDirty::Input;
+      if(status_board().textGeneration() != statusTextGeneration) dirty |= RenderDirty::Prompt;
+      if(status_board().watchGeneration() != statusWatchGeneration) syncStatusWatches();
+    }
+    if(events & LoopEvents::Status) status_board().filesChanged(loop.takeChangedPaths(LoopEvents::Status));
+    if(events & (LoopEvents::Timer | LoopEvents::Wake)){
+      if(agent_indicator_tick_blink()) dirty |= RenderDirty::Indicators;
+      if(todo_indicator_tick_blink()) dirty |= RenderDirty::Indicators;
+      if(todo_indicator_poll()) dirty |= RenderDirty::Indicators;
+    }
+    // 可执行文件索引自带锁，不需要补全状态锁
+    if(events & LoopEvents::Path) executable_index().invalidate(loop.takeChangedPaths(LoopEvents::Path));
+    if(events & (LoopEvents::Message | LoopEvents::Llm | LoopEvents::Todo)){
+      // 消息列表在补全状态快照里；后台线程只在复制快照时持锁，这里等待很短
+      std::lock_guard<std::mutex> stateLock(g_completion_state_mutex);
       bool beforeMsg = lastMessageUnread;
       bool beforeLlm = lastLlmUnread;
-      message_poll();
-      llm_poll();
-      bool todoChanged = todo_indicator_poll();
+      if(events & LoopEvents::Message) message_poll();
+      if(events & LoopEvents::Llm) llm_poll();
+      // 待办详情可能被原地改写，目录修改时间不变，靠 inotify 事件让任务缓存失效
+      if(events & LoopEvents::Todo) tool::Todo::invalidateTaskCache();
+      bool todoChanged = (events & LoopEvents::Todo) && todo_indicator_poll(true);
       bool afterMsg = message_has_unread();
       bool afterLlm = llm_has_unread();
       if(afterMsg != beforeMsg || afterLlm != beforeLlm || todoChanged){
         lastMessageUnread = afterMsg;
         lastLlmUnread = afterLlm;
-        needRender = true;
+        dirty |= RenderDirty::Indicators;
       }
-      continue;
     }
-    if(rc < 0){
-#ifndef _WIN32
-      if(errno == EINTR) continue;
-#endif
-      break;
+    if(!inputQueued){
+      if(!(events & LoopEvents::Input)) continue;
+      if(!input.fill()) break;
     }
+
     char ch;
-    if(!platform::read_char(ch)) break;
+    if(!input.next(ch)) break;
 
     if(ch=='\n' || ch=='\r'){
       reset_plain_tab();
-      std::cout << "\n";
+      // 同一批输入里尚未绘制的编辑先落屏，保证回显的是实际执行的命令
+      if(dirty) renderFrame();
+      screenReleaseForOutput();
+      // 命令会修改快照里的状态：先取消后台补全；它只在复制快照时持锁，不会让回车等待提供者
+      completion_session_invalidate();
+      std::unique_lock<std::mutex> stateLock(g_completion_state_mutex);
+      const std::string buf = inputLine.text();
       std::string trimmedInput = trim_copy(buf);
       if(!trimmedInput.empty()){
-        history_record_command(buf);
         auto tks = splitTokens(buf);
         if(!tks.empty()){
+          // 在执行前记下目录：cd 之类的命令会改变当前目录，历史里应是输入命令时所在的目录
+          std::error_code cwdEc;
+          const std::string commandCwd = std::filesystem::current_path(cwdEc).string();
           if(tks[0]=="help"){
             if(tks.size()==1) printHelpAll();
             else printHelpOne(tks[1]);
+            history_record_command(buf, commandCwd, 0);
+            usage_record_command(tks);
           }else{
-            execToolLine(buf);
+            // 执行完再记录，历史里能带上退出码
+            int exitCode = execToolLine(buf);
+            history_record_command(buf, commandCwd, exitCode);
+            usage_record_command(tks);
             if(!g_parse_error_cmd.empty()){ printHelpOne(g_parse_error_cmd); g_parse_error_cmd.clear(); }
             if(g_should_exit){ std::cout<<ansi::DIM<<"bye"<<ansi::RESET<<"\n"; break; }
           }
@@ -3769,54 +6034,108 @@ int main(){
       todo_indicator_poll(true);
       lastMessageUnread = message_has_unread();
       lastLlmUnread = llm_has_unread();
-      buf.clear(); cursorByte = 0; sel=0; lastShown=0;
-      needRender = true;
+      // 命令可能修改了文件系统或设置，补全缓存不再可信
+      candView = &noCandidates;
+      completion_session_invalidate();
+      // 设置可能改变了被监视的路径；命令运行期间终端也可能被调整过大小
+      syncWatches();
+      stateLock.unlock();
+      // 命令自己造成的文件变化先交给状态段，免得提示符先画出旧状态再跳变
+      carriedEvents |= loop.poll();
+      if(carriedEvents & LoopEvents::Status){
+        status_board().filesChanged(loop.takeChangedPaths(LoopEvents::Status));
+        carriedEvents &= ~LoopEvents::Status;
+      }
+      status_board().commandFinished();
+      status_board().settle(kStatusSettleWait);
+      terminalWidthInvalidate();
+      inputLine.clear(); sel=0;
+      dirty = RenderDirty::All;
+      continue;
+    }
+    if(ch==0x12){
+      // Ctrl-R：把当前输入变成 p 的历史搜索；已在搜索中时选中下一条
+      reset_plain_tab();
+      const auto& tokensNow = inputLine.tokens();
+      bool searching = !tokensNow.empty() &&
+                       inputLine.text().compare(tokensNow[0].begin, tokensNow[0].end - tokensNow[0].begin, "p") == 0;
+      if(searching){
+        if(haveCand && total>0){
+          sel=(sel+1)%total;
+          dirty |= RenderDirty::Candidates;
+        }
+      }else{
+        std::string query = "p " + trim_copy(inputLine.text());
+        inputLine.assign(query, query.size());
+        sel = 0;
+        dirty |= RenderDirty::Input;
+      }
       continue;
     }
     if(ch==0x7f){
       reset_plain_tab();
-      if(cursorByte > 0){
-        size_t prev = utf8PrevIndex(buf, cursorByte);
-        buf.erase(prev, cursorByte - prev);
-        cursorByte = prev;
+      if(inputLine.cursor() > 0){
+        inputLine.eraseBeforeCursor(inputLine.prevCharIndex(inputLine.cursor()));
         sel = 0;
-        needRender = true;
+        dirty |= RenderDirty::Input;
       }
       continue;
     }
     if(ch=='\t'){
-      CursorWordInfo wordCtx = analyzeWordAtCursor(buf, cursorByte);
+      // Tab 是明确的补全请求：后台结果未到时多等一会儿，仍未就绪就忽略这次按键，
+      // 以免被当作“无候选”而触发双 Tab 清空
+      if(completion_session_pending()){
+        if(!completion_session_wait(kTabCompletionWait)) continue;
+        dirty |= RenderDirty::Input;
+        renderFrame();
+      }
+      if(haveCand && sel >= 0 && sel < total) ensureCandidatesRanked(*candView, static_cast<size_t>(sel) + 1);
+      const Candidates& cand = *candView;
+      CursorWordInfo wordCtx = inputLine.wordAt(inputLine.cursor());
       std::string fullWord = wordCtx.wordBeforeCursor + wordCtx.wordAfterCursor;
+      // 条目可以在标签前多带前缀（$PATH 命令显示为命令名，插入为 run <命令>），
+      // 此时插入条目里当前词起的部分，否则插入标签
+      auto acceptedText = [&](size_t i) -> std::string {
+        const std::string& label = cand.labels[i];
+        if(i >= cand.items.size()) return label;
+        const std::string& item = cand.items[i];
+        const std::string& before = wordCtx.beforeWord;
+        if(item.size() > before.size() + label.size() && item.compare(0, before.size(), before) == 0 &&
+           item.compare(item.size() - label.size(), label.size(), label) == 0){
+          return item.substr(before.size());
+        }
+        return label;
+      };
       bool hasEffectiveCand = haveCand && total>0;
       if(hasEffectiveCand){
-        hasEffectiveCand = std::any_of(cand.labels.begin(), cand.labels.end(), [&](const std::string& label){
-          return label != fullWord;
-        });
+        hasEffectiveCand = false;
+        for(size_t i = 0; i < cand.labels.size() && !hasEffectiveCand; ++i){
+          hasEffectiveCand = acceptedText(i) != fullWord;
+        }
       }
 
       if(hasEffectiveCand){
         reset_plain_tab();
-        const std::string& label = cand.labels[sel];
-        auto tokensNow = splitTokens(buf);
-        if(!tokensNow.empty() && tokensNow[0] == "p"){
-          buf = label;
-          cursorByte = label.size();
+        const std::string label = acceptedText(candidateIndexAt(cand, static_cast<size_t>(sel)));
+        const auto& tokensNow = inputLine.tokens();
+        if(!tokensNow.empty() && inputLine.text().compare(tokensNow[0].begin, tokensNow[0].end - tokensNow[0].begin, "p") == 0){
+          inputLine.assign(label, label.size());
         }else{
-          buf = wordCtx.beforeWord + label + wordCtx.afterWord;
-          cursorByte = wordCtx.beforeWord.size() + label.size();
+          inputLine.assign(wordCtx.beforeWord + label + wordCtx.afterWord, wordCtx.beforeWord.size() + label.size());
         }
         sel=0;
-        needRender = true;
+        dirty |= RenderDirty::Input;
       }else{
         plainTabNoCandCount += 1;
         if(plainTabNoCandCount >= 2){
           plainTabNoCandCount = 0;
-          if(!buf.empty()){
-            history_record_command(buf);
-            buf.clear();
-            cursorByte = 0;
+          if(!inputLine.empty()){
+            completion_session_invalidate();
+            std::error_code cwdEc;
+            history_record_command(inputLine.text(), std::filesystem::current_path(cwdEc).string());
+            inputLine.clear();
             sel = 0;
-            needRender = true;
+            dirty |= RenderDirty::Input;
           }
         }
       }
@@ -3825,30 +6144,47 @@ int main(){
     if(ch=='\x1b'){
       reset_plain_tab();
       char seq[2];
-      if(!platform::read_char(seq[0])) continue;
-      if(!platform::read_char(seq[1])) continue;
-      if(seq[0]=='['){
+      if(!input.next(seq[0])) continue;
+      if(!input.next(seq[1])) continue;
+      if(seq[0]=='[' && seq[1]>='0' && seq[1]<='9'){
+        // 带参数的 CSI 序列，读到终止字节为止
+        std::string params(1, seq[1]);
+        char fin = 0;
+        while(input.next(fin)){
+          if(static_cast<unsigned char>(fin) >= 0x40 && static_cast<unsigned char>(fin) <= 0x7e) break;
+          params.push_back(fin);
+        }
+        if(fin=='~' && params=="200"){
+          std::string pasted;
+          readBracketedPaste(input, pasted);
+          if(!pasted.empty()){
+            inputLine.insert(pasted);
+            sel = 0;
+            dirty |= RenderDirty::Input;
+          }
+        }
+      }else if(seq[0]=='['){
         if(seq[1]=='A'){
           if(haveCand && total>0){
             sel=(sel-1+total)%total;
-            needRender = true;
+            dirty |= RenderDirty::Candidates;
           }
         }else if(seq[1]=='B'){
           if(haveCand && total>0){
             sel=(sel+1)%total;
-            needRender = true;
+            dirty |= RenderDirty::Candidates;
           }
         }else if(seq[1]=='D'){
-          size_t prev = utf8PrevIndex(buf, cursorByte);
-          if(prev != cursorByte){
-            cursorByte = prev;
-            needRender = true;
+          size_t prev = inputLine.prevCharIndex(inputLine.cursor());
+          if(prev != inputLine.cursor()){
+            inputLine.setCursor(prev);
+            dirty |= RenderDirty::Input;
           }
         }else if(seq[1]=='C'){
-          size_t next = utf8NextIndex(buf, cursorByte);
-          if(next != cursorByte){
-            cursorByte = next;
-            needRender = true;
+          size_t next = inputLine.nextCharIndex(inputLine.cursor());
+          if(next != inputLine.cursor()){
+            inputLine.setCursor(next);
+            dirty |= RenderDirty::Input;
           }
         }
       }
@@ -3858,35 +6194,35 @@ int main(){
     if(static_cast<unsigned char>(ch) == 0x00 || static_cast<unsigned char>(ch) == 0xE0){
       reset_plain_tab();
       char code;
-      if(!platform::read_char(code)) continue;
+      if(!input.next(code)) continue;
       switch(static_cast<unsigned char>(code)){
         case 72: // Up
           if(haveCand && total>0){
             sel=(sel-1+total)%total;
-            needRender = true;
+            dirty |= RenderDirty::Candidates;
           }
           break;
         case 80: // Down
           if(haveCand && total>0){
             sel=(sel+1)%total;
-            needRender = true;
+            dirty |= RenderDirty::Candidates;
           }
           break;
         case 75: // Left
           {
-            size_t prev = utf8PrevIndex(buf, cursorByte);
-            if(prev != cursorByte){
-              cursorByte = prev;
-              needRender = true;
+            size_t prev = inputLine.prevCharIndex(inputLine.cursor());
+            if(prev != inputLine.cursor()){
+              inputLine.setCursor(prev);
+              dirty |= RenderDirty::Input;
             }
           }
           break;
         case 77: // Right
           {
-            size_t next = utf8NextIndex(buf, cursorByte);
-            if(next != cursorByte){
-              cursorByte = next;
-              needRender = true;
+            size_t next = inputLine.nextCharIndex(inputLine.cursor());
+            if(next != inputLine.cursor()){
+              inputLine.setCursor(next);
+              dirty |= RenderDirty::Input;
             }
           }
           break;
@@ -3898,10 +6234,9 @@ int main(){
 #endif
     if(static_cast<unsigned char>(ch) >= 0x20){
       reset_plain_tab();
-      buf.insert(buf.begin() + static_cast<std::string::difference_type>(cursorByte), ch);
-      cursorByte += 1;
+      inputLine.insert(std::string_view(&ch, 1));
       sel=0;
-      needRender = true;
+      dirty |= RenderDirty::Input;
       continue;
     }
   }
@@ -38,6 +38,7 @@ const std::map<std::string, SettingKeyInfo>& keyInfoMap(){
     {"completion.ignore_case", {SettingValueKind::Boolean, {"false", "true"}}},
     {"completion.subsequence", {SettingValueKind::Boolean, {"false", "true"}}},
     {"completion.subsequence_mode", {SettingValueKind::Enum, {"ranked", "greedy"}}},
+    {"completion.deadline_ms", {SettingValueKind::String, {}}},
     {"language", {SettingValueKind::String, {}}},
     {"ui.path_error_hint", {SettingValueKind::Boolean, {"false", "true"}}},
     {"message.folder", {SettingValueKind::String, {}, true, PathKind::Dir, {}, true}},
@@ -196,6 +197,8 @@ inline std::vector<std::string> settings_value_suggestions_for(const std::string
         out = {"default", "20", "30", "50", "60"};
       }else if(key=="history.recent_limit"){
         out = {"5", "10", "20", "50"};
+      }else if(key=="completion.deadline_ms"){
+        out = {"0", "8", "16", "50"};
       }else if(key=="memory.summary.min_len" || key=="memory.summary.max_len"){
         out = {"50", "80", "100"};
       }
@@ -263,6 +266,12 @@ inline void load_settings(const std::string& path){
       }else if(key=="completion.subsequence_mode"){
         SubsequenceStrategy mode;
         if(parseSubsequenceStrategy(val, mode)) g_settings.completionSubsequenceStrategy = mode;
+      }else if(key=="completion.deadline_ms"){
+        try{
+          int v = std::stoi(val);
+          if(v >= 0) g_settings.completionDeadlineMs = v;
+        }catch(...){
+        }
       }else if(key=="language"){
         if(!val.empty()){ g_settings.language = val; settings_register_language(val); }
       }else if(key=="ui.path_error_hint"){
@@ -319,7 +328,6 @@ inline void load_settings(const std::string& path){
           int v = std::stoi(val);
           if(v < 0) v = 0;
           g_settings.historyRecentLimit = v;
-          history_apply_limit();
         }catch(...){
         }
       }else if(key=="memory.enabled"){
@@ -361,8 +369,6 @@ inline void load_settings(const std::string& path){
       return;
     }
   }
-
-  history_apply_limit();
 }
 
 inline void save_settings(const std::string& path){
@@ -373,6 +379,7 @@ inline void save_settings(const std::string& path){
   out << "completion.ignore_case=" << (g_settings.completionIgnoreCase? "true" : "false") << "\n";
   out << "completion.subsequence=" << (g_settings.completionSubsequence? "true" : "false") << "\n";
   out << "completion.subsequence_mode=" << subsequenceStrategyToString(g_settings.completionSubsequenceStrategy) << "\n";
+  out << "completion.deadline_ms=" << g_settings.completionDeadlineMs << "\n";
   out << "language=" << g_settings.language << "\n";
   out << "ui.path_error_hint=" << (g_settings.showPathErrorHint? "true" : "false") << "\n";
   out << "message.folder=" << g_settings.messageWatchFolder << "\n";
@@ -422,6 +429,9 @@ inline bool settings_get_value(const std::string& key, std::string& value){
   if(key=="completion.subsequence_mode"){
     value = subsequenceStrategyToString(g_settings.completionSubsequenceStrategy); return true;
   }
+  if(key=="completion.deadline_ms"){
+    value = std::to_string(g_settings.completionDeadlineMs); return true;
+  }
   if(key=="language"){
     value = g_settings.language; return true;
   }
@@ -548,6 +558,23 @@ inline bool settings_set_value(const std::string& key, const std::string& value,
     g_settings.completionSubsequenceStrategy = mode;
     return true;
   }
+  if(key=="completion.deadline_ms"){
+    int v = 0;
+    try{
+      size_t idx = 0;
+      v = std::stoi(value, &idx);
+      if(idx != value.size()) throw std::invalid_argument("extra");
+    }catch(...){
+      error = "invalid_value";
+      return false;
+    }
+    if(v < 0){
+      error = "invalid_value";
+      return false;
+    }
+    g_settings.completionDeadlineMs = v;
+    return true;
+  }
   if(key=="language"){
     if(value.empty()){
       error = "invalid_value";
@@ -643,7 +670,6 @@ inline bool settings_set_value(const std::string& key, const std::string& value,
       return false;
     }
     g_settings.historyRecentLimit = v;
-    history_apply_limit();
     return true;
   }
   if(key=="agent.fs_tools.expose"){
@@ -2,6 +2,7 @@
 #include "globals.hpp"
 #include "settings.hpp"
 #include <system_error>
+#include <mutex>
 #include <thread>
 #include <cctype>
 #include <sstream>
@@ -11,6 +12,7 @@
 #include <map>
 #include <set>
 
+#include "utils/dir_listing.hpp"
 #include "tools/tool_common.hpp"
 #include "tools/clear.hpp"
 #include "tools/run.hpp"
@@ -19,6 +21,7 @@
 #include "tools/cd.hpp"
 #include "tools/cds.hpp"
 #include "tools/ls.hpp"
+#include "tools/find.hpp"
 #include "tools/cat.hpp"
 #include "tools/cpf.hpp"
 #include "tools/agent/fs_read.hpp"
@@ -56,6 +59,36 @@ inline std::vector<std::string> render_mycli_ascii_art() {
 
 
 // ===== Path candidates (inline) =====
+// 规范化后的后缀列表（小写、带点、排序去重）与对应的提示文本；按原始列表缓存，
+// 各工具的后缀声明在运行期间不变，不必每次按键都重新规范化。
+struct NormalizedExtensions {
+  std::vector<std::string> list;
+  std::string hint;
+};
+
+inline const NormalizedExtensions& normalized_path_extensions(const std::vector<std::string>& raw){
+  static std::mutex mutex;
+  static std::map<std::vector<std::string>, NormalizedExtensions> cache;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = cache.find(raw);
+  if(it != cache.end()) return it->second;
+  NormalizedExtensions norm;
+  norm.list.reserve(raw.size());
+  for(const auto& rawExt : raw){
+    if(rawExt.empty()) continue;
+    std::string ext = rawExt;
+    if(ext.front() != '.') ext.insert(ext.begin(), '.');
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c){
+      return static_cast<char>(std::tolower(c));
+    });
+    norm.list.push_back(std::move(ext));
+  }
+  std::sort(norm.list.begin(), norm.list.end());
+  norm.list.erase(std::unique(norm.list.begin(), norm.list.end()), norm.list.end());
+  if(!norm.list.empty()) norm.hint = "[" + join(norm.list, "|") + "]";
+  return cache.emplace(raw, std::move(norm)).first->second;
+}
+
 inline Candidates pathCandidatesForWord(const std::string& fullBuf,
                                         const std::string& word,
                                         PathKind kind,
@@ -80,10 +113,8 @@ inline Candidates pathCandidatesForWord(const std::string& fullBuf,
     }
   }
 
-  std::filesystem::path rootPath = dir.empty() ? std::filesystem::path(".") : std::filesystem::path(dir);
-  std::error_code ec;
-  std::filesystem::directory_iterator it(rootPath, ec);
-  if(ec) return out;
+  std::shared_ptr<const DirListing> listing = dir_listing_cache().lookup(dir.empty() ? std::string(".") : dir);
+  if(!listing) return out;
 
   auto sw = splitLastWord(fullBuf);
   auto pickSep = [&](char fallback){
@@ -96,53 +127,36 @@ inline Candidates pathCandidatesForWord(const std::string& fullBuf,
   char preferredSep = pickSep(std::filesystem::path::preferred_separator);
 
   const std::vector<std::string>* extList = (extensions && !extensions->empty()) ? extensions : nullptr;
-  std::vector<std::string> normalizedExts;
-  std::string extensionHint;
-  if(extList){
-    normalizedExts.reserve(extList->size());
-    for(const auto& rawExt : *extList){
-      if(rawExt.empty()) continue;
-      std::string norm = rawExt;
-      if(norm.front() != '.') norm.insert(norm.begin(), '.');
-      std::transform(norm.begin(), norm.end(), norm.begin(), [](unsigned char c){
-        return static_cast<char>(std::tolower(c));
-      });
-      if(!norm.empty()) normalizedExts.push_back(norm);
-    }
-    std::sort(normalizedExts.begin(), normalizedExts.end());
-    normalizedExts.erase(std::unique(normalizedExts.begin(), normalizedExts.end()), normalizedExts.end());
-    if(!normalizedExts.empty()){
-      extensionHint = "[" + join(normalizedExts, "|") + "]";
-    }else{
-      extList = nullptr;
-    }
+  const NormalizedExtensions* exts = extList ? &normalized_path_extensions(*extList) : nullptr;
+  if(exts && exts->list.empty()){
+    exts = nullptr;
+    extList = nullptr;
   }
+  const std::string emptyHint;
+  const std::string& extensionHint = exts ? exts->hint : emptyHint;
 
-  auto matchesExtension = [&](const std::string& candidateName){
-    if(!extList) return true;
-    auto pos = candidateName.find_last_of('.');
+  auto matchesExtension = [&](const std::string& lowerName){
+    if(!exts) return true;
+    auto pos = lowerName.find_last_of('.');
     if(pos == std::string::npos) return false;
-    std::string ext = candidateName.substr(pos);
-    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c){
-      return static_cast<char>(std::tolower(c));
-    });
-    return std::find(normalizedExts.begin(), normalizedExts.end(), ext) != normalizedExts.end();
+    std::string_view ext(lowerName.data() + pos, lowerName.size() - pos);
+    return std::binary_search(exts->list.begin(), exts->list.end(), ext);
   };
 
-  for(const auto& entry : it){
-    std::string name = entry.path().filename().string();
-    if(name == "." || name == "..") continue;
+  size_t visited = 0;
+  for(const DirListingEntry& entry : listing->entries){
+    if((++visited & 1023) == 0 && completion_cancelled()) return out;
+    const std::string& name = entry.name;
+    bool isDir = entry.kind == DirEntryKind::Dir;
+    bool isFile = entry.kind == DirEntryKind::File;
+    if(isDir && !allowDirectories) continue;
+    if(isFile && kind == PathKind::Dir) continue;
+    if(!isDir && !isFile) continue;
 
     MatchResult match = compute_match(name, base);
     if(!base.empty() && !match.matched) continue;
     if(base.empty() && !match.matched) match.matched = true;
 
-    std::error_code statusEc;
-    bool isDir = entry.is_directory(statusEc);
-    if(statusEc){ statusEc.clear(); isDir = false; }
-    bool isFile = entry.is_regular_file(statusEc);
-    if(statusEc){ statusEc.clear(); isFile = false; }
-
     bool include = false;
     bool dirAsHint = false;
     if(isDir){
@@ -157,7 +171,7 @@ inline Candidates pathCandidatesForWord(const std::string& fullBuf,
       }
     }else if(isFile){
       if(kind == PathKind::Dir) continue;
-      if(!matchesExtension(name)) continue;
+      if(!matchesExtension(entry.lowerName)) continue;
       include = true;
     }
     if(!include) continue;
@@ -1154,6 +1168,7 @@ inline void register_all_tools(){
   REG.registerTool(tool::make_cd_tool());
   REG.registerTool(tool::make_cds_tool());
   REG.registerTool(tool::make_ls_tool());
+  REG.registerTool(tool::make_find_tool());
   REG.registerTool(tool::make_fs_read_tool());
   REG.registerTool(tool::make_fs_write_tool());
   REG.registerTool(tool::make_fs_create_tool());
@@ -1184,15 +1199,40 @@ inline void register_all_tools(){
 }
 
 inline StatusProvider make_cwd_status(){
-  return StatusProvider{"cwd", [](){
-    if(g_cwd_mode==CwdMode::Hidden) return std::string();
+  StatusProvider sp;
+  sp.name = "cwd";
+  sp.render = [](){
+    CwdMode mode = g_cwd_mode.load();
+    if(mode==CwdMode::Hidden) return std::string();
     char buf[4096]; if(!getcwd(buf,sizeof(buf))) return std::string();
     std::string full(buf);
-    if(g_cwd_mode==CwdMode::Omit) return std::string("[")+basenameOf(full)+"] ";
+    if(mode==CwdMode::Omit) return std::string("[")+basenameOf(full)+"] ";
     return std::string("[")+full+"] ";
-  }};
+  };
+  // 显示方式由 setting 命令修改，因此每条命令后都要重算
+  sp.refresh.afterCommand = true;
+  return sp;
+}
+
+// 仓库状态：分支、领先/落后与改动标记，直接读取 .git 而不启动 git
+inline StatusProvider make_git_status(){
+  // 线程分离且对象不析构，理由同 completionWorker
+  static GitStatusTracker* tracker = new GitStatusTracker();
+  StatusProvider sp;
+  sp.name = "git";
+  sp.render = [](){
+    char buf[4096]; if(!getcwd(buf,sizeof(buf))) return std::string();
+    return git_status_format(tracker->compute(buf));
+  };
+  sp.refresh.onCd = true;
+  sp.refresh.afterCommand = true;
+  sp.refresh.onFileChange = true;
+  sp.watches = [](){ return tracker->watches(); };
+  sp.changed = [](const std::vector<std::string>& paths){ tracker->pathsChanged(paths); };
+  return sp;
 }
 
 inline void register_status_providers(){
   REG.registerStatusProvider(make_cwd_status());
+  REG.registerStatusProvider(make_git_status());
 }
@@ -9,6 +9,8 @@
 #include "fs_exec.hpp"
 #include "../../utils/agent_state.hpp"
 #include "../../utils/json.hpp"
+#include "../../utils/json_reader.hpp"
+#include "../../utils/jsonl_loader.hpp"
 
 #include <filesystem>
 #include <fstream>
@@ -269,12 +271,6 @@ inline sj::Value build_tool_catalog(){
   return sj::Value(std::move(root));
 }
 
-inline std::string json_line(const sj::Value& value){
-  std::string dumped = sj::dump(value);
-  dumped.push_back('\n');
-  return dumped;
-}
-
 inline std::string now_timestamp(){
   auto now = std::chrono::system_clock::now();
   auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
@@ -283,8 +279,11 @@ inline std::string now_timestamp(){
   return oss.str();
 }
 
+// 每条记录先序列化进复用的缓冲区，再一次写出；守卫提示可能来自其他线程，写入时加锁
 struct TranscriptWriter {
   std::ofstream stream;
+  std::mutex mutex;
+  std::string buffer;
 
   bool open(const std::filesystem::path& path){
     stream.open(path, std::ios::out | std::ios::app);
@@ -292,12 +291,95 @@ struct TranscriptWriter {
   }
 
   void append(const sj::Value& value){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!stream.good()) return;
+    buffer.clear();
+    sj::Writer(buffer).value(value);
+    flushBuffer();
+  }
+
+  // {"ts":…,"event":…,"data":…}，data 直接从 payload 写出，不再拷贝一份
+  void appendEvent(std::string_view ts, std::string_view kind, const sj::Value& payload){
+    std::lock_guard<std::mutex> lock(mutex);
     if(!stream.good()) return;
-    stream << sj::dump(value) << "\n";
+    buffer.clear();
+    sj::Writer writer(buffer);
+    beginEvent(writer, ts, kind).value(payload).endObject();
+    flushBuffer();
+  }
+
+  // payloadJson 为已序列化好的 JSON 文本，原样嵌入
+  void appendRawEvent(std::string_view ts, std::string_view kind, std::string_view payloadJson){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!stream.good()) return;
+    buffer.clear();
+    sj::Writer writer(buffer);
+    beginEvent(writer, ts, kind).raw(payloadJson).endObject();
+    flushBuffer();
+  }
+
+private:
+  static sj::Writer& beginEvent(sj::Writer& writer, std::string_view ts, std::string_view kind){
+    return writer.beginObject().key("ts").string(ts).key("event").string(kind).key("data");
+  }
+
+  void flushBuffer(){
+    buffer.push_back('\n');
+    stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
     stream.flush();
   }
 };
 
+// 助手进程发来的一条消息中主循环用到的字段
+struct AgentMessage {
+  struct Artifact {
+    std::string name;
+    std::string content;
+    bool hasName = false;
+    bool hasContent = false;
+  };
+  std::string type;
+  std::string id;
+  std::string name;
+  sj::Value args;
+  std::string answer;
+  std::vector<Artifact> artifacts;
+};
+
+// 拉取式读取一条消息，只为 args 建树；JSON 不合法时抛出异常
+inline AgentMessage read_agent_message(std::string_view line){
+  AgentMessage msg;
+  sj::Reader reader(line);
+  if(!reader.enterObject()){
+    reader.finish();
+    return msg;
+  }
+  std::string_view key;
+  while(reader.nextMember(key)){
+    if(key == "type") reader.readString(msg.type);
+    else if(key == "id") reader.readString(msg.id);
+    else if(key == "name") reader.readString(msg.name);
+    else if(key == "args") msg.args = reader.readValue();
+    else if(key == "answer") reader.readString(msg.answer);
+    else if(key == "artifacts" && reader.enterArray()){
+      while(reader.nextElement()){
+        if(!reader.enterObject()) continue;
+        AgentMessage::Artifact artifact;
+        std::string_view field;
+        while(reader.nextMember(field)){
+          if(field == "name") artifact.hasName = reader.readString(artifact.name);
+          else if(field == "content") artifact.hasContent = reader.readString(artifact.content);
+          else reader.skip();
+        }
+        msg.artifacts.push_back(std::move(artifact));
+      }
+    }
+    else reader.skip();
+  }
+  reader.finish();
+  return msg;
+}
+
 #ifndef _WIN32
 struct AgentProcess {
   FILE* in = nullptr;
@@ -414,6 +496,7 @@ struct AgentSession {
   std::filesystem::path artifactDir;
   TranscriptWriter transcript;
   AgentProcess process;
+  std::string sendBuffer;  // send_message 复用的序列化缓冲
   size_t stdoutLimit = 4096;
   std::string finalAnswer;
   bool finalReceived = false;
@@ -521,11 +604,12 @@ struct AgentSession {
   }
 
   void record_event(const std::string& kind, const sj::Value& payload){
-    sj::Object rec;
-    rec.emplace("ts", sj::Value(now_timestamp()));
-    rec.emplace("event", sj::Value(kind));
-    rec.emplace("data", payload);
-    transcript.append(sj::Value(std::move(rec)));
+    transcript.appendEvent(now_timestamp(), kind, payload);
+  }
+
+  // payloadJson 为已校验过的 JSON 文本，原样嵌入记录而不重新序列化
+  void record_raw_event(const std::string& kind, std::string_view payloadJson){
+    transcript.appendRawEvent(now_timestamp(), kind, payloadJson);
   }
 
 #ifndef _WIN32
@@ -541,10 +625,14 @@ struct AgentSession {
     return true;
   }
 
+  // 只序列化一次：同一份文本先记入 transcript，再写给助手进程
   bool send_message(const sj::Value& value){
+    sendBuffer.clear();
+    sj::Writer(sendBuffer).value(value);
+    record_raw_event("send", sendBuffer);
     if(!process.in) return false;
-    std::string line = json_line(value);
-    if(std::fwrite(line.data(), 1, line.size(), process.in) != line.size()){
+    sendBuffer.push_back('\n');
+    if(std::fwrite(sendBuffer.data(), 1, sendBuffer.size(), process.in) != sendBuffer.size()){
       return false;
     }
     std::fflush(process.in);
@@ -1086,7 +1174,9 @@ struct TranscriptSummaryInfo {
 inline std::string summarize_transcript_entry(const std::string& raw,
                                               TranscriptSummaryInfo* outInfo = nullptr){
   try{
-    sj::Value value = sj::parse(raw);
+    // 记录行带嵌套的消息体，解析进每个线程复用的 Document，节点存储逐行复用
+    thread_local sj::Document doc;
+    const sj::Value& value = doc.parse(raw);
     if(!value.isObject()) return raw;
     const auto& obj = value.asObject();
     std::string ts;
@@ -1180,8 +1270,8 @@ inline ToolExecutionResult monitor_agent_session(const std::string& sessionId,
     bool active = true;
     ~MonitorAckGuard(){ if(active) agent_indicator_mark_acknowledged(); }
   } ackGuard;
-  std::ifstream stream(transcriptPath);
-  if(!stream.good()){
+  std::error_code ec;
+  if(!std::filesystem::is_regular_file(transcriptPath, ec)){
     g_parse_error_cmd = "agent";
     result.exitCode = 1;
     result.output = "agent monitor: unable to open transcript\n";
@@ -1204,9 +1294,13 @@ inline ToolExecutionResult monitor_agent_session(const std::string& sessionId,
     if(toolName.rfind("fs.read", 0) == 0) return ansi::CYAN;
     return ansi::WHITE;
   };
-  auto emit = [&](const std::string& raw){
+  struct TranscriptLine {
+    std::string text;
     TranscriptSummaryInfo summary;
-    std::string line = summarize_transcript_entry(raw, &summary);
+  };
+  auto emit = [&](TranscriptLine&& entry){
+    const std::string& line = entry.text;
+    const TranscriptSummaryInfo& summary = entry.summary;
     const char* color = nullptr;
     if(summary.eventKind == "guard_blocked"){
       color = ansi::RED;
@@ -1263,35 +1357,13 @@ inline ToolExecutionResult monitor_agent_session(const std::string& sessionId,
     }
     std::cout << ansi::YELLOW << "Press y to approve or n to reject this command." << ansi::RESET << std::endl;
   };
-  std::string line;
-  std::streampos lastPos = stream.tellg();
-  if(lastPos == std::streampos(-1)){
-    lastPos = std::streampos(0);
-  }
+  // 每次只解析上次位置之后写入的完整行；首次打开较长的记录时并行解析，再按顺序着色输出
+  JsonlCursor cursor;
   auto drain_new_entries = [&](){
-    stream.clear();
-    stream.seekg(lastPos);
-    if(!stream.good()){
-      stream.clear();
-      stream.seekg(0, std::ios::beg);
-      auto resetPos = stream.tellg();
-      if(resetPos == std::streampos(-1)){
-        resetPos = std::streampos(0);
-      }
-      lastPos = resetPos;
-    }
-    while(std::getline(stream, line)){
-      emit(line);
-      auto pos = stream.tellg();
-      if(pos == std::streampos(-1)){
-        lastPos = std::streampos(0);
-      }else{
-        lastPos = pos;
-      }
-    }
-    if(stream.bad()){
-      stream.clear();
-    }
+    load_jsonl<TranscriptLine>(transcriptPath.string(), [](std::string_view raw, TranscriptLine& out){
+      out.text = summarize_transcript_entry(std::string(raw), &out.summary);
+      return true;
+    }, emit, &cursor);
     auto nextPrompt = next_guard_prompt_for_session(sessionId);
     if(nextPrompt && nextPrompt->resolved.load(std::memory_order_acquire)){
       nextPrompt.reset();
@@ -1401,7 +1473,7 @@ inline void agent_session_thread_main(std::shared_ptr<AgentSession> session, std
     sj::Object hello;
     hello.emplace("type", sj::Value("hello"));
     hello.emplace("version", sj::Value("1.0"));
-    hello.emplace("tool_catalog", catalog);
+    hello.emplace("tool_catalog", std::move(catalog));
     sj::Object limits;
     limits.emplace("stdout_bytes", sj::Value(static_cast<long long>(session->stdoutLimit)));
     limits.emplace("tool_timeout_ms", sj::Value(static_cast<long long>(session->cfg.toolTimeoutMs)));
@@ -1421,7 +1493,6 @@ inline void agent_session_thread_main(std::shared_ptr<AgentSession> session, std
     }
     hello.emplace("policy", sj::Value(std::move(policy)));
     sj::Value helloVal(std::move(hello));
-    session->record_event("send", helloVal);
     if(!session->send_message(helloVal)){
       record_error("Failed to send hello message to agent process.");
       indicatorGuard.finish();
@@ -1435,7 +1506,6 @@ inline void agent_session_thread_main(std::shared_ptr<AgentSession> session, std
     context.emplace("cwd", sj::Value(std::filesystem::current_path().string()));
     start.emplace("context", sj::Value(std::move(context)));
     sj::Value startVal(std::move(start));
-    session->record_event("send", startVal);
     if(!session->send_message(startVal)){
       record_error("Failed to send start message to agent process.");
       indicatorGuard.finish();
@@ -1446,10 +1516,10 @@ inline void agent_session_thread_main(std::shared_ptr<AgentSession> session, std
     bool running = true;
     while(running && session->receive_message(line)){
       if(line.empty()) continue;
-      sj::Value msg;
+      AgentMessage msg;
       bool parsed = false;
       try{
-        msg = sj::parse(line);
+        msg = read_agent_message(line);
         parsed = true;
       }catch(const std::exception&){
       }
@@ -1464,42 +1534,33 @@ inline void agent_session_thread_main(std::shared_ptr<AgentSession> session, std
           err.emplace("type", sj::Value("error"));
           err.emplace("message", sj::Value("invalid json"));
           sj::Value errVal(std::move(err));
-          session->record_event("send", errVal);
           session->send_message(errVal);
         }
         continue;
       }
-      session->record_event("receive", msg);
-      const auto* typeField = msg.find("type");
-      if(!typeField) continue;
-      std::string type = typeField->asString();
+      // 消息已校验过，原文直接写入记录
+      session->record_raw_event("receive", line);
+      const std::string& type = msg.type;
       if(type == "tool_call"){
-        const auto* idField = msg.find("id");
-        const auto* nameField = msg.find("name");
-        const auto* argsField = msg.find("args");
-        std::string callId = idField ? idField->asString() : "";
-        std::string toolName = nameField ? nameField->asString() : "";
-        sj::Value args = argsField ? *argsField : sj::Value();
-        ToolExecutionResult res = session->invoke_tool(toolName, args);
+        ToolExecutionResult res = session->invoke_tool(msg.name, msg.args);
         sj::Object reply;
         reply.emplace("type", sj::Value("tool_result"));
-        reply.emplace("id", sj::Value(callId));
+        reply.emplace("id", sj::Value(msg.id));
         bool truncated = false;
         std::string stdoutLimited = clamp_stdout(res.output, session->stdoutLimit, truncated);
         reply.emplace("ok", sj::Value(res.exitCode == 0));
         reply.emplace("exit_code", sj::Value(res.exitCode));
-        reply.emplace("stdout", sj::Value(stdoutLimited));
+        reply.emplace("stdout", sj::Value(std::move(stdoutLimited)));
         reply.emplace("stderr", sj::Value(res.stderrOutput.value_or("")));
         sj::Value meta = meta_from_result(res);
         if(meta.type() == sj::Value::Type::Object){
-          sj::Object metaObj = meta.asObject();
+          sj::Object metaObj = std::move(meta.object());
           metaObj.emplace("stdout_truncated", sj::Value(truncated));
           reply.emplace("meta", sj::Value(std::move(metaObj)));
         }else{
           reply.emplace("meta", meta);
         }
         sj::Value replyVal(std::move(reply));
-        session->record_event("send", replyVal);
         if(!session->send_message(replyVal)){
           record_error("Failed to send tool_result to agent process.");
           running = false;
@@ -1507,35 +1568,27 @@ inline void agent_session_thread_main(std::shared_ptr<AgentSession> session, std
       }else if(type == "log"){
         // Logs are captured in the transcript; no realtime console output.
       }else if(type == "final"){
-        const auto* ans = msg.find("answer");
-        if(ans){
-          session->finalAnswer = ans->asString();
+        if(!msg.answer.empty()){
+          session->finalAnswer = std::move(msg.answer);
         }
-        const auto* artifactsField = msg.find("artifacts");
-        if(artifactsField && artifactsField->isArray()){
-          const auto& arr = artifactsField->asArray();
-          for(const auto& item : arr){
-            if(!item.isObject()) continue;
-            const auto* nameField = item.find("name");
-            const auto* contentField = item.find("content");
-            if(!nameField || !contentField) continue;
-            std::string name = nameField->asString();
-            std::string safeName = name;
-            for(char& ch : safeName){
-              if(ch == '/' || ch == '\\') ch = '_';
-            }
-            if(safeName.empty()) safeName = "artifact";
-            std::filesystem::path path = session->artifactDir / safeName;
-            std::ofstream ofs(path, std::ios::binary);
-            if(ofs){
-              ofs << contentField->asString();
-              ofs.close();
-              sj::Object rec;
-              rec.emplace("type", sj::Value("artifact"));
-              rec.emplace("name", sj::Value(name));
-              rec.emplace("path", sj::Value(path.string()));
-              session->record_event("artifact", sj::Value(std::move(rec)));
-            }
+        for(const auto& artifact : msg.artifacts){
+          if(!artifact.hasName || !artifact.hasContent) continue;
+          const std::string& name = artifact.name;
+          std::string safeName = name;
+          for(char& ch : safeName){
+            if(ch == '/' || ch == '\\') ch = '_';
+          }
+          if(safeName.empty()) safeName = "artifact";
+          std::filesystem::path path = session->artifactDir / safeName;
+          std::ofstream ofs(path, std::ios::binary);
+          if(ofs){
+            ofs << artifact.content;
+            ofs.close();
+            sj::Object rec;
+            rec.emplace("type", sj::Value("artifact"));
+            rec.emplace("name", sj::Value(name));
+            rec.emplace("path", sj::Value(path.string()));
+            session->record_event("artifact", sj::Value(std::move(rec)));
           }
         }
         session->finalReceived = true;
@@ -2,6 +2,8 @@
 
 #include "tool_common.hpp"
 #include "../utils/json.hpp"
+#include "../utils/json_reader.hpp"
+#include "../utils/completion_cache.hpp"
 
 #include <chrono>
 #include <iomanip>
@@ -52,7 +54,8 @@ struct Backup {
     if(tokens.empty() || tokens[0] != "backup") return cand;
     bool trailingSpace = (!buffer.empty() && std::isspace(static_cast<unsigned char>(buffer.back())));
     auto sw = splitLastWord(buffer);
-    auto entries = loadEntries();
+    const auto entryCache = cachedEntries();
+    const std::vector<BackupEntry>& entries = *entryCache;
     auto addEntries = [&](const std::string& word){
       for(const auto& e : entries){
         MatchResult m = compute_match(e.label, word);
@@ -207,38 +210,56 @@ private:
 
   static std::vector<BackupEntry> loadEntries(){
     std::vector<BackupEntry> entries;
-    std::ifstream in(indexPath());
+    std::ifstream in(indexPath(), std::ios::binary);
     if(!in) return entries;
-    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
-    if(content.empty()) return entries;
+    if(in.peek() == std::char_traits<char>::eof()) return entries;
     try{
-      sj::Parser parser(content);
-      sj::Value root = parser.parse();
-      const sj::Value* arrayVal = nullptr;
-      if(root.isObject()){
-        arrayVal = root.find("entries");
-      }else if(root.isArray()){
-        arrayVal = &root;
-      }
-      if(!arrayVal || !arrayVal->isArray()) return entries;
-      for(const auto& v : arrayVal->asArray()){
-        if(!v.isObject()) continue;
-        const auto& obj = v.asObject();
-        BackupEntry e;
-        if(auto idIt = obj.find("id"); idIt != obj.end() && idIt->second.isString()) e.id = idIt->second.asString();
-        if(auto labelIt = obj.find("label"); labelIt != obj.end() && labelIt->second.isString()) e.label = labelIt->second.asString();
-        if(auto pathIt = obj.find("backupPath"); pathIt != obj.end() && pathIt->second.isString()) e.backupPath = pathIt->second.asString();
-        if(auto srcIt = obj.find("sourcePath"); srcIt != obj.end() && srcIt->second.isString()) e.sourcePath = srcIt->second.asString();
-        if(auto tsIt = obj.find("timestamp"); tsIt != obj.end() && tsIt->second.isString()) e.timestamp = tsIt->second.asString();
-        if(!e.label.empty() && !e.backupPath.empty()) entries.push_back(std::move(e));
+      sj::Reader reader(in);
+      // 根可以是 {"entries": [...]} 或直接是数组；其余内容跳过但仍要求整份文件合法
+      bool found = false;
+      auto readEntries = [&]{
+        found = true;
+        while(reader.nextElement()){
+          if(!reader.enterObject()) continue;
+          BackupEntry e;
+          std::string_view key;
+          while(reader.nextMember(key)){
+            if(key == "id") reader.readString(e.id);
+            else if(key == "label") reader.readString(e.label);
+            else if(key == "backupPath") reader.readString(e.backupPath);
+            else if(key == "sourcePath") reader.readString(e.sourcePath);
+            else if(key == "timestamp") reader.readString(e.timestamp);
+            else reader.skip();
+          }
+          if(!e.label.empty() && !e.backupPath.empty()) entries.push_back(std::move(e));
+        }
+      };
+      sj::Token root = reader.next();
+      if(root == sj::Token::StartArray){
+        readEntries();
+      }else if(root == sj::Token::StartObject){
+        std::string_view key;
+        while(reader.nextMember(key)){
+          if(key == "entries" && !found && reader.enterArray()) readEntries();
+          else reader.skip();
+        }
       }
+      reader.finish();
+
     }catch(...){
       entries.clear();
     }
     return entries;
   }
 
+  // 补全用的索引副本，backups.json 未变化时不重新解析
+  static std::shared_ptr<const std::vector<BackupEntry>> cachedEntries(){
+    return completion_data_cache().get<std::vector<BackupEntry>>(
+      "backup.entries", {indexPath().string()}, 0, []{ return loadEntries(); });
+  }
+
   static bool saveEntries(const std::vector<BackupEntry>& entries, std::string& error){
+    completion_data_cache().invalidate("backup.entries");
     std::error_code ec;
     std::filesystem::create_directories(backupRoot(), ec);
     sj::Array arr;
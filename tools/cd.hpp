@@ -1,9 +1,24 @@
 #pragma once
 
 #include "tool_common.hpp"
+#include "../utils/dir_listing.hpp"
+#include "../utils/dir_frecency.hpp"
 
 namespace tool {
 
+inline std::string dir_frecency_file(){
+  return (std::filesystem::path(config_home()) / "mycli_dirs.db").string();
+}
+
+// 成功进入目录后记入 frecency 库，供 cds 模糊跳转使用
+inline void record_directory_visit(){
+  std::error_code ec;
+  auto cwd = std::filesystem::current_path(ec);
+  if(ec) return;
+  dir_frecency_record(dir_frecency_file(), cwd.lexically_normal().string(),
+                      static_cast<int64_t>(std::time(nullptr)));
+}
+
 struct Cd {
   static ToolSpec ui(){
     ToolSpec spec;
@@ -52,6 +67,8 @@ struct Cd {
     }
     const std::string& path = rest.front();
     if(chdir(path.c_str()) == 0){
+      dir_listing_cache().clear();
+      record_directory_visit();
       char buf[4096];
       if(getcwd(buf, sizeof(buf))){
         return detail::text_result(std::string(buf) + "\n");
@@ -1,7 +1,11 @@
 #pragma once
 
 #include "tool_common.hpp"
+#include "cd.hpp"
 #include "../utils/json.hpp"
+#include "../utils/dir_listing.hpp"
+#include "../utils/completion_cache.hpp"
+#include "../utils/frecency.hpp"
 
 namespace tool {
 
@@ -17,6 +21,11 @@ struct CdsState {
   std::string lastTarget;
 };
 
+struct CdsDirMatch {
+  const DirFrecencyEntry* entry = nullptr;
+  double score = 0.0;
+};
+
 struct Cds {
   static ToolSpec ui(){
     ToolSpec spec;
@@ -25,12 +34,12 @@ struct Cds {
     set_tool_summary_locale(spec, "en", "Quick jump between bookmarked directories");
     set_tool_summary_locale(spec, "zh", "在书签目录之间快速跳转");
     set_tool_help_locale(spec, "en",
-                         "cds /<name> | cds\n"
+                         "cds /<name> | cds <fuzzy terms...> | cds\n"
                          "cds add <name> <path> | cds set <name> <path>\n"
                          "cds rm <name> | cds rename <old> <new> | cds here <name>\n"
                          "cds list | cds clear");
     set_tool_help_locale(spec, "zh",
-                         "cds /<快捷名> | cds\n"
+                         "cds /<快捷名> | cds <模糊词...> | cds\n"
                          "cds add <快捷名> <路径> | cds set <快捷名> <路径>\n"
                          "cds rm <快捷名> | cds rename <旧名> <新名> | cds here <快捷名>\n"
                          "cds list | cds clear");
@@ -43,7 +52,7 @@ struct Cds {
       SubcommandSpec{"list", {}, {}, {}, nullptr},
       SubcommandSpec{"clear", {}, {}, {}, nullptr}
     };
-    spec.positional = {positional("[/<name>]")};
+    spec.positional = {positional("[/<name>|terms...]")};
     return spec;
   }
 
@@ -53,7 +62,8 @@ struct Cds {
 
     const bool trailingSpace = (!buffer.empty() && std::isspace(static_cast<unsigned char>(buffer.back())));
     const SplitWord sw = splitLastWord(buffer);
-    const CdsState state = loadState();
+    const auto stateCache = cachedState();
+    const CdsState& state = *stateCache;
 
     auto addCandidate = [&](const std::string& value, const std::string& annotation = std::string()){
       MatchResult match = compute_match(value, sw.word);
@@ -85,6 +95,7 @@ struct Cds {
       }else{
         addSubcommands();
         addAliases(true);
+        addVisitedDirectories(cand, sw, addCandidate);
       }
       sortCandidatesByMatch(sw.word, cand);
       return cand;
@@ -139,6 +150,15 @@ struct Cds {
 
     const std::string token = args[1];
     if(!token.empty() && token[0] == '/'){
+      // /<快捷名> 优先；不是已有快捷名而是目录时按路径跳转（补全插入的访问过的目录以 / 结尾）
+      std::vector<std::string> parts(args.begin() + 1, args.end());
+      const std::string path = join(parts, " ");
+      std::string alias = normalizeAlias(token, /*stripLeadingSlash=*/true);
+      bool isAlias = args.size() == 2 && isValidAlias(alias) && findEntryConst(loadState().entries, alias);
+      std::error_code ec;
+      if(!isAlias && (token.find('/', 1) != std::string::npos || std::filesystem::is_directory(path, ec))){
+        return handlePathJump(path);
+      }
       return handleJump(token);
     }
 
@@ -150,10 +170,77 @@ struct Cds {
     if(token == "list") return handleList(args);
     if(token == "clear") return handleClear(args);
 
-    return handleJump(token);
+    if(args.size() == 2 && isValidAlias(token) && findEntryConst(loadState().entries, token)){
+      return handleJump(token);
+    }
+    return handleFuzzyJump(std::vector<std::string>(args.begin() + 1, args.end()));
   }
 
 private:
+  // 按模糊词给访问过的目录排名（zoxide 的规则）：前面的词只需出现在路径中，
+  // 最后一个词要匹配末级目录名；分数为 frecency 乘以匹配质量，不扫描磁盘。
+  static std::vector<CdsDirMatch> rankVisitedDirectories(const std::vector<DirFrecencyEntry>& entries,
+                                                         const std::vector<std::string>& terms,
+                                                         const std::string& exclude,
+                                                         int64_t now){
+    std::vector<CdsDirMatch> ranked;
+    if(terms.empty()) return ranked;
+    for(const auto& entry : entries){
+      if(entry.path == exclude) continue;
+      bool matched = true;
+      for(size_t i = 0; i + 1 < terms.size() && matched; ++i){
+        matched = compute_match(entry.path, terms[i]).matched;
+      }
+      if(!matched) continue;
+      size_t slash = entry.path.find_last_of('/');
+      std::string base = (slash == std::string::npos || slash + 1 >= entry.path.size())
+                           ? entry.path : entry.path.substr(slash + 1);
+      double quality = 0.0;
+      MatchResult last = compute_match(base, terms.back());
+      if(last.matched){
+        quality = last.isSubstring ? 1.0 : 0.5;
+      }else if(compute_match(entry.path, terms.back()).matched){
+        quality = 0.25;
+      }else{
+        continue;
+      }
+      ranked.push_back(CdsDirMatch{&entry, dir_frecency_score(entry, now) * quality});
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const CdsDirMatch& a, const CdsDirMatch& b){
+      return a.score > b.score;
+    });
+    return ranked;
+  }
+
+  static constexpr size_t kVisitedCompletionLimit = 64;
+
+  // 访问过的目录作为补全候选，按 frecency 给排名加成。候选以 / 结尾，
+  // 即使是 /tmp 这样的一级目录也带第二个 /，执行时不会被当成 /<快捷名>
+  template <typename AddCandidate>
+  static void addVisitedDirectories(Candidates& cand, const SplitWord& sw, AddCandidate& addCandidate){
+    if(sw.word.empty()) return;
+    const auto entries = cachedVisitedDirectories();
+    int64_t now = static_cast<int64_t>(std::time(nullptr));
+    auto ranked = rankVisitedDirectories(*entries, {sw.word}, currentDirectory(), now);
+    if(ranked.size() > kVisitedCompletionLimit) ranked.resize(kVisitedCompletionLimit);
+    if(ranked.empty()) return;
+    std::vector<double> bonus(cand.labels.size(), 0.0);
+    for(const auto& match : ranked){
+      size_t before = cand.labels.size();
+      const std::string& path = match.entry->path;
+      addCandidate(path.back() == '/' ? path : path + "/", "visited");
+      if(cand.labels.size() == before) continue;
+      bonus.push_back(frecency_rank_bonus(match.score));
+    }
+    cand.usageBonus = std::move(bonus);
+  }
+
+  static std::shared_ptr<const std::vector<DirFrecencyEntry>> cachedVisitedDirectories(){
+    const std::string file = dir_frecency_file();
+    return completion_data_cache().get<std::vector<DirFrecencyEntry>>(
+      "cds.visited", {file}, 0, [file]{ return dir_frecency_load(file); });
+  }
+
   static std::filesystem::path statePath(){
     return std::filesystem::path(config_home()) / "cds.json";
   }
@@ -271,7 +358,14 @@ private:
     return state;
   }
 
+  // 补全用的书签副本，cds.json 未变化时不重新解析
+  static std::shared_ptr<const CdsState> cachedState(){
+    return completion_data_cache().get<CdsState>(
+      "cds.state", {statePath().string()}, 0, []{ return loadState(); });
+  }
+
   static bool saveState(const CdsState& state, std::string& error){
+    completion_data_cache().invalidate("cds.state");
     if(!ensureStateFolder(error)) return false;
     sj::Array arr;
     for(const auto& entry : state.entries){
@@ -314,7 +408,11 @@ private:
   }
 
   static bool changeDirectory(const std::string& path, std::string& error){
-    if(chdir(path.c_str()) == 0) return true;
+    if(chdir(path.c_str()) == 0){
+      dir_listing_cache().clear();
+      record_directory_visit();
+      return true;
+    }
     error = "cds: " + path + ": " + std::strerror(errno);
     return false;
   }
@@ -331,25 +429,63 @@ private:
       g_parse_error_cmd = "cds";
       return detail::text_result("cds: alias not found: " + alias + "\n", 1);
     }
+    std::string name = entry->name;
+    std::string target = entry->path;
+    return jumpTo(state, target, name);
+  }
+
+  // 跳转并记下来源，之后单独输入 cds 可以返回
+  static ToolExecutionResult jumpTo(CdsState& state, const std::string& target, const std::string& alias){
     std::string from = currentDirectory();
     std::string chdirError;
-    if(!changeDirectory(entry->path, chdirError)){
+    if(!changeDirectory(target, chdirError)){
       g_parse_error_cmd = "cds";
       return detail::text_result(chdirError + "\n", 1);
     }
     state.lastFrom = from;
-    state.lastAlias = entry->name;
-    state.lastTarget = entry->path;
+    state.lastAlias = alias;
+    state.lastTarget = target;
     std::string saveError;
     if(!saveState(state, saveError)){
       g_parse_error_cmd = "cds";
       return detail::text_result(saveError + "\n", 1);
     }
     std::ostringstream oss;
-    oss << "cds: /" << entry->name << " -> " << entry->path << "\n";
+    if(alias.empty()) oss << "cds: " << target << "\n";
+    else oss << "cds: /" << alias << " -> " << target << "\n";
     return detail::text_result(oss.str());
   }
 
+  static ToolExecutionResult handlePathJump(const std::string& rawPath){
+    std::string target;
+    std::string error;
+    if(!normalizeDirectoryPath(rawPath, target, error)){
+      g_parse_error_cmd = "cds";
+      return detail::text_result(error + "\n", 1);
+    }
+    while(target.size() > 1 && target.back() == '/') target.pop_back();
+    CdsState state = loadState();
+    return jumpTo(state, target, std::string());
+  }
+
+  // 已删除的目录在跳转时顺手从库里去掉
+  static ToolExecutionResult handleFuzzyJump(const std::vector<std::string>& terms){
+    const std::string file = dir_frecency_file();
+    std::vector<DirFrecencyEntry> entries = dir_frecency_load(file);
+    int64_t now = static_cast<int64_t>(std::time(nullptr));
+    for(const auto& match : rankVisitedDirectories(entries, terms, currentDirectory(), now)){
+      std::error_code ec;
+      if(!std::filesystem::is_directory(match.entry->path, ec)){
+        dir_frecency_forget(file, match.entry->path);
+        continue;
+      }
+      CdsState state = loadState();
+      return jumpTo(state, match.entry->path, std::string());
+    }
+    g_parse_error_cmd = "cds";
+    return detail::text_result("cds: no visited directory matches: " + join(terms, " ") + "\n", 1);
+  }
+
   static ToolExecutionResult handleReturn(){
     CdsState state = loadState();
     if(state.lastFrom.empty()){
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "tool_common.hpp"
+
+namespace tool {
+
+struct Find {
+  static constexpr size_t kDefaultLimit = 20;
+
+  static ToolSpec ui(){
+    ToolSpec spec;
+    spec.name = "find";
+    spec.summary = "Fuzzy-find paths in the current project";
+    set_tool_summary_locale(spec, "en", spec.summary);
+    set_tool_summary_locale(spec, "zh", "在当前项目中模糊查找路径");
+    spec.positional = {positional("<query>")};
+    spec.options = {
+      OptionSpec{"-n", true, {}, nullptr, false, "<count>"}
+    };
+    set_tool_help_locale(spec, "en",
+                         "find <query> [-n <count>]\n"
+                         "Fuzzy-match every path under the project root (nearest parent with .git, else the current directory;\n"
+                         "never / or $HOME)\n"
+                         "and print the best matches relative to the current directory. Entries ignored by .gitignore are skipped.");
+    set_tool_help_locale(spec, "zh",
+                         "find <查询> [-n <条数>]\n"
+                         "在项目根目录（向上最近的含 .git 的目录，否则为当前目录；不会是 / 或家目录）下的全部路径中模糊匹配，\n"
+                         "按相对当前目录的路径列出最佳结果；跳过 .gitignore 中忽略的条目。");
+    return spec;
+  }
+
+  static ToolExecutionResult run(const ToolExecutionRequest& request){
+    const auto& args = request.tokens;
+    std::string query;
+    size_t limit = kDefaultLimit;
+    for(size_t i = 1; i < args.size(); ++i){
+      if(args[i] == "-n"){
+        if(i + 1 >= args.size()){
+          g_parse_error_cmd = "find";
+          return detail::text_result("find: -n requires a count\n", 1);
+        }
+        try{
+          long long value = std::stoll(args[++i]);
+          if(value <= 0) throw std::invalid_argument("count");
+          limit = static_cast<size_t>(value);
+        }catch(...){
+          g_parse_error_cmd = "find";
+          return detail::text_result("find: invalid count: " + args[i] + "\n", 1);
+        }
+        continue;
+      }
+      if(!query.empty()){
+        g_parse_error_cmd = "find";
+        return detail::text_result("usage: find <query> [-n <count>]\n", 1);
+      }
+      query = args[i];
+    }
+    if(query.empty()){
+      g_parse_error_cmd = "find";
+      return detail::text_result("usage: find <query> [-n <count>]\n", 1);
+    }
+
+    auto matches = workspace_search(".", query, limit, /*wholeProject=*/true, /*fresh=*/true);
+    if(matches.empty()){
+      return detail::text_result("find: no matches for " + query + "\n", 1);
+    }
+    std::ostringstream oss;
+    for(const auto& match : matches){
+      oss << match.path << (match.isDir ? "/" : "") << "\n";
+    }
+    return detail::text_result(oss.str());
+  }
+};
+
+inline ToolDefinition make_find_tool(){
+  ToolDefinition def;
+  def.ui = Find::ui();
+  def.executor = Find::run;
+  return def;
+}
+
+} // namespace tool
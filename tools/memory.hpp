@@ -526,15 +526,17 @@ inline ToolExecutionResult handle_memory_query(const std::vector<std::string>& a
   return detail::text_result(oss.str());
 }
 
-inline std::string summarize_memory_event(const std::string& line){
+// kindOut 非空时顺带取出事件类型，省得再解析一遍
+inline std::string summarize_memory_event(std::string_view line, std::string* kindOut = nullptr){
   try{
     sj::Parser parser(line);
     sj::Value val = parser.parse();
-    if(!val.isObject()) return line;
+    if(!val.isObject()) return std::string(line);
     const auto& obj = val.asObject();
     std::string ts, kind, detail;
     if(auto it = obj.find("ts"); it != obj.end() && it->second.isString()) ts = it->second.asString();
     if(auto it = obj.find("kind"); it != obj.end() && it->second.isString()) kind = it->second.asString();
+    if(kindOut) *kindOut = kind;
     if(auto it = obj.find("detail"); it != obj.end() && it->second.isString()) detail = it->second.asString();
     std::ostringstream oss;
     if(!ts.empty()) oss << "[" << ts << "] ";
@@ -545,15 +547,15 @@ inline std::string summarize_memory_event(const std::string& line){
     }
     return oss.str();
   }catch(...){
-    return line;
+    return std::string(line);
   }
 }
 
-inline std::string summarize_memory_llm_entry(const std::string& line){
+inline std::string summarize_memory_llm_entry(std::string_view line){
   try{
     sj::Parser parser(line);
     sj::Value val = parser.parse();
-    if(!val.isObject()) return line;
+    if(!val.isObject()) return std::string(line);
     const auto& obj = val.asObject();
     std::string ts, system, user, response, source;
     auto collapse = [](const std::string& text){
@@ -579,7 +581,7 @@ inline std::string summarize_memory_llm_entry(const std::string& line){
     if(!system.empty()) oss << " | system: " << collapse(system);
     return oss.str();
   }catch(...){
-    return line;
+    return std::string(line);
   }
 }
 
@@ -587,43 +589,43 @@ inline ToolExecutionResult handle_memory_monitor(const MemoryConfig& cfg){
 #ifndef _WIN32
   auto logPath = memory_event_log_path(cfg);
   auto llmPath = memory_llm_log_path(cfg);
-  std::ifstream stream(logPath);
-  std::ifstream llmStream(llmPath);
-  if(!stream.good() && !llmStream.good()){
+  std::error_code ec;
+  bool hasEvents = std::filesystem::is_regular_file(logPath, ec);
+  bool hasLlm = std::filesystem::is_regular_file(llmPath, ec);
+  if(!hasEvents && !hasLlm){
     g_parse_error_cmd = "memory";
     return detail::text_result(std::string("memory monitor: event log missing at ") + logPath.string() + " and LLM log missing at " + llmPath.string() + "\n", 1);
   }
-  bool hasEvents = stream.good();
-  bool hasLlm = llmStream.good();
   std::cout << "[memory] monitoring events";
   if(hasEvents) std::cout << " from " << logPath; else std::cout << " (event log missing)";
   if(hasLlm) std::cout << " and LLM calls from " << llmPath;
   std::cout << " (press q to quit)" << std::endl;
-  std::string line;
   bool running = true;
-  auto is_import_complete = [](const std::string& input){
-    try{
-      sj::Parser parser(input);
-      sj::Value val = parser.parse();
-      if(!val.isObject()) return false;
-      const auto& obj = val.asObject();
-      if(auto it = obj.find("kind"); it != obj.end() && it->second.isString()){
-        return it->second.asString() == "import_complete";
-      }
-      return false;
-    }catch(...){
-      return false;
-    }
-  };
   bool sawImportComplete = false;
-  auto pump_stream = [&](std::ifstream& streamRef, auto formatter, bool checkComplete){
-    std::string innerLine;
-    while(std::getline(streamRef, innerLine)){
-      if(innerLine.empty()) continue;
-      if(checkComplete && is_import_complete(innerLine)) sawImportComplete = true;
-      std::cout << "[memory] " << formatter(innerLine) << std::endl;
-    }
-    if(streamRef.eof()) streamRef.clear();
+  struct MonitorLine {
+    std::string text;
+    bool importComplete = false;
+  };
+  // 每轮只读取上次位置之后新写入的完整行；积压较多时（如首次打开大日志）并行解析
+  JsonlCursor eventCursor, llmCursor;
+  auto pump_events = [&](){
+    load_jsonl<MonitorLine>(logPath.string(), [](std::string_view line, MonitorLine& out){
+      std::string kind;
+      out.text = summarize_memory_event(line, &kind);
+      out.importComplete = kind == "import_complete";
+      return true;
+    }, [&](MonitorLine&& line){
+      if(line.importComplete) sawImportComplete = true;
+      std::cout << "[memory] " << line.text << std::endl;
+    }, &eventCursor);
+  };
+  auto pump_llm = [&](){
+    load_jsonl<std::string>(llmPath.string(), [](std::string_view line, std::string& out){
+      out = summarize_memory_llm_entry(line);
+      return true;
+    }, [](std::string&& text){
+      std::cout << "[memory] " << text << std::endl;
+    }, &llmCursor);
   };
   while(running){
     fd_set readfds;
@@ -640,8 +642,8 @@ inline ToolExecutionResult handle_memory_monitor(const MemoryConfig& cfg){
         }
       }
     }
-    if(stream.good()) pump_stream(stream, summarize_memory_event, /*checkComplete=*/true);
-    if(llmStream.good()) pump_stream(llmStream, summarize_memory_llm_entry, /*checkComplete=*/false);
+    if(hasEvents) pump_events();
+    if(hasLlm) pump_llm();
   }
   if(sawImportComplete) memory_import_indicator_mark_seen();
   return detail::text_result("memory monitor stopped\n");
@@ -2,6 +2,7 @@
 import argparse
 import hashlib
 import json
+import os
 import sys
 from datetime import datetime
 from pathlib import Path
@@ -193,9 +194,12 @@ def build_index(root: Path, index_path: Path, personal: str, lang: str, min_len:
             node["summary"] = summarize_with_llm(joined, lang, min_len, max_len, kind="目录", log_path=log_path)
         nodes[rel] = node
 
-    with index_path.open("w", encoding="utf-8") as fp:
+    # Write a temp file and rename it: the CLI may be reading the index meanwhile
+    tmp_path = index_path.with_name(f"{index_path.name}.{os.getpid()}.tmp")
+    with tmp_path.open("w", encoding="utf-8") as fp:
         for rel in sorted(nodes.keys()):
             fp.write(json.dumps(nodes[rel], ensure_ascii=False) + "\n")
+    os.replace(tmp_path, index_path)
 
 
 
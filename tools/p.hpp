@@ -11,24 +11,26 @@ struct HistoryReplay {
     spec.summary = "Browse recent commands";
     set_tool_summary_locale(spec, "en", "Browse recent commands");
     set_tool_summary_locale(spec, "zh", "查看最近使用的命令");
-    spec.help = "Displays the recent command history. Type `p` followed by a space to trigger history completions and press Tab to insert a previous command.";
+    spec.help = "Displays the recent command history, shared by all sessions. Type `p` followed by a space and any part of an earlier command to fuzzy-search the whole history (Ctrl-R does this for the current input); press Tab to insert the selected command.";
     set_tool_help_locale(spec, "en", spec.help);
-    set_tool_help_locale(spec, "zh", "显示最近输入的命令。输入 `p` 再加空格即可触发历史补全，按 Tab 可将选中的旧指令直接放回输入行。");
+    set_tool_help_locale(spec, "zh", "显示最近输入的命令（所有会话共享）。输入 `p`、空格以及旧指令的任意片段即可在全部历史中模糊搜索（Ctrl-R 会以当前输入开始搜索），按 Tab 可将选中的旧指令直接放回输入行。");
     return spec;
   }
 
   static ToolExecutionResult run(const ToolExecutionRequest& request){
     (void)request;
     ToolExecutionResult result;
-    const auto& history = history_recent_commands();
+    const auto history = history_recent_commands();
     std::ostringstream oss;
     if(history.empty()){
       oss << "No recent commands." << '\n';
     }else{
       oss << "Recent commands (most recent first):" << '\n';
       int index = 1;
-      for(const auto& cmd : history){
-        oss << index++ << ". " << cmd << '\n';
+      for(const auto& rec : history){
+        oss << index++ << ". " << rec.command << "  (" << history_age_label(rec.timestamp) << " ago";
+        if(rec.exitCode && *rec.exitCode != 0) oss << ", exit " << *rec.exitCode;
+        oss << ")" << '\n';
       }
     }
     std::string output = oss.str();
@@ -37,26 +39,18 @@ struct HistoryReplay {
     return result;
   }
 
+  // `p` 之后的整段文本都是搜索词，可以包含空格
   static Candidates complete(const std::string& buffer, const std::vector<std::string>& tokens){
     Candidates cand;
     if(tokens.empty() || tokens[0] != "p") return cand;
     bool trailingSpace = (!buffer.empty() && std::isspace(static_cast<unsigned char>(buffer.back())));
-    if(tokens.size() > 1 && trailingSpace) return cand;
     if(tokens.size() <= 1 && !trailingSpace) return cand;
 
-    auto sw = splitLastWord(buffer);
-    const auto& history = history_recent_commands();
-    for(const auto& cmd : history){
-      MatchResult match = compute_match(cmd, sw.word);
-      if(!match.matched) continue;
-      cand.items.push_back(cmd);
-      cand.labels.push_back(cmd);
-      cand.matchPositions.push_back(match.positions);
-      cand.annotations.push_back("");
-      cand.exactMatches.push_back(match.exact);
-      cand.matchDetails.push_back(match);
-    }
-    return cand;
+    size_t start = buffer.find(tokens[0]) + tokens[0].size();
+    while(start < buffer.size() && std::isspace(static_cast<unsigned char>(buffer[start]))) ++start;
+    size_t end = buffer.size();
+    while(end > start && std::isspace(static_cast<unsigned char>(buffer[end - 1]))) --end;
+    return history_search_candidates(buffer.substr(start, end - start));
   }
 };
 
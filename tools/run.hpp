@@ -17,6 +17,21 @@ struct RunCommand {
     return spec;
   }
 
+  // 命令名来自 $PATH 可执行文件索引，其余参数按路径补全
+  static Candidates complete(const std::string& buffer, const std::vector<std::string>& tokens){
+    Candidates cand;
+    if(tokens.empty() || tokens[0] != "run") return cand;
+    const bool trailingSpace = (!buffer.empty() && std::isspace(static_cast<unsigned char>(buffer.back())));
+    const SplitWord sw = splitLastWord(buffer);
+    const bool commandSlot = (tokens.size() == 1 && trailingSpace) || (tokens.size() == 2 && !trailingSpace);
+    if(!commandSlot || sw.word.find('/') != std::string::npos){
+      return pathCandidatesForWord(buffer, sw.word, commandSlot ? PathKind::File : PathKind::Any);
+    }
+    cand = executable_candidates_for_word(sw.before, sw.word);
+    sortCandidatesByMatch(sw.word, cand);
+    return cand;
+  }
+
   static ToolExecutionResult run(const ToolExecutionRequest& request){
     const auto& args = request.tokens;
     if(args.size() < 2){
@@ -37,6 +52,7 @@ inline ToolDefinition make_run_tool(){
   ToolDefinition def;
   def.ui = RunCommand::ui();
   def.executor = RunCommand::run;
+  def.completion = RunCommand::complete;
   return def;
 }
 
@@ -2,6 +2,8 @@
 
 #include "tool_common.hpp"
 #include "../utils/json.hpp"
+#include "../utils/json_reader.hpp"
+#include "../utils/completion_cache.hpp"
 
 #include <algorithm>
 #include <chrono>
@@ -49,6 +51,7 @@ struct TodoIndicatorSnapshot {
   int urgencyLevel = 0; // 0: none, 1: <=5m, 2: <=1m
   int urgentCount = 0;
   long long nearestDeadline = 0;
+  long long nextChangeAt = 0; // 下一次紧急程度或活跃状态可能变化的时间
 };
 
 struct Todo {
@@ -143,7 +146,8 @@ struct Todo {
 
     const bool trailingSpace = (!buffer.empty() && std::isspace(static_cast<unsigned char>(buffer.back())));
     const auto sw = splitLastWord(buffer);
-    auto tasks = loadTasks();
+    const auto taskCache = cachedTasks();
+    const std::vector<TodoTask>& tasks = *taskCache;
 
     auto addCandidate = [&](const std::string& label, const std::string& annotation = ""){
       MatchResult match = compute_match(label, sw.word);
@@ -343,7 +347,8 @@ struct Todo {
   static TodoIndicatorSnapshot indicatorSnapshot(long long now = 0){
     TodoIndicatorSnapshot snapshot;
     if(now <= 0) now = nowSeconds();
-    auto tasks = loadTasks();
+    const auto taskCache = cachedTasks();
+    const std::vector<TodoTask>& tasks = *taskCache;
     for(const auto& task : tasks){
       TodoResolvedTiming timing = resolveTiming(task, now);
       bool active = false;
@@ -360,6 +365,11 @@ struct Todo {
         if(snapshot.nearestDeadline <= 0 || timing.deadlineAt < snapshot.nearestDeadline){
           snapshot.nearestDeadline = timing.deadlineAt;
         }
+        for(long long edge : {timing.deadlineAt - 5 * 60, timing.deadlineAt - 60, timing.deadlineAt + 1}){
+          if(edge > now && (snapshot.nextChangeAt <= 0 || edge < snapshot.nextChangeAt)){
+            snapshot.nextChangeAt = edge;
+          }
+        }
         long long delta = timing.deadlineAt - now;
         if(delta >= 0 && delta <= 5 * 60){
           snapshot.urgentCount += 1;
@@ -374,7 +384,29 @@ struct Todo {
     return snapshot;
   }
 
+  // 指示器依赖的存储目录，供主循环监视文件变化
+  static std::vector<std::filesystem::path> indicatorWatchDirectories(){
+    return {todoRoot(), todoDetailsDir()};
+  }
+
+  // 补全与提示符指示器共用的任务列表；Details 目录或旧索引变化时才重新解析。
+  // 目录内文件被原地改写不会改变目录的修改时间，因此写入与 inotify 事件都要调用
+  // invalidateTaskCache
+  static std::shared_ptr<const std::vector<TodoTask>> cachedTasks(){
+    return completion_data_cache().get<std::vector<TodoTask>>(
+      kTaskCacheKey,
+      {todoDetailsDir().string(), todoIndexPath().string()},
+      0,
+      []{ return loadTasks(); });
+  }
+
+  static void invalidateTaskCache(){
+    completion_data_cache().invalidate(kTaskCacheKey);
+  }
+
 private:
+  static constexpr const char* kTaskCacheKey = "todo.tasks";
+
   struct TodoListItem {
     const TodoTask* task = nullptr;
     TodoResolvedTiming timing;
@@ -397,6 +429,43 @@ private:
     std::vector<std::string> todoItems;
   };
 
+  // 详情 JSON 中的一个字段：present 表示出现过，typed 表示类型符合；重复的键只取第一次
+  template <typename T>
+  struct TodoJsonField {
+    bool present = false;
+    bool typed = false;
+    T value{};
+  };
+
+  struct TodoJsonDetail {
+    bool isObject = false;
+    TodoJsonField<std::string> text;
+    TodoJsonField<std::string> time;
+    TodoJsonField<long long> ts;
+  };
+
+  // 详情文件读一遍得到的全部字段，加载与编辑两条路径各自按原有顺序校验
+  struct TodoDetailJson {
+    bool isObject = false;
+    TodoJsonField<std::string> name;
+    TodoJsonField<long long> createdAt;
+    TodoJsonField<long long> updatedAt;
+    TodoJsonField<long long> startAt;
+    TodoJsonField<long long> deadlineAt;
+    TodoJsonField<long long> repeatSeconds;
+    TodoJsonField<std::string> repeatExpr;
+    TodoJsonField<std::string> startTime;
+    TodoJsonField<std::string> start;
+    TodoJsonField<std::string> deadline;
+    TodoJsonField<std::string> repeat;
+    TodoJsonField<std::string> note;
+    // 字符串或字符串数组，已去掉首尾空白与空项
+    TodoJsonField<std::vector<std::string>> todo;
+    bool todoIsArray = false;
+    bool todoItemsTyped = true;
+    TodoJsonField<std::vector<TodoJsonDetail>> details;
+  };
+
   static std::filesystem::path todoRoot(){
     return std::filesystem::path(config_home()) / "todo";
   }
@@ -1393,6 +1462,10 @@ private:
       return false;
     }
     out << text;
+    out.close();
+    // 写完并关闭后再失效：提前失效时并发的补全可能重新缓存写入前的内容；
+    // 写入失败时文件也可能已被截短，同样要失效
+    invalidateTaskCache();
     if(!out.good()){
       error = "failed to write file: " + path.string();
       return false;
@@ -1534,6 +1607,91 @@ private:
     return tasks;
   }
 
+  // 语法错误时返回 false；根不是对象时返回 true 且 isObject 为 false
+  static bool readDetailJson(std::string_view raw, TodoDetailJson& out, std::string& error){
+    try{
+      sj::Reader reader(raw);
+      if(!reader.enterObject()){
+        reader.finish();
+        return true;
+      }
+      out.isObject = true;
+      auto bindString = [&](TodoJsonField<std::string>& field){
+        if(field.present) return reader.skip();
+        field.present = true;
+        field.typed = reader.readString(field.value);
+      };
+      auto bindInteger = [&](TodoJsonField<long long>& field){
+        if(field.present) return reader.skip();
+        field.present = true;
+        field.typed = reader.readInteger(field.value);
+      };
+      std::string_view key;
+      while(reader.nextMember(key)){
+        if(key == "name") bindString(out.name);
+        else if(key == "created_at") bindInteger(out.createdAt);
+        else if(key == "updated_at") bindInteger(out.updatedAt);
+        else if(key == "start_at") bindInteger(out.startAt);
+        else if(key == "deadline_at") bindInteger(out.deadlineAt);
+        else if(key == "repeat_seconds") bindInteger(out.repeatSeconds);
+        else if(key == "repeat_expr") bindString(out.repeatExpr);
+        else if(key == "start_time") bindString(out.startTime);
+        else if(key == "start") bindString(out.start);
+        else if(key == "deadline") bindString(out.deadline);
+        else if(key == "repeat") bindString(out.repeat);
+        else if(key == "note") bindString(out.note);
+        else if(key == "todo" && !out.todo.present){
+          out.todo.present = true;
+          sj::Token first = reader.next();
+          if(first == sj::Token::String){
+            out.todo.typed = true;
+            std::string text = trimCopy(std::string(reader.string()));
+            if(!text.empty()) out.todo.value.push_back(std::move(text));
+          }else if(first == sj::Token::StartArray){
+            out.todo.typed = true;
+            out.todoIsArray = true;
+            std::string item;
+            while(reader.nextElement()){
+              if(!reader.readString(item)){
+                out.todoItemsTyped = false;
+                continue;
+              }
+              std::string text = trimCopy(item);
+              if(!text.empty()) out.todo.value.push_back(std::move(text));
+            }
+          }else{
+            reader.skip(first);
+          }
+        }
+        else if(key == "details" && !out.details.present){
+          out.details.present = true;
+          out.details.typed = reader.enterArray();
+          if(!out.details.typed) continue;
+          while(reader.nextElement()){
+            TodoJsonDetail detail;
+            detail.isObject = reader.enterObject();
+            if(detail.isObject){
+              std::string_view detailKey;
+              while(reader.nextMember(detailKey)){
+                if(detailKey == "text") bindString(detail.text);
+                else if(detailKey == "time") bindString(detail.time);
+                else if(detailKey == "ts") bindInteger(detail.ts);
+                else reader.skip();
+              }
+            }
+            out.details.value.push_back(std::move(detail));
+          }
+        }
+        else reader.skip();
+      }
+      reader.finish();
+    }catch(const std::exception& ex){
+      error = ex.what();
+      return false;
+    }
+    return true;
+  }
+
   static bool loadTaskFromDetailJson(const std::filesystem::path& path,
                                      TodoTask& taskOut,
                                      std::string& error){
@@ -1548,27 +1706,25 @@ private:
       return false;
     }
 
-    sj::Value root;
-    try{
-      root = sj::parse(raw);
-    }catch(const std::exception& ex){
-      error = std::string("invalid JSON in ") + path.filename().string() + ": " + ex.what();
+    TodoDetailJson json;
+    std::string readError;
+    if(!readDetailJson(raw, json, readError)){
+      error = std::string("invalid JSON in ") + path.filename().string() + ": " + readError;
       return false;
     }
-    if(!root.isObject()){
+    if(!json.isObject){
       error = "invalid JSON in " + path.filename().string() + ": root must be object";
       return false;
     }
-    const sj::Object& obj = root.asObject();
 
     TodoTask task;
     task.name = path.stem().string();
-    if(auto it = obj.find("name"); it != obj.end()){
-      if(!it->second.isString()){
+    if(json.name.present){
+      if(!json.name.typed){
         error = "invalid `name` in " + path.filename().string();
         return false;
       }
-      std::string jsonName = trimCopy(it->second.asString());
+      std::string jsonName = trimCopy(json.name.value);
       if(!jsonName.empty()) task.name = jsonName;
     }
     if(task.name.empty() || !isValidName(task.name)){
@@ -1583,108 +1739,77 @@ private:
     task.repeatSeconds = 0;
     task.repeatExpr.clear();
 
-    if(auto it = obj.find("created_at"); it != obj.end()){
-      if(!it->second.isNumber()){
-        error = "invalid `created_at` in " + path.filename().string();
-        return false;
-      }
-      task.createdAt = it->second.asInteger();
-    }
-    if(auto it = obj.find("updated_at"); it != obj.end()){
-      if(!it->second.isNumber()){
-        error = "invalid `updated_at` in " + path.filename().string();
-        return false;
-      }
-      task.updatedAt = it->second.asInteger();
-    }
-    if(auto it = obj.find("start_at"); it != obj.end()){
-      if(!it->second.isNumber()){
-        error = "invalid `start_at` in " + path.filename().string();
-        return false;
-      }
-      task.startAt = it->second.asInteger();
-    }
-    if(auto it = obj.find("deadline_at"); it != obj.end()){
-      if(!it->second.isNumber()){
-        error = "invalid `deadline_at` in " + path.filename().string();
-        return false;
-      }
-      task.deadlineAt = it->second.asInteger();
-    }
-    if(auto it = obj.find("repeat_seconds"); it != obj.end()){
-      if(!it->second.isNumber()){
-        error = "invalid `repeat_seconds` in " + path.filename().string();
-        return false;
-      }
-      task.repeatSeconds = it->second.asInteger();
-      if(task.repeatSeconds < 0){
-        error = "invalid `repeat_seconds` in " + path.filename().string();
+    auto readInteger = [&](const TodoJsonField<long long>& field, const char* key, long long& target)->bool{
+      if(!field.present) return true;
+      if(!field.typed){
+        error = std::string("invalid `") + key + "` in " + path.filename().string();
         return false;
       }
+      target = field.value;
+      return true;
+    };
+    if(!readInteger(json.createdAt, "created_at", task.createdAt)) return false;
+    if(!readInteger(json.updatedAt, "updated_at", task.updatedAt)) return false;
+    if(!readInteger(json.startAt, "start_at", task.startAt)) return false;
+    if(!readInteger(json.deadlineAt, "deadline_at", task.deadlineAt)) return false;
+    if(!readInteger(json.repeatSeconds, "repeat_seconds", task.repeatSeconds)) return false;
+    if(task.repeatSeconds < 0){
+      error = "invalid `repeat_seconds` in " + path.filename().string();
+      return false;
     }
-    if(auto it = obj.find("repeat_expr"); it != obj.end()){
-      if(!it->second.isString()){
+    if(json.repeatExpr.present){
+      if(!json.repeatExpr.typed){
         error = "invalid `repeat_expr` in " + path.filename().string();
         return false;
       }
-      task.repeatExpr = trimCopy(it->second.asString());
+      task.repeatExpr = trimCopy(json.repeatExpr.value);
     }
-    if(auto it = obj.find("todo"); it != obj.end()){
-      if(it->second.isString()){
-        std::string text = trimCopy(it->second.asString());
-        if(!text.empty()) task.todoItems.push_back(text);
-      }else if(it->second.isArray()){
-        for(const auto& item : it->second.asArray()){
-          if(!item.isString()){
-            error = "invalid `todo` item in " + path.filename().string();
-            return false;
-          }
-          std::string text = trimCopy(item.asString());
-          if(!text.empty()) task.todoItems.push_back(std::move(text));
-        }
-      }else{
+    if(json.todo.present){
+      if(!json.todo.typed){
         error = "invalid `todo` in " + path.filename().string() + ": must be string or string array";
         return false;
       }
+      if(!json.todoItemsTyped){
+        error = "invalid `todo` item in " + path.filename().string();
+        return false;
+      }
+      task.todoItems = json.todo.value;
     }
-    if(auto it = obj.find("details"); it != obj.end()){
-      if(!it->second.isArray()){
+    if(json.details.present){
+      if(!json.details.typed){
         error = "invalid `details` in " + path.filename().string();
         return false;
       }
-      for(const auto& item : it->second.asArray()){
-        if(!item.isObject()){
+      for(const auto& item : json.details.value){
+        if(!item.isObject){
           error = "invalid detail entry in " + path.filename().string();
           return false;
         }
-        const sj::Object& detailObj = item.asObject();
         TodoDetailEntry entry;
-        if(auto v = detailObj.find("text"); v != detailObj.end()){
-          if(!v->second.isString()){
+        if(item.text.present){
+          if(!item.text.typed){
             error = "invalid detail text in " + path.filename().string();
             return false;
           }
-          entry.text = v->second.asString();
+          entry.text = item.text.value;
         }
         if(entry.text.empty()) continue;
-        if(auto v = detailObj.find("time"); v != detailObj.end()){
-          if(!v->second.isString()){
+        if(item.time.present){
+          if(!item.time.typed){
             error = "invalid detail time in " + path.filename().string();
             return false;
           }
-          if(!parseTimeExpr(v->second.asString(), nowSeconds(), entry.ts)){
+          if(!parseTimeExpr(item.time.value, nowSeconds(), entry.ts)){
             error = "invalid detail time in " + path.filename().string();
             return false;
           }
         }
-        if(entry.ts <= 0){
-          if(auto v = detailObj.find("ts"); v != detailObj.end()){
-            if(!v->second.isNumber()){
-              error = "invalid detail ts in " + path.filename().string();
-              return false;
-            }
-            entry.ts = v->second.asInteger();
+        if(entry.ts <= 0 && item.ts.present){
+          if(!item.ts.typed){
+            error = "invalid detail ts in " + path.filename().string();
+            return false;
           }
+          entry.ts = item.ts.value;
         }
         if(entry.ts <= 0) entry.ts = nowSeconds();
         task.details.push_back(std::move(entry));
@@ -1693,7 +1818,7 @@ private:
 
     // Human-readable fields have higher priority when present.
     std::string payloadError;
-    std::optional<TodoEditorPayload> payload = parseEditorPayload(raw, task, payloadError);
+    std::optional<TodoEditorPayload> payload = editorPayloadFromJson(json, task, payloadError);
     if(!payload){
       error = "invalid editor fields in " + path.filename().string() + ": " + payloadError;
       return false;
@@ -1830,30 +1955,16 @@ private:
     return yes;
   }
 
-  static std::optional<TodoEditorPayload> parseEditorPayload(const std::string& raw,
-                                                             const TodoTask& task,
-                                                             std::string& error){
-    sj::Value root;
-    try{
-      root = sj::parse(raw);
-    }catch(const std::exception& ex){
-      error = std::string("invalid JSON: ") + ex.what();
-      return std::nullopt;
-    }
-    if(!root.isObject()){
-      error = "invalid JSON: root must be an object";
-      return std::nullopt;
-    }
-
-    const sj::Object& obj = root.asObject();
-    auto readString = [&](const std::string& key, std::string& target)->bool{
-      auto it = obj.find(key);
-      if(it == obj.end()) return true;
-      if(!it->second.isString()){
-        error = "invalid JSON: `" + key + "` must be a string";
+  static std::optional<TodoEditorPayload> editorPayloadFromJson(const TodoDetailJson& json,
+                                                                const TodoTask& task,
+                                                                std::string& error){
+    auto readString = [&](const TodoJsonField<std::string>& field, const char* key, std::string& target)->bool{
+      if(!field.present) return true;
+      if(!field.typed){
+        error = std::string("invalid JSON: `") + key + "` must be a string";
         return false;
       }
-      target = trimCopy(it->second.asString());
+      target = trimCopy(field.value);
       return true;
     };
 
@@ -1865,30 +1976,22 @@ private:
     std::vector<std::string> todoItems = normalizedTodoItems(task.todoItems);
     std::string note;
 
-    if(!readString("start_time", startExpr)) return std::nullopt;
-    if(!readString("start", startExpr)) return std::nullopt;
-    if(!readString("deadline", deadlineExpr)) return std::nullopt;
-    if(!readString("repeat", repeatExpr)) return std::nullopt;
-    if(!readString("note", note)) return std::nullopt;
-
-    if(auto it = obj.find("todo"); it != obj.end()){
-      todoItems.clear();
-      if(it->second.isString()){
-        std::string text = trimCopy(it->second.asString());
-        if(!text.empty()) todoItems.push_back(text);
-      }else if(it->second.isArray()){
-        for(const auto& item : it->second.asArray()){
-          if(!item.isString()){
-            error = "invalid JSON: `todo` must be string array";
-            return std::nullopt;
-          }
-          std::string text = trimCopy(item.asString());
-          if(!text.empty()) todoItems.push_back(std::move(text));
-        }
-      }else{
+    if(!readString(json.startTime, "start_time", startExpr)) return std::nullopt;
+    if(!readString(json.start, "start", startExpr)) return std::nullopt;
+    if(!readString(json.deadline, "deadline", deadlineExpr)) return std::nullopt;
+    if(!readString(json.repeat, "repeat", repeatExpr)) return std::nullopt;
+    if(!readString(json.note, "note", note)) return std::nullopt;
+
+    if(json.todo.present){
+      if(!json.todo.typed){
         error = "invalid JSON: `todo` must be string or string array";
         return std::nullopt;
       }
+      if(!json.todoItemsTyped){
+        error = "invalid JSON: `todo` must be string array";
+        return std::nullopt;
+      }
+      todoItems = json.todo.value;
     }
     note = trimCopy(note);
     if(!note.empty()){
@@ -1978,27 +2081,24 @@ private:
       std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
 
       std::string parseError;
-      try{
-        sj::Value root = sj::parse(content);
-        if(!root.isObject()){
-          parseError = "root must be object";
+      TodoDetailJson json;
+      std::string readError;
+      if(!readDetailJson(content, json, readError)){
+        parseError = "invalid JSON: " + readError;
+      }else if(!json.isObject){
+        parseError = "root must be object";
+      }else if(json.name.present){
+        if(!json.name.typed){
+          parseError = "`name` must be string";
         }else{
-          if(const sj::Value* v = root.find("name"); v){
-            if(!v->isString()){
-              parseError = "`name` must be string";
-            }else{
-              std::string editedName = trimCopy(v->asString());
-              if(!editedName.empty() && editedName != task.name){
-                parseError = "`name` cannot be changed in edit mode";
-              }
-            }
+          std::string editedName = trimCopy(json.name.value);
+          if(!editedName.empty() && editedName != task.name){
+            parseError = "`name` cannot be changed in edit mode";
           }
         }
-      }catch(const std::exception& ex){
-        parseError = std::string("invalid JSON: ") + ex.what();
       }
       if(parseError.empty()){
-        std::optional<TodoEditorPayload> payload = parseEditorPayload(content, task, parseError);
+        std::optional<TodoEditorPayload> payload = editorPayloadFromJson(json, task, parseError);
         if(payload){
           TodoTask sanitized = task;
           sanitized.startAt = payload->startAt;
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "dir_listing.hpp"
+
+// 工具补全数据源（待办、备份索引、cds 书签、消息列表）的解析结果缓存。
+// 每个数据源以 key 注册，附带它依赖的文件或目录以及一个可选的版本号：
+// 查询时只对这些路径做 stat，设备号、inode、修改时间（纳秒）与大小都未变且
+// 版本号相同就直接返回常驻的结果，不再读取或解析 JSON。
+// 目录只能反映条目的增删改名；目录内文件被原地改写时由写入方或 inotify
+// 事件调用 invalidate。
+struct CompletionSourceStamp {
+  bool exists = false;
+  dev_t device = 0;
+  ino_t inode = 0;
+  int64_t mtimeNs = 0;
+  int64_t size = 0;
+
+  bool operator==(const CompletionSourceStamp& other) const {
+    return exists == other.exists && device == other.device && inode == other.inode &&
+           mtimeNs == other.mtimeNs && size == other.size;
+  }
+  bool operator!=(const CompletionSourceStamp& other) const { return !(*this == other); }
+};
+
+inline CompletionSourceStamp completion_source_stamp(const std::string& path){
+  CompletionSourceStamp stamp;
+  struct stat st{};
+  if(::stat(path.c_str(), &st) != 0) return stamp;
+  stamp.exists = true;
+  stamp.device = st.st_dev;
+  stamp.inode = st.st_ino;
+  stamp.mtimeNs = dir_listing_mtime_ns(st);
+  stamp.size = static_cast<int64_t>(st.st_size);
+  return stamp;
+}
+
+class CompletionDataCache {
+public:
+  // 返回 key 对应的数据；依赖未变化时复用缓存，否则调用 load() 重新生成。
+  // 同一个 key 必须始终使用同一个类型 T。结果不可变，可跨线程持有。
+  template <typename T, typename Loader>
+  std::shared_ptr<const T> get(const std::string& key,
+                               const std::vector<std::string>& paths,
+                               uint64_t version,
+                               Loader&& load){
+    std::vector<CompletionSourceStamp> stamps;
+    stamps.reserve(paths.size());
+    for(const auto& path : paths) stamps.push_back(completion_source_stamp(path));
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = entries_.find(key);
+      if(it != entries_.end()){
+        const Entry& entry = it->second;
+        if(entry.type == typeTag<T>() && entry.version == version &&
+           entry.paths == paths && entry.stamps == stamps){
+          return std::static_pointer_cast<const T>(entry.data);
+        }
+      }
+    }
+
+    // 加载放在锁外，慢的数据源不会阻塞其他数据源的查询
+    auto data = std::make_shared<const T>(load());
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& entry = entries_[key];
+    entry.type = typeTag<T>();
+    entry.version = version;
+    entry.paths = paths;
+    entry.stamps = std::move(stamps);
+    entry.data = data;
+    return data;
+  }
+
+  void invalidate(const std::string& key){
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.erase(key);
+  }
+
+  void clear(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+  }
+
+private:
+  struct Entry {
+    const void* type = nullptr;
+    uint64_t version = 0;
+    std::vector<std::string> paths;
+    std::vector<CompletionSourceStamp> stamps;
+    std::shared_ptr<const void> data;
+  };
+
+  template <typename T>
+  static const void* typeTag(){
+    static const char tag = 0;
+    return &tag;
+  }
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, Entry> entries_;
+};
+
+inline CompletionDataCache& completion_data_cache(){
+  static CompletionDataCache cache;
+  return cache;
+}
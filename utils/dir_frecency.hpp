@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+// cd/cds 访问过的目录及其 frecency（思路同 zoxide）：每次进入目录 rank 加 1 并记下时间；
+// 所有 rank 之和超过上限时整体按比例缩小，并丢弃缩到 1 以下的目录，库因此不会无限增长，
+// 很久不去的目录会自然淘汰。查询时 rank 再按距上次访问的时间加权。
+// 文件为紧凑的二进制格式：魔数、版本、条目数，之后每条为 rank(double)、
+// 访问时间(int64，秒)、路径长度(uint32) 与路径字节，均为本机字节序。
+struct DirFrecencyEntry {
+  std::string path;
+  double rank = 0.0;
+  int64_t lastAccess = 0;
+};
+
+inline constexpr char kDirFrecencyMagic[4] = {'M', 'C', 'Z', 'D'};
+inline constexpr uint32_t kDirFrecencyVersion = 1;
+inline constexpr double kDirFrecencyMaxTotalRank = 10000.0;
+
+inline std::vector<DirFrecencyEntry> dir_frecency_load(const std::string& file){
+  std::vector<DirFrecencyEntry> entries;
+  std::ifstream in(file, std::ios::binary);
+  if(!in.good()) return entries;
+  std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  size_t at = 0;
+  auto take = [&](void* out, size_t size){
+    if(data.size() - at < size) return false;
+    std::memcpy(out, data.data() + at, size);
+    at += size;
+    return true;
+  };
+  char magic[4];
+  uint32_t version = 0;
+  uint32_t count = 0;
+  if(!take(magic, sizeof(magic)) || std::memcmp(magic, kDirFrecencyMagic, sizeof(magic)) != 0) return entries;
+  if(!take(&version, sizeof(version)) || version != kDirFrecencyVersion) return entries;
+  if(!take(&count, sizeof(count))) return entries;
+  entries.reserve(std::min<size_t>(count, data.size() / 20));
+  for(uint32_t i = 0; i < count; ++i){
+    DirFrecencyEntry entry;
+    uint32_t length = 0;
+    if(!take(&entry.rank, sizeof(entry.rank)) || !take(&entry.lastAccess, sizeof(entry.lastAccess)) ||
+       !take(&length, sizeof(length)) || data.size() - at < length){
+      break;
+    }
+    entry.path.assign(data.data() + at, length);
+    at += length;
+    entries.push_back(std::move(entry));
+  }
+  return entries;
+}
+
+// 先写临时文件再改名，别的会话读到的总是完整的库；临时文件名带进程号，几个会话同时 cd 也不会互相覆盖
+inline bool dir_frecency_save(const std::string& file, const std::vector<DirFrecencyEntry>& entries){
+  std::string data(kDirFrecencyMagic, sizeof(kDirFrecencyMagic));
+  auto put = [&](const void* src, size_t size){ data.append(static_cast<const char*>(src), size); };
+  uint32_t version = kDirFrecencyVersion;
+  uint32_t count = static_cast<uint32_t>(entries.size());
+  put(&version, sizeof(version));
+  put(&count, sizeof(count));
+  for(const auto& entry : entries){
+    uint32_t length = static_cast<uint32_t>(entry.path.size());
+    put(&entry.rank, sizeof(entry.rank));
+    put(&entry.lastAccess, sizeof(entry.lastAccess));
+    put(&length, sizeof(length));
+    data += entry.path;
+  }
+  std::error_code ec;
+  std::filesystem::create_directories(std::filesystem::path(file).parent_path(), ec);
+  std::string tmp = file + "." + std::to_string(static_cast<long long>(::getpid())) + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if(!out.good()) return false;
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if(!out.good()) return false;
+  }
+  std::filesystem::rename(tmp, file, ec);
+  if(ec){
+    std::filesystem::remove(tmp, ec);
+    return false;
+  }
+  return true;
+}
+
+// 访问时间越近权重越高：一小时内 ×4，一天内 ×2，一周内 ×0.5，更早 ×0.25
+inline double dir_frecency_score(const DirFrecencyEntry& entry, int64_t now){
+  int64_t age = now - entry.lastAccess;
+  if(age < 3600) return entry.rank * 4.0;
+  if(age < 86400) return entry.rank * 2.0;
+  if(age < 604800) return entry.rank * 0.5;
+  return entry.rank * 0.25;
+}
+
+inline void dir_frecency_age(std::vector<DirFrecencyEntry>& entries){
+  double total = 0.0;
+  for(const auto& entry : entries) total += entry.rank;
+  if(total <= kDirFrecencyMaxTotalRank) return;
+  double factor = 0.9 * kDirFrecencyMaxTotalRank / total;
+  for(auto& entry : entries) entry.rank *= factor;
+  entries.erase(std::remove_if(entries.begin(), entries.end(),
+                               [](const DirFrecencyEntry& entry){ return entry.rank < 1.0; }),
+                entries.end());
+}
+
+inline bool dir_frecency_record(const std::string& file, const std::string& dir, int64_t now){
+  if(dir.empty()) return false;
+  std::vector<DirFrecencyEntry> entries = dir_frecency_load(file);
+  auto it = std::find_if(entries.begin(), entries.end(),
+                         [&](const DirFrecencyEntry& entry){ return entry.path == dir; });
+  if(it == entries.end()){
+    entries.push_back(DirFrecencyEntry{dir, 1.0, now});
+  }else{
+    it->rank += 1.0;
+    it->lastAccess = now;
+  }
+  dir_frecency_age(entries);
+  return dir_frecency_save(file, entries);
+}
+
+inline bool dir_frecency_forget(const std::string& file, const std::string& dir){
+  std::vector<DirFrecencyEntry> entries = dir_frecency_load(file);
+  auto it = std::remove_if(entries.begin(), entries.end(),
+                           [&](const DirFrecencyEntry& entry){ return entry.path == dir; });
+  if(it == entries.end()) return true;
+  entries.erase(it, entries.end());
+  return dir_frecency_save(file, entries);
+}
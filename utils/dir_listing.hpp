@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// 路径补全用的目录列表缓存。条目类型尽量取自 readdir 的 d_type，只有类型未知或是
+// 符号链接时才补一次 stat（与 directory_entry::is_directory 一样跟随链接）。
+// 每次查询只对目录本身做一次 stat：设备号、inode 或修改时间（纳秒）变化即重新列出，
+// 因此 cd 之后相对路径指向别的目录也能被识别；cd 仍会主动清空缓存。
+enum class DirEntryKind : uint8_t { Other, File, Dir };
+
+struct DirListingEntry {
+  std::string name;
+  std::string lowerName;
+  DirEntryKind kind = DirEntryKind::Other;
+};
+
+struct DirListing {
+  std::vector<DirListingEntry> entries;
+  dev_t device = 0;
+  ino_t inode = 0;
+  int64_t mtimeNs = 0;
+  int64_t listedAtNs = 0;
+};
+
+inline int64_t dir_listing_mtime_ns(const struct stat& st){
+#if defined(__APPLE__)
+  return static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+  return static_cast<int64_t>(st.st_mtime) * 1000000000;
+#else
+  return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+class DirListingCache {
+public:
+  static constexpr size_t kCapacity = 64;
+
+  // 返回 path 的列表；目录不可读时返回 nullptr。结果不可变，可跨线程持有。
+  std::shared_ptr<const DirListing> lookup(const std::string& path){
+    const std::string& key = path.empty() ? kDot : path;
+    struct stat st{};
+    if(::stat(key.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)){
+      invalidate(key);
+      return nullptr;
+    }
+    int64_t mtime = dir_listing_mtime_ns(st);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = index_.find(key);
+      if(it != index_.end()){
+        const DirListing& cached = *it->second->listing;
+        // 列出时目录刚被修改过的话，同一时间戳内可能还有未看到的变化，不能凭 mtime 复用
+        bool settled = cached.listedAtNs - cached.mtimeNs > kRacyWindowNs;
+        if(settled && cached.device == st.st_dev && cached.inode == st.st_ino && cached.mtimeNs == mtime){
+          lru_.splice(lru_.begin(), lru_, it->second);
+          return it->second->listing;
+        }
+      }
+    }
+
+    auto listing = readListing(key);
+    if(!listing) return nullptr;
+    listing->device = st.st_dev;
+    listing->inode = st.st_ino;
+    listing->mtimeNs = mtime;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if(it != index_.end()){
+      it->second->listing = listing;
+      lru_.splice(lru_.begin(), lru_, it->second);
+    }else{
+      lru_.push_front(Slot{key, listing});
+      index_[key] = lru_.begin();
+      while(lru_.size() > kCapacity){
+        index_.erase(lru_.back().key);
+        lru_.pop_back();
+      }
+    }
+    return listing;
+  }
+
+  void invalidate(const std::string& path){
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(path);
+    if(it == index_.end()) return;
+    lru_.erase(it->second);
+    index_.erase(it);
+  }
+
+  void clear(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    index_.clear();
+    lru_.clear();
+  }
+
+private:
+  static constexpr int64_t kRacyWindowNs = 2000000000;
+  inline static const std::string kDot = ".";
+
+  struct Slot {
+    std::string key;
+    std::shared_ptr<const DirListing> listing;
+  };
+
+  static std::shared_ptr<DirListing> readListing(const std::string& path){
+    DIR* dir = ::opendir(path.c_str());
+    if(!dir) return nullptr;
+    auto listing = std::make_shared<DirListing>();
+    listing->listedAtNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    std::string base = path;
+    if(!base.empty() && base.back() != '/') base.push_back('/');
+    while(dirent* ent = ::readdir(dir)){
+      const char* raw = ent->d_name;
+      if(raw[0] == '.' && (raw[1] == '\0' || (raw[1] == '.' && raw[2] == '\0'))) continue;
+      DirListingEntry entry;
+      entry.name = raw;
+      entry.kind = kindOf(base, *ent);
+      entry.lowerName = entry.name;
+      for(char& ch : entry.lowerName){
+        if(ch >= 'A' && ch <= 'Z') ch = static_cast<char>(ch - 'A' + 'a');
+      }
+      listing->entries.push_back(std::move(entry));
+    }
+    ::closedir(dir);
+    return listing;
+  }
+
+  static DirEntryKind kindOf(const std::string& base, const dirent& ent){
+#ifdef DT_DIR
+    switch(ent.d_type){
+      case DT_DIR: return DirEntryKind::Dir;
+      case DT_REG: return DirEntryKind::File;
+      case DT_UNKNOWN:
+      case DT_LNK: break;
+      default: return DirEntryKind::Other;
+    }
+#endif
+    struct stat st{};
+    if(::stat((base + ent.d_name).c_str(), &st) != 0) return DirEntryKind::Other;
+    if(S_ISDIR(st.st_mode)) return DirEntryKind::Dir;
+    if(S_ISREG(st.st_mode)) return DirEntryKind::File;
+    return DirEntryKind::Other;
+  }
+
+  std::mutex mutex_;
+  std::list<Slot> lru_;
+  std::unordered_map<std::string, std::list<Slot>::iterator> index_;
+};
+
+inline DirListingCache& dir_listing_cache(){
+  static DirListingCache cache;
+  return cache;
+}
@@ -0,0 +1,504 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+#endif
+#endif
+
+// 主循环的事件源：标准输入、被监视的文件、定时器、终端尺寸变化以及后台线程唤醒。
+// Linux 上由 epoll + inotify + timerfd 驱动，空闲时没有任何系统调用；
+// 其他平台退化为带超时的轮询，被监视的来源在每次超时后都视为可能已变化。
+struct LoopEvents {
+  static constexpr unsigned Input   = 1u << 0;
+  static constexpr unsigned Message = 1u << 1;
+  static constexpr unsigned Llm     = 1u << 2;
+  static constexpr unsigned Todo    = 1u << 3;
+  static constexpr unsigned Timer   = 1u << 4;
+  static constexpr unsigned Resize  = 1u << 5;
+  static constexpr unsigned Wake    = 1u << 6;
+  static constexpr unsigned Closed  = 1u << 7;
+  static constexpr unsigned Path    = 1u << 8;
+  static constexpr unsigned Status  = 1u << 9;
+};
+
+// 监视目录 dir；name 非空时只关心该目录下同名条目的变化（用于监视单个文件，
+// 这样原子替换写入与文件稍后才创建的情况也能被捕获）。
+struct LoopWatch {
+  std::string dir;
+  std::string name;
+  bool operator==(const LoopWatch& other) const { return dir == other.dir && name == other.name; }
+};
+
+#ifndef _WIN32
+inline int g_event_loop_signal_fd = -1;
+
+inline void event_loop_on_sigwinch(int){
+  int saved = errno;
+  if(g_event_loop_signal_fd >= 0){
+    char byte = 'R';
+    (void)::write(g_event_loop_signal_fd, &byte, 1);
+  }
+  errno = saved;
+}
+#endif
+
+// 后台线程改变了提示符指示器等状态时调用，让主循环立即重绘。
+inline void event_loop_notify(){
+#ifndef _WIN32
+  if(g_event_loop_signal_fd >= 0){
+    char byte = 'W';
+    (void)::write(g_event_loop_signal_fd, &byte, 1);
+  }
+#endif
+}
+
+class EventLoop {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  EventLoop() = default;
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+  ~EventLoop(){ close(); }
+
+  void open(){
+#ifndef _WIN32
+    int fds[2];
+    if(::pipe(fds) == 0){
+      for(int fd : fds){
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+      }
+      wakeRead_ = fds[0];
+      wakeWrite_ = fds[1];
+      g_event_loop_signal_fd = wakeWrite_;
+#ifdef SIGWINCH
+      std::signal(SIGWINCH, event_loop_on_sigwinch);
+#endif
+    }
+#endif
+#if defined(__linux__)
+    epoll_ = ::epoll_create1(EPOLL_CLOEXEC);
+    inotify_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    timer_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(epoll_ >= 0){
+      addToEpoll(STDIN_FILENO);
+      addToEpoll(wakeRead_);
+      addToEpoll(inotify_);
+      addToEpoll(timer_);
+    }
+#endif
+  }
+
+  void close(){
+#ifndef _WIN32
+#ifdef SIGWINCH
+    if(wakeWrite_ >= 0) std::signal(SIGWINCH, SIG_DFL);
+#endif
+    if(g_event_loop_signal_fd == wakeWrite_) g_event_loop_signal_fd = -1;
+    closeFd(wakeRead_);
+    closeFd(wakeWrite_);
+#endif
+#if defined(__linux__)
+    closeFd(timer_);
+    closeFd(inotify_);
+    closeFd(epoll_);
+    watchesByFd_.clear();
+#endif
+    sources_.clear();
+  }
+
+  // 设置某个事件位对应的监视集合；与当前集合相同时不做任何系统调用。
+  void watch(unsigned event, const std::vector<LoopWatch>& watches){
+    Source& source = sources_[event];
+    if(source.configured && source.watches == watches) return;
+    removeWatches(event, source);
+    source.watches = watches;
+    source.configured = true;
+    addWatches(event, source);
+  }
+
+  // 下一个定时唤醒点（闪烁相位、待办截止时间等）；nullopt 表示无需定时。
+  void setDeadline(std::optional<Clock::time_point> deadline){
+    deadline_ = deadline;
+#if defined(__linux__)
+    if(timer_ < 0 || armed_ == deadline) return;
+    if(!deadline){
+      // 撤掉旧的定时，免得之后被已经作废的截止时间唤醒
+      itimerspec disarm{};
+      if(::timerfd_settime(timer_, 0, &disarm, nullptr) == 0) armed_.reset();
+      return;
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline->time_since_epoch()).count();
+    if(ns <= 0) ns = 1;
+    itimerspec spec{};
+    spec.it_value.tv_sec = static_cast<time_t>(ns / 1000000000LL);
+    spec.it_value.tv_nsec = static_cast<long>(ns % 1000000000LL);
+    if(spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) spec.it_value.tv_nsec = 1;
+    if(::timerfd_settime(timer_, TFD_TIMER_ABSTIME, &spec, nullptr) == 0){
+      armed_ = deadline;
+    }
+#endif
+  }
+
+  // 阻塞直到至少一个事件发生，返回 LoopEvents 位集合；被信号打断时返回 0。
+  unsigned wait(){
+    changed_.clear();
+#if defined(__linux__)
+    if(epoll_ >= 0) return waitEpoll(-1);
+#endif
+#ifdef _WIN32
+    return waitWindows();
+#else
+    return waitPoll();
+#endif
+  }
+
+  // 不阻塞地收取已经发生的事件；只有 Linux 上有意义，其他平台返回 0。
+  unsigned poll(){
+    changed_.clear();
+#if defined(__linux__)
+    if(epoll_ >= 0) return waitEpoll(0);
+#endif
+    return 0;
+  }
+
+  // 上一次 wait()/poll() 中该事件位下发生变化的路径（目录，或目录/条目名）。
+  // 返回空表示不知道具体是哪些路径（事件队列溢出、退化为轮询或变化过多）。
+  std::vector<std::string> takeChangedPaths(unsigned event){
+    auto it = changed_.find(event);
+    if(it == changed_.end() || it->second.saturated) return {};
+    return std::move(it->second.paths);
+  }
+
+private:
+  struct Source {
+    std::vector<LoopWatch> watches;
+    bool configured = false;
+    bool degraded = false; // 有监视未能建立，需要定期轮询并重试
+    bool polling = false;  // inotify 监视数已达上限：放弃该来源的全部监视，只按固定间隔轮询，不再重试
+#if defined(__linux__)
+    std::vector<int> wds;
+#endif
+  };
+
+  static constexpr int kFallbackPollMs = 200;
+  static constexpr int kDegradedRetryMs = 1000;
+  static constexpr int kExhaustedPollMs = 2000;
+  static constexpr size_t kMaxChangedPaths = 4096;
+
+  struct ChangedPaths {
+    std::vector<std::string> paths;
+    bool saturated = false;
+  };
+
+  void recordChanged(unsigned event, std::string path){
+    ChangedPaths& changed = changed_[event];
+    if(changed.saturated) return;
+    if(path.empty() || changed.paths.size() >= kMaxChangedPaths){
+      changed.saturated = true;
+      changed.paths.clear();
+      return;
+    }
+    changed.paths.push_back(std::move(path));
+  }
+
+  std::unordered_map<unsigned, Source> sources_;
+  std::unordered_map<unsigned, ChangedPaths> changed_;
+  std::optional<Clock::time_point> deadline_;
+#ifndef _WIN32
+  int wakeRead_ = -1;
+  int wakeWrite_ = -1;
+
+  static void closeFd(int& fd){
+    if(fd >= 0) ::close(fd);
+    fd = -1;
+  }
+
+  unsigned drainWake(){
+    unsigned events = 0;
+    char bytes[64];
+    while(true){
+      ssize_t n = ::read(wakeRead_, bytes, sizeof(bytes));
+      if(n <= 0) break;
+      for(ssize_t i = 0; i < n; ++i){
+        events |= (bytes[i] == 'R') ? LoopEvents::Resize : LoopEvents::Wake;
+      }
+    }
+    return events;
+  }
+#endif
+
+  int timeoutUntilDeadline(int capMs) const {
+    if(!deadline_) return capMs;
+    // 向上取整，避免在截止前一毫秒醒来后再空转一次
+    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(*deadline_ - Clock::now()).count();
+    if(remaining < 0) remaining = 0;
+    if(capMs >= 0 && remaining > capMs) return capMs;
+    return static_cast<int>(remaining);
+  }
+
+  unsigned deadlineEvents() const {
+    return (deadline_ && Clock::now() >= *deadline_) ? LoopEvents::Timer : 0u;
+  }
+
+  unsigned polledSourceEvents(bool degradedOnly) const {
+    unsigned events = 0;
+    for(const auto& kv : sources_){
+      if(kv.second.watches.empty()) continue;
+      if(!degradedOnly || kv.second.degraded) events |= kv.first;
+    }
+    return events;
+  }
+
+  unsigned pollingSourceEvents() const {
+    unsigned events = 0;
+    for(const auto& kv : sources_){
+      if(kv.second.polling) events |= kv.first;
+    }
+    return events;
+  }
+
+#if defined(__linux__)
+  int epoll_ = -1;
+  int inotify_ = -1;
+  int timer_ = -1;
+  std::optional<Clock::time_point> armed_;
+  Clock::time_point nextPoll_{};  // 下一次报告 polling 来源的时间
+  struct WatchTarget {
+    unsigned event = 0;
+    std::string dir;
+    std::string name;
+    bool awaitingCreate = false; // 目标尚不存在，暂时监视最近的已存在祖先目录
+  };
+  std::unordered_map<int, std::vector<WatchTarget>> watchesByFd_;
+
+  void addToEpoll(int fd){
+    if(fd < 0) return;
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    ::epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &ev);
+  }
+
+  void addWatches(unsigned event, Source& source){
+    source.degraded = false;
+    source.polling = false;
+    source.wds.clear();
+    if(inotify_ < 0){
+      source.degraded = !source.watches.empty();
+      return;
+    }
+    const uint32_t mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+                          IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+    for(const auto& w : source.watches){
+      int wd = ::inotify_add_watch(inotify_, w.dir.c_str(), mask);
+      if(wd >= 0){
+        source.wds.push_back(wd);
+        watchesByFd_[wd].push_back(WatchTarget{event, w.dir, w.name, false});
+        continue;
+      }
+      if(errno == ENOSPC || errno == ENOMEM){
+        // 监视数用完了：重试只会反复增删监视，留着已建的也只会挤占其他来源，改为单纯轮询
+        removeWatches(event, source);
+        source.polling = true;
+        nextPoll_ = Clock::now() + std::chrono::milliseconds(kExhaustedPollMs);
+        return;
+      }
+      // 目录还不存在时监视其最近的祖先，等路径出现后再重新建立监视
+      std::filesystem::path child(w.dir);
+      bool placed = false;
+      while((errno == ENOENT || errno == ENOTDIR) && child.has_parent_path() && child.parent_path() != child){
+        std::filesystem::path parent = child.parent_path();
+        wd = ::inotify_add_watch(inotify_, parent.c_str(), mask);
+        if(wd >= 0){
+          source.wds.push_back(wd);
+          watchesByFd_[wd].push_back(WatchTarget{event, parent.string(), child.filename().string(), true});
+          placed = true;
+          break;
+        }
+        child = parent;
+      }
+      if(!placed) source.degraded = true;
+    }
+  }
+
+  void removeWatches(unsigned event, Source& source){
+    for(int wd : source.wds){
+      auto it = watchesByFd_.find(wd);
+      if(it == watchesByFd_.end()) continue;
+      // 同一目录可能被多个来源共享（inotify 对同一路径返回同一个 wd）
+      auto& targets = it->second;
+      targets.erase(std::remove_if(targets.begin(), targets.end(), [&](const WatchTarget& t){
+        return t.event == event;
+      }), targets.end());
+      if(!targets.empty()) continue;
+      ::inotify_rm_watch(inotify_, wd);
+      watchesByFd_.erase(it);
+    }
+    source.wds.clear();
+  }
+
+  unsigned drainInotify(){
+    unsigned events = 0;
+    std::vector<unsigned> rearm;
+    alignas(inotify_event) char buffer[4096];
+    while(true){
+      ssize_t n = ::read(inotify_, buffer, sizeof(buffer));
+      if(n <= 0) break;
+      for(char* ptr = buffer; ptr < buffer + n; ){
+        auto* ev = reinterpret_cast<inotify_event*>(ptr);
+        ptr += sizeof(inotify_event) + ev->len;
+        if(ev->mask & IN_Q_OVERFLOW){
+          // 事件队列溢出：所有来源都可能漏掉了变化
+          for(const auto& kv : sources_){
+            if(kv.second.watches.empty()) continue;
+            events |= kv.first;
+            recordChanged(kv.first, std::string());
+          }
+          continue;
+        }
+        auto it = watchesByFd_.find(ev->wd);
+        if(it == watchesByFd_.end()) continue;
+        std::string name = (ev->len > 0) ? std::string(ev->name) : std::string();
+        bool gone = (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) != 0;
+        for(const auto& target : it->second){
+          bool matched = target.name.empty() || target.name == name;
+          if(gone || matched){
+            events |= target.event;
+            recordChanged(target.event, name.empty() ? target.dir : target.dir + "/" + name);
+          }
+          if(gone || (target.awaitingCreate && matched)){
+            rearm.push_back(target.event);
+          }
+        }
+        if(ev->mask & IN_IGNORED){
+          for(auto& kv : sources_){
+            auto& wds = kv.second.wds;
+            wds.erase(std::remove(wds.begin(), wds.end(), ev->wd), wds.end());
+          }
+          watchesByFd_.erase(it);
+        }
+      }
+    }
+    for(unsigned event : rearm){
+      auto src = sources_.find(event);
+      if(src == sources_.end()) continue;
+      removeWatches(event, src->second);
+      addWatches(event, src->second);
+    }
+    return events;
+  }
+
+  void retryDegraded(){
+    for(auto& kv : sources_){
+      if(!kv.second.degraded) continue;
+      removeWatches(kv.first, kv.second);
+      addWatches(kv.first, kv.second);
+    }
+  }
+
+  // timeoutMs 为 -1 时一直等（有退化的来源时改为定期重试，有轮询的来源时等到下一次轮询）
+  unsigned waitEpoll(int timeoutMs){
+    bool anyDegraded = false;
+    bool anyPolling = false;
+    for(const auto& kv : sources_){
+      anyDegraded = anyDegraded || kv.second.degraded;
+      anyPolling = anyPolling || kv.second.polling;
+    }
+    int timeout = (timeoutMs < 0 && anyDegraded) ? kDegradedRetryMs : timeoutMs;
+    if(timeoutMs < 0 && anyPolling){
+      auto untilPoll = std::chrono::ceil<std::chrono::milliseconds>(nextPoll_ - Clock::now()).count();
+      int capped = static_cast<int>(std::max<decltype(untilPoll)>(0, std::min<decltype(untilPoll)>(untilPoll, kExhaustedPollMs)));
+      if(timeout < 0 || capped < timeout) timeout = capped;
+    }
+    epoll_event evs[8];
+    int n = ::epoll_wait(epoll_, evs, 8, timeout);
+    if(n < 0){
+      if(errno == EINTR) return 0;
+      return LoopEvents::Closed;
+    }
+    unsigned events = 0;
+    if(anyPolling && timeoutMs != 0 && Clock::now() >= nextPoll_){
+      events |= pollingSourceEvents();
+      nextPoll_ = Clock::now() + std::chrono::milliseconds(kExhaustedPollMs);
+    }
+    if(n == 0){
+      if(timeoutMs == 0) return 0;
+      if(anyDegraded){
+        events |= polledSourceEvents(true);
+        retryDegraded();
+      }
+      return events;
+    }
+    for(int i = 0; i < n; ++i){
+      int fd = evs[i].data.fd;
+      if(fd == STDIN_FILENO){
+        if(evs[i].events & EPOLLIN) events |= LoopEvents::Input;
+        else if(evs[i].events & (EPOLLHUP | EPOLLERR)) events |= LoopEvents::Closed;
+      }else if(fd == wakeRead_){
+        events |= drainWake();
+      }else if(fd == inotify_){
+        events |= drainInotify();
+      }else if(fd == timer_){
+        uint64_t expirations = 0;
+        (void)::read(timer_, &expirations, sizeof(expirations));
+        armed_.reset();
+        events |= LoopEvents::Timer;
+      }
+    }
+    return events;
+  }
+#else
+  void addWatches(unsigned, Source& source){ source.degraded = !source.watches.empty(); }
+  void removeWatches(unsigned, Source&){}
+#endif
+
+#ifdef _WIN32
+  unsigned waitWindows(){
+    HANDLE hIn = GetStdHandle(STD_INPUT_HANDLE);
+    int timeout = timeoutUntilDeadline(kFallbackPollMs);
+    DWORD rc = WaitForSingleObject(hIn, static_cast<DWORD>(timeout));
+    if(rc == WAIT_OBJECT_0) return LoopEvents::Input | deadlineEvents();
+    if(rc != WAIT_TIMEOUT) return LoopEvents::Closed;
+    // 没有尺寸变化通知，超时时顺带重新确认终端宽度
+    return deadlineEvents() | polledSourceEvents(false) | LoopEvents::Resize;
+  }
+#else
+  unsigned waitPoll(){
+    struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {wakeRead_, POLLIN, 0}};
+    nfds_t count = (wakeRead_ >= 0) ? 2 : 1;
+    int timeout = timeoutUntilDeadline(kFallbackPollMs);
+    int rc = ::poll(fds, count, timeout);
+    if(rc < 0){
+      if(errno == EINTR) return 0;
+      return LoopEvents::Closed;
+    }
+    unsigned events = deadlineEvents();
+    if(rc == 0) return events | polledSourceEvents(false);
+    if(fds[0].revents & POLLIN) events |= LoopEvents::Input;
+    else if(fds[0].revents & (POLLHUP | POLLERR)) events |= LoopEvents::Closed;
+    if(count > 1 && (fds[1].revents & POLLIN)) events |= drainWake();
+    return events;
+  }
+#endif
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+// 按时间衰减的使用计数（frecency）。每个键保存一个权重和最后更新时间，
+// 读取时按半衰期折算到当前时刻；每次使用先折算再加 1。
+// 条目数超过上限时淘汰折算后权重最低的，文件因此保持很小。
+// 文件为文本，每行：权重、更新时间（秒）、键，以制表符分隔。
+class FrecencyTable {
+public:
+  static constexpr double kHalfLifeSeconds = 14.0 * 86400.0;
+  static constexpr size_t kMaxEntries = 4096;
+
+  double score(const std::string& key, int64_t now) const {
+    auto it = entries_.find(key);
+    if(it == entries_.end()) return 0.0;
+    return decayed(it->second, now);
+  }
+
+  void bump(const std::string& key, int64_t now){
+    Entry& entry = entries_[key];
+    entry.weight = decayed(entry, now) + 1.0;
+    entry.stamp = now;
+    if(entries_.size() > kMaxEntries + kMaxEntries / 4) prune(now);
+  }
+
+  void clear(){ entries_.clear(); }
+
+  bool load(const std::string& path){
+    std::ifstream in(path);
+    if(!in.good()) return false;
+    entries_.clear();
+    std::string line;
+    while(std::getline(in, line)){
+      size_t a = line.find('\t');
+      if(a == std::string::npos) continue;
+      size_t b = line.find('\t', a + 1);
+      if(b == std::string::npos || b + 1 >= line.size()) continue;
+      try{
+        Entry entry;
+        entry.weight = std::stod(line.substr(0, a));
+        entry.stamp = std::stoll(line.substr(a + 1, b - a - 1));
+        if(!(entry.weight > 0.0)) continue;
+        entries_[line.substr(b + 1)] = entry;
+      }catch(...){
+      }
+    }
+    return true;
+  }
+
+  // 先写以进程号区分的临时文件再改名：另一个会话读到的总是完整的文件，同时保存的会话也不会写进同一个临时文件
+  bool save(const std::string& path, int64_t now){
+    prune(now);
+    std::string tmp = path + "." + std::to_string(static_cast<long long>(::getpid())) + ".tmp";
+    {
+      std::ofstream out(tmp, std::ios::trunc);
+      if(!out.good()) return false;
+      for(const auto& [key, entry] : entries_){
+        out << entry.weight << '\t' << entry.stamp << '\t' << key << '\n';
+      }
+      if(!out.good()) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if(ec){
+      std::filesystem::remove(tmp, ec);
+      return false;
+    }
+    return true;
+  }
+
+private:
+  struct Entry {
+    double weight = 0.0;
+    int64_t stamp = 0;
+  };
+
+  static double decayed(const Entry& entry, int64_t now){
+    double age = static_cast<double>(std::max<int64_t>(0, now - entry.stamp));
+    return entry.weight * std::exp2(-age / kHalfLifeSeconds);
+  }
+
+  // 丢掉衰减到可以忽略的条目，并把条目数压回上限
+  void prune(int64_t now){
+    static constexpr double kNegligible = 0.02;
+    std::vector<std::pair<double, std::string>> ranked;
+    ranked.reserve(entries_.size());
+    for(const auto& [key, entry] : entries_){
+      double weight = decayed(entry, now);
+      if(weight >= kNegligible) ranked.emplace_back(weight, key);
+    }
+    if(ranked.size() == entries_.size() && ranked.size() <= kMaxEntries) return;
+    if(ranked.size() > kMaxEntries){
+      std::nth_element(ranked.begin(), ranked.begin() + static_cast<std::ptrdiff_t>(kMaxEntries), ranked.end(),
+                       [](const auto& lhs, const auto& rhs){ return lhs.first > rhs.first; });
+      ranked.resize(kMaxEntries);
+    }
+    std::unordered_map<std::string, Entry> kept;
+    kept.reserve(ranked.size());
+    for(const auto& item : ranked) kept.emplace(item.second, entries_[item.second]);
+    entries_.swap(kept);
+  }
+
+  std::unordered_map<std::string, Entry> entries_;
+};
+
+// 使用权重换算成补全排名加成：按对数增长并封顶。上限低于子串与前缀奖励之和，
+// 常用但只是零散命中的候选压不过真正的前缀命中。命令用法与 cds 的目录加成共用这一换算。
+constexpr double kFrecencyRankBonusScale = 2.0;
+constexpr double kFrecencyRankBonusCap = 8.0;
+
+inline double frecency_rank_bonus(double weight){
+  if(weight <= 0.0) return 0.0;
+  return std::min(kFrecencyRankBonusCap, kFrecencyRankBonusScale * std::log2(1.0 + weight));
+}
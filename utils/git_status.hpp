@@ -0,0 +1,1604 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "event_loop.hpp"
+#include "parallel.hpp"
+
+// 不启动 git 进程，直接读取仓库文件得到提示符用的分支、领先/落后提交数与改动标记。
+// 工作区是否有改动按 git 的 stat 缓存判断：索引里记录的 mtime/size/inode 与磁盘一致即视为未改，
+// 不一致或处于“racy”窗口内时才读文件内容重算对象 id。对象读取自带 DEFLATE 解码，支持松散对象与 pack。
+
+// ===== SHA-1 =====
+class GitSha1 {
+public:
+  void update(const void* data, size_t size){
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    total_ += size;
+    while(size > 0){
+      size_t take = std::min(size, sizeof(buffer_) - buffered_);
+      std::memcpy(buffer_ + buffered_, p, take);
+      buffered_ += take;
+      p += take;
+      size -= take;
+      if(buffered_ == sizeof(buffer_)){
+        block(buffer_);
+        buffered_ = 0;
+      }
+    }
+  }
+
+  std::string finish(){
+    uint64_t bits = total_ * 8;
+    uint8_t pad = 0x80;
+    update(&pad, 1);
+    uint8_t zero = 0;
+    while(buffered_ != 56) update(&zero, 1);
+    uint8_t length[8];
+    for(int i = 0; i < 8; ++i) length[i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+    update(length, 8);
+    std::string out(20, '\0');
+    for(int i = 0; i < 5; ++i){
+      for(int j = 0; j < 4; ++j) out[i * 4 + j] = static_cast<char>(h_[i] >> (24 - 8 * j));
+    }
+    return out;
+  }
+
+private:
+  static uint32_t rotl(uint32_t x, int n){ return (x << n) | (x >> (32 - n)); }
+
+  void block(const uint8_t* p){
+    uint32_t w[80];
+    for(int i = 0; i < 16; ++i){
+      w[i] = (uint32_t(p[i * 4]) << 24) | (uint32_t(p[i * 4 + 1]) << 16) | (uint32_t(p[i * 4 + 2]) << 8) | uint32_t(p[i * 4 + 3]);
+    }
+    for(int i = 16; i < 80; ++i) w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    uint32_t a = h_[0], b = h_[1], c = h_[2], d = h_[3], e = h_[4];
+    for(int i = 0; i < 80; ++i){
+      uint32_t f, k;
+      if(i < 20){ f = (b & c) | (~b & d); k = 0x5A827999; }
+      else if(i < 40){ f = b ^ c ^ d; k = 0x6ED9EBA1; }
+      else if(i < 60){ f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+      else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+      uint32_t t = rotl(a, 5) + f + e + k + w[i];
+      e = d; d = c; c = rotl(b, 30); b = a; a = t;
+    }
+    h_[0] += a; h_[1] += b; h_[2] += c; h_[3] += d; h_[4] += e;
+  }
+
+  uint32_t h_[5] = {0x67452301u, 0xEFCDAB89u, 0x98BADCFEu, 0x10325476u, 0xC3D2E1F0u};
+  uint8_t buffer_[64];
+  size_t buffered_ = 0;
+  uint64_t total_ = 0;
+};
+
+// ===== DEFLATE =====
+// 最小的 zlib/DEFLATE 解码器（RFC 1950/1951，结构同 zlib 自带的 puff），只用来读 git 对象
+class GitInflater {
+public:
+  // 解码一个 zlib 流；输出超过 maxOut 或数据损坏时返回 false。不校验 adler32
+  static bool zlib(const uint8_t* data, size_t size, std::string& out, size_t maxOut){
+    if(size < 2) return false;
+    unsigned cmf = data[0], flg = data[1];
+    if((cmf & 0x0f) != 8 || ((cmf << 8) | flg) % 31 != 0 || (flg & 0x20)) return false;
+    GitInflater inflater(data + 2, size - 2, out, maxOut);
+    try{
+      int last = 0;
+      do{
+        last = inflater.bits(1);
+        int type = inflater.bits(2);
+        if(type == 0) inflater.stored();
+        else if(type == 1) inflater.fixed();
+        else if(type == 2) inflater.dynamic();
+        else return false;
+      }while(!last);
+    }catch(const Failure&){
+      return false;
+    }
+    return true;
+  }
+
+private:
+  struct Failure {};
+  struct Huffman {
+    uint16_t count[16];
+    uint16_t symbol[288];
+  };
+
+  GitInflater(const uint8_t* in, size_t size, std::string& out, size_t maxOut)
+    : in_(in), size_(size), out_(out), maxOut_(maxOut) {}
+
+  int bits(int need){
+    uint32_t value = bitBuffer_;
+    while(bitCount_ < need){
+      if(pos_ >= size_) throw Failure{};
+      value |= uint32_t(in_[pos_++]) << bitCount_;
+      bitCount_ += 8;
+    }
+    bitBuffer_ = value >> need;
+    bitCount_ -= need;
+    return static_cast<int>(value & ((1u << need) - 1));
+  }
+
+  void emit(char c){
+    if(out_.size() >= maxOut_) throw Failure{};
+    out_.push_back(c);
+  }
+
+  void stored(){
+    bitBuffer_ = 0;
+    bitCount_ = 0;
+    if(size_ - pos_ < 4) throw Failure{};
+    unsigned len = in_[pos_] | (unsigned(in_[pos_ + 1]) << 8);
+    unsigned nlen = in_[pos_ + 2] | (unsigned(in_[pos_ + 3]) << 8);
+    pos_ += 4;
+    if(len != (~nlen & 0xffffu) || size_ - pos_ < len || out_.size() + len > maxOut_) throw Failure{};
+    out_.append(reinterpret_cast<const char*>(in_ + pos_), len);
+    pos_ += len;
+  }
+
+  int decode(const Huffman& h){
+    int code = 0, first = 0, index = 0;
+    for(int len = 1; len <= 15; ++len){
+      code |= bits(1);
+      int count = h.count[len];
+      if(code - count < first) return h.symbol[index + (code - first)];
+      index += count;
+      first += count;
+      first <<= 1;
+      code <<= 1;
+    }
+    throw Failure{};
+  }
+
+  // 返回 0 表示码表完整，大于 0 表示不完整，小于 0 表示过满
+  static int construct(Huffman& h, const uint16_t* lengths, int n){
+    for(int len = 0; len <= 15; ++len) h.count[len] = 0;
+    for(int s = 0; s < n; ++s) h.count[lengths[s]]++;
+    if(h.count[0] == n) return 0;
+    int left = 1;
+    for(int len = 1; len <= 15; ++len){
+      left <<= 1;
+      left -= h.count[len];
+      if(left < 0) return left;
+    }
+    uint16_t offs[16];
+    offs[1] = 0;
+    for(int len = 1; len < 15; ++len) offs[len + 1] = static_cast<uint16_t>(offs[len] + h.count[len]);
+    for(int s = 0; s < n; ++s){
+      if(lengths[s] != 0) h.symbol[offs[lengths[s]]++] = static_cast<uint16_t>(s);
+    }
+    return left;
+  }
+
+  void codes(const Huffman& lencode, const Huffman& distcode){
+    static const uint16_t lbase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                       35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint16_t lext[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                      3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t dbase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                       257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                       8193, 12289, 16385, 24577};
+    static const uint16_t dext[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                      7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    while(true){
+      int symbol = decode(lencode);
+      if(symbol < 256){
+        emit(static_cast<char>(symbol));
+        continue;
+      }
+      if(symbol == 256) return;
+      symbol -= 257;
+      if(symbol >= 29) throw Failure{};
+      size_t len = lbase[symbol] + bits(lext[symbol]);
+      int distSymbol = decode(distcode);
+      if(distSymbol >= 30) throw Failure{};
+      size_t dist = dbase[distSymbol] + bits(dext[distSymbol]);
+      if(dist > out_.size() || out_.size() + len > maxOut_) throw Failure{};
+      size_t from = out_.size() - dist;
+      for(size_t i = 0; i < len; ++i) out_.push_back(out_[from + i]);
+    }
+  }
+
+  void fixed(){
+    static Huffman lencode, distcode;
+    static const bool built = []{
+      uint16_t lengths[288];
+      int s = 0;
+      for(; s < 144; ++s) lengths[s] = 8;
+      for(; s < 256; ++s) lengths[s] = 9;
+      for(; s < 280; ++s) lengths[s] = 7;
+      for(; s < 288; ++s) lengths[s] = 8;
+      construct(lencode, lengths, 288);
+      for(s = 0; s < 30; ++s) lengths[s] = 5;
+      construct(distcode, lengths, 30);
+      return true;
+    }();
+    (void)built;
+    codes(lencode, distcode);
+  }
+
+  void dynamic(){
+    static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    int nlen = bits(5) + 257;
+    int ndist = bits(5) + 1;
+    int ncode = bits(4) + 4;
+    if(nlen > 286 || ndist > 30) throw Failure{};
+    uint16_t lengths[320] = {};
+    for(int i = 0; i < ncode; ++i) lengths[order[i]] = static_cast<uint16_t>(bits(3));
+    Huffman lencode, distcode;
+    if(construct(lencode, lengths, 19) != 0) throw Failure{};
+    int index = 0;
+    while(index < nlen + ndist){
+      int symbol = decode(lencode);
+      if(symbol < 16){
+        lengths[index++] = static_cast<uint16_t>(symbol);
+        continue;
+      }
+      uint16_t len = 0;
+      int repeat = 0;
+      if(symbol == 16){
+        if(index == 0) throw Failure{};
+        len = lengths[index - 1];
+        repeat = 3 + bits(2);
+      }else if(symbol == 17){
+        repeat = 3 + bits(3);
+      }else{
+        repeat = 11 + bits(7);
+      }
+      if(index + repeat > nlen + ndist) throw Failure{};
+      while(repeat--) lengths[index++] = len;
+    }
+    if(lengths[256] == 0) throw Failure{};
+    int err = construct(lencode, lengths, nlen);
+    if(err < 0 || (err > 0 && nlen - lencode.count[0] != 1)) throw Failure{};
+    err = construct(distcode, lengths + nlen, ndist);
+    if(err < 0 || (err > 0 && ndist - distcode.count[0] != 1)) throw Failure{};
+    codes(lencode, distcode);
+  }
+
+  const uint8_t* in_;
+  size_t size_;
+  size_t pos_ = 0;
+  uint32_t bitBuffer_ = 0;
+  int bitCount_ = 0;
+  std::string& out_;
+  size_t maxOut_;
+};
+
+// ===== Files, config, refs =====
+inline bool git_read_file(const std::string& path, std::string& out){
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if(!in.good()) return false;
+  std::streamoff size = in.tellg();
+  if(size < 0) return false;
+  out.resize(static_cast<size_t>(size));
+  in.seekg(0);
+  if(size > 0) in.read(&out[0], size);
+  out.resize(static_cast<size_t>(in.gcount()));
+  return true;
+}
+
+inline std::string git_trim(std::string_view text){
+  size_t b = 0, e = text.size();
+  while(b < e && std::isspace(static_cast<unsigned char>(text[b]))) ++b;
+  while(e > b && std::isspace(static_cast<unsigned char>(text[e - 1]))) --e;
+  return std::string(text.substr(b, e - b));
+}
+
+// 文件身份：内容变了这几项里至少有一项会变
+struct GitFileStamp {
+  bool exists = false;
+  int64_t mtimeNs = 0;
+  uint64_t size = 0;
+  uint64_t inode = 0;
+  bool operator==(const GitFileStamp& o) const {
+    return exists == o.exists && mtimeNs == o.mtimeNs && size == o.size && inode == o.inode;
+  }
+  bool operator!=(const GitFileStamp& o) const { return !(*this == o); }
+};
+
+inline GitFileStamp git_file_stamp(const std::string& path){
+  GitFileStamp stamp;
+#ifndef _WIN32
+  struct stat st{};
+  if(::stat(path.c_str(), &st) != 0) return stamp;
+  stamp.exists = true;
+#if defined(__APPLE__)
+  stamp.mtimeNs = int64_t(st.st_mtimespec.tv_sec) * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+  stamp.mtimeNs = int64_t(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+  stamp.size = static_cast<uint64_t>(st.st_size);
+  stamp.inode = static_cast<uint64_t>(st.st_ino);
+#else
+  std::error_code ec;
+  auto size = std::filesystem::file_size(path, ec);
+  if(ec) return stamp;
+  stamp.exists = true;
+  stamp.size = size;
+  stamp.mtimeNs = static_cast<int64_t>(std::filesystem::last_write_time(path, ec).time_since_epoch().count());
+#endif
+  return stamp;
+}
+
+// git 配置的极简解析：键为 "section.subsection.key"（section 与 key 转小写，subsection 保留大小写）。
+// 不处理 include 与续行，足够读取 branch.<名>.remote/merge 与 extensions.objectformat
+inline std::unordered_map<std::string, std::string> git_parse_config(const std::string& text){
+  std::unordered_map<std::string, std::string> out;
+  auto lower = [](std::string s){
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c){ return static_cast<char>(std::tolower(c)); });
+    return s;
+  };
+  std::string section;
+  size_t start = 0;
+  while(start < text.size()){
+    size_t end = text.find('\n', start);
+    if(end == std::string::npos) end = text.size();
+    std::string line = git_trim(std::string_view(text).substr(start, end - start));
+    start = end + 1;
+    if(line.empty() || line[0] == '#' || line[0] == ';') continue;
+    if(line[0] == '['){
+      size_t close = line.rfind(']');
+      std::string inner = line.substr(1, close == std::string::npos ? std::string::npos : close - 1);
+      size_t quote = inner.find('"');
+      if(quote == std::string::npos){
+        // 旧式 [section.sub] 写法
+        size_t dot = inner.find('.');
+        section = dot == std::string::npos ? lower(git_trim(inner))
+                                           : lower(git_trim(inner.substr(0, dot))) + "." + git_trim(inner.substr(dot + 1));
+      }else{
+        size_t endQuote = inner.rfind('"');
+        std::string sub = endQuote > quote ? inner.substr(quote + 1, endQuote - quote - 1) : std::string();
+        section = lower(git_trim(inner.substr(0, quote))) + "." + sub;
+      }
+      continue;
+    }
+    size_t eq = line.find('=');
+    std::string key = lower(git_trim(line.substr(0, eq)));
+    std::string value = eq == std::string::npos ? std::string("true") : git_trim(line.substr(eq + 1));
+    std::string cleaned;
+    bool quoted = false;
+    for(char c : value){
+      if(c == '"'){ quoted = !quoted; continue; }
+      if(!quoted && (c == '#' || c == ';')) break;
+      cleaned.push_back(c);
+    }
+    out[section + "." + key] = git_trim(cleaned);
+  }
+  return out;
+}
+
+struct GitRepoPaths {
+  std::string workTree;
+  std::string gitDir;    // 本工作树的 .git（链接工作树时为 .git/worktrees/<名>）
+  std::string commonDir; // 共享的对象库与引用所在目录
+  bool valid() const { return !gitDir.empty(); }
+  bool operator==(const GitRepoPaths& o) const {
+    return workTree == o.workTree && gitDir == o.gitDir && commonDir == o.commonDir;
+  }
+};
+
+// 从 start 向上找第一个含 .git 的目录；.git 可以是目录，也可以是写有 "gitdir: <路径>" 的文件
+inline GitRepoPaths git_find_repo(const std::string& start){
+  GitRepoPaths paths;
+  std::error_code ec;
+  std::filesystem::path dir(start);
+  while(!dir.empty()){
+    std::filesystem::path dotGit = dir / ".git";
+    auto status = std::filesystem::symlink_status(dotGit, ec);
+    if(!ec && std::filesystem::is_directory(status)){
+      paths.gitDir = dotGit.string();
+    }else if(!ec && std::filesystem::is_regular_file(status)){
+      std::string text;
+      if(git_read_file(dotGit.string(), text) && text.compare(0, 7, "gitdir:") == 0){
+        std::filesystem::path target(git_trim(std::string_view(text).substr(7)));
+        if(target.is_relative()) target = dir / target;
+        paths.gitDir = target.lexically_normal().string();
+      }
+    }
+    if(!paths.gitDir.empty()){
+      paths.workTree = dir.string();
+      std::string common;
+      if(git_read_file(paths.gitDir + "/commondir", common)){
+        std::filesystem::path target(git_trim(common));
+        if(target.is_relative()) target = std::filesystem::path(paths.gitDir) / target;
+        paths.commonDir = target.lexically_normal().string();
+        while(paths.commonDir.size() > 1 && paths.commonDir.back() == '/') paths.commonDir.pop_back();
+      }else{
+        paths.commonDir = paths.gitDir;
+      }
+      return paths;
+    }
+    std::filesystem::path parent = dir.parent_path();
+    if(parent == dir) break;
+    dir = parent;
+  }
+  return paths;
+}
+
+inline std::string git_hex_to_oid(std::string_view hex, size_t hashLen){
+  if(hex.size() < hashLen * 2) return std::string();
+  std::string out(hashLen, '\0');
+  auto nibble = [](char c) -> int {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  };
+  for(size_t i = 0; i < hashLen; ++i){
+    int hi = nibble(hex[i * 2]), lo = nibble(hex[i * 2 + 1]);
+    if(hi < 0 || lo < 0) return std::string();
+    out[i] = static_cast<char>((hi << 4) | lo);
+  }
+  return out;
+}
+
+inline std::string git_oid_to_hex(std::string_view oid){
+  static const char digits[] = "0123456789abcdef";
+  std::string out;
+  out.reserve(oid.size() * 2);
+  for(unsigned char c : oid){
+    out.push_back(digits[c >> 4]);
+    out.push_back(digits[c & 15]);
+  }
+  return out;
+}
+
+// 引用解析：先找松散引用文件，再找 packed-refs。packed-refs 按文件身份缓存
+class GitRefStore {
+public:
+  void reset(const GitRepoPaths& paths, size_t hashLen){
+    paths_ = paths;
+    hashLen_ = hashLen;
+    packedStamp_ = GitFileStamp{};
+    packed_.clear();
+  }
+
+  // name 为 "HEAD" 或 "refs/..."；解析失败（如尚无提交的分支）返回空串
+  std::string resolve(const std::string& name){
+    std::string current = name;
+    for(int depth = 0; depth < 5; ++depth){
+      std::string text;
+      if(git_read_file(loosePath(current), text)){
+        std::string value = git_trim(text);
+        if(value.compare(0, 4, "ref:") == 0){
+          current = git_trim(std::string_view(value).substr(4));
+          continue;
+        }
+        return git_hex_to_oid(value, hashLen_);
+      }
+      loadPacked();
+      auto it = packed_.find(current);
+      return it == packed_.end() ? std::string() : it->second;
+    }
+    return std::string();
+  }
+
+  // HEAD 指向的引用名；分离 HEAD 时返回空串
+  std::string headTarget() const {
+    std::string text;
+    if(!git_read_file(paths_.gitDir + "/HEAD", text)) return std::string();
+    std::string value = git_trim(text);
+    if(value.compare(0, 4, "ref:") != 0) return std::string();
+    return git_trim(std::string_view(value).substr(4));
+  }
+
+  // 每个工作树私有的引用在 gitDir，其余在共享目录
+  std::string loosePath(const std::string& name) const {
+    bool perWorktree = name.find('/') == std::string::npos || name.compare(0, 14, "refs/worktree/") == 0 ||
+                       name.compare(0, 12, "refs/bisect/") == 0;
+    return (perWorktree ? paths_.gitDir : paths_.commonDir) + "/" + name;
+  }
+
+private:
+  void loadPacked(){
+    std::string file = paths_.commonDir + "/packed-refs";
+    GitFileStamp stamp = git_file_stamp(file);
+    if(stamp == packedStamp_) return;
+    packedStamp_ = stamp;
+    packed_.clear();
+    std::string text;
+    if(!git_read_file(file, text)) return;
+    size_t start = 0;
+    while(start < text.size()){
+      size_t end = text.find('\n', start);
+      if(end == std::string::npos) end = text.size();
+      std::string_view line(text.data() + start, end - start);
+      start = end + 1;
+      if(line.empty() || line[0] == '#' || line[0] == '^') continue;
+      size_t space = line.find(' ');
+      if(space == std::string_view::npos) continue;
+      std::string oid = git_hex_to_oid(line.substr(0, space), hashLen_);
+      if(oid.empty()) continue;
+      std::string_view ref = line.substr(space + 1);
+      while(!ref.empty() && (ref.back() == '\r' || ref.back() == ' ')) ref.remove_suffix(1);
+      packed_[std::string(ref)] = std::move(oid);
+    }
+  }
+
+  GitRepoPaths paths_;
+  size_t hashLen_ = 20;
+  GitFileStamp packedStamp_;
+  std::unordered_map<std::string, std::string> packed_;
+};
+
+// ===== Object database =====
+enum class GitObjectType { None = 0, Commit = 1, Tree = 2, Blob = 3, Tag = 4 };
+
+// 松散对象与 pack（idx v2）的只读访问；pack 数据按需定位读取，不整体载入
+class GitObjectStore {
+public:
+  static constexpr size_t kMaxObjectSize = 64u << 20;
+  static constexpr int kMaxDeltaDepth = 64;
+
+  void reset(const std::string& objectsDir, size_t hashLen){
+    objectsDir_ = objectsDir;
+    hashLen_ = hashLen;
+    packs_.clear();
+    packDirStamp_ = GitFileStamp{};
+  }
+
+  bool read(const std::string& oid, GitObjectType& type, std::string& data){
+    if(oid.size() != hashLen_) return false;
+    if(readLoose(oid, type, data)) return true;
+    refreshPacks();
+    for(auto& pack : packs_){
+      uint64_t offset = 0;
+      if(pack->find(oid, hashLen_, offset)) return readPacked(*pack, offset, type, data, 0);
+    }
+    // pack 目录可能刚被 gc 替换
+    if(packDirStamp_ != git_file_stamp(objectsDir_ + "/pack")){
+      refreshPacks();
+      for(auto& pack : packs_){
+        uint64_t offset = 0;
+        if(pack->find(oid, hashLen_, offset)) return readPacked(*pack, offset, type, data, 0);
+      }
+    }
+    return false;
+  }
+
+private:
+  struct Pack {
+    std::string idx;                 // 整个 .idx 文件
+    uint32_t count = 0;
+    size_t namesAt = 0, offsetsAt = 0, largeAt = 0;
+    std::vector<uint64_t> sortedOffsets; // 用来推算每个条目压缩数据的长度
+    std::ifstream file;
+    uint64_t fileSize = 0;
+
+    uint32_t be32(size_t at) const {
+      const uint8_t* p = reinterpret_cast<const uint8_t*>(idx.data()) + at;
+      return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+
+    uint64_t offsetOf(uint32_t i) const {
+      uint32_t small = be32(offsetsAt + size_t(i) * 4);
+      if(!(small & 0x80000000u)) return small;
+      size_t at = largeAt + size_t(small & 0x7fffffffu) * 8;
+      return (uint64_t(be32(at)) << 32) | be32(at + 4);
+    }
+
+    bool find(const std::string& oid, size_t hashLen, uint64_t& offset) const {
+      unsigned first = static_cast<unsigned char>(oid[0]);
+      uint32_t lo = first == 0 ? 0 : be32(8 + (first - 1) * 4);
+      uint32_t hi = be32(8 + first * 4);
+      while(lo < hi){
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = std::memcmp(idx.data() + namesAt + size_t(mid) * hashLen, oid.data(), hashLen);
+        if(cmp == 0){
+          offset = offsetOf(mid);
+          return true;
+        }
+        if(cmp < 0) lo = mid + 1;
+        else hi = mid;
+      }
+      return false;
+    }
+  };
+
+  bool readLoose(const std::string& oid, GitObjectType& type, std::string& data){
+    std::string hex = git_oid_to_hex(oid);
+    std::string raw;
+    if(!git_read_file(objectsDir_ + "/" + hex.substr(0, 2) + "/" + hex.substr(2), raw)) return false;
+    std::string inflated;
+    if(!GitInflater::zlib(reinterpret_cast<const uint8_t*>(raw.data()), raw.size(), inflated, kMaxObjectSize)) return false;
+    size_t nul = inflated.find('\0');
+    size_t space = inflated.find(' ');
+    if(nul == std::string::npos || space == std::string::npos || space > nul) return false;
+    std::string_view name(inflated.data(), space);
+    if(name == "commit") type = GitObjectType::Commit;
+    else if(name == "tree") type = GitObjectType::Tree;
+    else if(name == "blob") type = GitObjectType::Blob;
+    else if(name == "tag") type = GitObjectType::Tag;
+    else return false;
+    data = inflated.substr(nul + 1);
+    return true;
+  }
+
+  void refreshPacks(){
+    std::string packDir = objectsDir_ + "/pack";
+    GitFileStamp stamp = git_file_stamp(packDir);
+    if(stamp == packDirStamp_) return;
+    packDirStamp_ = stamp;
+    packs_.clear();
+    std::error_code ec;
+    for(std::filesystem::directory_iterator it(packDir, ec), end; !ec && it != end; it.increment(ec)){
+      const auto& path = it->path();
+      if(path.extension() != ".idx") continue;
+      auto pack = std::make_unique<Pack>();
+      if(!git_read_file(path.string(), pack->idx) || pack->idx.size() < 8 + 256 * 4) continue;
+      if(std::memcmp(pack->idx.data(), "\377tOc", 4) != 0 || pack->be32(4) != 2) continue;
+      pack->count = pack->be32(8 + 255 * 4);
+      pack->namesAt = 8 + 256 * 4;
+      size_t crcAt = pack->namesAt + size_t(pack->count) * hashLen_;
+      pack->offsetsAt = crcAt + size_t(pack->count) * 4;
+      pack->largeAt = pack->offsetsAt + size_t(pack->count) * 4;
+      if(pack->largeAt > pack->idx.size()) continue;
+      std::filesystem::path packPath = path;
+      packPath.replace_extension(".pack");
+      pack->file.open(packPath, std::ios::binary);
+      if(!pack->file.good()) continue;
+      pack->file.seekg(0, std::ios::end);
+      pack->fileSize = static_cast<uint64_t>(pack->file.tellg());
+      pack->sortedOffsets.reserve(pack->count);
+      for(uint32_t i = 0; i < pack->count; ++i) pack->sortedOffsets.push_back(pack->offsetOf(i));
+      std::sort(pack->sortedOffsets.begin(), pack->sortedOffsets.end());
+      packs_.push_back(std::move(pack));
+    }
+  }
+
+  bool readChunk(Pack& pack, uint64_t offset, std::string& chunk){
+    auto next = std::upper_bound(pack.sortedOffsets.begin(), pack.sortedOffsets.end(), offset);
+    uint64_t end = next == pack.sortedOffsets.end() ? pack.fileSize - hashLen_ : *next;
+    if(end <= offset || end - offset > kMaxObjectSize) return false;
+    chunk.resize(static_cast<size_t>(end - offset));
+    pack.file.clear();
+    pack.file.seekg(static_cast<std::streamoff>(offset));
+    pack.file.read(&chunk[0], static_cast<std::streamsize>(chunk.size()));
+    return pack.file.gcount() == static_cast<std::streamsize>(chunk.size());
+  }
+
+  bool readPacked(Pack& pack, uint64_t offset, GitObjectType& type, std::string& data, int depth){
+    if(depth > kMaxDeltaDepth) return false;
+    std::string chunk;
+    if(!readChunk(pack, offset, chunk)) return false;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(chunk.data());
+    size_t at = 0, n = chunk.size();
+    if(n == 0) return false;
+    uint8_t c = p[at++];
+    int kind = (c >> 4) & 7;
+    uint64_t size = c & 15;
+    int shift = 4;
+    while(c & 0x80){
+      if(at >= n || shift > 56) return false;
+      c = p[at++];
+      size |= uint64_t(c & 0x7f) << shift;
+      shift += 7;
+    }
+    if(size > kMaxObjectSize) return false;
+    std::string base;
+    GitObjectType baseType = GitObjectType::None;
+    if(kind == 6){
+      if(at >= n) return false;
+      c = p[at++];
+      uint64_t distance = c & 0x7f;
+      while(c & 0x80){
+        if(at >= n) return false;
+        c = p[at++];
+        distance = ((distance + 1) << 7) | (c & 0x7f);
+      }
+      if(distance == 0 || distance > offset) return false;
+      if(!readPacked(pack, offset - distance, baseType, base, depth + 1)) return false;
+    }else if(kind == 7){
+      if(n - at < hashLen_) return false;
+      std::string baseOid(chunk.data() + at, hashLen_);
+      at += hashLen_;
+      uint64_t baseOffset = 0;
+      bool ok = pack.find(baseOid, hashLen_, baseOffset) ? readPacked(pack, baseOffset, baseType, base, depth + 1)
+                                                          : read(baseOid, baseType, base);
+      if(!ok) return false;
+    }else if(kind < 1 || kind > 4){
+      return false;
+    }
+    std::string inflated;
+    inflated.reserve(static_cast<size_t>(size));
+    if(!GitInflater::zlib(p + at, n - at, inflated, static_cast<size_t>(size))) return false;
+    if(kind <= 4){
+      type = static_cast<GitObjectType>(kind);
+      data = std::move(inflated);
+      return true;
+    }
+    type = baseType;
+    return applyDelta(base, inflated, data);
+  }
+
+  static bool applyDelta(const std::string& base, const std::string& delta, std::string& out){
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(delta.data());
+    size_t at = 0, n = delta.size();
+    auto varint = [&](uint64_t& value){
+      value = 0;
+      int shift = 0;
+      while(at < n){
+        uint8_t c = p[at++];
+        value |= uint64_t(c & 0x7f) << shift;
+        shift += 7;
+        if(!(c & 0x80)) return true;
+      }
+      return false;
+    };
+    uint64_t baseSize = 0, resultSize = 0;
+    if(!varint(baseSize) || !varint(resultSize) || baseSize != base.size() || resultSize > kMaxObjectSize) return false;
+    out.clear();
+    out.reserve(static_cast<size_t>(resultSize));
+    while(at < n){
+      uint8_t op = p[at++];
+      if(op & 0x80){
+        uint64_t copyOffset = 0, copySize = 0;
+        for(int i = 0; i < 4; ++i){
+          if(op & (1u << i)){
+            if(at >= n) return false;
+            copyOffset |= uint64_t(p[at++]) << (8 * i);
+          }
+        }
+        for(int i = 0; i < 3; ++i){
+          if(op & (0x10u << i)){
+            if(at >= n) return false;
+            copySize |= uint64_t(p[at++]) << (8 * i);
+          }
+        }
+        if(copySize == 0) copySize = 0x10000;
+        if(copyOffset + copySize > base.size()) return false;
+        out.append(base, static_cast<size_t>(copyOffset), static_cast<size_t>(copySize));
+      }else if(op != 0){
+        if(n - at < op) return false;
+        out.append(delta, at, op);
+        at += op;
+      }else{
+        return false;
+      }
+    }
+    return out.size() == resultSize;
+  }
+
+  std::string objectsDir_;
+  size_t hashLen_ = 20;
+  GitFileStamp packDirStamp_;
+  std::vector<std::unique_ptr<Pack>> packs_;
+};
+
+// ===== Index =====
+// path 与 oid 指向 GitIndex 自己持有的缓冲区，避免十万级条目逐个分配
+struct GitIndexEntry {
+  std::string_view path;
+  std::string_view oid;
+  uint32_t mtimeSec = 0;
+  uint32_t mtimeNsec = 0;
+  uint32_t inode = 0;
+  uint32_t mode = 0;
+  uint32_t size = 0;
+  uint8_t stage = 0;
+  bool assumeValid = false;
+  bool skipWorktree = false;
+  bool intentToAdd = false;
+
+  bool sameStat(const GitIndexEntry& o) const {
+    return oid == o.oid && mtimeSec == o.mtimeSec && mtimeNsec == o.mtimeNsec && inode == o.inode &&
+           mode == o.mode && size == o.size && stage == o.stage && assumeValid == o.assumeValid &&
+           skipWorktree == o.skipWorktree && intentToAdd == o.intentToAdd;
+  }
+};
+
+struct GitIndex {
+  GitIndex() = default;
+  GitIndex(GitIndex&&) = default;
+  GitIndex& operator=(GitIndex&&) = default;
+  GitIndex(const GitIndex&) = delete;
+  GitIndex& operator=(const GitIndex&) = delete;
+
+  // 条目里的视图指向这两块缓冲；二者都在堆上，移动 GitIndex 不会使视图失效
+  std::string raw;     // 整个索引文件
+  std::string paths;   // v4 还原出的完整路径
+  uint32_t version = 0;
+  std::vector<GitIndexEntry> entries;                 // 按路径字节序、再按 stage 排列
+  std::unordered_map<std::string, std::string> cacheTree; // 有效的 TREE 扩展节点：目录（以 / 结尾，根为空串）→ 树对象 id
+  bool hasConflicts = false;
+  std::shared_ptr<const GitIndex> shared; // split index 的共享部分；部分条目的视图指向它的缓冲
+};
+
+// EWAH 压缩位图（link 扩展里的删除、替换位图）：返回置位的下标，used 为位图占用的字节数。
+// 格式：位数、字数（均为 32 位大端），若干 64 位大端字，最后是 32 位的当前 RLW 位置。
+// 每个 RLW 的 bit0 为连续段的值，bit1–32 为连续段的字数，其上为随后的字面字数
+inline bool git_read_ewah(const uint8_t* p, size_t size, size_t& used, std::vector<uint32_t>& bits){
+  auto be32 = [&](size_t at){
+    return (uint32_t(p[at]) << 24) | (uint32_t(p[at + 1]) << 16) | (uint32_t(p[at + 2]) << 8) | uint32_t(p[at + 3]);
+  };
+  auto be64 = [&](size_t at){ return (uint64_t(be32(at)) << 32) | be32(at + 4); };
+  if(size < 8) return false;
+  uint32_t bitCount = be32(0);
+  uint64_t wordCount = be32(4);
+  if((size - 8) / 8 < wordCount || size - 8 - wordCount * 8 < 4) return false;
+  used = static_cast<size_t>(8 + wordCount * 8 + 4);
+  bits.clear();
+  uint64_t pos = 0;
+  for(uint64_t w = 0; w < wordCount;){
+    uint64_t rlw = be64(8 + w * 8);
+    ++w;
+    uint64_t running = (rlw >> 1) & 0xffffffffULL;
+    uint64_t literals = rlw >> 33;
+    if(rlw & 1){
+      for(uint64_t b = 0; b < running * 64 && pos + b < bitCount; ++b) bits.push_back(static_cast<uint32_t>(pos + b));
+    }
+    pos += running * 64;
+    if(wordCount - w < literals) return false;
+    for(uint64_t l = 0; l < literals; ++l, ++w, pos += 64){
+      uint64_t word = be64(8 + w * 8);
+      for(int b = 0; b < 64 && word; ++b, word >>= 1){
+        if((word & 1) && pos + b < bitCount) bits.push_back(static_cast<uint32_t>(pos + b));
+      }
+    }
+  }
+  return true;
+}
+
+// 解析索引 v2–v4（v4 的路径按前缀压缩）。split index 时读入 sharedindex.<id>，
+// 按 link 扩展的替换、删除位图合成完整的条目列表
+inline bool git_read_index(const std::string& file, size_t hashLen, GitIndex& index){
+  std::string& data = index.raw;
+  if(!git_read_file(file, data)) return false;
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data.data());
+  size_t n = data.size();
+  auto be32 = [&](size_t at){
+    return (uint32_t(p[at]) << 24) | (uint32_t(p[at + 1]) << 16) | (uint32_t(p[at + 2]) << 8) | uint32_t(p[at + 3]);
+  };
+  auto be16 = [&](size_t at){ return static_cast<uint16_t>((p[at] << 8) | p[at + 1]); };
+  if(n < 12 + hashLen || std::memcmp(p, "DIRC", 4) != 0) return false;
+  index.version = be32(4);
+  if(index.version < 2 || index.version > 4) return false;
+  uint32_t count = be32(8);
+  size_t end = n - hashLen;
+  size_t at = 12;
+  index.entries.clear();
+  index.entries.reserve(count);
+  index.cacheTree.clear();
+  index.hasConflicts = false;
+  index.paths.clear();
+  std::vector<std::pair<size_t, size_t>> v4Spans; // v4 路径在 index.paths 中的位置，解析完再转成视图
+  if(index.version == 4){
+    index.paths.reserve(std::max<size_t>(64, n));
+    v4Spans.reserve(count);
+  }
+  size_t previousAt = 0, previousLen = 0;
+  for(uint32_t i = 0; i < count; ++i){
+    size_t begin = at;
+    if(end - at < 40 + hashLen + 2) return false;
+    GitIndexEntry entry;
+    entry.mtimeSec = be32(at + 8);
+    entry.mtimeNsec = be32(at + 12);
+    entry.inode = be32(at + 20);
+    entry.mode = be32(at + 24);
+    entry.size = be32(at + 36);
+    entry.oid = std::string_view(data.data() + at + 40, hashLen);
+    at += 40 + hashLen;
+    uint16_t flags = be16(at);
+    at += 2;
+    entry.assumeValid = (flags & 0x8000) != 0;
+    entry.stage = static_cast<uint8_t>((flags >> 12) & 3);
+    if(flags & 0x4000){
+      if(index.version < 3 || end - at < 2) return false;
+      uint16_t extended = be16(at);
+      at += 2;
+      entry.skipWorktree = (extended & 0x4000) != 0;
+      entry.intentToAdd = (extended & 0x2000) != 0;
+    }
+    if(index.version == 4){
+      // 去掉前一条路径末尾 strip 个字节，再接上本条的后缀
+      uint64_t strip = 0;
+      if(at >= end) return false;
+      uint8_t c = p[at++];
+      strip = c & 0x7f;
+      while(c & 0x80){
+        if(at >= end) return false;
+        c = p[at++];
+        strip = ((strip + 1) << 7) | (c & 0x7f);
+      }
+      if(strip > previousLen) return false;
+      const void* nul = std::memchr(p + at, 0, end - at);
+      if(!nul) return false;
+      size_t len = static_cast<const uint8_t*>(nul) - (p + at);
+      size_t keep = previousLen - static_cast<size_t>(strip);
+      size_t start = index.paths.size();
+      index.paths.append(index.paths, previousAt, keep);
+      index.paths.append(data, at, len);
+      at += len + 1;
+      previousAt = start;
+      previousLen = keep + len;
+      v4Spans.emplace_back(previousAt, previousLen);
+    }else{
+      const void* nul = std::memchr(p + at, 0, end - at);
+      if(!nul) return false;
+      size_t len = static_cast<const uint8_t*>(nul) - (p + at);
+      entry.path = std::string_view(data.data() + at, len);
+      // 条目按 8 字节对齐，路径后至少补一个 NUL
+      at = begin + ((at - begin + len + 8) & ~size_t(7));
+      if(at > end) return false;
+    }
+    if(entry.stage != 0) index.hasConflicts = true;
+    index.entries.push_back(entry);
+  }
+  for(size_t i = 0; i < v4Spans.size(); ++i){
+    index.entries[i].path = std::string_view(index.paths.data() + v4Spans[i].first, v4Spans[i].second);
+  }
+
+  // 扩展区：TREE（cache tree）用来快速判断暂存区是否与 HEAD 一致；link 表示 split index
+  std::string sharedOid;
+  std::vector<uint32_t> deleted, replaced;
+  while(end - at >= 8){
+    uint32_t size = be32(at + 4);
+    if(end - at - 8 < size) break;
+    if(std::memcmp(p + at, "link", 4) == 0){
+      if(size < hashLen) return false;
+      sharedOid.assign(data, at + 8, hashLen);
+      size_t cur = at + 8 + hashLen, stop = at + 8 + size;
+      size_t used = 0;
+      if(cur < stop){
+        if(!git_read_ewah(p + cur, stop - cur, used, deleted)) return false;
+        cur += used;
+        if(!git_read_ewah(p + cur, stop - cur, used, replaced)) return false;
+      }
+    }else if(std::memcmp(p + at, "TREE", 4) == 0){
+      size_t cur = at + 8, stop = at + 8 + size;
+      std::vector<std::pair<std::string, int>> stack; // 目录路径与尚未读到的子树数
+      while(cur < stop){
+        const void* nul = std::memchr(p + cur, 0, stop - cur);
+        if(!nul) break;
+        std::string name(reinterpret_cast<const char*>(p + cur), static_cast<const uint8_t*>(nul) - (p + cur));
+        cur = static_cast<const uint8_t*>(nul) - p + 1;
+        size_t newline = cur;
+        while(newline < stop && p[newline] != '\n') ++newline;
+        if(newline >= stop) break;
+        std::string counts(reinterpret_cast<const char*>(p + cur), newline - cur);
+        cur = newline + 1;
+        int entryCount = 0, subtrees = 0;
+        if(std::sscanf(counts.c_str(), "%d %d", &entryCount, &subtrees) != 2) break;
+        while(!stack.empty() && stack.back().second == 0) stack.pop_back();
+        std::string path = stack.empty() ? std::string() : stack.back().first + name + "/";
+        if(!stack.empty()) --stack.back().second;
+        if(entryCount >= 0){
+          if(stop - cur < hashLen) break;
+          index.cacheTree[path].assign(reinterpret_cast<const char*>(p + cur), hashLen);
+          cur += hashLen;
+        }
+        stack.emplace_back(path, subtrees);
+      }
+    }
+    at += 8 + size;
+  }
+  if(sharedOid.empty() || sharedOid.find_first_not_of('\0') == std::string::npos) return true;
+
+  // 本文件里先是按替换位图依次替换共享条目的条目（路径可为空，表示沿用原路径），其余为新增条目
+  auto shared = std::make_shared<GitIndex>();
+  std::string sharedFile = (std::filesystem::path(file).parent_path() / ("sharedindex." + git_oid_to_hex(sharedOid))).string();
+  if(!git_read_index(sharedFile, hashLen, *shared) || shared->shared) return false;
+  std::vector<GitIndexEntry> merged = shared->entries;
+  std::vector<char> drop(merged.size(), 0);
+  size_t next = 0;
+  for(uint32_t bit : replaced){
+    if(bit >= merged.size() || next >= index.entries.size()) return false;
+    GitIndexEntry entry = index.entries[next++];
+    if(entry.path.empty()) entry.path = merged[bit].path;
+    merged[bit] = entry;
+  }
+  for(uint32_t bit : deleted){
+    if(bit >= merged.size()) return false;
+    drop[bit] = 1;
+  }
+  size_t kept = 0;
+  for(size_t i = 0; i < merged.size(); ++i){
+    if(!drop[i]) merged[kept++] = merged[i];
+  }
+  merged.resize(kept);
+  merged.insert(merged.end(), index.entries.begin() + static_cast<std::ptrdiff_t>(next), index.entries.end());
+  std::stable_sort(merged.begin(), merged.end(), [](const GitIndexEntry& a, const GitIndexEntry& b){
+    return a.path != b.path ? a.path < b.path : a.stage < b.stage;
+  });
+  index.entries = std::move(merged);
+  index.hasConflicts = std::any_of(index.entries.begin(), index.entries.end(),
+                                   [](const GitIndexEntry& e){ return e.stage != 0; });
+  index.shared = std::move(shared);
+  return true;
+}
+
+// ===== Tracker =====
+struct GitStatusSummary {
+  bool inRepo = false;
+  std::string branch;     // 分离 HEAD 时为短提交号
+  bool detached = false;
+  int ahead = -1;         // -1：没有上游或无法计算
+  int behind = -1;
+  bool dirty = false;     // 工作区中被跟踪的文件有改动
+  bool staged = false;    // 暂存区与 HEAD 不同
+  bool conflicted = false;
+};
+
+// 形如 "(main*+ ↑1↓2) "；不在仓库中时为空串
+inline std::string git_status_format(const GitStatusSummary& s){
+  if(!s.inRepo) return std::string();
+  std::string out = "(" + s.branch;
+  if(s.conflicted) out += "!";
+  if(s.dirty) out += "*";
+  if(s.staged) out += "+";
+  if(s.ahead > 0 || s.behind > 0){
+    out += " ";
+    if(s.ahead > 0) out += "↑" + std::to_string(s.ahead);
+    if(s.behind > 0) out += "↓" + std::to_string(s.behind);
+  }
+  return out + ") ";
+}
+
+// 仓库状态的增量跟踪。compute 与 watches 只在状态线程调用；pathsChanged 可在任意线程调用，
+// 传入 inotify 报告的变化路径，下一次 compute 只重新检查这些路径对应的索引条目。
+class GitStatusTracker {
+public:
+  // 被跟踪文件所在目录超过这么多时不再逐目录监视，每次 compute 都完整重查；
+  // 实际上限还受 inotify 的 max_user_watches 约束，见 maxWatchedDirectories
+  static constexpr size_t kMaxWatchedDirectories = 16384;
+  // 领先/落后计数最多遍历的提交数
+  static constexpr size_t kMaxWalkedCommits = 20000;
+  // 队列只剩两边都可达的提交后再多走的步数
+  static constexpr int kAheadBehindSlop = 5;
+  static constexpr size_t kScanBatch = 8192;
+
+  GitStatusSummary compute(const std::string& cwd){
+    GitStatusSummary summary;
+    // 不在仓库里时每次都重新查找，git init 之后无需切换目录就能显示
+    if(cwd != lastCwd_ || !repo_.valid()){
+      lastCwd_ = cwd;
+      GitRepoPaths paths = git_find_repo(cwd);
+      if(!(paths == repo_)) openRepo(paths);
+    }
+    if(!repo_.valid()) return summary;
+    summary.inRepo = true;
+
+    GitFileStamp configStamp = git_file_stamp(repo_.commonDir + "/config");
+    if(configStamp != configStamp_){
+      configStamp_ = configStamp;
+      std::string text;
+      config_ = git_read_file(repo_.commonDir + "/config", text) ? git_parse_config(text)
+                                                                  : std::unordered_map<std::string, std::string>{};
+      auto format = config_.find("extensions.objectformat");
+      size_t hashLen = (format != config_.end() && format->second == "sha256") ? 32 : 20;
+      auto fileMode = config_.find("core.filemode");
+      trustFileMode_ = fileMode == config_.end() || (fileMode->second != "false" && fileMode->second != "0");
+      if(hashLen != hashLen_){
+        hashLen_ = hashLen;
+        refs_.reset(repo_, hashLen_);
+        objects_.reset(repo_.commonDir + "/objects", hashLen_);
+        indexStamp_ = GitFileStamp{};
+      }
+    }
+
+    // HEAD、分支与上游
+    std::string headRef = refs_.headTarget();
+    std::string headOid = refs_.resolve("HEAD");
+    std::string upstreamRef;
+    if(headRef.compare(0, 11, "refs/heads/") == 0){
+      summary.branch = headRef.substr(11);
+      auto remote = config_.find("branch." + summary.branch + ".remote");
+      auto merge = config_.find("branch." + summary.branch + ".merge");
+      if(remote != config_.end() && merge != config_.end()){
+        if(remote->second == ".") upstreamRef = merge->second;
+        else if(merge->second.compare(0, 11, "refs/heads/") == 0){
+          upstreamRef = "refs/remotes/" + remote->second + "/" + merge->second.substr(11);
+        }
+      }
+    }else if(!headRef.empty()){
+      summary.branch = headRef;
+    }else{
+      summary.detached = true;
+      summary.branch = git_oid_to_hex(headOid).substr(0, 7);
+    }
+    if(headRef != watchedHeadRef_ || upstreamRef != watchedUpstreamRef_){
+      watchedHeadRef_ = headRef;
+      watchedUpstreamRef_ = upstreamRef;
+      rebuildWatches();
+    }
+    if(!upstreamRef.empty() && !headOid.empty()){
+      std::string upstreamOid = refs_.resolve(upstreamRef);
+      if(!upstreamOid.empty()) aheadBehind(headOid, upstreamOid, summary.ahead, summary.behind);
+    }
+
+    // 先把变化路径记到旧索引上，再换新索引，这样沿用旧结果的条目不会漏查
+    applyPendingChanges();
+    GitFileStamp indexStamp = git_file_stamp(repo_.gitDir + "/index");
+    if(indexStamp != indexStamp_){
+      indexStamp_ = indexStamp;
+      loadIndex();
+    }
+    if(unwatched_) markAllUnknown();
+    scanWorktree();
+    summary.dirty = dirtyCount_ > 0;
+    summary.conflicted = index_.hasConflicts;
+    summary.staged = staged(headOid);
+    return summary;
+  }
+
+  std::vector<LoopWatch> watches() const { return watches_; }
+
+  void pathsChanged(const std::vector<std::string>& paths){
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+    if(paths.empty()) pendingAll_ = true;
+    if(pendingAll_) return;
+    pending_.insert(pending_.end(), paths.begin(), paths.end());
+  }
+
+private:
+  enum : uint8_t { kUnknown = 0, kClean = 1, kDirty = 2 };
+
+  // inotify 监视数按用户计、与其他程序及本程序的其他来源共享，最多占用上限的一半；
+  // 超出时 inotify_add_watch 报 ENOSPC，整个来源只能退化为轮询
+  static size_t maxWatchedDirectories(){
+    static const size_t limit = []{
+      size_t cap = kMaxWatchedDirectories;
+#if defined(__linux__)
+      std::ifstream in("/proc/sys/fs/inotify/max_user_watches");
+      long long watches = 0;
+      if(in >> watches && watches > 0) cap = std::min(cap, static_cast<size_t>(watches) / 2);
+#endif
+      return cap;
+    }();
+    return limit;
+  }
+
+  void openRepo(const GitRepoPaths& paths){
+    repo_ = paths;
+    hashLen_ = 20;
+    configStamp_ = GitFileStamp{};
+    config_.clear();
+    refs_.reset(repo_, hashLen_);
+    objects_.reset(repo_.commonDir + "/objects", hashLen_);
+    index_ = GitIndex{};
+    indexStamp_ = GitFileStamp{};
+    state_.clear();
+    countable_.assign(1, 0);
+    recheck_.clear();
+    cursor_ = 0;
+    dirtyCount_ = 0;
+    stagedKey_.clear();
+    walkKey_.clear();
+    watchedHeadRef_.clear();
+    watchedUpstreamRef_.clear();
+    worktreeDirectories_.clear();
+    unwatched_ = false;
+    {
+      std::lock_guard<std::mutex> lock(pendingMutex_);
+      pending_.clear();
+      pendingAll_ = false;
+    }
+    rebuildWatches();
+  }
+
+  // 按路径在 [begin, end) 中找以 prefix 开头的条目区间
+  std::pair<size_t, size_t> prefixRange(size_t begin, size_t end, const std::string& prefix) const {
+    auto less = [](const GitIndexEntry& e, const std::string& key){ return e.path < std::string_view(key); };
+    auto first = std::lower_bound(index_.entries.begin() + begin, index_.entries.begin() + end, prefix, less);
+    auto last = first;
+    if(!prefix.empty()){
+      std::string upper = prefix;
+      upper.back() = static_cast<char>(upper.back() + 1);
+      last = std::lower_bound(first, index_.entries.begin() + end, upper, less);
+    }else{
+      last = index_.entries.begin() + end;
+    }
+    return {static_cast<size_t>(first - index_.entries.begin()), static_cast<size_t>(last - index_.entries.begin())};
+  }
+
+  void markUnknown(size_t i){
+    if(state_[i] == kUnknown) return;
+    if(state_[i] == kDirty) --dirtyCount_;
+    state_[i] = kUnknown;
+    if(i < cursor_) recheck_.push_back(static_cast<uint32_t>(i));
+  }
+
+  void markAllUnknown(){
+    std::fill(state_.begin(), state_.end(), kUnknown);
+    recheck_.clear();
+    cursor_ = 0;
+    dirtyCount_ = 0;
+  }
+
+  static bool underDirectory(const std::string& path, const std::string& dir){
+    return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 && path[dir.size()] == '/';
+  }
+
+  void applyPendingChanges(){
+    std::vector<std::string> paths;
+    bool all = false;
+    {
+      std::lock_guard<std::mutex> lock(pendingMutex_);
+      paths.swap(pending_);
+      all = pendingAll_;
+      pendingAll_ = false;
+    }
+    if(all){
+      markAllUnknown();
+      return;
+    }
+    for(const auto& path : paths){
+      // .git 里的变化只影响 HEAD/引用/索引，它们每次都会重新读取
+      if(path == repo_.gitDir || underDirectory(path, repo_.gitDir) ||
+         path == repo_.commonDir || underDirectory(path, repo_.commonDir)) continue;
+      if(path == repo_.workTree){
+        markAllUnknown();
+        return;
+      }
+      if(!underDirectory(path, repo_.workTree)) continue;
+      std::string rel = path.substr(repo_.workTree.size() + 1);
+      // 路径本身是被跟踪的文件，或是一个目录（目录被删除、改名时其下全部条目都要重查）
+      auto exact = prefixRange(0, index_.entries.size(), rel);
+      for(size_t i = exact.first; i < exact.second && index_.entries[i].path == rel; ++i) markUnknown(i);
+      auto subtree = prefixRange(0, index_.entries.size(), rel + "/");
+      for(size_t i = subtree.first; i < subtree.second; ++i) markUnknown(i);
+    }
+  }
+
+  // 新旧索引按路径合并：统计信息完全相同的条目沿用已知结果，其余待查
+  void loadIndex(){
+    GitIndex next;
+    if(!git_read_index(repo_.gitDir + "/index", hashLen_, next)) next = GitIndex{};
+    std::vector<uint8_t> nextState(next.entries.size(), kUnknown);
+    size_t old = 0;
+    dirtyCount_ = 0;
+    for(size_t i = 0; i < next.entries.size(); ++i){
+      const auto& entry = next.entries[i];
+      while(old < index_.entries.size() &&
+            (index_.entries[old].path < entry.path ||
+             (index_.entries[old].path == entry.path && index_.entries[old].stage < entry.stage))){
+        ++old;
+      }
+      if(old < index_.entries.size() && index_.entries[old].sameStat(entry) && index_.entries[old].path == entry.path){
+        nextState[i] = state_[old];
+        if(nextState[i] == kDirty) ++dirtyCount_;
+      }
+    }
+    index_ = std::move(next);
+    state_ = std::move(nextState);
+    recheck_.clear();
+    cursor_ = 0;
+    countable_.assign(index_.entries.size() + 1, 0);
+    for(size_t i = 0; i < index_.entries.size(); ++i){
+      const auto& e = index_.entries[i];
+      countable_[i + 1] = countable_[i] + ((e.stage == 0 && !e.intentToAdd) ? 1 : 0);
+    }
+    indexMtimeNs_ = indexStamp_.mtimeNs;
+
+    std::vector<std::string> directories;
+    for(const auto& entry : index_.entries){
+      if(entry.skipWorktree) continue;
+      size_t slash = entry.path.rfind('/');
+      std::string dir = slash == std::string_view::npos ? std::string() : std::string(entry.path.substr(0, slash));
+      if(directories.empty() || directories.back() != dir) directories.push_back(std::move(dir));
+    }
+    std::sort(directories.begin(), directories.end());
+    directories.erase(std::unique(directories.begin(), directories.end()), directories.end());
+    if(directories.empty() || directories.front() != std::string()) directories.insert(directories.begin(), std::string());
+    unwatched_ = directories.size() > maxWatchedDirectories();
+    if(unwatched_) directories.clear();
+    if(directories != worktreeDirectories_){
+      worktreeDirectories_ = std::move(directories);
+      rebuildWatches();
+    }
+  }
+
+  void rebuildWatches(){
+    watches_.clear();
+    if(!repo_.valid()) return;
+    watches_.push_back(LoopWatch{repo_.gitDir, std::string()});
+    if(repo_.commonDir != repo_.gitDir) watches_.push_back(LoopWatch{repo_.commonDir, std::string()});
+    for(const auto& ref : {watchedHeadRef_, watchedUpstreamRef_}){
+      if(ref.empty()) continue;
+      std::filesystem::path file(refs_.loosePath(ref));
+      watches_.push_back(LoopWatch{file.parent_path().string(), file.filename().string()});
+    }
+    for(const auto& dir : worktreeDirectories_){
+      watches_.push_back(LoopWatch{dir.empty() ? repo_.workTree : repo_.workTree + "/" + dir, std::string()});
+    }
+  }
+
+  // 与 git 的 ie_match_stat 思路相同：统计信息一致且不在 racy 窗口内即视为未改，否则比对内容
+  uint8_t checkEntry(const GitIndexEntry& entry) const {
+    if(entry.skipWorktree || entry.assumeValid) return kClean;
+    if((entry.mode & 0170000) == 0160000) return kClean; // 子模块不深入
+    if(entry.intentToAdd || entry.stage != 0) return kDirty;
+#ifndef _WIN32
+    std::string full = repo_.workTree + "/";
+    full.append(entry.path);
+    struct stat st{};
+    if(::lstat(full.c_str(), &st) != 0) return kDirty;
+    bool isLink = (entry.mode & 0170000) == 0120000;
+    if(isLink != S_ISLNK(st.st_mode)) return kDirty;
+    if(!isLink && !S_ISREG(st.st_mode)) return kDirty;
+    if(!isLink && trustFileMode_ && ((entry.mode & 0100) != 0) != ((st.st_mode & 0100) != 0)) return kDirty;
+    if(entry.size != static_cast<uint32_t>(st.st_size)) return kDirty;
+#if defined(__APPLE__)
+    int64_t sec = st.st_mtimespec.tv_sec, nsec = st.st_mtimespec.tv_nsec;
+#else
+    int64_t sec = st.st_mtim.tv_sec, nsec = st.st_mtim.tv_nsec;
+#endif
+    bool statMatch = entry.mtimeSec == static_cast<uint32_t>(sec) &&
+                     (entry.mtimeNsec == 0 || entry.mtimeNsec == static_cast<uint32_t>(nsec)) &&
+                     (entry.inode == 0 || entry.inode == static_cast<uint32_t>(st.st_ino));
+    int64_t entryMtimeNs = int64_t(entry.mtimeSec) * 1000000000LL + entry.mtimeNsec;
+    bool racy = entryMtimeNs >= indexMtimeNs_;
+    if(statMatch && !racy) return kClean;
+    // 只实现了 SHA-1；SHA-256 仓库以统计信息为准
+    if(hashLen_ != 20) return statMatch ? kClean : kDirty;
+    std::string content;
+    if(isLink){
+      content.resize(static_cast<size_t>(st.st_size) + 1);
+      ssize_t len = ::readlink(full.c_str(), &content[0], content.size());
+      if(len < 0) return kDirty;
+      content.resize(static_cast<size_t>(len));
+    }else if(!git_read_file(full, content)){
+      return kDirty;
+    }
+    GitSha1 sha;
+    std::string header = "blob " + std::to_string(content.size());
+    sha.update(header.data(), header.size() + 1);
+    sha.update(content.data(), content.size());
+    return sha.finish() == entry.oid ? kClean : kDirty;
+#else
+    std::error_code ec;
+    auto size = std::filesystem::file_size(std::filesystem::path(repo_.workTree) / entry.path, ec);
+    if(ec || static_cast<uint32_t>(size) != entry.size) return kDirty;
+    return kClean;
+#endif
+  }
+
+  // 先重查标记过的条目；工作区仍然干净时再从游标处继续，发现第一处改动即停
+  void scanWorktree(){
+    for(uint32_t i : recheck_){
+      if(state_[i] != kUnknown) continue;
+      state_[i] = checkEntry(index_.entries[i]);
+      if(state_[i] == kDirty) ++dirtyCount_;
+    }
+    recheck_.clear();
+    auto& pool = WorkStealingPool::shared();
+    while(dirtyCount_ == 0 && cursor_ < state_.size()){
+      size_t begin = cursor_;
+      size_t end = std::min(state_.size(), begin + kScanBatch);
+      std::atomic<size_t> found{0};
+      pool.parallelFor(end - begin, 256, [&](size_t, size_t b, size_t e){
+        size_t dirty = 0;
+        for(size_t i = begin + b; i < begin + e; ++i){
+          if(state_[i] != kUnknown) continue;
+          state_[i] = checkEntry(index_.entries[i]);
+          if(state_[i] == kDirty) ++dirty;
+        }
+        found.fetch_add(dirty, std::memory_order_relaxed);
+      });
+      dirtyCount_ += found.load();
+      cursor_ = end;
+    }
+  }
+
+  // 暂存区与 HEAD 的树比较：cache tree 中有效且与 HEAD 子树相同的目录直接跳过
+  bool staged(const std::string& headOid){
+    std::string key = headOid + '\0' + std::to_string(indexStamp_.mtimeNs) + '\0' + std::to_string(indexStamp_.size);
+    if(key == stagedKey_) return stagedValue_;
+    stagedKey_ = key;
+    if(index_.hasConflicts){
+      stagedValue_ = true;
+    }else if(headOid.empty()){
+      stagedValue_ = countable_.back() > 0;
+    }else{
+      GitObjectType type = GitObjectType::None;
+      std::string commit;
+      std::string tree;
+      if(objects_.read(headOid, type, commit) && type == GitObjectType::Commit && commit.compare(0, 5, "tree ") == 0){
+        tree = git_hex_to_oid(std::string_view(commit).substr(5), hashLen_);
+      }
+      stagedValue_ = !tree.empty() && treeDiffers(tree, std::string(), 0, index_.entries.size());
+    }
+    return stagedValue_;
+  }
+
+  bool treeDiffers(const std::string& treeOid, const std::string& prefix, size_t begin, size_t end){
+    auto cached = index_.cacheTree.find(prefix);
+    if(cached != index_.cacheTree.end() && cached->second == treeOid) return false;
+    GitObjectType type = GitObjectType::None;
+    std::string tree;
+    // 读不到对象时无法判断，按未暂存处理
+    if(!objects_.read(treeOid, type, tree) || type != GitObjectType::Tree) return false;
+    size_t covered = 0;
+    size_t at = 0;
+    while(at < tree.size()){
+      size_t space = tree.find(' ', at);
+      size_t nul = tree.find('\0', space == std::string::npos ? at : space);
+      if(space == std::string::npos || nul == std::string::npos || tree.size() - nul - 1 < hashLen_) return true;
+      uint32_t mode = static_cast<uint32_t>(std::strtoul(tree.c_str() + at, nullptr, 8));
+      std::string path = prefix + tree.substr(space + 1, nul - space - 1);
+      std::string oid = tree.substr(nul + 1, hashLen_);
+      at = nul + 1 + hashLen_;
+      if((mode & 0170000) == 0040000){
+        auto range = prefixRange(begin, end, path + "/");
+        if(range.first == range.second) return true;
+        if(treeDiffers(oid, path + "/", range.first, range.second)) return true;
+        covered += countable_[range.second] - countable_[range.first];
+        continue;
+      }
+      auto range = prefixRange(begin, end, path);
+      size_t i = range.first;
+      while(i < range.second && index_.entries[i].path == path && index_.entries[i].intentToAdd) ++i;
+      if(i >= range.second || index_.entries[i].path != path) return true;
+      const auto& entry = index_.entries[i];
+      if(entry.oid != oid || entry.mode != mode) return true;
+      ++covered;
+    }
+    return covered != countable_[end] - countable_[begin];
+  }
+
+  struct CommitInfo {
+    int64_t time = 0;
+    std::vector<std::string> parents;
+  };
+
+  bool readCommit(const std::string& oid, CommitInfo& info){
+    GitObjectType type = GitObjectType::None;
+    std::string data;
+    if(!objects_.read(oid, type, data) || type != GitObjectType::Commit) return false;
+    size_t at = 0;
+    while(at < data.size()){
+      size_t end = data.find('\n', at);
+      if(end == std::string::npos || end == at) break;
+      std::string_view line(data.data() + at, end - at);
+      if(line.compare(0, 7, "parent ") == 0){
+        std::string parent = git_hex_to_oid(line.substr(7), hashLen_);
+        if(!parent.empty()) info.parents.push_back(std::move(parent));
+      }else if(line.compare(0, 10, "committer ") == 0){
+        size_t gt = line.rfind('>');
+        if(gt != std::string_view::npos) info.time = std::strtoll(std::string(line.substr(gt + 1)).c_str(), nullptr, 10);
+      }
+      at = end + 1;
+    }
+    return true;
+  }
+
+  // 与 git 的 ahead/behind 相同：按提交时间从新到旧同时遍历两边，给每个提交标上从哪边可达。
+  // 已展开的提交后来又被另一边到达时，新标记立即沿它已知的祖先传下去；队列里只剩两边都可达的
+  // 提交后再多走 kAheadBehindSlop 步，容忍同一秒或时钟偏差造成的乱序。走完再数只有一边可达的提交
+  void aheadBehind(const std::string& local, const std::string& upstream, int& ahead, int& behind){
+    std::string key = local + upstream;
+    if(key == walkKey_){
+      ahead = walkAhead_;
+      behind = walkBehind_;
+      return;
+    }
+    walkKey_ = key;
+    walkAhead_ = walkBehind_ = -1;
+    if(local == upstream){
+      ahead = walkAhead_ = 0;
+      behind = walkBehind_ = 0;
+      return;
+    }
+    struct Node {
+      uint8_t flags = 0;
+      bool queued = false;
+      bool expanded = false;
+      bool loaded = false;
+      bool missing = false; // 浅克隆的边界等，当作根提交
+      CommitInfo info;
+    };
+    std::unordered_map<std::string, Node> nodes;
+    using Item = std::pair<int64_t, std::string>;
+    std::priority_queue<Item> queue;
+    size_t active = 0; // 队列中尚未被两边同时到达的提交数
+    std::vector<std::string> pending;
+    auto mark = [&](const std::string& oid, uint8_t flags){
+      pending.push_back(oid);
+      while(!pending.empty()){
+        std::string current = std::move(pending.back());
+        pending.pop_back();
+        Node& node = nodes[current];
+        if(!node.loaded){
+          node.loaded = true;
+          node.missing = !readCommit(current, node.info);
+        }
+        if(node.missing || (node.flags | flags) == node.flags) continue;
+        node.flags |= flags;
+        if(node.expanded){
+          for(const auto& parent : node.info.parents) pending.push_back(parent);
+        }else if(!node.queued){
+          node.queued = true;
+          queue.emplace(node.info.time, current);
+          if(node.flags != 3) ++active;
+        }else if(node.flags == 3){
+          --active;
+        }
+      }
+    };
+    mark(local, 1);
+    mark(upstream, 2);
+    size_t walked = 0;
+    int slop = kAheadBehindSlop;
+    while(!queue.empty()){
+      if(active > 0) slop = kAheadBehindSlop;
+      else if(slop-- == 0) break;
+      if(++walked > kMaxWalkedCommits) return;
+      std::string oid = queue.top().second;
+      queue.pop();
+      Node& node = nodes[oid];
+      node.queued = false;
+      node.expanded = true;
+      if(node.flags != 3) --active;
+      std::vector<std::string> parents = node.info.parents;
+      for(const auto& parent : parents) mark(parent, node.flags);
+    }
+    int aheadCount = 0, behindCount = 0;
+    for(const auto& entry : nodes){
+      if(entry.second.flags == 1) ++aheadCount;
+      else if(entry.second.flags == 2) ++behindCount;
+    }
+    ahead = walkAhead_ = aheadCount;
+    behind = walkBehind_ = behindCount;
+  }
+
+  std::string lastCwd_;
+  GitRepoPaths repo_;
+  size_t hashLen_ = 20;
+  bool trustFileMode_ = true;
+  GitFileStamp configStamp_;
+  std::unordered_map<std::string, std::string> config_;
+  GitRefStore refs_;
+  GitObjectStore objects_;
+
+  GitIndex index_;
+  GitFileStamp indexStamp_;
+  int64_t indexMtimeNs_ = 0;
+  std::vector<uint8_t> state_;       // 与 index_.entries 平行
+  std::vector<size_t> countable_;    // 前缀和：stage 0 且非 intent-to-add 的条目数
+  std::vector<uint32_t> recheck_;    // 游标之前、因变化需要重查的条目
+  size_t cursor_ = 0;                // 之后的条目尚未检查过
+  size_t dirtyCount_ = 0;
+
+  std::string stagedKey_;
+  bool stagedValue_ = false;
+  std::string walkKey_;
+  int walkAhead_ = -1;
+  int walkBehind_ = -1;
+
+  std::string watchedHeadRef_;
+  std::string watchedUpstreamRef_;
+  std::vector<std::string> worktreeDirectories_;
+  bool unwatched_ = false;
+  std::vector<LoopWatch> watches_;
+
+  std::mutex pendingMutex_;
+  std::vector<std::string> pending_;
+  bool pendingAll_ = false;
+};
@@ -0,0 +1,445 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// 跨会话共享的命令历史日志。每条记录占一行：时间戳、退出码（未知为 -）、工作目录、命令，
+// 以制表符分隔，字段内的反斜杠、制表符与换行都转义。追加时用 O_APPEND 打开，
+// 整条记录一次 write，多个会话同时写入也不会交错；文件从不改写。
+// 读取时把整个文件映射进内存：recent() 只从末尾往前扫描最近的几条；
+// 按命令哈希去重的全量索引在第一次搜索时才建立，之后每次查询只把文件新增的尾部补进来，
+// 因此启动时不需要读取历史。
+struct HistoryRecord {
+  int64_t timestamp = 0;
+  std::optional<int> exitCode;
+  std::string cwd;
+  std::string command;
+  uint32_t uses = 1;
+};
+
+class HistoryLog {
+public:
+  // 去重后的历史，rank 0 为最近使用的命令。只能在 withIndex 的回调内使用。
+  // 命令再次执行时它原来的位置作废而不挪动其余条目，作废的位置 live() 为 false，遍历时跳过
+  class Index {
+  public:
+    size_t size() const { return log_.order_.size(); }
+    bool live(size_t rank) const { return id(rank) != kNoEntry; }
+    // 去重后的命令数，编号取 [0, commandCount())
+    size_t commandCount() const { return log_.entries_.size(); }
+
+    // 命令的原始字节；needsDecode 为 true 时其中含有转义，需改用 command()
+    std::string_view rawCommand(size_t rank) const { return rawCommandOf(id(rank)); }
+    bool needsDecode(size_t rank) const { return log_.entries_[id(rank)].escaped; }
+    std::string command(size_t rank) const { return unescape(rawCommand(rank)); }
+
+    // 命令在去重表中的编号：同一 generation 内编号只增不减，可用来缓存按命令计算的数据
+    uint32_t id(size_t rank) const { return log_.order_[log_.order_.size() - 1 - rank]; }
+    std::string_view rawCommandOf(uint32_t id) const {
+      const Entry& entry = log_.entries_[id];
+      return std::string_view(log_.data_ + entry.commandOffset, entry.commandLength);
+    }
+    uint64_t generation() const { return log_.generation_; }
+
+    HistoryRecord record(size_t rank) const {
+      const Entry& entry = log_.entries_[id(rank)];
+      HistoryRecord rec;
+      parseLine(lineAt(log_.data_, log_.size_, entry.recordOffset), rec);
+      rec.uses = entry.uses;
+      return rec;
+    }
+
+  private:
+    friend class HistoryLog;
+    explicit Index(const HistoryLog& log) : log_(log) {}
+    const HistoryLog& log_;
+  };
+
+  HistoryLog() = default;
+  HistoryLog(const HistoryLog&) = delete;
+  HistoryLog& operator=(const HistoryLog&) = delete;
+  ~HistoryLog(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    closeAll();
+  }
+
+  // 切换到 path 对应的日志；只记下路径，不读取文件
+  void open(const std::string& path){
+    std::lock_guard<std::mutex> lock(mutex_);
+    closeAll();
+    path_ = path;
+  }
+
+  bool append(const HistoryRecord& rec){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(path_.empty()) return false;
+    if(appendFd_ < 0){
+#ifdef _WIN32
+      appendFd_ = ::_open(path_.c_str(), _O_WRONLY | _O_APPEND | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+      appendFd_ = ::open(path_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+#endif
+      if(appendFd_ < 0) return false;
+    }
+    std::string line = std::to_string(rec.timestamp);
+    line.push_back('\t');
+    line += rec.exitCode ? std::to_string(*rec.exitCode) : std::string("-");
+    line.push_back('\t');
+    escapeInto(line, rec.cwd);
+    line.push_back('\t');
+    escapeInto(line, rec.command);
+    line.push_back('\n');
+#ifdef _WIN32
+    return ::_write(appendFd_, line.data(), static_cast<unsigned>(line.size())) == static_cast<int>(line.size());
+#else
+    ssize_t written = ::write(appendFd_, line.data(), line.size());
+    return written == static_cast<ssize_t>(line.size());
+#endif
+  }
+
+  // 最近使用的 limit 条不同命令，最新在前
+  std::vector<HistoryRecord> recent(size_t limit){
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<HistoryRecord> out;
+    if(limit == 0 || !remap()) return out;
+    if(indexBuilt_){
+      catchUp();
+      Index index(*this);
+      for(size_t rank = 0; rank < index.size() && out.size() < limit; ++rank){
+        if(index.live(rank)) out.push_back(index.record(rank));
+      }
+      return out;
+    }
+    // 索引尚未建立：从文件末尾往前逐行解析，只读到凑够 limit 条为止
+    std::unordered_set<std::string> seen;
+    size_t end = completeEnd();
+    while(end > 0 && out.size() < limit){
+      size_t begin = end - 1;
+      while(begin > 0 && data_[begin - 1] != '\n') --begin;
+      HistoryRecord rec;
+      if(parseLine(std::string_view(data_ + begin, end - 1 - begin), rec) && seen.insert(rec.command).second){
+        out.push_back(std::move(rec));
+      }
+      end = begin;
+    }
+    return out;
+  }
+
+  // 在锁内以去重视图调用 fn(const Index&)；返回 false 表示日志不可读
+  template <typename Fn>
+  bool withIndex(Fn&& fn){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!remap()) return false;
+    catchUp();
+    fn(Index(*this));
+    return true;
+  }
+
+  static std::string unescape(std::string_view raw){
+    std::string out;
+    out.reserve(raw.size());
+    for(size_t i = 0; i < raw.size(); ++i){
+      char ch = raw[i];
+      if(ch == '\\' && i + 1 < raw.size()){
+        char next = raw[++i];
+        if(next == 'n') ch = '\n';
+        else if(next == 't') ch = '\t';
+        else if(next == 'r') ch = '\r';
+        else ch = next;
+      }
+      out.push_back(ch);
+    }
+    return out;
+  }
+
+private:
+  struct Entry {
+    uint64_t hash = 0;
+    uint64_t recordOffset = 0;   // 最近一次出现的记录
+    uint64_t commandOffset = 0;
+    uint32_t commandLength = 0;
+    uint32_t orderPos = 0;       // 在 order_ 中的位置
+    uint32_t uses = 0;
+    bool escaped = false;
+  };
+
+  static void escapeInto(std::string& out, const std::string& text){
+    for(char ch : text){
+      switch(ch){
+        case '\\': out += "\\\\"; break;
+        case '\t': out += "\\t"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        default: out.push_back(ch); break;
+      }
+    }
+  }
+
+  static std::string_view lineAt(const char* data, size_t size, uint64_t offset){
+    const char* begin = data + offset;
+    const void* nl = std::memchr(begin, '\n', size - offset);
+    size_t length = nl ? static_cast<size_t>(static_cast<const char*>(nl) - begin) : size - offset;
+    return std::string_view(begin, length);
+  }
+
+  // 拆出四个字段；以 # 开头的行留作注释
+  static bool splitLine(std::string_view line, std::string_view fields[4]){
+    if(line.empty() || line[0] == '#') return false;
+    size_t from = 0;
+    for(int f = 0; f < 3; ++f){
+      size_t tab = line.find('\t', from);
+      if(tab == std::string_view::npos) return false;
+      fields[f] = line.substr(from, tab - from);
+      from = tab + 1;
+    }
+    fields[3] = line.substr(from);
+    return !fields[3].empty();
+  }
+
+  static bool parseLine(std::string_view line, HistoryRecord& rec){
+    std::string_view fields[4];
+    if(!splitLine(line, fields)) return false;
+    rec.timestamp = 0;
+    for(char ch : fields[0]){
+      if(ch < '0' || ch > '9') return false;
+      rec.timestamp = rec.timestamp * 10 + (ch - '0');
+    }
+    rec.exitCode.reset();
+    if(fields[1] != "-"){
+      try{
+        rec.exitCode = std::stoi(std::string(fields[1]));
+      }catch(...){
+      }
+    }
+    rec.cwd = unescape(fields[2]);
+    rec.command = unescape(fields[3]);
+    return true;
+  }
+
+  // 每次吃 8 个字节的乘法混合哈希，只用于去重表分桶，命中后仍比较原文
+  static uint64_t hashOf(std::string_view text){
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ text.size();
+    size_t i = 0;
+    for(; i + 8 <= text.size(); i += 8){
+      uint64_t word;
+      std::memcpy(&word, text.data() + i, 8);
+      h = (h ^ word) * 0xFF51AFD7ED558CCDull;
+      h ^= h >> 32;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, text.data() + i, text.size() - i);
+    h = (h ^ tail) * 0xC4CEB9FE1A85EC53ull;
+    return h ^ (h >> 29);
+  }
+
+  // 只解析以换行结尾的完整记录，别的会话写到一半的尾部留到下次
+  size_t completeEnd() const {
+    size_t end = size_;
+    while(end > 0 && data_[end - 1] != '\n') --end;
+    return end;
+  }
+
+  // 文件被替换或截断时丢弃索引；变长时重新映射
+  bool remap(){
+    if(path_.empty()) return false;
+    struct stat st{};
+    if(::stat(path_.c_str(), &st) != 0){
+      unmap();
+      resetIndex();
+      return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    if(st.st_dev != device_ || st.st_ino != inode_ || size < size_){
+      unmap();
+      resetIndex();
+      device_ = st.st_dev;
+      inode_ = st.st_ino;
+    }
+    if(size == size_ && (data_ || size == 0)) return true;
+    unmap();
+    if(size == 0) return true;
+#ifdef _WIN32
+    int fd = ::_open(path_.c_str(), _O_RDONLY | _O_BINARY);
+    if(fd < 0) return false;
+    buffer_.resize(size);
+    int got = ::_read(fd, buffer_.data(), static_cast<unsigned>(size));
+    ::_close(fd);
+    if(got < 0) return false;
+    buffer_.resize(static_cast<size_t>(got));
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#else
+    int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return false;
+    void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mapped == MAP_FAILED) return false;
+    data_ = static_cast<const char*>(mapped);
+    size_ = size;
+#endif
+    return true;
+  }
+
+  // 把 indexed_ 之后的完整记录并入去重索引。每条新记录只把命令移到 order_ 末尾、
+  // 把旧位置记为作废，代价与历史长度无关；作废位置多于有效位置时再整体压实
+  void catchUp(){
+    size_t end = completeEnd();
+    while(indexed_ < end){
+      uint64_t offset = indexed_;
+      std::string_view line = lineAt(data_, size_, offset);
+      indexed_ = offset + line.size() + 1;
+      std::string_view fields[4];
+      if(!splitLine(line, fields)) continue;
+      std::string_view command = fields[3];
+      uint64_t hash = hashOf(command);
+      size_t slot = findSlot(hash, command);
+      uint32_t id = slots_[slot].id;
+      if(id == kNoEntry){
+        id = static_cast<uint32_t>(entries_.size());
+        entries_.push_back(Entry{});
+        entries_.back().hash = hash;
+        slots_[slot] = Slot{id, static_cast<uint32_t>(hash >> 32)};
+        if(entries_.size() * 2 > slots_.size()) reserveSlots(entries_.size() * 2);
+      }
+      Entry& entry = entries_[id];
+      if(entry.uses > 0){
+        order_[entry.orderPos] = kNoEntry;
+        ++staleOrder_;
+      }
+      entry.recordOffset = offset;
+      entry.commandOffset = static_cast<uint64_t>(command.data() - data_);
+      entry.commandLength = static_cast<uint32_t>(command.size());
+      entry.escaped = command.find('\\') != std::string_view::npos;
+      entry.orderPos = static_cast<uint32_t>(order_.size());
+      entry.uses += 1;
+      order_.push_back(id);
+    }
+    indexBuilt_ = true;
+    if(staleOrder_ > kMinStaleOrder && staleOrder_ * 2 > order_.size()) compactOrder();
+  }
+
+  void compactOrder(){
+    size_t live = 0;
+    for(uint32_t id : order_){
+      if(id == kNoEntry) continue;
+      entries_[id].orderPos = static_cast<uint32_t>(live);
+      order_[live++] = id;
+    }
+    order_.resize(live);
+    staleOrder_ = 0;
+  }
+
+  // 开放寻址的去重表：槽里存条目编号和哈希高 32 位，探测时先比标签，
+  // 标签相同才去读条目比较原文；装载率不超过一半。返回命中的槽或应插入的空槽
+  struct Slot {
+    uint32_t id = kNoEntry;
+    uint32_t tag = 0;
+  };
+
+  size_t findSlot(uint64_t hash, std::string_view command){
+    if(slots_.empty()){
+      size_t expected = size_ / kTypicalRecordBytes;
+      reserveSlots(expected);
+      entries_.reserve(expected);
+      order_.reserve(expected);
+    }
+    size_t mask = slots_.size() - 1;
+    uint32_t tag = static_cast<uint32_t>(hash >> 32);
+    for(size_t slot = static_cast<size_t>(hash) & mask;; slot = (slot + 1) & mask){
+      const Slot& s = slots_[slot];
+      if(s.id == kNoEntry) return slot;
+      if(s.tag != tag) continue;
+      const Entry& entry = entries_[s.id];
+      if(std::string_view(data_ + entry.commandOffset, entry.commandLength) == command) return slot;
+    }
+  }
+
+  void reserveSlots(size_t expected){
+    size_t capacity = kInitialSlots;
+    while(capacity < expected * 2) capacity *= 2;
+    if(capacity <= slots_.size()) return;
+    std::vector<Slot> grown(capacity);
+    size_t mask = capacity - 1;
+    for(const Slot& s : slots_){
+      if(s.id == kNoEntry) continue;
+      size_t slot = static_cast<size_t>(entries_[s.id].hash) & mask;
+      while(grown[slot].id != kNoEntry) slot = (slot + 1) & mask;
+      grown[slot] = s;
+    }
+    slots_.swap(grown);
+  }
+
+  void unmap(){
+#ifdef _WIN32
+    buffer_.clear();
+#else
+    if(data_) ::munmap(const_cast<char*>(data_), size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+  void resetIndex(){
+    entries_.clear();
+    slots_.clear();
+    order_.clear();
+    staleOrder_ = 0;
+    indexed_ = 0;
+    indexBuilt_ = false;
+    ++generation_;
+    device_ = 0;
+    inode_ = 0;
+  }
+
+  void closeAll(){
+    unmap();
+    resetIndex();
+    if(appendFd_ >= 0){
+#ifdef _WIN32
+      ::_close(appendFd_);
+#else
+      ::close(appendFd_);
+#endif
+    }
+    appendFd_ = -1;
+  }
+
+  static constexpr uint32_t kNoEntry = 0xffffffffu;
+  static constexpr size_t kInitialSlots = 1024;
+  static constexpr size_t kTypicalRecordBytes = 64;
+  static constexpr size_t kMinStaleOrder = 1024;
+
+  std::mutex mutex_;
+  std::string path_;
+  int appendFd_ = -1;
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  std::string buffer_;
+#endif
+  dev_t device_ = 0;
+  ino_t inode_ = 0;
+  uint64_t indexed_ = 0;
+  bool indexBuilt_ = false;
+  uint64_t generation_ = 0;
+  std::vector<Entry> entries_;
+  std::vector<Slot> slots_;
+  std::vector<uint32_t> order_;  // 按最后一次出现从旧到新，作废的位置为 kNoEntry
+  size_t staleOrder_ = 0;
+};
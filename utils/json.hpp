@@ -1,40 +1,291 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <algorithm>
 #include <vector>
-#include <map>
+#include <memory>
+#include <new>
+#include <utility>
+#include <initializer_list>
+#include <functional>
 #include <optional>
 #include <stdexcept>
 #include <cctype>
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
+#include <charconv>
 
 namespace sj {
 
 class Value;
-using Object = std::map<std::string, Value>;
-using Array = std::vector<Value>;
 
+// 单次解析的节点存储：按块顺序分配，只能整体释放。Document 用它存放数组与对象的元素，
+// 同一份文本的全部节点只需几次大块分配。
+class Arena {
+public:
+  Arena() = default;
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(size_t bytes, size_t align){
+    size_t offset = (used_ + align - 1) & ~(align - 1);
+    if(blocks_.empty() || offset + bytes > blocks_[current_].size){
+      nextBlock(bytes + align);
+      offset = (used_ + align - 1) & ~(align - 1);
+    }
+    used_ = offset + bytes;
+    return blocks_[current_].data.get() + offset;
+  }
+
+  // 保留已申请的块，下次解析直接复用
+  void reset(){
+    current_ = 0;
+    used_ = 0;
+  }
+
+private:
+  static constexpr size_t kFirstBlock = 16 * 1024;
+
+  struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size = 0;
+  };
+
+  void nextBlock(size_t minimum){
+    while(!blocks_.empty() && current_ + 1 < blocks_.size()){
+      ++current_;
+      used_ = 0;
+      if(blocks_[current_].size >= minimum) return;
+    }
+    size_t size = blocks_.empty() ? kFirstBlock : blocks_.back().size * 2;
+    while(size < minimum) size *= 2;
+    blocks_.push_back(Block{std::unique_ptr<char[]>(new char[size]), size});
+    current_ = blocks_.size() - 1;
+    used_ = 0;
+  }
+
+  std::vector<Block> blocks_;
+  size_t current_ = 0;
+  size_t used_ = 0;
+};
+
+// 元素连续存放的数组，接口取 std::vector 的常用子集。存储来自堆或某个 Arena；
+// 复制总是得到堆上的独立副本，移动则连同存储一起转交。
+class Array {
+public:
+  using value_type = Value;
+  using iterator = Value*;
+  using const_iterator = const Value*;
+  using size_type = size_t;
+
+  Array() = default;
+  Array(std::initializer_list<Value> values);
+  Array(const Array& other);
+  Array(Array&& other) noexcept : data_(other.data_), size_(other.size_), capacity_(other.capacity_), arena_(other.arena_) {
+    other.data_ = nullptr;
+    other.size_ = other.capacity_ = 0;
+    other.arena_ = nullptr;
+  }
+  Array& operator=(const Array& other){
+    if(this != &other){
+      Array copy(other);
+      swap(copy);
+    }
+    return *this;
+  }
+  Array& operator=(Array&& other) noexcept {
+    if(this != &other){
+      Array moved(std::move(other));
+      swap(moved);
+    }
+    return *this;
+  }
+  ~Array(){ release(); }
+
+  void swap(Array& other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(arena_, other.arena_);
+  }
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  bool empty() const { return size_ == 0; }
+  Value* data() { return data_; }
+  const Value* data() const { return data_; }
+  iterator begin() { return data_; }
+  iterator end();
+  const_iterator begin() const { return data_; }
+  const_iterator end() const;
+  Value& operator[](size_t i);
+  const Value& operator[](size_t i) const;
+  Value& at(size_t i);
+  const Value& at(size_t i) const;
+  Value& front() { return *data_; }
+  const Value& front() const { return *data_; }
+  Value& back();
+  const Value& back() const;
+
+  void reserve(size_t capacity);
+  void push_back(const Value& value);
+  void push_back(Value&& value);
+  template <typename... Args>
+  Value& emplace_back(Args&&... args);
+  void pop_back();
+  void clear();
+
+private:
+  friend class Parser;
+
+  // 把 values 中的元素移入恰好大小的新存储（解析时用）
+  static Array adopt(Value* values, size_t count, Arena* arena);
+  void grow(size_t minimum);
+  void release();
+
+  Value* data_ = nullptr;
+  uint32_t size_ = 0;
+  uint32_t capacity_ = 0;
+  Arena* arena_ = nullptr;
+};
+
+// 按插入顺序保存成员的对象，接口取 std::map 的常用子集。成员少时线性查找；
+// 超过 kIndexedSize 个成员时另建开放寻址的哈希索引。重复的键保留第一次出现的值。
+class Object {
+public:
+  using key_type = std::string;
+  using mapped_type = Value;
+  using value_type = std::pair<std::string, Value>;
+  using iterator = value_type*;
+  using const_iterator = const value_type*;
+  using size_type = size_t;
+
+  static constexpr size_t kIndexedSize = 16;
+
+  Object() = default;
+  Object(std::initializer_list<value_type> members);
+  Object(const Object& other);
+  Object(Object&& other) noexcept
+    : data_(other.data_), size_(other.size_), capacity_(other.capacity_), arena_(other.arena_), index_(other.index_) {
+    other.data_ = nullptr;
+    other.size_ = other.capacity_ = 0;
+    other.arena_ = nullptr;
+    other.index_ = nullptr;
+  }
+  Object& operator=(const Object& other){
+    if(this != &other){
+      Object copy(other);
+      swap(copy);
+    }
+    return *this;
+  }
+  Object& operator=(Object&& other) noexcept {
+    if(this != &other){
+      Object moved(std::move(other));
+      swap(moved);
+    }
+    return *this;
+  }
+  ~Object(){ release(); }
+
+  void swap(Object& other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(arena_, other.arena_);
+    std::swap(index_, other.index_);
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  iterator begin() { return data_; }
+  iterator end();
+  const_iterator begin() const { return data_; }
+  const_iterator end() const;
+
+  iterator find(std::string_view key);
+  const_iterator find(std::string_view key) const;
+  size_t count(std::string_view key) const { return indexOf(key) < size_ ? 1 : 0; }
+  bool contains(std::string_view key) const { return indexOf(key) < size_; }
+  Value& at(std::string_view key);
+  const Value& at(std::string_view key) const;
+  Value& operator[](std::string_view key);
+
+  template <typename V>
+  std::pair<iterator, bool> emplace(std::string key, V&& value);
+  std::pair<iterator, bool> insert(const value_type& member);
+  std::pair<iterator, bool> insert(value_type&& member);
+  template <typename V>
+  std::pair<iterator, bool> insert_or_assign(std::string key, V&& value);
+  size_t erase(std::string_view key);
+  iterator erase(const_iterator pos);
+  void reserve(size_t capacity);
+  void clear();
+
+private:
+  friend class Parser;
+
+  static size_t hashKey(std::string_view key){ return std::hash<std::string_view>{}(key); }
+  size_t indexOf(std::string_view key) const;
+  // 追加一个确定不重复的成员
+  iterator append(std::string&& key, Value&& value);
+  static Object adopt(value_type* members, size_t count, Arena* arena);
+  void grow(size_t minimum);
+  void release();
+  void rebuildIndex();
+  void indexInsert(size_t position);
+
+  value_type* data_ = nullptr;
+  uint32_t size_ = 0;
+  uint32_t capacity_ = 0;
+  Arena* arena_ = nullptr;
+  // 哈希索引：index_[0] 为槽数减一，其后每个槽存成员下标加一，0 表示空槽
+  uint32_t* index_ = nullptr;
+};
+
+// JSON 值：类型标签加一个载荷，字符串直接用 std::string（短串不分配）。
 class Value {
 public:
-  enum class Type { Null, Bool, Number, String, Array, Object };
+  enum class Type : uint8_t { Null, Bool, Number, String, Array, Object };
 
-  Value() : type_(Type::Null), number_(0.0), bool_(false) {}
+  Value() : type_(Type::Null), number_(0.0) {}
   explicit Value(std::nullptr_t) : Value() {}
-  explicit Value(bool b) : type_(Type::Bool), number_(0.0), bool_(b) {}
-  explicit Value(double num) : type_(Type::Number), number_(num), bool_(false) {}
-  explicit Value(int num) : type_(Type::Number), number_(static_cast<double>(num)), bool_(false) {}
-  explicit Value(long long num) : type_(Type::Number), number_(static_cast<double>(num)), bool_(false) {}
-  explicit Value(const std::string& s) : type_(Type::String), string_(s), number_(0.0), bool_(false) {}
-  explicit Value(std::string&& s) : type_(Type::String), string_(std::move(s)), number_(0.0), bool_(false) {}
-  explicit Value(const char* s) : type_(Type::String), string_(s ? s : ""), number_(0.0), bool_(false) {}
-  explicit Value(const Array& arr) : type_(Type::Array), array_(arr), number_(0.0), bool_(false) {}
-  explicit Value(Array&& arr) : type_(Type::Array), array_(std::move(arr)), number_(0.0), bool_(false) {}
-  explicit Value(const Object& obj) : type_(Type::Object), object_(obj), number_(0.0), bool_(false) {}
-  explicit Value(Object&& obj) : type_(Type::Object), object_(std::move(obj)), number_(0.0), bool_(false) {}
+  explicit Value(bool b) : type_(Type::Bool), bool_(b) {}
+  explicit Value(double num) : type_(Type::Number), number_(num) {}
+  explicit Value(int num) : type_(Type::Number), number_(static_cast<double>(num)) {}
+  explicit Value(long long num) : type_(Type::Number), number_(static_cast<double>(num)) {}
+  explicit Value(const std::string& s) : type_(Type::String) { new (&string_) std::string(s); }
+  explicit Value(std::string&& s) : type_(Type::String) { new (&string_) std::string(std::move(s)); }
+  explicit Value(std::string_view s) : type_(Type::String) { new (&string_) std::string(s); }
+  explicit Value(const char* s) : type_(Type::String) { new (&string_) std::string(s ? s : ""); }
+  explicit Value(const sj::Array& arr) : type_(Type::Array) { new (&array_) sj::Array(arr); }
+  explicit Value(sj::Array&& arr) : type_(Type::Array) { new (&array_) sj::Array(std::move(arr)); }
+  explicit Value(const sj::Object& obj) : type_(Type::Object) { new (&object_) sj::Object(obj); }
+  explicit Value(sj::Object&& obj) : type_(Type::Object) { new (&object_) sj::Object(std::move(obj)); }
+
+  Value(const Value& other) : type_(Type::Null), number_(0.0) { copyFrom(other); }
+  Value(Value&& other) noexcept : type_(Type::Null), number_(0.0) { moveFrom(std::move(other)); }
+  Value& operator=(const Value& other){
+    if(this != &other){
+      Value copy(other);
+      destroy();
+      moveFrom(std::move(copy));
+    }
+    return *this;
+  }
+  Value& operator=(Value&& other) noexcept {
+    if(this != &other){
+      destroy();
+      moveFrom(std::move(other));
+    }
+    return *this;
+  }
+  ~Value(){ destroy(); }
 
   Type type() const { return type_; }
   bool isNull() const { return type_ == Type::Null; }
@@ -67,27 +318,27 @@ public:
     return string_;
   }
 
-  const Array& asArray() const {
+  const sj::Array& asArray() const {
     if(!isArray()) throw std::runtime_error("json value is not array");
     return array_;
   }
 
-  const Object& asObject() const {
+  const sj::Object& asObject() const {
     if(!isObject()) throw std::runtime_error("json value is not object");
     return object_;
   }
 
-  Array& array() {
+  sj::Array& array() {
     if(!isArray()) throw std::runtime_error("json value is not array");
     return array_;
   }
 
-  Object& object() {
+  sj::Object& object() {
     if(!isObject()) throw std::runtime_error("json value is not object");
     return object_;
   }
 
-  const Value* find(const std::string& key) const {
+  const Value* find(std::string_view key) const {
     if(!isObject()) return nullptr;
     auto it = object_.find(key);
     if(it == object_.end()) return nullptr;
@@ -95,21 +346,380 @@ public:
   }
 
 private:
+  void destroy(){
+    switch(type_){
+      case Type::String: string_.~basic_string(); break;
+      case Type::Array: array_.~Array(); break;
+      case Type::Object: object_.~Object(); break;
+      default: break;
+    }
+    type_ = Type::Null;
+    number_ = 0.0;
+  }
+
+  void copyFrom(const Value& other){
+    switch(other.type_){
+      case Type::Null: number_ = 0.0; break;
+      case Type::Bool: bool_ = other.bool_; break;
+      case Type::Number: number_ = other.number_; break;
+      case Type::String: new (&string_) std::string(other.string_); break;
+      case Type::Array: new (&array_) sj::Array(other.array_); break;
+      case Type::Object: new (&object_) sj::Object(other.object_); break;
+    }
+    type_ = other.type_;
+  }
+
+  void moveFrom(Value&& other) noexcept {
+    switch(other.type_){
+      case Type::Null: number_ = 0.0; break;
+      case Type::Bool: bool_ = other.bool_; break;
+      case Type::Number: number_ = other.number_; break;
+      case Type::String: new (&string_) std::string(std::move(other.string_)); break;
+      case Type::Array: new (&array_) sj::Array(std::move(other.array_)); break;
+      case Type::Object: new (&object_) sj::Object(std::move(other.object_)); break;
+    }
+    type_ = other.type_;
+    other.destroy();
+  }
+
   Type type_;
-  std::string string_;
-  Array array_;
-  Object object_;
-  double number_;
-  bool bool_;
+  union {
+    bool bool_;
+    double number_;
+    std::string string_;
+    sj::Array array_;
+    sj::Object object_;
+  };
 };
 
+// ===== Array =====
+inline Array::iterator Array::end() { return data_ + size_; }
+inline Array::const_iterator Array::end() const { return data_ + size_; }
+inline Value& Array::operator[](size_t i) { return data_[i]; }
+inline const Value& Array::operator[](size_t i) const { return data_[i]; }
+inline Value& Array::back() { return data_[size_ - 1]; }
+inline const Value& Array::back() const { return data_[size_ - 1]; }
+
+inline Value& Array::at(size_t i){
+  if(i >= size_) throw std::out_of_range("json array index out of range");
+  return data_[i];
+}
+
+inline const Value& Array::at(size_t i) const {
+  if(i >= size_) throw std::out_of_range("json array index out of range");
+  return data_[i];
+}
+
+inline Array::Array(std::initializer_list<Value> values){
+  reserve(values.size());
+  for(const auto& v : values) new (data_ + size_++) Value(v);
+}
+
+inline Array::Array(const Array& other){
+  reserve(other.size_);
+  for(const auto& v : other) new (data_ + size_++) Value(v);
+}
+
+inline void Array::release(){
+  for(uint32_t i = 0; i < size_; ++i) data_[i].~Value();
+  if(!arena_) ::operator delete(static_cast<void*>(data_));
+  data_ = nullptr;
+  size_ = capacity_ = 0;
+  arena_ = nullptr;
+}
+
+inline void Array::grow(size_t minimum){
+  if(minimum > std::numeric_limits<uint32_t>::max()) throw std::length_error("json array too large");
+  size_t capacity = std::max<size_t>(minimum, capacity_ ? size_t(capacity_) * 2 : 4);
+  capacity = std::min<size_t>(capacity, std::numeric_limits<uint32_t>::max());
+  Value* next = static_cast<Value*>(::operator new(capacity * sizeof(Value)));
+  for(uint32_t i = 0; i < size_; ++i){
+    new (next + i) Value(std::move(data_[i]));
+    data_[i].~Value();
+  }
+  if(!arena_) ::operator delete(static_cast<void*>(data_));
+  data_ = next;
+  capacity_ = static_cast<uint32_t>(capacity);
+  arena_ = nullptr; // 增长后的存储总在堆上
+}
+
+inline void Array::reserve(size_t capacity){
+  if(capacity > capacity_) grow(capacity);
+}
+
+inline void Array::push_back(const Value& value){
+  if(size_ == capacity_){
+    Value copy(value); // value 可能就是本数组的元素
+    grow(size_t(size_) + 1);
+    new (data_ + size_++) Value(std::move(copy));
+    return;
+  }
+  new (data_ + size_++) Value(value);
+}
+
+inline void Array::push_back(Value&& value){
+  if(size_ == capacity_){
+    Value moved(std::move(value));
+    grow(size_t(size_) + 1);
+    new (data_ + size_++) Value(std::move(moved));
+    return;
+  }
+  new (data_ + size_++) Value(std::move(value));
+}
+
+template <typename... Args>
+inline Value& Array::emplace_back(Args&&... args){
+  Value value(std::forward<Args>(args)...);
+  push_back(std::move(value));
+  return back();
+}
+
+inline void Array::pop_back(){
+  data_[--size_].~Value();
+}
+
+inline void Array::clear(){
+  for(uint32_t i = 0; i < size_; ++i) data_[i].~Value();
+  size_ = 0;
+}
+
+inline Array Array::adopt(Value* values, size_t count, Arena* arena){
+  Array out;
+  if(count == 0) return out;
+  if(count > std::numeric_limits<uint32_t>::max()) throw std::length_error("json array too large");
+  out.data_ = static_cast<Value*>(arena ? arena->allocate(count * sizeof(Value), alignof(Value))
+                                        : ::operator new(count * sizeof(Value)));
+  out.arena_ = arena;
+  out.capacity_ = static_cast<uint32_t>(count);
+  for(size_t i = 0; i < count; ++i) new (out.data_ + out.size_++) Value(std::move(values[i]));
+  return out;
+}
+
+// ===== Object =====
+inline Object::iterator Object::end() { return data_ + size_; }
+inline Object::const_iterator Object::end() const { return data_ + size_; }
+inline Object::iterator Object::find(std::string_view key){ return data_ + indexOf(key); }
+inline Object::const_iterator Object::find(std::string_view key) const { return data_ + indexOf(key); }
+
+inline Object::Object(std::initializer_list<value_type> members){
+  reserve(members.size());
+  for(const auto& m : members) emplace(m.first, m.second);
+}
+
+inline Object::Object(const Object& other){
+  reserve(other.size_);
+  for(const auto& m : other) new (data_ + size_++) value_type(m);
+  if(other.index_) rebuildIndex();
+}
+
+inline void Object::release(){
+  for(uint32_t i = 0; i < size_; ++i) data_[i].~value_type();
+  if(!arena_) ::operator delete(static_cast<void*>(data_));
+  delete[] index_;
+  data_ = nullptr;
+  size_ = capacity_ = 0;
+  arena_ = nullptr;
+  index_ = nullptr;
+}
+
+inline void Object::grow(size_t minimum){
+  if(minimum > std::numeric_limits<uint32_t>::max()) throw std::length_error("json object too large");
+  size_t capacity = std::max<size_t>(minimum, capacity_ ? size_t(capacity_) * 2 : 4);
+  capacity = std::min<size_t>(capacity, std::numeric_limits<uint32_t>::max());
+  value_type* next = static_cast<value_type*>(::operator new(capacity * sizeof(value_type)));
+  for(uint32_t i = 0; i < size_; ++i){
+    new (next + i) value_type(std::move(data_[i]));
+    data_[i].~value_type();
+  }
+  if(!arena_) ::operator delete(static_cast<void*>(data_));
+  data_ = next;
+  capacity_ = static_cast<uint32_t>(capacity);
+  arena_ = nullptr;
+}
+
+inline void Object::reserve(size_t capacity){
+  if(capacity > capacity_) grow(capacity);
+}
+
+inline void Object::clear(){
+  for(uint32_t i = 0; i < size_; ++i) data_[i].~value_type();
+  size_ = 0;
+  delete[] index_;
+  index_ = nullptr;
+}
+
+inline size_t Object::indexOf(std::string_view key) const {
+  if(index_){
+    uint32_t mask = index_[0];
+    for(size_t slot = hashKey(key) & mask;; slot = (slot + 1) & mask){
+      uint32_t entry = index_[1 + slot];
+      if(entry == 0) return size_;
+      if(data_[entry - 1].first == key) return entry - 1;
+    }
+  }
+  for(uint32_t i = 0; i < size_; ++i){
+    if(data_[i].first == key) return i;
+  }
+  return size_;
+}
+
+// 槽数取成员数两倍以上的 2 的幂，装载率不超过一半
+inline void Object::rebuildIndex(){
+  delete[] index_;
+  index_ = nullptr;
+  if(size_ < kIndexedSize) return;
+  size_t slots = 1;
+  while(slots < size_t(capacity_) * 2) slots <<= 1;
+  index_ = new uint32_t[slots + 1]();
+  index_[0] = static_cast<uint32_t>(slots - 1);
+  for(uint32_t i = 0; i < size_; ++i) indexInsert(i);
+}
+
+inline void Object::indexInsert(size_t position){
+  uint32_t mask = index_[0];
+  size_t slot = hashKey(data_[position].first) & mask;
+  while(index_[1 + slot] != 0) slot = (slot + 1) & mask;
+  index_[1 + slot] = static_cast<uint32_t>(position + 1);
+}
+
+inline Object::iterator Object::append(std::string&& key, Value&& value){
+  bool grew = size_ == capacity_;
+  if(grew) grow(size_t(size_) + 1);
+  new (data_ + size_) value_type(std::move(key), std::move(value));
+  ++size_;
+  if(grew || (!index_ && size_ >= kIndexedSize)) rebuildIndex();
+  else if(index_) indexInsert(size_ - 1);
+  return data_ + size_ - 1;
+}
+
+template <typename V>
+inline std::pair<Object::iterator, bool> Object::emplace(std::string key, V&& value){
+  size_t at = indexOf(key);
+  if(at < size_) return {data_ + at, false};
+  Value v(std::forward<V>(value));
+  return {append(std::move(key), std::move(v)), true};
+}
+
+template <typename V>
+inline std::pair<Object::iterator, bool> Object::insert_or_assign(std::string key, V&& value){
+  size_t at = indexOf(key);
+  if(at < size_){
+    data_[at].second = Value(std::forward<V>(value));
+    return {data_ + at, false};
+  }
+  Value v(std::forward<V>(value));
+  return {append(std::move(key), std::move(v)), true};
+}
+
+inline std::pair<Object::iterator, bool> Object::insert(const value_type& member){
+  return emplace(member.first, member.second);
+}
+
+inline std::pair<Object::iterator, bool> Object::insert(value_type&& member){
+  return emplace(std::move(member.first), std::move(member.second));
+}
+
+inline Value& Object::operator[](std::string_view key){
+  size_t at = indexOf(key);
+  if(at < size_) return data_[at].second;
+  return append(std::string(key), Value())->second;
+}
+
+inline Value& Object::at(std::string_view key){
+  size_t i = indexOf(key);
+  if(i >= size_) throw std::out_of_range("json object has no such key");
+  return data_[i].second;
+}
+
+inline const Value& Object::at(std::string_view key) const {
+  size_t i = indexOf(key);
+  if(i >= size_) throw std::out_of_range("json object has no such key");
+  return data_[i].second;
+}
+
+inline Object::iterator Object::erase(const_iterator pos){
+  size_t at = static_cast<size_t>(pos - data_);
+  for(size_t i = at; i + 1 < size_; ++i) data_[i] = std::move(data_[i + 1]);
+  data_[--size_].~value_type();
+  rebuildIndex();
+  return data_ + at;
+}
+
+inline size_t Object::erase(std::string_view key){
+  size_t at = indexOf(key);
+  if(at >= size_) return 0;
+  erase(data_ + at);
+  return 1;
+}
+
+inline Object Object::adopt(value_type* members, size_t count, Arena* arena){
+  Object out;
+  if(count == 0) return out;
+  if(count > std::numeric_limits<uint32_t>::max()) throw std::length_error("json object too large");
+  out.data_ = static_cast<value_type*>(arena ? arena->allocate(count * sizeof(value_type), alignof(value_type))
+                                             : ::operator new(count * sizeof(value_type)));
+  out.arena_ = arena;
+  out.capacity_ = static_cast<uint32_t>(count);
+  for(size_t i = 0; i < count; ++i) new (out.data_ + out.size_++) value_type(std::move(members[i]));
+  out.rebuildIndex();
+  return out;
+}
+
+namespace detail {
+
+// token 是已校验过语法的数字文本；integral 表示没有小数与指数部分
+inline double number_from_text(std::string_view token, bool integral){
+  bool negative = !token.empty() && token[0] == '-';
+  size_t digits = token.size() - (negative ? 1 : 0);
+  // 不超过 15 位的整数可精确地直接换算
+  if(integral && digits <= 15){
+    int64_t value = 0;
+    for(size_t i = negative ? 1 : 0; i < token.size(); ++i) value = value * 10 + (token[i] - '0');
+    if(negative && value == 0) return -0.0;
+    return static_cast<double>(negative ? -value : value);
+  }
+  // token 不一定以 NUL 结尾，复制出来再交给 strtod
+  char buf[64];
+  if(token.size() < sizeof(buf)){
+    std::memcpy(buf, token.data(), token.size());
+    buf[token.size()] = '\0';
+    return std::strtod(buf, nullptr);
+  }
+  std::string copy(token);
+  return std::strtod(copy.c_str(), nullptr);
+}
+
+inline void append_utf8(std::string& out, unsigned int code){
+  if(code <= 0x7F){
+    out.push_back(static_cast<char>(code));
+  }else if(code <= 0x7FF){
+    out.push_back(static_cast<char>(0xC0 | ((code >> 6) & 0x1F)));
+    out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+  }else if(code <= 0xFFFF){
+    out.push_back(static_cast<char>(0xE0 | ((code >> 12) & 0x0F)));
+    out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+  }else{
+    out.push_back(static_cast<char>(0xF0 | ((code >> 18) & 0x07)));
+    out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+  }
+}
+
+} // namespace detail
+
+// 递归下降解析。数组与对象的元素先压在共用的暂存栈上，解析完一层再一次性搬进恰好大小的存储，
+// 给定 Arena 时存储来自 Arena。
 class Parser {
 public:
-  Parser(const std::string& text) : text_(text), pos_(0) {}
+  static constexpr int kMaxDepth = 512;
+
+  explicit Parser(std::string_view text, Arena* arena = nullptr) : text_(text), pos_(0), arena_(arena) {}
 
   Value parse(){
     skipWhitespace();
-    Value v = parseValue();
+    Value v = parseValue(0);
     skipWhitespace();
     if(pos_ != text_.size()){
       throw std::runtime_error("unexpected characters after JSON value");
@@ -118,165 +728,183 @@ public:
   }
 
 private:
-  const std::string& text_;
+  std::string_view text_;
   size_t pos_;
+  Arena* arena_;
+  std::vector<Value> values_;
+  std::vector<Object::value_type> members_;
 
   void skipWhitespace(){
-    while(pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))){
+    while(pos_ < text_.size()){
+      char ch = text_[pos_];
+      if(ch != ' ' && ch != '\n' && ch != '\r' && ch != '\t') break;
       ++pos_;
     }
   }
 
-  Value parseValue(){
+  Value parseValue(int depth){
     if(pos_ >= text_.size()) throw std::runtime_error("unexpected end of JSON");
     char ch = text_[pos_];
     switch(ch){
-      case 'n': return parseNull();
-      case 't': return parseTrue();
-      case 'f': return parseFalse();
-      case '"': return parseString();
-      case '[': return parseArray();
-      case '{': return parseObject();
+      case 'n': expect("null"); return Value();
+      case 't': expect("true"); return Value(true);
+      case 'f': expect("false"); return Value(false);
+      case '"': return Value(parseString());
+      case '[': return parseArray(depth + 1);
+      case '{': return parseObject(depth + 1);
       default:
-        if(ch == '-' || std::isdigit(static_cast<unsigned char>(ch))) return parseNumber();
+        if(ch == '-' || (ch >= '0' && ch <= '9')) return parseNumber();
         throw std::runtime_error("invalid JSON value");
     }
   }
 
-  Value parseNull(){
-    expect("null");
-    return Value();
-  }
-
-  Value parseTrue(){
-    expect("true");
-    return Value(true);
-  }
-
-  Value parseFalse(){
-    expect("false");
-    return Value(false);
-  }
+  bool digitAt(size_t i) const { return i < text_.size() && text_[i] >= '0' && text_[i] <= '9'; }
 
   Value parseNumber(){
     size_t start = pos_;
-    if(text_[pos_] == '-') ++pos_;
-    if(pos_ >= text_.size()) throw std::runtime_error("invalid number");
+    bool negative = text_[pos_] == '-';
+    if(negative) ++pos_;
+    if(!digitAt(pos_)) throw std::runtime_error("invalid number");
     if(text_[pos_] == '0'){
       ++pos_;
     }else{
-      if(!std::isdigit(static_cast<unsigned char>(text_[pos_]))) throw std::runtime_error("invalid number");
-      while(pos_ < text_.size() && std::isdigit(static_cast<unsigned char>(text_[pos_]))){ ++pos_; }
+      while(digitAt(pos_)) ++pos_;
     }
+    bool integral = true;
     if(pos_ < text_.size() && text_[pos_] == '.'){
+      integral = false;
       ++pos_;
-      if(pos_ >= text_.size() || !std::isdigit(static_cast<unsigned char>(text_[pos_]))) throw std::runtime_error("invalid number");
-      while(pos_ < text_.size() && std::isdigit(static_cast<unsigned char>(text_[pos_]))){ ++pos_; }
+      if(!digitAt(pos_)) throw std::runtime_error("invalid number");
+      while(digitAt(pos_)) ++pos_;
     }
     if(pos_ < text_.size() && (text_[pos_] == 'e' || text_[pos_] == 'E')){
+      integral = false;
       ++pos_;
       if(pos_ < text_.size() && (text_[pos_] == '+' || text_[pos_] == '-')) ++pos_;
-      if(pos_ >= text_.size() || !std::isdigit(static_cast<unsigned char>(text_[pos_]))) throw std::runtime_error("invalid number");
-      while(pos_ < text_.size() && std::isdigit(static_cast<unsigned char>(text_[pos_]))){ ++pos_; }
+      if(!digitAt(pos_)) throw std::runtime_error("invalid number");
+      while(digitAt(pos_)) ++pos_;
     }
-    std::string token = text_.substr(start, pos_ - start);
-    double value = std::strtod(token.c_str(), nullptr);
-    return Value(value);
+    return Value(detail::number_from_text(text_.substr(start, pos_ - start), integral));
   }
 
-  Value parseString(){
+  unsigned int parseHex4(){
+    if(pos_ + 4 > text_.size()) throw std::runtime_error("invalid unicode escape");
+    unsigned int code = 0;
+    for(int i=0;i<4;++i){
+      char hex = text_[pos_++];
+      code <<= 4;
+      if(hex >= '0' && hex <= '9') code += static_cast<unsigned int>(hex - '0');
+      else if(hex >= 'a' && hex <= 'f') code += static_cast<unsigned int>(hex - 'a' + 10);
+      else if(hex >= 'A' && hex <= 'F') code += static_cast<unsigned int>(hex - 'A' + 10);
+      else throw std::runtime_error("invalid unicode escape");
+    }
+    return code;
+  }
+
+  // 没有转义的片段整段复制
+  std::string parseString(){
     if(text_[pos_] != '"') throw std::runtime_error("expected string");
     ++pos_;
     std::string out;
-    while(pos_ < text_.size()){
-      char ch = text_[pos_++];
-      if(ch == '"'){
-        return Value(out);
-      }
-      if(ch == '\\'){
-        if(pos_ >= text_.size()) throw std::runtime_error("invalid escape");
-        char esc = text_[pos_++];
-        switch(esc){
-          case '"': out.push_back('"'); break;
-          case '\\': out.push_back('\\'); break;
-          case '/': out.push_back('/'); break;
-          case 'b': out.push_back('\b'); break;
-          case 'f': out.push_back('\f'); break;
-          case 'n': out.push_back('\n'); break;
-          case 'r': out.push_back('\r'); break;
-          case 't': out.push_back('\t'); break;
-          case 'u':{
-            if(pos_ + 4 > text_.size()) throw std::runtime_error("invalid unicode escape");
-            unsigned int code = 0;
-            for(int i=0;i<4;++i){
-              char hex = text_[pos_++];
-              code <<= 4;
-              if(hex >= '0' && hex <= '9') code += static_cast<unsigned int>(hex - '0');
-              else if(hex >= 'a' && hex <= 'f') code += static_cast<unsigned int>(hex - 'a' + 10);
-              else if(hex >= 'A' && hex <= 'F') code += static_cast<unsigned int>(hex - 'A' + 10);
-              else throw std::runtime_error("invalid unicode escape");
-            }
-            if(code <= 0x7F){
-              out.push_back(static_cast<char>(code));
-            }else if(code <= 0x7FF){
-              out.push_back(static_cast<char>(0xC0 | ((code >> 6) & 0x1F)));
-              out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
-            }else{
-              out.push_back(static_cast<char>(0xE0 | ((code >> 12) & 0x0F)));
-              out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
-              out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
-            }
-            break;
+    while(true){
+      size_t run = pos_;
+      while(run < text_.size() && text_[run] != '"' && text_[run] != '\\') ++run;
+      if(run >= text_.size()) throw std::runtime_error("unterminated string");
+      out.append(text_.data() + pos_, run - pos_);
+      pos_ = run + 1;
+      if(text_[run] == '"') return out;
+      if(pos_ >= text_.size()) throw std::runtime_error("invalid escape");
+      char esc = text_[pos_++];
+      switch(esc){
+        case '"': out.push_back('"'); break;
+        case '\\': out.push_back('\\'); break;
+        case '/': out.push_back('/'); break;
+        case 'b': out.push_back('\b'); break;
+        case 'f': out.push_back('\f'); break;
+        case 'n': out.push_back('\n'); break;
+        case 'r': out.push_back('\r'); break;
+        case 't': out.push_back('\t'); break;
+        case 'u':{
+          unsigned int code = parseHex4();
+          // 代理对合成一个码点
+          if(code >= 0xD800 && code <= 0xDBFF && pos_ + 6 <= text_.size() &&
+             text_[pos_] == '\\' && text_[pos_ + 1] == 'u'){
+            size_t save = pos_;
+            pos_ += 2;
+            unsigned int low = parseHex4();
+            if(low >= 0xDC00 && low <= 0xDFFF) code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            else pos_ = save;
           }
-          default:
-            throw std::runtime_error("invalid escape sequence");
+          detail::append_utf8(out, code);
+          break;
         }
-      }else{
-        out.push_back(ch);
+        default:
+          throw std::runtime_error("invalid escape sequence");
       }
     }
-    throw std::runtime_error("unterminated string");
   }
 
-  Value parseArray(){
-    if(text_[pos_] != '[') throw std::runtime_error("expected array");
+  Value parseArray(int depth){
+    if(depth > kMaxDepth) throw std::runtime_error("JSON nested too deeply");
     ++pos_;
-    Array arr;
+    size_t base = values_.size();
     skipWhitespace();
-    if(pos_ < text_.size() && text_[pos_] == ']'){ ++pos_; return Value(std::move(arr)); }
+    if(pos_ < text_.size() && text_[pos_] == ']'){ ++pos_; return Value(Array()); }
     while(true){
       skipWhitespace();
-      arr.push_back(parseValue());
+      values_.push_back(parseValue(depth));
       skipWhitespace();
-      if(pos_ >= text_.size()) throw std::runtime_error("unterminated array");
+      if(pos_ >= text_.size()){ values_.resize(base); throw std::runtime_error("unterminated array"); }
       char ch = text_[pos_++];
       if(ch == ']') break;
-      if(ch != ',') throw std::runtime_error("expected comma in array");
+      if(ch != ','){ values_.resize(base); throw std::runtime_error("expected comma in array"); }
     }
+    Array arr = Array::adopt(values_.data() + base, values_.size() - base, arena_);
+    values_.resize(base);
     return Value(std::move(arr));
   }
 
-  Value parseObject(){
-    if(text_[pos_] != '{') throw std::runtime_error("expected object");
+  Value parseObject(int depth){
+    if(depth > kMaxDepth) throw std::runtime_error("JSON nested too deeply");
     ++pos_;
-    Object obj;
+    size_t base = members_.size();
     skipWhitespace();
-    if(pos_ < text_.size() && text_[pos_] == '}'){ ++pos_; return Value(std::move(obj)); }
+    if(pos_ < text_.size() && text_[pos_] == '}'){ ++pos_; return Value(Object()); }
     while(true){
       skipWhitespace();
-      Value key = parseString();
+      if(pos_ >= text_.size() || text_[pos_] != '"'){ members_.resize(base); throw std::runtime_error("expected string"); }
+      std::string key = parseString();
       skipWhitespace();
-      if(pos_ >= text_.size() || text_[pos_] != ':') throw std::runtime_error("expected colon in object");
+      if(pos_ >= text_.size() || text_[pos_] != ':'){ members_.resize(base); throw std::runtime_error("expected colon in object"); }
       ++pos_;
       skipWhitespace();
-      Value value = parseValue();
-      obj.emplace(key.asString(), std::move(value));
+      members_.emplace_back(std::move(key), parseValue(depth));
       skipWhitespace();
-      if(pos_ >= text_.size()) throw std::runtime_error("unterminated object");
+      if(pos_ >= text_.size()){ members_.resize(base); throw std::runtime_error("unterminated object"); }
       char ch = text_[pos_++];
       if(ch == '}') break;
-      if(ch != ',') throw std::runtime_error("expected comma in object");
+      if(ch != ','){ members_.resize(base); throw std::runtime_error("expected comma in object"); }
+    }
+    size_t count = members_.size() - base;
+    // 与 std::map::emplace 相同，重复的键保留第一次出现的值；成员不多时直接两两比较
+    bool duplicates = false;
+    if(count <= Object::kIndexedSize){
+      for(size_t i = base + 1; i < members_.size() && !duplicates; ++i){
+        for(size_t j = base; j < i; ++j){
+          if(members_[i].first == members_[j].first){ duplicates = true; break; }
+        }
+      }
+    }else{
+      duplicates = true; // 大对象交给带索引的 emplace 去重
+    }
+    Object obj;
+    if(!duplicates){
+      obj = Object::adopt(members_.data() + base, count, arena_);
+    }else{
+      obj.reserve(count);
+      for(size_t i = base; i < members_.size(); ++i) obj.emplace(std::move(members_[i].first), std::move(members_[i].second));
     }
+    members_.resize(base);
     return Value(std::move(obj));
   }
 
@@ -289,17 +917,70 @@ private:
   }
 };
 
-inline Value parse(const std::string& text){
+inline Value parse(std::string_view text){
   Parser parser(text);
   return parser.parse();
 }
 
-inline std::string dumpString(const std::string& value){
-  std::string out;
-  out.reserve(value.size() + 2);
+// 一次解析的结果连同它的节点存储：数组与对象的元素都分配在内部 Arena 上，
+// 下一次 parse 或析构时整体释放。root() 返回的值只在 Document 存活且未重新解析期间有效，
+// 需要保留时复制一份（复制总是得到堆上的独立副本）。
+class Document {
+public:
+  Document() = default;
+  Document(const Document&) = delete;
+  Document& operator=(const Document&) = delete;
+
+  const Value& parse(std::string_view text){
+    root_ = Value();
+    arena_.reset();
+    Parser parser(text, &arena_);
+    root_ = parser.parse();
+    return root_;
+  }
+
+  const Value& root() const { return root_; }
+
+private:
+  Arena arena_;  // 先于 root_ 声明：析构时 root_ 先释放元素，再归还 arena 的内存
+  Value root_;
+};
+
+namespace detail {
+
+// 8 字节一组跳过无需转义的字节，停在第一个含引号、反斜杠或控制字符的字之前
+inline const char* skip_clean_bytes(const char* p, const char* end){
+  constexpr uint64_t ones = 0x0101010101010101ull;
+  constexpr uint64_t highs = 0x8080808080808080ull;
+  auto hasByte = [](uint64_t word, uint64_t pattern){
+    uint64_t x = word ^ pattern;
+    return (x - ones) & ~x & highs;
+  };
+  while(end - p >= 8){
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    uint64_t control = (word - ones * 0x20) & ~word & highs;  // 小于 0x20 的字节
+    if(control | hasByte(word, ones * '"') | hasByte(word, ones * '\\')) break;
+    p += 8;
+  }
+  return p;
+}
+
+inline bool needs_escape(char ch){
+  return ch == '"' || ch == '\\' || static_cast<unsigned char>(ch) < 0x20;
+}
+
+// 干净的片段整段追加，只在需要转义的字节上逐个处理
+inline void append_string(std::string& out, std::string_view value){
   out.push_back('"');
-  for(char ch : value){
-    switch(ch){
+  const char* p = value.data();
+  const char* end = p + value.size();
+  while(p < end){
+    const char* run = skip_clean_bytes(p, end);
+    while(run < end && !needs_escape(*run)) ++run;
+    out.append(p, static_cast<size_t>(run - p));
+    if(run == end) break;
+    switch(*run){
       case '"': out += "\\\""; break;
       case '\\': out += "\\\\"; break;
       case '\b': out += "\\b"; break;
@@ -307,93 +988,146 @@ inline std::string dumpString(const std::string& value){
       case '\n': out += "\\n"; break;
       case '\r': out += "\\r"; break;
       case '\t': out += "\\t"; break;
-      default:
-        if(static_cast<unsigned char>(ch) < 0x20){
-          char buf[7];
-          std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned int>(static_cast<unsigned char>(ch)));
-          out += buf;
-        }else{
-          out.push_back(ch);
-        }
+      default: {
+        static const char hex[] = "0123456789abcdef";
+        unsigned char code = static_cast<unsigned char>(*run);
+        char buf[6] = {'\\', 'u', '0', '0', hex[code >> 4], hex[code & 0xf]};
+        out.append(buf, sizeof(buf));
         break;
+      }
     }
+    p = run + 1;
   }
   out.push_back('"');
-  return out;
 }
 
-inline std::string dump(const Value& value, int indent = -1, int level = 0){
-  switch(value.type()){
-    case Value::Type::Null:
-      return "null";
-    case Value::Type::Bool:
-      return value.asBool() ? "true" : "false";
-    case Value::Type::Number: {
-      char buf[64];
-      double num = value.asNumber();
-      if(std::isfinite(num)){
-        std::snprintf(buf, sizeof(buf), "%.15g", num);
-      }else if(std::isnan(num)){
-        return "null";
-      }else{
-        return num < 0 ? "-1e9999" : "1e9999";
-      }
-      std::string out(buf);
-      if(out.find('.') == std::string::npos && out.find('e') == std::string::npos && out.find('E') == std::string::npos){
-        // ensure integer formatting doesn't include trailing .0
-      }
-      return out;
+// 输出与 "%.15g" 一致：绝对值小于 1e15 的整数走整数转换，其余交给 to_chars（不可用时退回 snprintf）
+inline void append_number(std::string& out, double num){
+  if(!std::isfinite(num)){
+    if(std::isnan(num)) out += "null";
+    else out += num < 0 ? "-1e9999" : "1e9999";
+    return;
+  }
+  char buf[32];
+  if(num > -1e15 && num < 1e15){
+    long long whole = static_cast<long long>(num);
+    if(static_cast<double>(whole) == num && (whole != 0 || !std::signbit(num))){
+      auto result = std::to_chars(buf, buf + sizeof(buf), whole);
+      out.append(buf, static_cast<size_t>(result.ptr - buf));
+      return;
     }
-    case Value::Type::String:
-      return dumpString(value.asString());
-    case Value::Type::Array: {
-      const auto& arr = value.asArray();
-      if(arr.empty()) return "[]";
-      std::string out;
-      out.push_back('[');
-      bool pretty = indent >= 0;
-      for(size_t i=0;i<arr.size();++i){
-        if(pretty){
-          out.push_back('\n');
-          out.append((level+1)*indent, ' ');
+  }
+#if defined(__cpp_lib_to_chars)
+  auto result = std::to_chars(buf, buf + sizeof(buf), num, std::chars_format::general, 15);
+  out.append(buf, static_cast<size_t>(result.ptr - buf));
+#else
+  int len = std::snprintf(buf, sizeof(buf), "%.15g", num);
+  out.append(buf, static_cast<size_t>(len));
+#endif
+}
+
+} // namespace detail
+
+// 把 JSON 追加到调用方持有的缓冲区末尾，缓冲区可在多次序列化之间复用。
+// 既能整体写出 Value，也能逐个写出成员与元素，不必先拼出一棵 Value。
+// indent >= 0 时按该缩进换行输出。
+class Writer {
+public:
+  explicit Writer(std::string& out, int indent = -1) : out_(out), indent_(indent) {}
+
+  Writer& value(const Value& value){
+    switch(value.type()){
+      case Value::Type::Null: return null();
+      case Value::Type::Bool: return boolean(value.asBool());
+      case Value::Type::Number: return number(value.asNumber());
+      case Value::Type::String: return string(value.asString());
+      case Value::Type::Array:
+        beginArray();
+        for(const auto& item : value.asArray()) this->value(item);
+        return endArray();
+      case Value::Type::Object:
+        beginObject();
+        for(const auto& kv : value.asObject()){
+          key(kv.first);
+          this->value(kv.second);
         }
-        out += dump(arr[i], indent, level+1);
-        if(i + 1 < arr.size()) out.push_back(',');
-      }
-      if(pretty){
-        out.push_back('\n');
-        out.append(level*indent, ' ');
-      }
-      out.push_back(']');
-      return out;
+        return endObject();
     }
-    case Value::Type::Object: {
-      const auto& obj = value.asObject();
-      if(obj.empty()) return "{}";
-      std::string out;
-      out.push_back('{');
-      bool pretty = indent >= 0;
-      size_t i = 0;
-      for(const auto& kv : obj){
-        if(pretty){
-          out.push_back('\n');
-          out.append((level+1)*indent, ' ');
-        }
-        out += dumpString(kv.first);
-        out.push_back(':');
-        if(pretty) out.push_back(' ');
-        out += dump(kv.second, indent, level+1);
-        if(++i < obj.size()) out.push_back(',');
-      }
-      if(pretty){
-        out.push_back('\n');
-        out.append(level*indent, ' ');
-      }
-      out.push_back('}');
-      return out;
+    return null();
+  }
+
+  Writer& null(){ separator(); out_ += "null"; return *this; }
+  Writer& boolean(bool value){ separator(); out_ += value ? "true" : "false"; return *this; }
+  Writer& number(double value){ separator(); detail::append_number(out_, value); return *this; }
+  Writer& string(std::string_view value){ separator(); detail::append_string(out_, value); return *this; }
+  // 原样写入一段已序列化的 JSON
+  Writer& raw(std::string_view json){ separator(); out_.append(json); return *this; }
+
+  Writer& key(std::string_view name){
+    separator();
+    detail::append_string(out_, name);
+    out_.push_back(':');
+    if(indent_ >= 0) out_.push_back(' ');
+    afterKey_ = true;
+    return *this;
+  }
+
+  Writer& beginObject(){ return open('{'); }
+  Writer& endObject(){ return close('}'); }
+  Writer& beginArray(){ return open('['); }
+  Writer& endArray(){ return close(']'); }
+
+private:
+  Writer& open(char bracket){
+    separator();
+    out_.push_back(bracket);
+    empty_.push_back(true);
+    return *this;
+  }
+
+  Writer& close(char bracket){
+    bool empty = empty_.back();
+    empty_.pop_back();
+    if(!empty) newline();
+    out_.push_back(bracket);
+    return *this;
+  }
+
+  // 值或键之前：补逗号与换行缩进；紧跟在键后面的值什么都不用补
+  void separator(){
+    if(afterKey_){
+      afterKey_ = false;
+      return;
     }
+    if(empty_.empty()) return;
+    if(!empty_.back()) out_.push_back(',');
+    empty_.back() = false;
+    newline();
+  }
+
+  void newline(){
+    if(indent_ < 0) return;
+    out_.push_back('\n');
+    out_.append(empty_.size() * static_cast<size_t>(indent_), ' ');
   }
-  return "null";
+
+  std::string& out_;
+  int indent_;
+  bool afterKey_ = false;
+  std::vector<bool> empty_;  // 每层容器是否还没有写入元素
+};
+
+inline std::string dumpString(std::string_view value){
+  std::string out;
+  out.reserve(value.size() + 2);
+  detail::append_string(out, value);
+  return out;
+}
+
+inline std::string dump(const Value& value, int indent = -1){
+  std::string out;
+  Writer(out, indent).value(value);
+  return out;
 }
 
 inline Value make_object(std::initializer_list<std::pair<const std::string, Value>> entries){
@@ -0,0 +1,545 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.hpp"
+
+namespace sj {
+
+enum class Token : uint8_t { StartObject, EndObject, StartArray, EndArray, Key, String, Number, Bool, Null, End };
+
+namespace detail {
+
+// 字符串扫描中需要停下来看的字节；换行只在 JSONL 时有意义
+struct StringStopTable {
+  bool stop[256] = {};
+  constexpr StringStopTable(){
+    stop[static_cast<unsigned char>('"')] = true;
+    stop[static_cast<unsigned char>('\\')] = true;
+    stop[static_cast<unsigned char>('\n')] = true;
+  }
+};
+
+inline constexpr StringStopTable kStringStop{};
+
+// 每次检查 8 个字节，跳过不含引号、反斜杠与换行的整段，返回第一个可能需要停下的位置
+inline const char* skip_plain_bytes(const char* p, const char* end){
+  constexpr uint64_t ones = 0x0101010101010101ull;
+  constexpr uint64_t highs = 0x8080808080808080ull;
+  auto hasByte = [](uint64_t word, uint64_t pattern){
+    uint64_t x = word ^ pattern;
+    return (x - ones) & ~x & highs;
+  };
+  while(end - p >= 8){
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    if(hasByte(word, ones * '"') | hasByte(word, ones * '\\') | hasByte(word, ones * '\n')) break;
+    p += 8;
+  }
+  return p;
+}
+
+} // namespace detail
+
+// 拉取式读取：逐个取出记号而不建树，加载器边读边把字段写进自己的结构体。
+// 输入可以是内存中的文本，也可以是按块读入的流（缓冲只需容纳最长的单个记号）。
+// string() 返回的视图只在下一次读取前有效。
+// jsonLines 为真时按 JSONL 读取：每行一个值，值内部不允许换行；出错后可用 resync() 跳到下一行继续。
+class Reader {
+public:
+  static constexpr size_t kChunkSize = 64 * 1024;
+
+  explicit Reader(std::string_view text, bool jsonLines = false)
+    : data_(text.data()), size_(text.size()), lines_(jsonLines) {}
+  explicit Reader(std::istream& in, bool jsonLines = false, size_t chunkSize = kChunkSize)
+    : in_(&in), lines_(jsonLines), chunk_(chunkSize ? chunkSize : kChunkSize) {}
+  Reader(const Reader&) = delete;
+  Reader& operator=(const Reader&) = delete;
+
+  Token next(){
+    switch(state_){
+      case State::Start:
+        skipWhitespace(false);
+        if(peek() < 0){
+          if(lines_) return Token::End;
+          fail("unexpected end of JSON");
+        }
+        return valueToken();
+      case State::Done:
+        if(!more()) return Token::End;
+        return next();
+      case State::Value:
+        skipWhitespace(true);
+        return valueToken();
+      case State::FirstKey:
+        skipWhitespace(true);
+        if(peek() == '}'){
+          ++pos_;
+          return close(Token::EndObject);
+        }
+        return keyToken();
+      case State::FirstElement:
+        skipWhitespace(true);
+        if(peek() == ']'){
+          ++pos_;
+          return close(Token::EndArray);
+        }
+        return valueToken();
+      case State::Separator:{
+        skipWhitespace(true);
+        bool inObject = stack_.back();
+        int ch = peek();
+        if(ch == ','){
+          ++pos_;
+          skipWhitespace(true);
+          return inObject ? keyToken() : valueToken();
+        }
+        if(ch == (inObject ? '}' : ']')){
+          ++pos_;
+          return close(inObject ? Token::EndObject : Token::EndArray);
+        }
+        fail(inObject ? "expected comma in object" : "expected comma in array");
+      }
+    }
+    return Token::End;
+  }
+
+  // 一个顶层值读完（或尚未开始）时判断后面是否还有值；JSONL 逐行读取时作为循环条件
+  bool more(){
+    if(state_ == State::Done){
+      finish();
+      if(!lines_) return false;
+      state_ = State::Start;
+    }
+    if(state_ == State::Start){
+      skipWhitespace(false);
+      return peek() >= 0;
+    }
+    return true;
+  }
+
+  // 确认刚读完的顶层值之后只有空白；JSONL 时只检查本行的剩余部分
+  void finish(){
+    if(state_ != State::Done) fail("JSON value not finished");
+    if(lines_){
+      skipLineTail();
+      return;
+    }
+    skipWhitespace(false);
+    if(peek() >= 0) fail("unexpected characters after JSON value");
+  }
+
+  // 当前 Key 或 String 记号的文本
+  std::string_view string() const { return text_; }
+  double number() const { return detail::number_from_text(text_, integral_); }
+  long long integer() const { return static_cast<long long>(number()); }
+  bool boolean() const { return bool_; }
+  size_t depth() const { return stack_.size(); }
+
+  // 在对象内逐个取成员名，遇到 '}' 返回 false；取到成员名后必须读取或跳过它的值
+  bool nextMember(std::string_view& key){
+    Token t = next();
+    if(t == Token::Key){
+      key = key_;
+      return true;
+    }
+    if(t == Token::EndObject) return false;
+    fail("expected object member");
+  }
+
+  // 在数组内逐个推进，遇到 ']' 返回 false；返回 true 后必须读取或跳过该元素
+  bool nextElement(){
+    if(stack_.empty() || stack_.back()) fail("not inside an array");
+    if(state_ != State::FirstElement && state_ != State::Separator) fail("array element not consumed");
+    skipWhitespace(true);
+    int ch = peek();
+    if(ch == ']'){
+      ++pos_;
+      close(Token::EndArray);
+      return false;
+    }
+    if(state_ == State::Separator){
+      if(ch != ',') fail("expected comma in array");
+      ++pos_;
+    }
+    state_ = State::Value;
+    return true;
+  }
+
+  // 以下读取下一个值：类型相符时取出并返回 true，否则整个跳过并返回 false
+  bool enterObject(){ return enter(Token::StartObject); }
+  bool enterArray(){ return enter(Token::StartArray); }
+
+  bool readString(std::string& out){
+    Token t = next();
+    if(t != Token::String) return skipRest(t);
+    out.assign(text_.data(), text_.size());
+    return true;
+  }
+
+  bool readNumber(double& out){
+    Token t = next();
+    if(t != Token::Number) return skipRest(t);
+    out = number();
+    return true;
+  }
+
+  bool readInteger(long long& out){
+    Token t = next();
+    if(t != Token::Number) return skipRest(t);
+    out = integer();
+    return true;
+  }
+
+  bool readBool(bool& out){
+    Token t = next();
+    if(t != Token::Bool) return skipRest(t);
+    out = bool_;
+    return true;
+  }
+
+  void skip(){ skipRest(next()); }
+  // 已用 next() 取出某个值的第一个记号时，跳过该值余下的部分
+  void skip(Token first){ skipRest(first); }
+
+  // 只为需要整棵子树的字段建树
+  Value readValue(){ return valueFrom(next()); }
+
+  // JSONL 出错后丢弃本行剩余内容，从下一行重新开始
+  void resync(){
+    stack_.clear();
+    state_ = State::Start;
+    while(true){
+      if(pos_ >= size_){
+        mark_ = pos_;
+        if(!refill()) return;
+      }
+      const void* nl = std::memchr(data_ + pos_, '\n', size_ - pos_);
+      if(nl){
+        pos_ = static_cast<size_t>(static_cast<const char*>(nl) - data_) + 1;
+        mark_ = pos_;
+        return;
+      }
+      pos_ = size_;
+    }
+  }
+
+private:
+  enum class State : uint8_t { Start, Done, Value, FirstKey, FirstElement, Separator };
+
+
+  [[noreturn]] static void fail(const char* message){ throw std::runtime_error(message); }
+
+  // 从 mark_ 起的内容保留，其余丢弃后再读入一块
+  bool refill(){
+    if(!in_ || !*in_) return false;
+    if(mark_ > 0){
+      buf_.erase(0, mark_);
+      pos_ -= mark_;
+      size_ -= mark_;
+      mark_ = 0;
+    }
+    size_t old = buf_.size();
+    buf_.resize(old + chunk_);
+    in_->read(&buf_[old], static_cast<std::streamsize>(chunk_));
+    size_t got = static_cast<size_t>(in_->gcount());
+    buf_.resize(old + got);
+    data_ = buf_.data();
+    size_ = buf_.size();
+    return got > 0;
+  }
+
+  int peek(){
+    if(pos_ < size_) return static_cast<unsigned char>(data_[pos_]);
+    while(pos_ >= size_){
+      if(!refill()) return -1;
+    }
+    return static_cast<unsigned char>(data_[pos_]);
+  }
+
+  void skipWhitespace(bool inDocument){
+    if(pos_ < size_ && static_cast<unsigned char>(data_[pos_]) > ' '){
+      mark_ = pos_;
+      return;
+    }
+    while(true){
+      while(pos_ < size_){
+        char ch = data_[pos_];
+        if(ch == ' ' || ch == '\t' || ch == '\r'){
+          ++pos_;
+        }else if(ch == '\n'){
+          // 停在换行上，resync() 正好跳过它
+          if(inDocument && lines_) fail("unterminated JSON line");
+          ++pos_;
+        }else{
+          mark_ = pos_;
+          return;
+        }
+      }
+      mark_ = pos_;
+      if(!refill()) return;
+    }
+  }
+
+  void skipLineTail(){
+    mark_ = pos_;
+    int ch = peek();
+    while(ch == ' ' || ch == '\t' || ch == '\r'){
+      ++pos_;
+      mark_ = pos_;
+      ch = peek();
+    }
+    if(ch >= 0 && ch != '\n') fail("unexpected characters after JSON value");
+  }
+
+  Token close(Token token){
+    stack_.pop_back();
+    afterValue();
+    return token;
+  }
+
+  void afterValue(){
+    state_ = stack_.empty() ? State::Done : State::Separator;
+  }
+
+  Token valueToken(){
+    int ch = peek();
+    switch(ch){
+      case -1: fail("unexpected end of JSON");
+      case '{':
+      case '[':
+        if(stack_.size() >= static_cast<size_t>(Parser::kMaxDepth)) fail("JSON nested too deeply");
+        ++pos_;
+        stack_.push_back(ch == '{');
+        state_ = ch == '{' ? State::FirstKey : State::FirstElement;
+        return ch == '{' ? Token::StartObject : Token::StartArray;
+      case '"':
+        scanString();
+        afterValue();
+        return Token::String;
+      case 'n':
+        expect("null");
+        afterValue();
+        return Token::Null;
+      case 't':
+      case 'f':
+        bool_ = ch == 't';
+        expect(bool_ ? "true" : "false");
+        afterValue();
+        return Token::Bool;
+      default:
+        if(ch == '-' || (ch >= '0' && ch <= '9')){
+          scanNumber();
+          afterValue();
+          return Token::Number;
+        }
+        fail("invalid JSON value");
+    }
+  }
+
+  Token keyToken(){
+    if(peek() != '"') fail("expected string");
+    scanString();
+    key_.assign(text_.data(), text_.size());
+    text_ = key_;
+    skipWhitespace(true);
+    if(peek() != ':') fail("expected colon in object");
+    ++pos_;
+    state_ = State::Value;
+    return Token::Key;
+  }
+
+  void expect(const char* literal){
+    mark_ = pos_;
+    for(const char* p = literal; *p; ++p){
+      if(peek() != static_cast<unsigned char>(*p)) fail("unexpected token");
+      ++pos_;
+    }
+  }
+
+  bool digit(){
+    int ch = peek();
+    return ch >= '0' && ch <= '9';
+  }
+
+  void scanNumber(){
+    mark_ = pos_;
+    if(peek() == '-') ++pos_;
+    if(!digit()) fail("invalid number");
+    if(peek() == '0'){
+      ++pos_;
+    }else{
+      while(digit()) ++pos_;
+    }
+    integral_ = true;
+    if(peek() == '.'){
+      integral_ = false;
+      ++pos_;
+      if(!digit()) fail("invalid number");
+      while(digit()) ++pos_;
+    }
+    int ch = peek();
+    if(ch == 'e' || ch == 'E'){
+      integral_ = false;
+      ++pos_;
+      ch = peek();
+      if(ch == '+' || ch == '-') ++pos_;
+      if(!digit()) fail("invalid number");
+      while(digit()) ++pos_;
+    }
+    text_ = std::string_view(data_ + mark_, pos_ - mark_);
+  }
+
+  unsigned int hex4(){
+    unsigned int code = 0;
+    for(int i = 0; i < 4; ++i){
+      int hex = peek();
+      ++pos_;
+      code <<= 4;
+      if(hex >= '0' && hex <= '9') code += static_cast<unsigned int>(hex - '0');
+      else if(hex >= 'a' && hex <= 'f') code += static_cast<unsigned int>(hex - 'a' + 10);
+      else if(hex >= 'A' && hex <= 'F') code += static_cast<unsigned int>(hex - 'A' + 10);
+      else fail("invalid unicode escape");
+    }
+    return code;
+  }
+
+  // 没有转义时 text_ 直接指向缓冲区；有转义时解码到 scratch_
+  void scanString(){
+    ++pos_;
+    mark_ = pos_;
+    bool escaped = false;
+    scratch_.clear();
+    while(true){
+      if(peek() < 0) fail("unterminated string");
+      const char* p = data_ + pos_;
+      const char* end = data_ + size_;
+      p = detail::skip_plain_bytes(p, end);
+      while(p < end && !detail::kStringStop.stop[static_cast<unsigned char>(*p)]) ++p;
+      pos_ = static_cast<size_t>(p - data_);
+      if(p == end) continue;
+      if(*p == '\n'){
+        if(lines_) fail("unterminated string");
+        ++pos_;
+        continue;
+      }
+      if(*p == '"'){
+        if(escaped){
+          scratch_.append(data_ + mark_, pos_ - mark_);
+          text_ = scratch_;
+        }else{
+          text_ = std::string_view(data_ + mark_, pos_ - mark_);
+        }
+        ++pos_;
+        return;
+      }
+      escaped = true;
+      scratch_.append(data_ + mark_, pos_ - mark_);
+      ++pos_;
+      mark_ = pos_;
+      int esc = peek();
+      ++pos_;
+      switch(esc){
+        case '"': scratch_.push_back('"'); break;
+        case '\\': scratch_.push_back('\\'); break;
+        case '/': scratch_.push_back('/'); break;
+        case 'b': scratch_.push_back('\b'); break;
+        case 'f': scratch_.push_back('\f'); break;
+        case 'n': scratch_.push_back('\n'); break;
+        case 'r': scratch_.push_back('\r'); break;
+        case 't': scratch_.push_back('\t'); break;
+        case 'u':{
+          unsigned int code = hex4();
+          // 代理对合成一个码点
+          if(code >= 0xD800 && code <= 0xDBFF && peek() == '\\'){
+            mark_ = pos_;
+            ++pos_;
+            if(peek() == 'u'){
+              ++pos_;
+              unsigned int low = hex4();
+              if(low >= 0xDC00 && low <= 0xDFFF){
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+              }else{
+                detail::append_utf8(scratch_, code);
+                code = low;
+              }
+            }else{
+              pos_ = mark_;
+            }
+          }
+          detail::append_utf8(scratch_, code);
+          break;
+        }
+        default:
+          fail("invalid escape sequence");
+      }
+      mark_ = pos_;
+    }
+  }
+
+  bool enter(Token want){
+    Token t = next();
+    if(t == want) return true;
+    return skipRest(t);
+  }
+
+  // 已取出 t；若它开启了容器则跳过容器余下的部分。总是返回 false
+  bool skipRest(Token t){
+    if(t == Token::StartObject || t == Token::StartArray){
+      size_t level = stack_.size();
+      while(stack_.size() >= level) next();
+    }else if(t == Token::Key || t == Token::EndObject || t == Token::EndArray || t == Token::End){
+      fail("expected JSON value");
+    }
+    return false;
+  }
+
+  Value valueFrom(Token t){
+    switch(t){
+      case Token::Null: return Value();
+      case Token::Bool: return Value(bool_);
+      case Token::Number: return Value(number());
+      case Token::String: return Value(std::string(text_));
+      case Token::StartArray:{
+        Array arr;
+        while(nextElement()) arr.push_back(readValue());
+        return Value(std::move(arr));
+      }
+      case Token::StartObject:{
+        Object obj;
+        std::string_view key;
+        while(nextMember(key)){
+          std::string name(key);
+          obj.emplace(std::move(name), readValue());
+        }
+        return Value(std::move(obj));
+      }
+      default:
+        fail("expected JSON value");
+    }
+  }
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  size_t pos_ = 0;
+  size_t mark_ = 0;  // 当前记号的起点，补读时不丢弃它之后的内容
+  std::istream* in_ = nullptr;
+  std::string buf_;
+  bool lines_ = false;
+  size_t chunk_ = kChunkSize;
+  State state_ = State::Start;
+  std::vector<uint8_t> stack_;  // 1 为对象
+  std::string_view text_;
+  std::string key_;
+  std::string scratch_;
+  bool integral_ = true;
+  bool bool_ = false;
+};
+
+} // namespace sj
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "parallel.hpp"
+
+// 把文件从某个偏移到末尾的内容一次读进内存。不用 mmap：记忆索引等文件会被别的进程
+// 原地截短重写，映射区里超出新文件尾的页一经访问就是 SIGBUS
+class FileContents {
+public:
+  FileContents() = default;
+  ~FileContents(){ close(); }
+  FileContents(const FileContents&) = delete;
+  FileContents& operator=(const FileContents&) = delete;
+
+  bool open(const std::string& path){
+    close();
+#ifdef _WIN32
+    fd_ = ::_open(path.c_str(), _O_RDONLY | _O_BINARY);
+    if(fd_ < 0) return false;
+    struct _stat64 st{};
+    if(::_fstat64(fd_, &st) != 0){
+      close();
+      return false;
+    }
+#else
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd_ < 0) return false;
+    struct stat st{};
+    if(::fstat(fd_, &st) != 0){
+      close();
+      return false;
+    }
+#endif
+    device_ = static_cast<uint64_t>(st.st_dev);
+    inode_ = static_cast<uint64_t>(st.st_ino);
+    size_ = static_cast<uint64_t>(st.st_size);
+    return true;
+  }
+
+  // 读取 [offset, size()) 到 text()；文件在此期间变短时读到实际末尾为止
+  bool read(uint64_t offset){
+    buffer_.clear();
+    if(fd_ < 0 || offset >= size_) return fd_ >= 0;
+    buffer_.resize(static_cast<size_t>(size_ - offset));
+    size_t got = 0;
+#ifdef _WIN32
+    if(::_lseeki64(fd_, static_cast<__int64>(offset), SEEK_SET) < 0) return false;
+    while(got < buffer_.size()){
+      unsigned chunk = static_cast<unsigned>(std::min<size_t>(buffer_.size() - got, 1u << 30));
+      int n = ::_read(fd_, &buffer_[got], chunk);
+      if(n < 0) return false;
+      if(n == 0) break;
+      got += static_cast<size_t>(n);
+    }
+#else
+    while(got < buffer_.size()){
+      ssize_t n = ::pread(fd_, &buffer_[got], buffer_.size() - got, static_cast<off_t>(offset + got));
+      if(n < 0){
+        if(errno == EINTR) continue;
+        return false;
+      }
+      if(n == 0) break;
+      got += static_cast<size_t>(n);
+    }
+#endif
+    buffer_.resize(got);
+    return true;
+  }
+
+  void close(){
+#ifdef _WIN32
+    if(fd_ >= 0) ::_close(fd_);
+#else
+    if(fd_ >= 0) ::close(fd_);
+#endif
+    fd_ = -1;
+    buffer_.clear();
+    size_ = device_ = inode_ = 0;
+  }
+
+  std::string_view text() const { return buffer_; }
+  uint64_t size() const { return size_; }
+  uint64_t device() const { return device_; }
+  uint64_t inode() const { return inode_; }
+
+private:
+  int fd_ = -1;
+  uint64_t size_ = 0;
+  uint64_t device_ = 0;
+  uint64_t inode_ = 0;
+  std::string buffer_;
+};
+
+// 增量读取的位置：offset 之前的行都已读过。文件被替换或截短时从头重读
+struct JsonlCursor {
+  uint64_t offset = 0;
+  uint64_t device = 0;
+  uint64_t inode = 0;
+};
+
+struct JsonlLoadStats {
+  bool opened = false;
+  bool restarted = false;  // 游标已失效，本次从文件开头读起，调用方应丢弃之前的结果
+  size_t lines = 0;        // 非空行数
+  size_t rejected = 0;     // 解析失败或被 parse 拒绝的行数
+};
+
+namespace jsonl_detail {
+
+constexpr size_t kParallelBytes = 256 * 1024;  // 小于此大小的范围直接在调用线程解析
+constexpr size_t kPieceBytes = 64 * 1024;
+
+inline bool is_blank(std::string_view line){
+  for(char ch : line){
+    if(ch != ' ' && ch != '\t' && ch != '\r') return false;
+  }
+  return true;
+}
+
+// 换行交给 memchr 查找（主流 libc 都按 SIMD 实现），每行交给 parse 填进一条记录，成功的交给 sink
+template<class Record, class Parse, class Sink>
+void parse_range(const char* p, const char* end, JsonlLoadStats& stats, Parse& parse, Sink&& sink){
+  while(p < end){
+    const char* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+    const char* lineEnd = nl ? nl : end;
+    std::string_view line(p, static_cast<size_t>(lineEnd - p));
+    p = nl ? nl + 1 : end;
+    if(!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    if(is_blank(line)) continue;
+    ++stats.lines;
+    Record record{};
+    bool ok = false;
+    try{
+      ok = parse(line, record);
+    }catch(...){
+      ok = false;
+    }
+    if(ok) sink(std::move(record));
+    else ++stats.rejected;
+  }
+}
+
+} // namespace jsonl_detail
+
+// 把 JSONL 文件逐行解析成 Record，按文件中的顺序逐条交给 consume。
+// 文件一次读入内存；范围较大时按行边界切成若干段，在共享线程池上并行解析，
+// 因此 parse(std::string_view line, Record& record) 必须可以并发调用，返回 false 或抛异常时该行被丢弃；
+// consume(Record&&) 总在调用线程上按顺序执行。
+// 给定 cursor 时只读取 cursor->offset 之后以换行结尾的完整行并推进游标，用于对追加写入的日志增量读取。
+template<class Record, class Parse, class Consume>
+JsonlLoadStats load_jsonl(const std::string& path, Parse&& parse, Consume&& consume, JsonlCursor* cursor = nullptr){
+  JsonlLoadStats stats;
+  FileContents file;
+  if(!file.open(path)) return stats;
+
+  // 增量模式只读游标之后的部分；text 从 base 处开始
+  uint64_t base = 0;
+  if(cursor){
+    bool sameFile = cursor->device == file.device() && cursor->inode == file.inode();
+    if(cursor->offset > 0 && (!sameFile || cursor->offset > file.size())){
+      stats.restarted = true;
+    }else{
+      base = cursor->offset;
+    }
+  }
+  if(!file.read(base)) return stats;
+  stats.opened = true;
+  if(cursor){
+    cursor->device = file.device();
+    cursor->inode = file.inode();
+  }
+  std::string_view text = file.text();
+
+  // 最后一个换行之后的内容可能还在写入，不参与并行切分
+  size_t lastNewline = text.rfind('\n');
+  size_t complete = (lastNewline == std::string_view::npos) ? 0 : lastNewline + 1;
+
+  const char* data = text.data();
+  size_t span = complete;
+  auto& pool = WorkStealingPool::shared();
+  if(span < jsonl_detail::kParallelBytes || pool.concurrency() == 1){
+    jsonl_detail::parse_range<Record>(data, data + complete, stats, parse, consume);
+  }else{
+    // 按字节均分后把每个切点推到下一行开头
+    size_t pieces = std::min(span / jsonl_detail::kPieceBytes, pool.concurrency() * 4);
+    std::vector<size_t> cuts(pieces + 1);
+    cuts[0] = 0;
+    cuts[pieces] = complete;
+    for(size_t i = 1; i < pieces; ++i){
+      size_t target = std::max(cuts[i - 1], span / pieces * i);
+      const void* nl = target < complete ? std::memchr(data + target, '\n', complete - target) : nullptr;
+      cuts[i] = nl ? static_cast<size_t>(static_cast<const char*>(nl) - data) + 1 : complete;
+    }
+    std::vector<std::vector<Record>> parts(pieces);
+    std::vector<JsonlLoadStats> partStats(pieces);
+    pool.parallelFor(pieces, 1, [&](size_t, size_t b, size_t e){
+      for(size_t i = b; i < e; ++i){
+        auto& part = parts[i];
+        jsonl_detail::parse_range<Record>(data + cuts[i], data + cuts[i + 1], partStats[i], parse,
+                                          [&](Record&& record){ part.push_back(std::move(record)); });
+      }
+    });
+    for(size_t i = 0; i < pieces; ++i){
+      for(auto& record : parts[i]) consume(std::move(record));
+      std::vector<Record>().swap(parts[i]);
+      stats.lines += partStats[i].lines;
+      stats.rejected += partStats[i].rejected;
+    }
+  }
+
+  // 没有换行结尾的最后一行：整体读取时照常解析；增量模式下可能还没写完，留到下次
+  if(!cursor && complete < text.size()){
+    jsonl_detail::parse_range<Record>(data + complete, data + text.size(), stats, parse, consume);
+  }
+  if(cursor) cursor->offset = base + complete;
+  return stats;
+}
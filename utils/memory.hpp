@@ -2,6 +2,8 @@
 
 #include "../globals.hpp"
 #include "json.hpp"
+#include "json_reader.hpp"
+#include "jsonl_loader.hpp"
 
 #include <algorithm>
 #include <cctype>
@@ -119,46 +121,13 @@ public:
   bool load(const std::string& indexPath, const std::string& rootPath){
     root_ = rootPath;
     nodes_.clear();
-    std::ifstream in(indexPath);
-    if(!in.good()) return false;
-    std::string line;
-    while(std::getline(in, line)){
-      if(line.empty()) continue;
-      try{
-        sj::Parser parser(line);
-        sj::Value val = parser.parse();
-        if(!val.isObject()) continue;
-        const auto& obj = val.asObject();
-        MemoryNode node;
-        if(auto it = obj.find("id"); it != obj.end() && it->second.isString()) node.id = it->second.asString();
-        if(auto it = obj.find("rel_path"); it != obj.end() && it->second.isString()) node.relPath = it->second.asString();
-        if(node.id.empty()) node.id = node.relPath;
-        if(node.relPath.empty()) node.relPath = node.id;
-        if(auto it = obj.find("parent"); it != obj.end() && it->second.isString()) node.parent = it->second.asString();
-        if(node.parent.empty()) node.parent = memory_parent_of(node.relPath);
-        if(auto it = obj.find("depth"); it != obj.end()) node.depth = static_cast<int>(it->second.asInteger(memory_depth_of(node.relPath)));
-        else node.depth = memory_depth_of(node.relPath);
-        if(auto it = obj.find("kind"); it != obj.end() && it->second.isString()) node.kind = it->second.asString();
-        if(node.kind.empty()) node.kind = "file";
-        if(auto it = obj.find("title"); it != obj.end() && it->second.isString()) node.title = it->second.asString();
-        if(node.title.empty()) node.title = basenameOf(node.relPath);
-        if(auto it = obj.find("summary"); it != obj.end() && it->second.isString()) node.summary = it->second.asString();
-        if(auto it = obj.find("is_personal"); it != obj.end()) node.isPersonal = it->second.asBool(false);
-        if(auto it = obj.find("bucket"); it != obj.end() && it->second.isString()) node.bucket = it->second.asString();
-        if(node.bucket.empty()) node.bucket = node.isPersonal ? "personal" : "knowledge";
-        if(auto it = obj.find("eager_expose"); it != obj.end()) node.eagerExpose = it->second.asBool(false);
-        if(auto it = obj.find("size_bytes"); it != obj.end()) node.sizeBytes = it->second.asInteger(-1);
-        if(auto it = obj.find("token_est"); it != obj.end()) node.tokenEst = it->second.asInteger(-1);
-        if(auto it = obj.find("children"); it != obj.end() && it->second.isArray()){
-          for(const auto& c : it->second.asArray()){
-            if(c.isString()) node.children.push_back(c.asString());
-          }
-        }
-        nodes_[node.relPath] = std::move(node);
-      }catch(const std::exception&){
-        continue;
-      }
-    }
+    // 文件一次读入内存后按行边界切段并行解析，字段直接填进 MemoryNode，不为每行建树；坏行跳过。
+    // 同一路径出现多次时以文件中靠后的一行为准
+    auto keep = [this](MemoryNode&& node){
+      MemoryNode& slot = nodes_[node.relPath];
+      slot = std::move(node);
+    };
+    if(!load_jsonl<MemoryNode>(indexPath, readNodeLine, keep).opened) return false;
     if(nodes_.find("") == nodes_.end()){
       MemoryNode root;
       root.id = root.relPath = "";
@@ -301,6 +270,49 @@ public:
   const std::string& root() const { return root_; }
 
 private:
+  // 一行索引记录；可在多个线程上同时调用
+  static bool readNodeLine(std::string_view line, MemoryNode& node){
+    sj::Reader reader(line);
+    if(!reader.enterObject()) return false;
+    std::optional<long long> depth;
+    std::string_view key;
+    while(reader.nextMember(key)){
+      if(key == "id") reader.readString(node.id);
+      else if(key == "rel_path") reader.readString(node.relPath);
+      else if(key == "parent") reader.readString(node.parent);
+      else if(key == "depth"){
+        long long value = 0;
+        if(reader.readInteger(value)) depth = value;
+      }
+      else if(key == "kind") reader.readString(node.kind);
+      else if(key == "title") reader.readString(node.title);
+      else if(key == "summary") reader.readString(node.summary);
+      else if(key == "is_personal") reader.readBool(node.isPersonal);
+      else if(key == "bucket") reader.readString(node.bucket);
+      else if(key == "eager_expose") reader.readBool(node.eagerExpose);
+      else if(key == "size_bytes") reader.readInteger(node.sizeBytes);
+      else if(key == "token_est") reader.readInteger(node.tokenEst);
+      else if(key == "children"){
+        if(reader.enterArray()){
+          std::string child;
+          while(reader.nextElement()){
+            if(reader.readString(child)) node.children.push_back(std::move(child));
+          }
+        }
+      }
+      else reader.skip();
+    }
+    reader.finish();
+    if(node.id.empty()) node.id = node.relPath;
+    if(node.relPath.empty()) node.relPath = node.id;
+    if(node.parent.empty()) node.parent = memory_parent_of(node.relPath);
+    node.depth = static_cast<int>(depth ? *depth : memory_depth_of(node.relPath));
+    if(node.kind.empty()) node.kind = "file";
+    if(node.title.empty()) node.title = basenameOf(node.relPath);
+    if(node.bucket.empty()) node.bucket = node.isPersonal ? "personal" : "knowledge";
+    return true;
+  }
+
   std::string root_;
   std::map<std::string, MemoryNode> nodes_;
 };
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 工作窃取线程池：parallelFor 把区间切成若干块，每个参与者先领到一段连续的块，
+// 从自己那段的前端依次取；做完后到其他参与者那段的尾端去偷。调用线程也作为
+// 参与者 0 干活，函数返回时所有块都已完成。工作线程在第一次需要时才创建。
+class WorkStealingPool {
+public:
+  using RangeFn = std::function<void(size_t worker, size_t begin, size_t end)>;
+
+  explicit WorkStealingPool(size_t threads = 0){
+    if(threads == 0){
+      unsigned hw = std::thread::hardware_concurrency();
+      threads = hw == 0 ? 1 : static_cast<size_t>(hw);
+    }
+    participants_ = std::max<size_t>(1, std::min<size_t>(threads, kMaxParticipants));
+  }
+
+  ~WorkStealingPool(){
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for(auto& t : threads_) t.join();
+  }
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  static WorkStealingPool& shared(){
+    static WorkStealingPool pool;
+    return pool;
+  }
+
+  // 参与者数量（含调用线程），可用作每线程局部结果的数组大小
+  size_t concurrency() const { return participants_; }
+
+  void parallelFor(size_t count, size_t chunk, const RangeFn& fn){
+    if(count == 0) return;
+    chunk = std::max<size_t>(1, chunk);
+    size_t chunks = (count + chunk - 1) / chunk;
+    if(participants_ == 1 || chunks == 1){
+      fn(0, 0, count);
+      return;
+    }
+
+    // 同一时刻只跑一个任务；嵌套调用会退化为串行
+    std::unique_lock<std::mutex> jobLock(jobMutex_, std::try_to_lock);
+    if(!jobLock.owns_lock()){
+      fn(0, 0, count);
+      return;
+    }
+    ensureThreads();
+
+    size_t workers = std::min(participants_, chunks);
+    Job job;
+    job.fn = &fn;
+    job.count = count;
+    job.chunk = chunk;
+    job.remaining.store(chunks, std::memory_order_relaxed);
+    job.queues = std::unique_ptr<ChunkQueue[]>(new ChunkQueue[workers]);
+    job.queueCount = workers;
+    for(size_t w = 0; w < workers; ++w){
+      job.queues[w].front = chunks * w / workers;
+      job.queues[w].back = chunks * (w + 1) / workers;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_ = &job;
+      ++generation_;
+    }
+    wake_.notify_all();
+
+    runParticipant(job, 0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [&]{ return job.remaining.load(std::memory_order_acquire) == 0 && job.active == 0; });
+    job_ = nullptr;
+  }
+
+private:
+  static constexpr size_t kMaxParticipants = 64;
+
+  struct ChunkQueue {
+    std::mutex mutex;
+    size_t front = 0;
+    size_t back = 0;
+  };
+
+  struct Job {
+    const RangeFn* fn = nullptr;
+    size_t count = 0;
+    size_t chunk = 1;
+    std::unique_ptr<ChunkQueue[]> queues;
+    size_t queueCount = 0;
+    std::atomic<size_t> remaining{0};
+    size_t active = 0;  // 受 mutex_ 保护：仍持有该任务指针的工作线程数
+  };
+
+  void ensureThreads(){
+    if(!threads_.empty()) return;
+    threads_.reserve(participants_ - 1);
+    for(size_t w = 1; w < participants_; ++w){
+      threads_.emplace_back([this, w]{ workerMain(w); });
+    }
+  }
+
+  void workerMain(size_t worker){
+    uint64_t seen = 0;
+    while(true){
+      Job* job = nullptr;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&]{ return stopping_ || (job_ && generation_ != seen); });
+        if(stopping_) return;
+        seen = generation_;
+        job = job_;
+        ++job->active;
+      }
+      runParticipant(*job, worker);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --job->active;
+      }
+      done_.notify_all();
+    }
+  }
+
+  static bool takeOwn(ChunkQueue& q, size_t& chunkIndex){
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if(q.front >= q.back) return false;
+    chunkIndex = q.front++;
+    return true;
+  }
+
+  static bool stealFrom(ChunkQueue& q, size_t& chunkIndex){
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if(q.front >= q.back) return false;
+    chunkIndex = --q.back;
+    return true;
+  }
+
+  void runChunk(Job& job, size_t worker, size_t chunkIndex){
+    size_t begin = chunkIndex * job.chunk;
+    size_t end = std::min(job.count, begin + job.chunk);
+    (*job.fn)(worker, begin, end);
+    if(job.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1){
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_.notify_all();
+    }
+  }
+
+  void runParticipant(Job& job, size_t worker){
+    size_t chunkIndex = 0;
+    if(worker < job.queueCount){
+      while(takeOwn(job.queues[worker], chunkIndex)) runChunk(job, worker, chunkIndex);
+    }
+    // 自己的块做完后依次去别人的尾端偷，直到所有队列都空
+    bool stole = true;
+    while(stole){
+      stole = false;
+      for(size_t k = 1; k <= job.queueCount; ++k){
+        size_t victim = (worker + k) % job.queueCount;
+        if(stealFrom(job.queues[victim], chunkIndex)){
+          runChunk(job, worker, chunkIndex);
+          stole = true;
+        }
+      }
+    }
+  }
+
+  size_t participants_ = 1;
+  std::vector<std::thread> threads_;
+  std::mutex jobMutex_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  Job* job_ = nullptr;
+  uint64_t generation_ = 0;
+  bool stopping_ = false;
+};
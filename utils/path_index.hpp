@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// $PATH 中可执行文件的索引快照：名字排好序，同名只保留 PATH 中靠前目录里的那个。
+// 快照不可变，读者持有 shared_ptr 即可与后台更新并发。
+struct ExecutableSnapshot {
+  std::vector<std::string> directories;
+  std::vector<std::string> names;
+  std::vector<uint32_t> directoryOf; // 与 names 平行，下标指向 directories
+  uint64_t generation = 0;
+};
+
+// 后台线程逐个目录扫描，每扫完一个目录就发布一次新快照，启动时不阻塞输入；
+// 目录变化（由主循环的 inotify 监视报告）后只把变化的目录标脏，同样在后台重扫。
+class ExecutableIndex {
+public:
+  ExecutableIndex() : snapshot_(std::make_shared<ExecutableSnapshot>()) {}
+
+  // PATH 与上次相同时什么也不做
+  void start(const std::string& pathEnv){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(started_ && pathEnv == pathEnv_) return;
+    pathEnv_ = pathEnv;
+    directories_ = splitPath(pathEnv);
+    perDirectory_.assign(directories_.size(), {});
+    dirty_.assign(directories_.size(), true);
+    scanned_.assign(directories_.size(), false);
+    ++epoch_;
+    publishLocked();
+    if(!started_){
+      started_ = true;
+      std::thread([this]{ run(); }).detach();
+    }
+    wake_.notify_all();
+  }
+
+  // changedPaths 为监视报告的变化路径（目录或目录/条目名），只把相关的目录标脏；
+  // 为空表示不知道是哪些路径，全部标脏。后台重扫时名字列表未变的目录不会触发重新发布
+  void invalidate(const std::vector<std::string>& changedPaths){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(changedPaths.empty()){
+      std::fill(dirty_.begin(), dirty_.end(), true);
+    }else{
+      for(size_t d = 0; d < directories_.size(); ++d){
+        if(dirty_[d]) continue;
+        // 目录尚不存在时监视的是它的祖先，报告的路径可能是它的上级
+        dirty_[d] = std::any_of(changedPaths.begin(), changedPaths.end(), [&](const std::string& path){
+          return path == directories_[d] || isUnder(path, directories_[d]) || isUnder(directories_[d], path);
+        });
+      }
+    }
+    wake_.notify_all();
+  }
+
+  std::shared_ptr<const ExecutableSnapshot> snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return snapshot_;
+  }
+
+  std::vector<std::string> directories() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return directories_;
+  }
+
+private:
+  static bool isUnder(const std::string& path, const std::string& dir){
+    return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 &&
+           (path[dir.size()] == '/' || dir.back() == '/');
+  }
+
+  static std::vector<std::string> splitPath(const std::string& pathEnv){
+#ifdef _WIN32
+    const char separator = ';';
+#else
+    const char separator = ':';
+#endif
+    std::vector<std::string> out;
+    size_t start = 0;
+    while(start <= pathEnv.size()){
+      size_t end = pathEnv.find(separator, start);
+      if(end == std::string::npos) end = pathEnv.size();
+      std::string dir = pathEnv.substr(start, end - start);
+      // 空项按 POSIX 表示当前目录；当前目录随 cd 变化，不适合放进索引
+      if(!dir.empty() && std::find(out.begin(), out.end(), dir) == out.end()) out.push_back(dir);
+      start = end + 1;
+    }
+    return out;
+  }
+
+  static std::vector<std::string> scanDirectory(const std::string& dir){
+    std::vector<std::string> names;
+#ifdef _WIN32
+    std::error_code ec;
+    for(std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)){
+      std::string ext = it->path().extension().string();
+      std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c){ return static_cast<char>(std::tolower(c)); });
+      if(ext != ".exe" && ext != ".bat" && ext != ".cmd" && ext != ".com") continue;
+      if(it->is_regular_file(ec)) names.push_back(it->path().stem().string());
+    }
+#else
+    int dirFd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dirFd < 0) return names;
+    DIR* handle = ::fdopendir(dirFd);
+    if(!handle){
+      ::close(dirFd);
+      return names;
+    }
+    while(dirent* entry = ::readdir(handle)){
+      const char* name = entry->d_name;
+      if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+#ifdef DT_DIR
+      if(entry->d_type == DT_DIR) continue;
+#endif
+      struct stat st{};
+      if(::fstatat(dirFd, name, &st, 0) != 0) continue;
+      if(!S_ISREG(st.st_mode) || (st.st_mode & 0111) == 0) continue;
+      names.emplace_back(name);
+    }
+    ::closedir(handle);
+#endif
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    return names;
+  }
+
+  // 合并各目录的有序列表；同名时保留 PATH 中靠前的目录
+  void publishLocked(){
+    auto next = std::make_shared<ExecutableSnapshot>();
+    next->directories = directories_;
+    size_t total = 0;
+    for(const auto& names : perDirectory_) total += names.size();
+    std::vector<std::pair<std::string_view, uint32_t>> merged;
+    merged.reserve(total);
+    for(size_t d = 0; d < perDirectory_.size(); ++d){
+      for(const auto& name : perDirectory_[d]) merged.emplace_back(name, static_cast<uint32_t>(d));
+    }
+    std::sort(merged.begin(), merged.end());
+    next->names.reserve(merged.size());
+    next->directoryOf.reserve(merged.size());
+    for(const auto& item : merged){
+      if(!next->names.empty() && next->names.back() == item.first) continue;
+      next->names.emplace_back(item.first);
+      next->directoryOf.push_back(item.second);
+    }
+    next->generation = snapshot_->generation + 1;
+    snapshot_ = std::move(next);
+  }
+
+  void run(){
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(true){
+      wake_.wait(lock, [&]{ return std::find(dirty_.begin(), dirty_.end(), true) != dirty_.end(); });
+      size_t index = static_cast<size_t>(std::find(dirty_.begin(), dirty_.end(), true) - dirty_.begin());
+      dirty_[index] = false;
+      std::string dir = directories_[index];
+      uint64_t epoch = epoch_;
+      lock.unlock();
+      std::vector<std::string> names = scanDirectory(dir);
+      lock.lock();
+      // 扫描期间 PATH 变了，结果作废
+      if(epoch != epoch_) continue;
+      bool firstScan = !scanned_[index];
+      scanned_[index] = true;
+      if(!firstScan && names == perDirectory_[index]) continue;
+      perDirectory_[index] = std::move(names);
+      publishLocked();
+    }
+  }
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  bool started_ = false;
+  std::string pathEnv_;
+  uint64_t epoch_ = 0;
+  std::vector<std::string> directories_;
+  std::vector<std::vector<std::string>> perDirectory_;
+  std::vector<bool> dirty_;
+  std::vector<bool> scanned_;
+  std::shared_ptr<const ExecutableSnapshot> snapshot_;
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "event_loop.hpp"
+
+// 提示符状态段的刷新策略；可以组合。都不设时只在注册时算一次。
+struct StatusRefreshPolicy {
+  bool afterCommand = false;              // 每条命令执行后（命令可能改了设置或文件）
+  bool onCd = false;                      // 工作目录变化后
+  std::chrono::milliseconds interval{0};  // 大于 0 时定时刷新
+  bool onFileChange = false;              // 提供者给出的监视路径有变化时
+};
+
+// 状态段在后台线程计算，结果缓存为字符串；绘制提示符时只读缓存，不会被慢的提供者拖住。
+// 文件监视由主循环的 inotify 负责：主循环取 watches() 建立监视，有事件时把变化路径交给 filesChanged()。
+// 缓存文字或监视集合变化后经 event_loop_notify 唤醒主循环，主循环比较 generation 决定是否重绘。
+class StatusBoard {
+public:
+  using RenderFn = std::function<std::string()>;
+  using WatchFn = std::function<std::vector<LoopWatch>()>;
+  // 收到变化路径的通知（可在任意线程调用）；路径为空表示不知道具体变化
+  using ChangedFn = std::function<void(const std::vector<std::string>&)>;
+
+  StatusBoard() = default;
+  StatusBoard(const StatusBoard&) = delete;
+  StatusBoard& operator=(const StatusBoard&) = delete;
+
+  void add(const std::string& name, RenderFn render, StatusRefreshPolicy policy, WatchFn watches = nullptr,
+           ChangedFn changed = nullptr){
+    std::lock_guard<std::mutex> lock(mutex_);
+    Slot slot;
+    slot.name = name;
+    slot.render = std::move(render);
+    slot.watchFn = std::move(watches);
+    slot.changedFn = std::move(changed);
+    slot.policy = policy;
+    slot.dirty = true;
+    slots_.push_back(std::move(slot));
+    if(!started_){
+      started_ = true;
+      lastCwd_ = currentDirectory();
+      std::thread([this]{ run(); }).detach();
+    }
+    wake_.notify_all();
+  }
+
+  // 各段缓存文字按注册顺序拼接
+  std::string text() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return composed_;
+  }
+
+  uint64_t textGeneration() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return textGeneration_;
+  }
+
+  std::vector<LoopWatch> watches() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<LoopWatch> all;
+    std::unordered_set<std::string> seen;
+    for(const auto& slot : slots_){
+      if(!slot.policy.onFileChange) continue;
+      for(const auto& w : slot.watches){
+        if(seen.insert(w.dir + '\0' + w.name).second) all.push_back(w);
+      }
+    }
+    return all;
+  }
+
+  uint64_t watchGeneration() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return watchGeneration_;
+  }
+
+  // 主线程在每条命令执行完后调用
+  void commandFinished(){
+    std::string cwd = currentDirectory();
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool cwdChanged = cwd != lastCwd_;
+    lastCwd_ = std::move(cwd);
+    markLocked([&](const Slot& slot){ return slot.policy.afterCommand || (cwdChanged && slot.policy.onCd); });
+  }
+
+  // paths 为事件循环报告的变化路径，可能包含别的提供者监视的路径，由各提供者自行筛选
+  void filesChanged(const std::vector<std::string>& paths){
+    std::vector<ChangedFn> notify;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for(const auto& slot : slots_){
+        if(slot.policy.onFileChange && slot.changedFn) notify.push_back(slot.changedFn);
+      }
+    }
+    for(const auto& fn : notify){
+      try{ fn(paths); }catch(...){}
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    markLocked([](const Slot& slot){ return slot.policy.onFileChange; });
+  }
+
+  // 最多等待 timeout，直到没有待刷新的段；命令执行后与启动时用它避免先画出旧状态
+  bool settle(std::chrono::milliseconds timeout){
+    std::unique_lock<std::mutex> lock(mutex_);
+    return settled_.wait_for(lock, timeout, [&]{ return !running_ && !anyDirtyLocked(); });
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Slot {
+    std::string name;
+    RenderFn render;
+    WatchFn watchFn;
+    ChangedFn changedFn;
+    StatusRefreshPolicy policy;
+    std::string text;
+    std::vector<LoopWatch> watches;
+    bool dirty = false;
+    std::optional<Clock::time_point> due;
+  };
+
+  static std::string currentDirectory(){
+#ifndef _WIN32
+    char buf[4096];
+    if(::getcwd(buf, sizeof(buf))) return std::string(buf);
+#endif
+    return std::string();
+  }
+
+  template <typename Pred>
+  void markLocked(Pred pred){
+    bool any = false;
+    for(auto& slot : slots_){
+      if(pred(slot)){
+        slot.dirty = true;
+        any = true;
+      }
+    }
+    if(any) wake_.notify_all();
+  }
+
+  bool anyDirtyLocked() const {
+    for(const auto& slot : slots_) if(slot.dirty) return true;
+    return false;
+  }
+
+  void recomposeLocked(){
+    std::string out;
+    for(const auto& slot : slots_) out += slot.text;
+    composed_ = std::move(out);
+    ++textGeneration_;
+  }
+
+  void run(){
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool notifyPending = false;
+    while(true){
+      auto now = Clock::now();
+      std::optional<Clock::time_point> next;
+      for(auto& slot : slots_){
+        if(!slot.due) continue;
+        if(*slot.due <= now){
+          slot.dirty = true;
+          slot.due.reset();
+        }else if(!next || *slot.due < *next){
+          next = slot.due;
+        }
+      }
+      size_t index = slots_.size();
+      for(size_t i = 0; i < slots_.size(); ++i){
+        if(slots_[i].dirty){
+          index = i;
+          break;
+        }
+      }
+      if(index == slots_.size()){
+        settled_.notify_all();
+        if(notifyPending){
+          notifyPending = false;
+          lock.unlock();
+          event_loop_notify();
+          lock.lock();
+          continue;
+        }
+        if(next) wake_.wait_until(lock, *next);
+        else wake_.wait(lock);
+        continue;
+      }
+
+      Slot& slot = slots_[index];
+      slot.dirty = false;
+      running_ = true;
+      RenderFn render = slot.render;
+      WatchFn watchFn = slot.watchFn;
+      lock.unlock();
+      std::string text;
+      std::vector<LoopWatch> watches;
+      try{ if(render) text = render(); }catch(...){ text.clear(); }
+      try{ if(watchFn) watches = watchFn(); }catch(...){ watches.clear(); }
+      lock.lock();
+      running_ = false;
+      // slots_ 只增不减，下标仍然有效
+      Slot& done = slots_[index];
+      if(done.policy.interval.count() > 0) done.due = Clock::now() + done.policy.interval;
+      if(text != done.text){
+        done.text = std::move(text);
+        recomposeLocked();
+        notifyPending = true;
+      }
+      if(watches != done.watches){
+        done.watches = std::move(watches);
+        ++watchGeneration_;
+        notifyPending = true;
+      }
+    }
+  }
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable settled_;
+  std::vector<Slot> slots_;
+  std::string composed_;
+  std::string lastCwd_;
+  uint64_t textGeneration_ = 0;
+  uint64_t watchGeneration_ = 0;
+  bool started_ = false;
+  bool running_ = false;
+};
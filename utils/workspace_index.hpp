@@ -0,0 +1,449 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dir_listing.hpp"
+
+// 工作区（项目根目录）下全部路径的索引，供 `**/` 补全与 find 使用。
+// 路径按目录深度优先、同级按名字排序，并做前端编码（front coding）：每条只存与上一条共享的
+// 前缀长度和剩余字节，每 kBlockSize 条完整存一次，块之间互不依赖，可以并行解码。
+// 目录条目另存修改时间：刷新时逐个目录 stat，时间没变的目录沿用旧的子项列表，
+// 只有增删过条目的目录才重新列出。索引落盘，下次启动直接加载再增量校验。
+//
+// 条目格式：varint 共享前缀长度、varint 剩余长度、剩余字节、标志字节（bit0 为目录），
+// 目录再跟 8 字节修改时间（纳秒，本机字节序；0 表示下次必须重新列出）。
+struct WorkspaceSnapshot {
+  static constexpr size_t kBlockSize = 32;
+
+  std::string root;
+  uint64_t rulesHash = 0;
+  int64_t rootMtimeNs = 0;
+  size_t count = 0;
+  bool truncated = false;
+  std::string data;
+  std::vector<uint32_t> blockOffsets;
+
+  size_t blockCount() const { return blockOffsets.size(); }
+
+  // 依次解码第 block 块：fn(index, path, isDir, mtimeNs)，path 只在回调期间有效
+  template <typename Fn>
+  void forEachInBlock(size_t block, std::string& scratch, Fn&& fn) const {
+    size_t at = blockOffsets[block];
+    size_t end = (block + 1 < blockOffsets.size()) ? blockOffsets[block + 1] : data.size();
+    size_t index = block * kBlockSize;
+    scratch.clear();
+    while(at < end){
+      uint64_t shared = readVarint(at);
+      uint64_t length = readVarint(at);
+      scratch.resize(static_cast<size_t>(shared));
+      scratch.append(data, at, static_cast<size_t>(length));
+      at += static_cast<size_t>(length);
+      bool isDir = (static_cast<unsigned char>(data[at++]) & 1u) != 0;
+      int64_t mtime = 0;
+      if(isDir){
+        std::memcpy(&mtime, data.data() + at, sizeof(mtime));
+        at += sizeof(mtime);
+      }
+      fn(index++, std::string_view(scratch), isDir, mtime);
+    }
+  }
+
+  template <typename Fn>
+  void forEach(Fn&& fn) const {
+    std::string scratch;
+    for(size_t b = 0; b < blockOffsets.size(); ++b) forEachInBlock(b, scratch, fn);
+  }
+
+  // 只在构建时调用
+  void append(std::string_view path, bool isDir, int64_t mtimeNs){
+    size_t shared = 0;
+    if(count % kBlockSize == 0){
+      blockOffsets.push_back(static_cast<uint32_t>(data.size()));
+    }else{
+      size_t limit = std::min(last_.size(), path.size());
+      while(shared < limit && last_[shared] == path[shared]) ++shared;
+    }
+    writeVarint(shared);
+    writeVarint(path.size() - shared);
+    data.append(path.data() + shared, path.size() - shared);
+    data.push_back(static_cast<char>(isDir ? 1 : 0));
+    if(isDir) data.append(reinterpret_cast<const char*>(&mtimeNs), sizeof(mtimeNs));
+    last_.assign(path.data(), path.size());
+    ++count;
+  }
+
+  // 加载后重建块偏移；数据损坏时返回 false
+  bool rebuildBlocks(size_t expected){
+    blockOffsets.clear();
+    count = 0;
+    size_t at = 0;
+    while(at < data.size()){
+      if(count % kBlockSize == 0) blockOffsets.push_back(static_cast<uint32_t>(at));
+      uint64_t shared = 0;
+      uint64_t length = 0;
+      if(!tryVarint(at, shared) || !tryVarint(at, length)) return false;
+      if(data.size() - at < length + 1) return false;
+      at += static_cast<size_t>(length);
+      bool isDir = (static_cast<unsigned char>(data[at++]) & 1u) != 0;
+      if(isDir){
+        if(data.size() - at < sizeof(int64_t)) return false;
+        at += sizeof(int64_t);
+      }
+      ++count;
+    }
+    return count == expected;
+  }
+
+private:
+  std::string last_;
+
+  uint64_t readVarint(size_t& at) const {
+    uint64_t value = 0;
+    for(int shift = 0;; shift += 7){
+      unsigned char byte = static_cast<unsigned char>(data[at++]);
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if(!(byte & 0x80)) return value;
+    }
+  }
+
+  bool tryVarint(size_t& at, uint64_t& value) const {
+    value = 0;
+    for(int shift = 0; shift < 64; shift += 7){
+      if(at >= data.size()) return false;
+      unsigned char byte = static_cast<unsigned char>(data[at++]);
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if(!(byte & 0x80)) return true;
+    }
+    return false;
+  }
+
+  void writeVarint(uint64_t value){
+    while(value >= 0x80){
+      data.push_back(static_cast<char>((value & 0x7F) | 0x80));
+      value >>= 7;
+    }
+    data.push_back(static_cast<char>(value));
+  }
+};
+
+class WorkspaceIndex {
+public:
+  using IgnoreFn = std::function<bool(const std::string& relPath)>;
+
+  static constexpr size_t kMaxEntries = 2000000;
+  static constexpr std::chrono::milliseconds kRevalidateInterval{2000};
+
+  // root 的索引快照。内存里没有时先读 cacheFile；距上次校验超过 kRevalidateInterval 时需要刷新。
+  // fresh 为真时同步刷新（已有刷新在进行则等它完成），cancel 置位时放弃并返回旧快照；
+  // 否则交给后台线程，本次先返回旧快照，还没有任何快照时返回空快照。
+  // 同一 root 同时只有一个刷新在进行。ignore 规则变化（rulesHash 不同）时整棵树重新列出。
+  std::shared_ptr<const WorkspaceSnapshot> acquire(const std::string& root, const std::string& cacheFile,
+                                                   const IgnoreFn& ignore, uint64_t rulesHash, bool fresh,
+                                                   const std::atomic<bool>* cancel = nullptr){
+    std::shared_ptr<const WorkspaceSnapshot> current;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      Slot& slot = slots_[root];
+      current = slot.snapshot;
+      bool stale = !current || std::chrono::steady_clock::now() - slot.validatedAt >= kRevalidateInterval;
+      if(current && (!stale || (!fresh && slot.refreshing))) return current;
+      if(!current && !fresh && slot.refreshing) return emptySnapshot(root);
+    }
+    if(!current){
+      // 磁盘上的索引可能已经过时，与内存里过期的快照一样处理；规则变了则只能全量构建
+      auto loaded = load(cacheFile, root);
+      if(loaded && loaded->rulesHash == rulesHash){
+        current = loaded;
+        std::lock_guard<std::mutex> lock(mutex_);
+        Slot& slot = slots_[root];
+        if(!slot.snapshot) slot.snapshot = current;
+      }
+    }
+    if(fresh){
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        Slot& slot = slots_[root];
+        if(slot.refreshing){
+          settled_.wait(lock, [&]{ return !slot.refreshing; });
+          if(slot.snapshot) return slot.snapshot;
+        }
+        slot.refreshing = true;
+      }
+      auto next = refresh(root, current.get(), ignore, rulesHash, cancel);
+      if(!next){
+        abandon(root);
+        return current ? current : emptySnapshot(root);
+      }
+      save(cacheFile, *next);
+      publish(root, next);
+      return next;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      Slot& slot = slots_[root];
+      if(slot.refreshing) return current ? current : emptySnapshot(root);
+      slot.refreshing = true;
+    }
+    std::thread([this, root, cacheFile, ignore, rulesHash, current]{
+      auto next = refresh(root, current.get(), ignore, rulesHash, nullptr);
+      save(cacheFile, *next);
+      publish(root, next);
+    }).detach();
+    return current ? current : emptySnapshot(root);
+  }
+
+  // 任一 root 的索引内容变化（包括首次建成）时递增；据此丢弃用旧索引算出的补全结果
+  uint64_t generation() const { return generation_.load(std::memory_order_relaxed); }
+
+private:
+  struct Slot {
+    std::shared_ptr<const WorkspaceSnapshot> snapshot;
+    std::chrono::steady_clock::time_point validatedAt{};
+    bool refreshing = false;
+  };
+
+  struct Child {
+    std::string name;
+    bool isDir = false;
+  };
+
+  struct DirState {
+    int64_t mtimeNs = 0;
+    std::vector<Child> children;
+  };
+
+  static constexpr char kMagic[4] = {'M', 'C', 'W', 'I'};
+  static constexpr uint32_t kVersion = 1;
+  // 与 DirListingCache 同理：刚被修改过的目录可能在同一时间戳内还有变化，不能凭 mtime 复用
+  static constexpr int64_t kRacyWindowNs = 2000000000;
+
+  void publish(const std::string& root, std::shared_ptr<const WorkspaceSnapshot> snapshot){
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      Slot& slot = slots_[root];
+      if(!slot.snapshot || slot.snapshot->data != snapshot->data) generation_.fetch_add(1, std::memory_order_relaxed);
+      slot.snapshot = std::move(snapshot);
+      slot.refreshing = false;
+      slot.validatedAt = std::chrono::steady_clock::now();
+    }
+    settled_.notify_all();
+  }
+
+  // 刷新被取消：不发布结果，下次再校验
+  void abandon(const std::string& root){
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      slots_[root].refreshing = false;
+    }
+    settled_.notify_all();
+  }
+
+  static std::shared_ptr<const WorkspaceSnapshot> emptySnapshot(const std::string& root){
+    auto snapshot = std::make_shared<WorkspaceSnapshot>();
+    snapshot->root = root;
+    return snapshot;
+  }
+
+  static int64_t nowNs(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  }
+
+  static std::vector<Child> listDirectory(const std::string& absDir, const std::string& relDir, const IgnoreFn& ignore){
+    std::vector<Child> children;
+    int dirFd = ::open(absDir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dirFd < 0) return children;
+    DIR* handle = ::fdopendir(dirFd);
+    if(!handle){
+      ::close(dirFd);
+      return children;
+    }
+    std::string rel;
+    while(dirent* entry = ::readdir(handle)){
+      const char* name = entry->d_name;
+      // 与 fs.tree 默认一致：跳过隐藏条目（也就跳过了 .git）
+      if(name[0] == '.') continue;
+      bool isDir = false;
+#ifdef DT_DIR
+      if(entry->d_type == DT_DIR){
+        isDir = true;
+      }else if(entry->d_type == DT_UNKNOWN){
+        struct stat st{};
+        if(::fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        isDir = S_ISDIR(st.st_mode);
+      }
+#else
+      struct stat st{};
+      if(::fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+      isDir = S_ISDIR(st.st_mode);
+#endif
+      rel = relDir.empty() ? std::string(name) : relDir + "/" + name;
+      if(ignore && ignore(rel)) continue;
+      children.push_back(Child{name, isDir});
+    }
+    ::closedir(handle);
+    std::sort(children.begin(), children.end(), [](const Child& a, const Child& b){ return a.name < b.name; });
+    return children;
+  }
+
+  // 以 previous 为基础增量刷新；previous 为空时全量构建。每列一个目录前检查 cancel，置位时返回空指针
+  static std::shared_ptr<WorkspaceSnapshot> refresh(const std::string& root, const WorkspaceSnapshot* previous,
+                                                    const IgnoreFn& ignore, uint64_t rulesHash,
+                                                    const std::atomic<bool>* cancel){
+    std::unordered_map<std::string, DirState> old;
+    if(previous && previous->rulesHash == rulesHash){
+      old.reserve(previous->count / 8 + 1);
+      old[std::string()].mtimeNs = previous->rootMtimeNs;
+      previous->forEach([&](size_t, std::string_view path, bool isDir, int64_t mtime){
+        size_t slash = path.rfind('/');
+        std::string parent = (slash == std::string_view::npos) ? std::string() : std::string(path.substr(0, slash));
+        std::string_view name = (slash == std::string_view::npos) ? path : path.substr(slash + 1);
+        old[parent].children.push_back(Child{std::string(name), isDir});
+        if(isDir) old[std::string(path)].mtimeNs = mtime;
+      });
+    }
+
+    auto next = std::make_shared<WorkspaceSnapshot>();
+    next->root = root;
+    next->rulesHash = rulesHash;
+    const int64_t now = nowNs();
+    auto settledMtime = [&](const struct stat& st){
+      int64_t mtime = dir_listing_mtime_ns(st);
+      return (now - mtime > kRacyWindowNs) ? mtime : 0;
+    };
+    auto childrenOf = [&](const std::string& rel, int64_t mtime){
+      auto it = old.find(rel);
+      if(mtime != 0 && it != old.end() && it->second.mtimeNs == mtime) return std::move(it->second.children);
+      std::string abs = rel.empty() ? root : root + "/" + rel;
+      return listDirectory(abs, rel, ignore);
+    };
+
+    struct stat rootStat{};
+    if(::stat(root.c_str(), &rootStat) != 0 || !S_ISDIR(rootStat.st_mode)) return next;
+    next->rootMtimeNs = settledMtime(rootStat);
+
+    bool cancelled = false;
+    std::function<void(const std::string&, int64_t)> visit = [&](const std::string& rel, int64_t mtime){
+      if(cancelled || (cancel && cancel->load(std::memory_order_relaxed))){
+        cancelled = true;
+        return;
+      }
+      std::vector<Child> children = childrenOf(rel, mtime);
+      std::string path;
+      for(const Child& child : children){
+        if(next->count >= kMaxEntries){
+          next->truncated = true;
+          return;
+        }
+        path = rel.empty() ? child.name : rel + "/" + child.name;
+        if(!child.isDir){
+          next->append(path, false, 0);
+          continue;
+        }
+        struct stat st{};
+        std::string abs = root + "/" + path;
+        if(::lstat(abs.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) continue;
+        int64_t childMtime = settledMtime(st);
+        next->append(path, true, childMtime);
+        visit(path, childMtime);
+        if(cancelled) return;
+      }
+    };
+    visit(std::string(), next->rootMtimeNs);
+    if(cancelled) return nullptr;
+    return next;
+  }
+
+  static std::shared_ptr<WorkspaceSnapshot> load(const std::string& file, const std::string& root){
+    std::ifstream in(file, std::ios::binary);
+    if(!in.good()) return nullptr;
+    std::string raw((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    size_t at = 0;
+    auto take = [&](void* out, size_t size){
+      if(raw.size() - at < size) return false;
+      std::memcpy(out, raw.data() + at, size);
+      at += size;
+      return true;
+    };
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t rootLength = 0;
+    uint64_t count = 0;
+    auto snapshot = std::make_shared<WorkspaceSnapshot>();
+    uint8_t truncated = 0;
+    if(!take(magic, sizeof(magic)) || std::memcmp(magic, kMagic, sizeof(magic)) != 0) return nullptr;
+    if(!take(&version, sizeof(version)) || version != kVersion) return nullptr;
+    if(!take(&rootLength, sizeof(rootLength)) || raw.size() - at < rootLength) return nullptr;
+    snapshot->root.assign(raw.data() + at, rootLength);
+    at += rootLength;
+    if(snapshot->root != root) return nullptr;
+    if(!take(&snapshot->rulesHash, sizeof(snapshot->rulesHash)) ||
+       !take(&snapshot->rootMtimeNs, sizeof(snapshot->rootMtimeNs)) ||
+       !take(&truncated, sizeof(truncated)) || !take(&count, sizeof(count))){
+      return nullptr;
+    }
+    snapshot->truncated = truncated != 0;
+    snapshot->data = raw.substr(at);
+    if(!snapshot->rebuildBlocks(static_cast<size_t>(count))) return nullptr;
+    return snapshot;
+  }
+
+  // 先写临时文件再改名；临时文件名带进程号，别的会话同时保存同一索引也不会写进同一个文件
+  static bool save(const std::string& file, const WorkspaceSnapshot& snapshot){
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(file).parent_path(), ec);
+    std::string tmp = file + "." + std::to_string(static_cast<long long>(::getpid())) + ".tmp";
+    {
+      std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+      if(!out.good()) return false;
+      auto put = [&](const void* src, size_t size){ out.write(static_cast<const char*>(src), static_cast<std::streamsize>(size)); };
+      uint32_t version = kVersion;
+      uint32_t rootLength = static_cast<uint32_t>(snapshot.root.size());
+      uint8_t truncated = snapshot.truncated ? 1 : 0;
+      uint64_t count = snapshot.count;
+      put(kMagic, sizeof(kMagic));
+      put(&version, sizeof(version));
+      put(&rootLength, sizeof(rootLength));
+      put(snapshot.root.data(), snapshot.root.size());
+      put(&snapshot.rulesHash, sizeof(snapshot.rulesHash));
+      put(&snapshot.rootMtimeNs, sizeof(snapshot.rootMtimeNs));
+      put(&truncated, sizeof(truncated));
+      put(&count, sizeof(count));
+      put(snapshot.data.data(), snapshot.data.size());
+      if(!out.good()) return false;
+    }
+    std::filesystem::rename(tmp, file, ec);
+    if(ec){
+      std::filesystem::remove(tmp, ec);
+      return false;
+    }
+    return true;
+  }
+
+  std::mutex mutex_;
+  std::condition_variable settled_;  // 某个刷新结束（发布或放弃）
+  std::atomic<uint64_t> generation_{0};
+  std::unordered_map<std::string, Slot> slots_;
+};